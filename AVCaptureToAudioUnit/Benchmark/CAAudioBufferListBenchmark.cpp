@@ -0,0 +1,306 @@
+/*
+     File: CAAudioBufferListBenchmark.cpp
+ Abstract: Command line correctness check and benchmark for the CAAudioBufferList sample kernels.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2012 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+/*
+ Build and run from this directory on a Mac with:
+ 
+	c++ -O2 -I../PublicUtility -o CAAudioBufferListBenchmark CAAudioBufferListBenchmark.cpp ../PublicUtility/CAAudioBufferList.cpp ../PublicUtility/CAVectorUnit.cpp
+	./CAAudioBufferListBenchmark
+ 
+ For every kernel set this machine can run (SSE2, or NEON), it uses CAVectorUnit::SetVectorUnitType to run
+ SumWithGain in each sample format, Interleave, Deinterleave and Copy on random samples and checks that the results
+ match the scalar kernels bit for bit. Lengths cover every vector tail, and gains include 1 and values that saturate.
+ Then it reports frames per second for each operation and kernel set on stereo buffers of a typical render size.
+*/
+
+#include "CAAudioBufferList.h"
+#include "CAVectorUnit.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what, SInt32 vectorUnit, UInt32 frames)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s, vector unit %d, %u frames\n", what, (int)vectorUnit, (unsigned)frames);
+		failures++;
+	}
+}
+
+static UInt32 sSeed = 1;
+
+static UInt32 Random()
+{
+	sSeed = sSeed * 1103515245 + 12345;
+	return sSeed >> 8;
+}
+
+// random samples of the format, Float32 within about +/-8 so that gains can push sums well past full scale
+static void FillRandom(std::vector<Byte> &samples, UInt32 sampleFormat)
+{
+	if (sampleFormat == CAAudioBufferList::kSampleFormat_Float32)
+	{
+		Float32 *floats = (Float32 *)&samples[0];
+		for (size_t i = 0; i < samples.size() / sizeof(Float32); i++)
+			floats[i] = ((Float32)(Random() & 0xffff) - 32768.f) / 4096.f;
+	}
+	else
+	{
+		for (size_t i = 0; i < samples.size(); i++)
+			samples[i] = (Byte)Random();
+	}
+}
+
+// an AudioBufferList with room for two buffers
+struct StereoBufferList
+{
+	UInt32		mNumberBuffers;
+	AudioBuffer	mBuffers[2];
+	
+	StereoBufferList(UInt32 numberBuffers, UInt32 channelsPerBuffer, UInt32 bytesPerBuffer, Byte *first, Byte *second)
+	{
+		mNumberBuffers = numberBuffers;
+		mBuffers[0].mNumberChannels = channelsPerBuffer;
+		mBuffers[0].mDataByteSize = bytesPerBuffer;
+		mBuffers[0].mData = first;
+		mBuffers[1].mNumberChannels = channelsPerBuffer;
+		mBuffers[1].mDataByteSize = bytesPerBuffer;
+		mBuffers[1].mData = second;
+	}
+	
+	AudioBufferList &List() { return *(AudioBufferList *)this; }
+};
+
+static UInt32 BytesPerSample(UInt32 sampleFormat)
+{
+	return (sampleFormat == CAAudioBufferList::kSampleFormat_SInt16) ? 2 : 4;
+}
+
+// the kernel sets this machine can run, scalar first
+static std::vector<SInt32> VectorUnits()
+{
+	CAVectorUnit::SetVectorUnitType(kVecUninitialized);
+	SInt32 native = CAVectorUnit::GetVectorUnitType();
+	std::vector<SInt32> units(1, kVecNone);
+	// an AVX2 machine runs the SSE2 kernels
+	if (native == kVecSSE2 || native == kVecAVX2)
+		units.push_back(kVecSSE2);
+	if (native == kVecNeon)
+		units.push_back(native);
+	return units;
+}
+
+static const char *VectorUnitName(SInt32 vectorUnit)
+{
+	switch (vectorUnit)
+	{
+		case kVecSSE2:	return "SSE2";
+		case kVecNeon:	return "NEON";
+		default:		return "scalar";
+	}
+}
+
+static void CheckSum(SInt32 vectorUnit, UInt32 sampleFormat, UInt32 frames, Float32 gain)
+{
+	UInt32 bytes = frames * BytesPerSample(sampleFormat);
+	// one byte more than the data, which no kernel may touch
+	std::vector<Byte> source(bytes + 1), sum(bytes + 1);
+	FillRandom(source, sampleFormat);
+	FillRandom(sum, sampleFormat);
+	std::vector<Byte> expected = sum, actual = sum;
+	
+	StereoBufferList sourceList(1, 1, bytes, &source[0], NULL);
+	StereoBufferList expectedList(1, 1, bytes, &expected[0], NULL);
+	StereoBufferList actualList(1, 1, bytes, &actual[0], NULL);
+	CAVectorUnit::SetVectorUnitType(kVecNone);
+	CAAudioBufferList::SumWithGain(sourceList.List(), expectedList.List(), gain, sampleFormat);
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAAudioBufferList::SumWithGain(sourceList.List(), actualList.List(), gain, sampleFormat);
+	
+	static const char *names[] = { "Float32 sum", "SInt16 sum", "8.24 sum" };
+	char what[64];
+	snprintf(what, sizeof(what), "%s with gain %g matches scalar", names[sampleFormat], gain);
+	Check(actual == expected, what, vectorUnit, frames);
+}
+
+static void CheckInterleave(SInt32 vectorUnit, UInt32 bytesPerSample, UInt32 frames)
+{
+	UInt32 bytes = frames * bytesPerSample;
+	std::vector<Byte> left(bytes + 1), right(bytes + 1);
+	FillRandom(left, CAAudioBufferList::kSampleFormat_SInt16);
+	FillRandom(right, CAAudioBufferList::kSampleFormat_SInt16);
+	std::vector<Byte> expected(2 * bytes + 1, 0x5a), actual(2 * bytes + 1, 0x5a);
+	
+	StereoBufferList sourceList(2, 1, bytes, &left[0], &right[0]);
+	AudioBuffer expectedBuffer = { 2, 2 * bytes, &expected[0] };
+	AudioBuffer actualBuffer = { 2, 2 * bytes, &actual[0] };
+	CAVectorUnit::SetVectorUnitType(kVecNone);
+	CAAudioBufferList::Interleave(sourceList.List(), expectedBuffer, bytesPerSample);
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAAudioBufferList::Interleave(sourceList.List(), actualBuffer, bytesPerSample);
+	Check(actual == expected, bytesPerSample == 2 ? "16-bit interleave matches scalar" : "32-bit interleave matches scalar", vectorUnit, frames);
+	
+	// and back again
+	std::vector<Byte> newLeft(bytes + 1, 0x5a), newRight(bytes + 1, 0x5a);
+	StereoBufferList destinationList(2, 1, bytes, &newLeft[0], &newRight[0]);
+	CAAudioBufferList::Deinterleave(actualBuffer, destinationList.List(), bytesPerSample);
+	bool ok = (memcmp(&newLeft[0], &left[0], bytes) == 0) && (memcmp(&newRight[0], &right[0], bytes) == 0) &&
+			  (newLeft[bytes] == 0x5a) && (newRight[bytes] == 0x5a);
+	Check(ok, bytesPerSample == 2 ? "16-bit deinterleave restores the channels" : "32-bit deinterleave restores the channels", vectorUnit, frames);
+}
+
+// one interleaved stereo buffer copied to two mono buffers, which needs the destination found per channel
+static void CheckCopy(SInt32 vectorUnit, UInt32 bytesPerSample, UInt32 frames)
+{
+	UInt32 bytes = frames * bytesPerSample;
+	std::vector<Byte> interleaved(2 * bytes + 1);
+	FillRandom(interleaved, CAAudioBufferList::kSampleFormat_SInt16);
+	std::vector<Byte> left(bytes + 1, 0x5a), right(bytes + 1, 0x5a);
+	
+	StereoBufferList sourceList(1, 2, 2 * bytes, &interleaved[0], NULL);
+	StereoBufferList destinationList(2, 1, bytes, &left[0], &right[0]);
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAAudioBufferList::Copy(sourceList.List(), 0, destinationList.List(), 0, bytesPerSample);
+	
+	bool ok = (left[bytes] == 0x5a) && (right[bytes] == 0x5a);
+	for (UInt32 i = 0; ok && i < frames; i++)
+		ok = (memcmp(&left[i * bytesPerSample], &interleaved[2 * i * bytesPerSample], bytesPerSample) == 0) &&
+			 (memcmp(&right[i * bytesPerSample], &interleaved[(2 * i + 1) * bytesPerSample], bytesPerSample) == 0);
+	Check(ok, "interleaved stereo copies to two mono buffers", vectorUnit, frames);
+}
+
+static double FramesPerSecond(SInt32 vectorUnit, int operation, UInt32 frames)
+{
+	const UInt32 passes = 20000;
+	std::vector<Byte> a(8 * frames), b(8 * frames), c(8 * frames);
+	FillRandom(a, CAAudioBufferList::kSampleFormat_SInt16);
+	std::vector<Float32> floats(2 * frames, 0.25f), sums(2 * frames, 0.f);
+	
+	// Float32 sums are of values that stay well inside the normal range
+	StereoBufferList floatSource(2, 1, frames * 4, (Byte *)&floats[0], (Byte *)&floats[frames]);
+	StereoBufferList floatSum(2, 1, frames * 4, (Byte *)&sums[0], (Byte *)&sums[frames]);
+	StereoBufferList source16(2, 1, frames * 2, &a[0], &a[frames * 2]);
+	StereoBufferList sum16(2, 1, frames * 2, &b[0], &b[frames * 2]);
+	StereoBufferList source32(2, 1, frames * 4, &a[0], &a[frames * 4]);
+	StereoBufferList sum32(2, 1, frames * 4, &b[0], &b[frames * 4]);
+	StereoBufferList interleaved32(1, 2, frames * 8, &c[0], NULL);
+	AudioBuffer interleaved16 = { 2, frames * 4, &c[0] };
+	
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	double start = NowSeconds();
+	for (UInt32 pass = 0; pass < passes; pass++)
+	{
+		switch (operation)
+		{
+			case 0:	CAAudioBufferList::SumWithGain(floatSource.List(), floatSum.List(), (pass & 1) ? 0.5f : -0.5f); break;
+			case 1:	CAAudioBufferList::SumWithGain(source16.List(), sum16.List(), 0.5f, CAAudioBufferList::kSampleFormat_SInt16); break;
+			case 2:	CAAudioBufferList::SumWithGain(source32.List(), sum32.List(), 0.5f, CAAudioBufferList::kSampleFormat_Fixed8_24); break;
+			case 3:	CAAudioBufferList::Interleave(source16.List(), interleaved16, 2); break;
+			case 4:	CAAudioBufferList::Interleave(floatSource.List(), interleaved32.mBuffers[0], 4); break;
+			case 5:	CAAudioBufferList::Deinterleave(interleaved16, sum16.List(), 2); break;
+			case 6:	CAAudioBufferList::Deinterleave(interleaved32.mBuffers[0], floatSum.List(), 4); break;
+			case 7:	CAAudioBufferList::Copy(interleaved32.List(), 0, floatSum.List(), 0); break;
+		}
+	}
+	return (double)frames * passes / (NowSeconds() - start);
+}
+
+int main()
+{
+	std::vector<SInt32> units = VectorUnits();
+	static const UInt32 lengths[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 512, 1023 };
+	static const Float32 gains[] = { 1.f, 0.5f, -1.f, 0.3f, 1.7f, -3.f, 40000.f };
+	
+	for (size_t u = 0; u < units.size(); u++)
+		for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+		{
+			for (UInt32 sampleFormat = 0; sampleFormat < 3; sampleFormat++)
+				for (size_t g = 0; g < sizeof(gains) / sizeof(gains[0]); g++)
+					CheckSum(units[u], sampleFormat, lengths[l], gains[g]);
+			CheckInterleave(units[u], 2, lengths[l]);
+			CheckInterleave(units[u], 4, lengths[l]);
+			CheckCopy(units[u], 2, lengths[l]);
+			CheckCopy(units[u], 4, lengths[l]);
+		}
+	printf("checked %d kernel sets against scalar\n", (int)units.size());
+	
+	static const char *operations[] =
+	{
+		"Float32 gain-sum", "SInt16 gain-sum", "8.24 gain-sum", "16-bit interleave",
+		"32-bit interleave", "16-bit deinterleave", "32-bit deinterleave", "stereo copy to mono"
+	};
+	const UInt32 frames = 1024;
+	printf("M stereo frames/s, %u frame buffers\n%-20s", (unsigned)frames, "");
+	for (size_t u = 0; u < units.size(); u++)
+		printf("%10s", VectorUnitName(units[u]));
+	printf("\n");
+	for (int operation = 0; operation < 8; operation++)
+	{
+		printf("%-20s", operations[operation]);
+		for (size_t u = 0; u < units.size(); u++)
+			printf("%10.1f", FramesPerSecond(units[u], operation, frames) * 1e-6);
+		printf("\n");
+	}
+	
+	printf(failures ? "FAILED\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
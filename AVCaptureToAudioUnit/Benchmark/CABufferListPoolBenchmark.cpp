@@ -0,0 +1,239 @@
+/*
+     File: CABufferListPoolBenchmark.cpp
+ Abstract: Command line check and benchmark for CABufferListPool, including its live assertion mode.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2012 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+/*
+ Build and run from this directory on a Mac with:
+ 
+	c++ -std=c++11 -O2 -pthread -DCABufferListPool_AssertLive=1 -I../PublicUtility -o CABufferListPoolBenchmark CABufferListPoolBenchmark.cpp ../PublicUtility/CABufferListPool.cpp ../PublicUtility/CAStreamBasicDescription.cpp
+	./CABufferListPoolBenchmark
+ 
+ It marks a pool live and has two threads acquire, fill, check and release its lists millions of times, checking that no
+ list is handed out twice, that format changes within the allocation are taken while live, and that AllocationCount
+ doesn't move. It then checks that Allocate on a live pool asserts (in a child process) and that it works again once the
+ pool is no longer live. Finally it reports the time for an Acquire and Release pair on one thread and on two.
+*/
+
+#include "CABufferListPool.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#if !CABufferListPool_AssertLive
+	#error build with -DCABufferListPool_AssertLive=1 to check the live assertion
+#endif
+
+static const UInt32 kLists = 4;
+static const UInt32 kMaxFrames = 1024;
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+struct Worker
+{
+	CABufferListPool	*pool;
+	UInt32				id;
+	UInt32				passes;
+	UInt32				acquired;
+	bool				ok;
+};
+
+// fills every buffer of each list it gets with its own id, and checks nobody else wrote to it before releasing it
+static void *Work(void *inWorker)
+{
+	Worker *worker = static_cast<Worker *>(inWorker);
+	worker->acquired = 0;
+	worker->ok = true;
+	for (UInt32 pass = 0; pass < worker->passes; pass++)
+	{
+		UInt32 frames = 1 + (pass * 7) % kMaxFrames;
+		AudioBufferList *list = worker->pool->Acquire(frames);
+		if (list == NULL)
+			continue;
+		worker->acquired++;
+		for (UInt32 i = 0; i < list->mNumberBuffers; i++)
+		{
+			UInt32 *samples = (UInt32 *)list->mBuffers[i].mData;
+			for (UInt32 s = 0; s < list->mBuffers[i].mDataByteSize / 4; s++)
+				samples[s] = worker->id;
+		}
+		for (UInt32 i = 0; i < list->mNumberBuffers; i++)
+		{
+			const UInt32 *samples = (const UInt32 *)list->mBuffers[i].mData;
+			for (UInt32 s = 0; s < list->mBuffers[i].mDataByteSize / 4; s++)
+				worker->ok = worker->ok && (samples[s] == worker->id);
+		}
+		worker->pool->Release(list);
+	}
+	return NULL;
+}
+
+static void CheckLivePool()
+{
+	CABufferListPool pool;
+	CAStreamBasicDescription stereo(48000, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	CAStreamBasicDescription mono(48000, 1, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	Check(pool.Allocate(stereo, kMaxFrames, kLists), "pool allocates");
+	pool.SetLive(true);
+	
+	Worker workers[2];
+	pthread_t threads[2];
+	for (int round = 0; round < 4; round++)
+	{
+		// format changes need every list in, and fit the allocation
+		Check(pool.SetFormat((round & 1) ? mono : stereo), "format within the allocation is set on a live pool");
+		for (int t = 0; t < 2; t++)
+		{
+			workers[t].pool = &pool;
+			workers[t].id = round * 2 + t + 1;
+			workers[t].passes = 500000;
+			pthread_create(&threads[t], NULL, Work, &workers[t]);
+		}
+		for (int t = 0; t < 2; t++)
+		{
+			pthread_join(threads[t], NULL);
+			Check(workers[t].ok, "no list is held by two threads at once");
+			Check(workers[t].acquired > 0, "lists are acquired");
+		}
+	}
+	
+	Check(pool.Acquire(kMaxFrames + 1) == NULL, "more frames than a list holds are refused");
+	
+	// every list is back
+	AudioBufferList *lists[kLists + 1];
+	UInt32 count = 0;
+	while (count <= kLists && (lists[count] = pool.Acquire(kMaxFrames)) != NULL)
+		count++;
+	Check(count == kLists, "every list is returned to the pool");
+	for (UInt32 i = 0; i < count; i++)
+		pool.Release(lists[i]);
+	Check(pool.AllocationCount() == 1, "no allocation while the pool is live");
+	
+	CAStreamBasicDescription eightChannels(48000, 8, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	Check(!pool.SetFormat(eightChannels), "format larger than the allocation is refused");
+	
+	// Allocate on the live pool must stop the process
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0)
+	{
+		int devNull = open("/dev/null", O_WRONLY);
+		dup2(devNull, STDERR_FILENO);
+		pool.Allocate(eightChannels, kMaxFrames, kLists);
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(child, &status, 0);
+	Check(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "Allocate on a live pool asserts");
+	
+	pool.SetLive(false);
+	Check(pool.Allocate(eightChannels, kMaxFrames, kLists) && pool.AllocationCount() == 2, "Allocate works once the pool is no longer live");
+}
+
+static void TimeAcquireRelease()
+{
+	CABufferListPool pool;
+	CAStreamBasicDescription stereo(48000, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	pool.Allocate(stereo, kMaxFrames, kLists);
+	pool.SetLive(true);
+	
+	const UInt32 passes = 10000000;
+	double start = NowSeconds();
+	for (UInt32 pass = 0; pass < passes; pass++)
+		pool.Release(pool.Acquire(256));
+	double single = (NowSeconds() - start) / passes;
+	
+	// two threads contending for the free list, doing nothing with the lists
+	struct Contender
+	{
+		static void *Run(void *inPool)
+		{
+			CABufferListPool *thePool = static_cast<CABufferListPool *>(inPool);
+			for (UInt32 pass = 0; pass < passes; pass++)
+				thePool->Release(thePool->Acquire(256));
+			return NULL;
+		}
+	};
+	pthread_t threads[2];
+	start = NowSeconds();
+	for (int t = 0; t < 2; t++)
+		pthread_create(&threads[t], NULL, Contender::Run, &pool);
+	for (int t = 0; t < 2; t++)
+		pthread_join(threads[t], NULL);
+	double contended = (NowSeconds() - start) / (2.0 * passes);
+	
+	printf("Acquire and Release: %.1f ns on one thread, %.1f ns each on two\n", single * 1e9, contended * 1e9);
+}
+
+int main()
+{
+	CheckLivePool();
+	TimeAcquireRelease();
+	printf(failures ? "FAILED\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
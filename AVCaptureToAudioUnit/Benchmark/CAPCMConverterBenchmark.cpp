@@ -0,0 +1,400 @@
+/*
+     File: CAPCMConverterBenchmark.cpp
+ Abstract: Command line correctness check and benchmark for CAPCMConverter.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2012 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+/*
+ Build and run from this directory on a Mac with:
+ 
+	c++ -O2 -I../PublicUtility -o CAPCMConverterBenchmark CAPCMConverterBenchmark.cpp ../PublicUtility/CAPCMConverter.cpp ../PublicUtility/CAStreamBasicDescription.cpp ../PublicUtility/CAVectorUnit.cpp
+	./CAPCMConverterBenchmark
+ 
+ For every kernel set this machine can run, it checks that Int16 and 8.24 go through Float32 and back unchanged, that
+ mono is spread to both channels of a stereo output, and that converting in random slices gives the same output as one
+ call. With the rate converter at each quality it measures the SNR of a 1 kHz tone taken from 44.1 to 48 kHz, and how
+ far a 23 kHz tone is rejected on the way from 48 to 44.1 kHz, against the figures CAPCMConverter.h gives. Then it
+ reports stereo frames per second for a format conversion, an up-mix and both rate conversions.
+*/
+
+#include "CAPCMConverter.h"
+#include "CAVectorUnit.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what, SInt32 vectorUnit)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s, vector unit %d\n", what, (int)vectorUnit);
+		failures++;
+	}
+}
+
+static UInt32 sSeed = 1;
+
+static UInt32 Random()
+{
+	sSeed = sSeed * 1103515245 + 12345;
+	return sSeed >> 8;
+}
+
+// an AudioBufferList with room for two buffers, over samples owned by the caller
+struct StereoBufferList
+{
+	UInt32		mNumberBuffers;
+	AudioBuffer	mBuffers[2];
+	
+	// interleaved formats get one buffer of every channel, the others one buffer per channel
+	StereoBufferList(const CAStreamBasicDescription &format, UInt32 frames, std::vector<Byte> &samples)
+	{
+		UInt32 bytes = format.FramesToBytes(frames);
+		samples.resize(bytes * format.NumberChannelStreams());
+		mNumberBuffers = format.NumberChannelStreams();
+		for (UInt32 i = 0; i < mNumberBuffers; i++)
+		{
+			mBuffers[i].mNumberChannels = format.NumberInterleavedChannels();
+			mBuffers[i].mDataByteSize = bytes;
+			mBuffers[i].mData = &samples[i * bytes];
+		}
+	}
+	
+	AudioBufferList &List() { return *(AudioBufferList *)this; }
+};
+
+// the kernel sets this machine can run, scalar first
+static std::vector<SInt32> VectorUnits()
+{
+	CAVectorUnit::SetVectorUnitType(kVecUninitialized);
+	SInt32 native = CAVectorUnit::GetVectorUnitType();
+	std::vector<SInt32> units(1, kVecNone);
+	if (native == kVecSSE2 || native == kVecAVX2)
+		units.push_back(kVecSSE2);
+	if (native == kVecAVX2 || native == kVecNeon)
+		units.push_back(native);
+	return units;
+}
+
+static const char *VectorUnitName(SInt32 vectorUnit)
+{
+	switch (vectorUnit)
+	{
+		case kVecSSE2:	return "SSE2";
+		case kVecAVX2:	return "AVX2";
+		case kVecNeon:	return "NEON";
+		default:		return "scalar";
+	}
+}
+
+// --- formats and mixing ------------------------------------
+
+// Int16 -> Float32 -> Int16, and the same for 8.24, must give back every sample, including both extremes
+static void CheckRoundTrip(SInt32 vectorUnit, CAStreamBasicDescription::CommonPCMFormat pcmFormat, const char *what)
+{
+	const UInt32 frames = 1000;
+	CAStreamBasicDescription integer(48000, 2, pcmFormat, true);
+	CAStreamBasicDescription floats(48000, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	std::vector<Byte> source, middle, result;
+	StereoBufferList sourceList(integer, frames, source);
+	StereoBufferList middleList(floats, frames, middle);
+	StereoBufferList resultList(integer, frames, result);
+	
+	if (pcmFormat == CAStreamBasicDescription::kPCMFormatInt16)
+	{
+		SInt16 *samples = (SInt16 *)&source[0];
+		for (UInt32 i = 0; i < 2 * frames; i++)
+			samples[i] = (SInt16)Random();
+		samples[0] = -32768;
+		samples[1] = 32767;
+	}
+	else
+	{
+		// 8.24 that fits in a float, so within 24 bits
+		SInt32 *samples = (SInt32 *)&source[0];
+		for (UInt32 i = 0; i < 2 * frames; i++)
+			samples[i] = (SInt32)(Random() & 0xffffff) - 0x800000;
+		samples[0] = -0x800000;
+		samples[1] = 0x7fffff;
+	}
+	
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAPCMConverter toFloat, fromFloat;
+	bool ok = toFloat.Initialize(integer, floats, 256) && fromFloat.Initialize(floats, integer, 256);
+	ok = ok && toFloat.Convert(sourceList.List(), frames, middleList.List()) == frames;
+	ok = ok && fromFloat.Convert(middleList.List(), frames, resultList.List()) == frames;
+	ok = ok && memcmp(&source[0], &result[0], source.size()) == 0;
+	Check(ok, what, vectorUnit);
+}
+
+// the default matrix spreads mono to every output channel
+static void CheckUpMix(SInt32 vectorUnit)
+{
+	const UInt32 frames = 777;
+	CAStreamBasicDescription mono(48000, 1, CAStreamBasicDescription::kPCMFormatInt16, true);
+	CAStreamBasicDescription stereo(48000, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	std::vector<Byte> source, result;
+	StereoBufferList sourceList(mono, frames, source);
+	StereoBufferList resultList(stereo, frames, result);
+	SInt16 *samples = (SInt16 *)&source[0];
+	for (UInt32 i = 0; i < frames; i++)
+		samples[i] = (SInt16)Random();
+	
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAPCMConverter converter;
+	bool ok = converter.Initialize(mono, stereo, 256) && converter.Convert(sourceList.List(), frames, resultList.List()) == frames;
+	const Float32 *left = (const Float32 *)resultList.mBuffers[0].mData;
+	const Float32 *right = (const Float32 *)resultList.mBuffers[1].mData;
+	for (UInt32 i = 0; ok && i < frames; i++)
+		ok = (left[i] == samples[i] / 32768.f) && (right[i] == left[i]);
+	Check(ok, "mono Int16 is spread to both channels of stereo Float32", vectorUnit);
+}
+
+// runs of random length through one converter give the same output as a single call through another
+static void CheckSlices(SInt32 vectorUnit)
+{
+	const UInt32 frames = 20000;
+	CAStreamBasicDescription source(44100, 2, CAStreamBasicDescription::kPCMFormatInt16, true);
+	CAStreamBasicDescription destination(48000, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	std::vector<Byte> input;
+	StereoBufferList inputList(source, frames, input);
+	for (size_t i = 0; i < input.size(); i++)
+		input[i] = (Byte)Random();
+	
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAPCMConverter whole, sliced;
+	bool ok = whole.Initialize(source, destination, 512) && sliced.Initialize(source, destination, 512);
+	
+	std::vector<Byte> expected;
+	StereoBufferList expectedList(destination, whole.MaxDestinationFrames(frames), expected);
+	UInt32 expectedFrames = whole.Convert(inputList.List(), frames, expectedList.List());
+	
+	std::vector<Float32> actual[2];
+	UInt32 offset = 0;
+	while (ok && offset < frames)
+	{
+		UInt32 slice = 1 + Random() % 1500;
+		if (slice > frames - offset)
+			slice = frames - offset;
+		std::vector<Byte> part, out;
+		StereoBufferList partList(source, slice, part);
+		memcpy(&part[0], &input[source.FramesToBytes(offset)], part.size());
+		StereoBufferList outList(destination, sliced.MaxDestinationFrames(slice), out);
+		UInt32 written = sliced.Convert(partList.List(), slice, outList.List());
+		for (int ch = 0; ch < 2; ch++)
+		{
+			const Float32 *p = (const Float32 *)outList.mBuffers[ch].mData;
+			actual[ch].insert(actual[ch].end(), p, p + written);
+		}
+		offset += slice;
+	}
+	
+	ok = ok && actual[0].size() == expectedFrames;
+	for (int ch = 0; ok && ch < 2; ch++)
+		ok = memcmp(&actual[ch][0], expectedList.mBuffers[ch].mData, expectedFrames * sizeof(Float32)) == 0;
+	Check(ok, "random slices convert the same as one call", vectorUnit);
+}
+
+// --- sample rate conversion --------------------------------
+
+// a tone through the converter, mono Float32; returns the output after the filter has settled
+static std::vector<Float32> ConvertTone(double sourceRate, double destinationRate, double hertz, UInt32 quality)
+{
+	const UInt32 frames = (UInt32)sourceRate;
+	CAStreamBasicDescription source(sourceRate, 1, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	CAStreamBasicDescription destination(destinationRate, 1, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	std::vector<Byte> input, output;
+	StereoBufferList inputList(source, frames, input);
+	Float32 *samples = (Float32 *)&input[0];
+	for (UInt32 i = 0; i < frames; i++)
+		samples[i] = (Float32)(0.5 * sin(2. * M_PI * hertz * i / sourceRate));
+	
+	CAPCMConverter converter;
+	std::vector<Float32> result;
+	if (!converter.Initialize(source, destination, 4096, quality))
+		return result;
+	StereoBufferList outputList(destination, converter.MaxDestinationFrames(frames), output);
+	UInt32 written = converter.Convert(inputList.List(), frames, outputList.List());
+	
+	// skip a tenth of a second of start up, and as much at the end
+	UInt32 settle = (UInt32)(destinationRate / 10);
+	const Float32 *out = (const Float32 *)outputList.mBuffers[0].mData;
+	if (written > 2 * settle)
+		result.assign(out + settle, out + written - settle);
+	return result;
+}
+
+// how far a tone of the given frequency stands above what's left once the best fitting sine of that frequency is taken out
+static double SignalToNoiseDB(const std::vector<Float32> &samples, double hertz, double rate)
+{
+	double ss = 0., sc = 0., cc = 0., ys = 0., yc = 0.;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		double s = sin(2. * M_PI * hertz * i / rate), c = cos(2. * M_PI * hertz * i / rate);
+		ss += s * s; sc += s * c; cc += c * c;
+		ys += samples[i] * s; yc += samples[i] * c;
+	}
+	double det = ss * cc - sc * sc;
+	double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+	double signal = 0., noise = 0.;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		double fit = a * sin(2. * M_PI * hertz * i / rate) + b * cos(2. * M_PI * hertz * i / rate);
+		signal += fit * fit;
+		noise += (samples[i] - fit) * (samples[i] - fit);
+	}
+	return 10. * log10(signal / noise);
+}
+
+static double RMS(const std::vector<Float32> &samples)
+{
+	double sum = 0.;
+	for (size_t i = 0; i < samples.size(); i++)
+		sum += (double)samples[i] * samples[i];
+	return samples.empty() ? 0. : sqrt(sum / samples.size());
+}
+
+static void CheckRateConversion(SInt32 vectorUnit, UInt32 quality, double minSNR, double minRejection)
+{
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	const char *name = (quality == CAPCMConverter::kQuality_High) ? "High" : "Medium";
+	char what[128];
+	
+	std::vector<Float32> tone = ConvertTone(44100, 48000, 1000, quality);
+	double snr = tone.empty() ? 0. : SignalToNoiseDB(tone, 1000, 48000);
+	snprintf(what, sizeof(what), "%s quality: 1 kHz from 44.1 to 48 kHz at %.1f dB SNR, wanted %.0f", name, snr, minSNR);
+	Check(snr >= minSNR, what, vectorUnit);
+	
+	// 0.5 peak in, so the input RMS is 0.5 / sqrt(2)
+	std::vector<Float32> alias = ConvertTone(48000, 44100, 23000, quality);
+	double rejection = alias.empty() ? 0. : 20. * log10((0.5 / sqrt(2.)) / (RMS(alias) + 1e-12));
+	snprintf(what, sizeof(what), "%s quality: 23 kHz from 48 to 44.1 kHz rejected by %.1f dB, wanted %.0f", name, rejection, minRejection);
+	Check(rejection >= minRejection, what, vectorUnit);
+	
+	if (vectorUnit == kVecNone)
+		printf("%-6s quality: 1 kHz SNR %.1f dB, 23 kHz rejected by %.1f dB\n", name, snr, rejection);
+}
+
+// --- timing ------------------------------------------------
+
+static double FramesPerSecond(SInt32 vectorUnit, const CAStreamBasicDescription &source, const CAStreamBasicDescription &destination)
+{
+	const UInt32 frames = 1024, passes = 2000;
+	std::vector<Byte> input, output;
+	StereoBufferList inputList(source, frames, input);
+	// random integer samples; Float32 is left at silence rather than random bit patterns
+	if (!(source.mFormatFlags & kAudioFormatFlagIsFloat))
+		for (size_t i = 0; i < input.size(); i++)
+			input[i] = (Byte)Random();
+	
+	CAVectorUnit::SetVectorUnitType(vectorUnit);
+	CAPCMConverter converter;
+	if (!converter.Initialize(source, destination, frames))
+		return 0.;
+	StereoBufferList outputList(destination, converter.MaxDestinationFrames(frames), output);
+	double start = NowSeconds();
+	for (UInt32 pass = 0; pass < passes; pass++)
+	{
+		for (UInt32 i = 0; i < outputList.mNumberBuffers; i++)
+			outputList.mBuffers[i].mDataByteSize = (UInt32)(output.size() / outputList.mNumberBuffers);
+		converter.Convert(inputList.List(), frames, outputList.List());
+	}
+	return (double)frames * passes / (NowSeconds() - start);
+}
+
+int main()
+{
+	std::vector<SInt32> units = VectorUnits();
+	for (size_t u = 0; u < units.size(); u++)
+	{
+		CheckRoundTrip(units[u], CAStreamBasicDescription::kPCMFormatInt16, "Int16 through Float32 and back is exact");
+		CheckRoundTrip(units[u], CAStreamBasicDescription::kPCMFormatFixed824, "8.24 through Float32 and back is exact");
+		CheckUpMix(units[u]);
+		CheckSlices(units[u]);
+		CheckRateConversion(units[u], CAPCMConverter::kQuality_High, 95., 85.);
+		CheckRateConversion(units[u], CAPCMConverter::kQuality_Medium, 75., 70.);
+	}
+	printf("checked %d kernel sets\n", (int)units.size());
+	
+	CAStreamBasicDescription int16Mono44(44100, 1, CAStreamBasicDescription::kPCMFormatInt16, true);
+	CAStreamBasicDescription int16Stereo44(44100, 2, CAStreamBasicDescription::kPCMFormatInt16, true);
+	CAStreamBasicDescription floatStereo44(44100, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	CAStreamBasicDescription floatStereo48(48000, 2, CAStreamBasicDescription::kPCMFormatFloat32, false);
+	
+	printf("M stereo frames/s, 1024 frame slices\n%-32s", "");
+	for (size_t u = 0; u < units.size(); u++)
+		printf("%10s", VectorUnitName(units[u]));
+	printf("\n");
+	struct { const char *name; const CAStreamBasicDescription *source, *destination; } conversions[] =
+	{
+		{ "Int16 to Float32",				&int16Stereo44,	&floatStereo44 },
+		{ "mono Int16 to stereo Float32",	&int16Mono44,	&floatStereo44 },
+		{ "44.1 to 48 kHz, Int16 in",		&int16Stereo44,	&floatStereo48 },
+		{ "48 to 44.1 kHz, Int16 out",		&floatStereo48,	&int16Stereo44 },
+	};
+	for (size_t c = 0; c < sizeof(conversions) / sizeof(conversions[0]); c++)
+	{
+		printf("%-32s", conversions[c].name);
+		for (size_t u = 0; u < units.size(); u++)
+			printf("%10.1f", FramesPerSecond(units[u], *conversions[c].source, *conversions[c].destination) * 1e-6);
+		printf("\n");
+	}
+	
+	printf(failures ? "FAILED\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,316 @@
+/*
+     File: CARingBufferBenchmark.cpp
+ Abstract: Command line stress test and benchmark for CARingBuffer.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2012 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+/*
+ Build and run from this directory with:
+ 
+	c++ -O2 -pthread -I../PublicUtility -o CARingBufferBenchmark CARingBufferBenchmark.cpp ../PublicUtility/CARingBuffer.cpp
+	./CARingBufferBenchmark
+ 
+ Every frame holds its own sample time, plus one so that silence can't pass for a frame. On one thread it checks that
+ a store going back in time, or jumping further ahead than the capacity, starts the buffer over: the read time and fill
+ level follow the new data, and it fetches intact. Then a producer thread stores runs of random length at the sample
+ times they belong to while a consumer thread fetches runs of random length from its read time, and every frame
+ fetched has to be either its own or silence reported as a miss. Once with the producer only ever moving forward,
+ keeping within the capacity, where every frame must arrive; once with the producer starting over, forwards and back,
+ every few thousand frames. It reports frames per second through the buffer.
+*/
+
+#include "CARingBuffer.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static UInt32 Random(UInt32 &ioSeed)
+{
+	ioSeed = ioSeed * 1103515245 + 12345;
+	return ioSeed >> 8;
+}
+
+static const UInt32 kCapacity = 4096;
+static const UInt32 kMaxRun = 512;
+
+// two buffers of one UInt32 channel each, both holding the sample time of the frame plus one
+struct Frames
+{
+	UInt32		mNumberBuffers;
+	AudioBuffer	mBuffers[2];
+	UInt32		mSamples[2][kMaxRun];
+	
+	Frames()
+	{
+		mNumberBuffers = 2;
+		for (int b = 0; b < 2; b++)
+		{
+			mBuffers[b].mNumberChannels = 1;
+			mBuffers[b].mDataByteSize = sizeof(mSamples[b]);
+			mBuffers[b].mData = mSamples[b];
+		}
+	}
+	
+	AudioBufferList *List() { return (AudioBufferList *)this; }
+	
+	void Fill(SampleTime inTime, UInt32 inFrames)
+	{
+		for (int b = 0; b < 2; b++)
+			for (UInt32 i = 0; i < inFrames; i++)
+				mSamples[b][i] = (UInt32)(inTime + i + 1);
+	}
+	
+	// frames that are neither their own nor silence; outSilent counts the silent ones
+	UInt32 CountWrong(SampleTime inTime, UInt32 inFrames, UInt32 &outSilent) const
+	{
+		UInt32 wrong = 0;
+		outSilent = 0;
+		for (UInt32 i = 0; i < inFrames; i++)
+		{
+			UInt32 expected = (UInt32)(inTime + i + 1);
+			if (mSamples[0][i] == 0 && mSamples[1][i] == 0)
+				outSilent++;
+			else if (mSamples[0][i] != expected || mSamples[1][i] != expected)
+				wrong++;
+		}
+		return wrong;
+	}
+};
+
+// --- restarts on one thread --------------------------------
+
+static bool FetchIntact(CARingBuffer &ioBuffer, Frames &ioFrames, SampleTime inTime, UInt32 inFrames)
+{
+	UInt32 silent;
+	CARingBufferError err = ioBuffer.Fetch(ioFrames.List(), inFrames, inTime);
+	return err == kCARingBufferError_OK && ioFrames.CountWrong(inTime, inFrames, silent) == 0 && silent == 0;
+}
+
+static void CheckRestarts()
+{
+	CARingBuffer buffer;
+	Frames frames;
+	Check(buffer.Allocate(2, sizeof(UInt32), kCapacity), "ring buffer allocates");
+	
+	// read everything up to 1128, then time goes back to 500
+	frames.Fill(1000, 64);
+	buffer.Store(frames.List(), 64, 1000);
+	frames.Fill(1064, 64);
+	buffer.Store(frames.List(), 64, 1064);
+	Check(buffer.GetFillLevel() == 128 && buffer.GetReadTime() == 1000, "the first store starts the buffer, and the read time, at its time");
+	Check(FetchIntact(buffer, frames, 1000, 128), "frames fetch intact");
+	Check(buffer.GetFillLevel() == 0 && buffer.GetReadTime() == 1128, "fetch moves the read time to its end");
+	
+	frames.Fill(500, 64);
+	buffer.Store(frames.List(), 64, 500);
+	SampleTime start, end;
+	buffer.GetTimeBounds(start, end);
+	Check(start == 500 && end == 564, "going back in time starts the buffer over");
+	Check(buffer.GetReadTime() == 500 && buffer.GetFillLevel() == 64, "read time follows a restart before the consumer's next fetch");
+	Check(FetchIntact(buffer, frames, 500, 64), "frames stored after going back in time fetch intact");
+	
+	// a gap longer than the buffer, with frames still unread
+	frames.Fill(564, 32);
+	buffer.Store(frames.List(), 32, 564);
+	SampleTime far = 564 + 3 * kCapacity;
+	frames.Fill(far, 100);
+	buffer.Store(frames.List(), 100, far);
+	buffer.GetTimeBounds(start, end);
+	Check(start == far && end == far + 100, "a gap longer than the capacity starts the buffer over");
+	Check(buffer.GetReadTime() == far && buffer.GetFillLevel() == 100, "read time follows a restart forwards");
+	Check(FetchIntact(buffer, frames, far, 100), "frames stored after a long gap fetch intact");
+	
+	// a short gap reads as silence, and is not a restart
+	frames.Fill(far + 200, 50);
+	buffer.Store(frames.List(), 50, far + 200);
+	buffer.GetTimeBounds(start, end);
+	UInt32 silent;
+	buffer.Fetch(frames.List(), 150, far + 100);
+	Check(start == far && frames.CountWrong(far + 100, 150, silent) == 0 && silent == 100, "a short gap reads as silence");
+}
+
+// --- two threads -------------------------------------------
+
+struct Stress
+{
+	CARingBuffer		buffer;
+	UInt32				frames;			// to store in all
+	UInt32				restartEvery;	// frames between restarts, 0 for none
+	volatile int		producerDone;
+	
+	// results
+	UInt32				stored;
+	UInt32				restarts;
+	UInt32				fetched;
+	UInt32				intact;
+	UInt32				silent;
+	UInt32				wrong;
+};
+
+static void *Produce(void *inStress)
+{
+	Stress *stress = static_cast<Stress *>(inStress);
+	Frames frames;
+	UInt32 seed = 7;
+	SampleTime time = 0;
+	UInt32 sinceRestart = 0;
+	while (stress->stored < stress->frames)
+	{
+		UInt32 run = 1 + Random(seed) % kMaxRun;
+		if (stress->restartEvery && sinceRestart >= stress->restartEvery)
+		{
+			// back by up to twice the capacity, or forward by more than it
+			SampleTime jump = (SampleTime)(Random(seed) % (2 * kCapacity)) + 1;
+			time = (Random(seed) & 1) ? ((time > jump) ? time - jump : time + kCapacity + jump) : time + kCapacity + jump;
+			sinceRestart = 0;
+			stress->restarts++;
+		}
+		else
+		{
+			// stay within the capacity so nothing unread is overwritten
+			while (__sync_add_and_fetch(&stress->producerDone, 0) == 0 && stress->buffer.GetFillLevel() + run > kCapacity)
+				sched_yield();
+		}
+		frames.Fill(time, run);
+		stress->buffer.Store(frames.List(), run, time);
+		time += run;
+		sinceRestart += run;
+		stress->stored += run;
+	}
+	__sync_fetch_and_add(&stress->producerDone, 1);
+	return NULL;
+}
+
+static void Consume(Stress *stress)
+{
+	Frames frames;
+	UInt32 seed = 11;
+	for (;;)
+	{
+		bool done = __sync_add_and_fetch(&stress->producerDone, 0) != 0;
+		SampleTime time = stress->buffer.GetReadTime();
+		UInt32 fill = stress->buffer.GetFillLevel();
+		if (fill == 0)
+		{
+			if (done)
+				break;
+			sched_yield();
+			continue;
+		}
+		UInt32 run = 1 + Random(seed) % kMaxRun;
+		if (run > fill)
+			run = fill;
+		stress->buffer.Fetch(frames.List(), run, time);
+		UInt32 silent;
+		UInt32 wrong = frames.CountWrong(time, run, silent);
+		stress->fetched += run;
+		stress->wrong += wrong;
+		stress->silent += silent;
+		stress->intact += run - wrong - silent;
+	}
+}
+
+static void RunStress(UInt32 inFrames, UInt32 inRestartEvery)
+{
+	Stress *stress = new Stress;
+	memset(&stress->stored, 0, sizeof(UInt32) * 6);
+	stress->frames = inFrames;
+	stress->restartEvery = inRestartEvery;
+	stress->producerDone = 0;
+	Check(stress->buffer.Allocate(2, sizeof(UInt32), kCapacity), "ring buffer allocates");
+	
+	double start = NowSeconds();
+	pthread_t producer;
+	pthread_create(&producer, NULL, Produce, stress);
+	Consume(stress);
+	pthread_join(producer, NULL);
+	double elapsed = NowSeconds() - start;
+	
+	printf("%s: %.1f M frames/s, %u stored, %u restarts, %u intact, %u silent, %u overruns, %u underruns\n",
+		   inRestartEvery ? "restarting" : "in order  ", stress->stored / elapsed * 1e-6, (unsigned)stress->stored,
+		   (unsigned)stress->restarts, (unsigned)stress->intact, (unsigned)stress->silent,
+		   (unsigned)stress->buffer.GetOverrunCount(), (unsigned)stress->buffer.GetUnderrunCount());
+	Check(stress->wrong == 0, "no frame is fetched at another frame's time");
+	if (inRestartEvery == 0)
+	{
+		Check(stress->intact == stress->stored && stress->fetched == stress->stored, "every frame stored in order is fetched intact");
+		Check(stress->buffer.GetOverrunCount() == 0 && stress->buffer.GetUnderrunCount() == 0, "no overruns or underruns when the producer keeps within the capacity");
+	}
+	else
+	{
+		Check(stress->restarts > 0 && stress->intact > stress->stored / 2, "most frames arrive intact across restarts");
+	}
+	delete stress;
+}
+
+int main()
+{
+	CheckRestarts();
+	RunStress(50000000, 0);
+	RunStress(20000000, 5000);
+	printf(failures ? "FAILED\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
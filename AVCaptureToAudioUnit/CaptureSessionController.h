@@ -57,7 +57,10 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
 #include "CAStreamBasicDescription.h"
 #include "CAComponentDescription.h"
 #include "CAAudioBufferList.h"
-#include "AUOutputBL.h"
+#include "CABufferListPool.h"
+#include "CAPCMConverter.h"
+#include "CARingBuffer.h"
+#include "CAAudioFileRecorder.h"
 
 @interface CaptureSessionController : NSObject <AVCaptureAudioDataOutputSampleBufferDelegate> {
 @private
@@ -66,17 +69,19 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
     AVCaptureAudioDataOutput    *captureAudioDataOutput;
 	
     AUGraph                     auGraph;
-    AudioUnit					converterAudioUnit;
 	AudioUnit					delayAudioUnit;
     AudioChannelLayout          *currentRecordingChannelLayout;
-    ExtAudioFileRef             extAudioFile;
+    CAAudioFileRecorder         *fileRecorder;
 	
     AudioStreamBasicDescription currentInputASBD;
     AudioStreamBasicDescription graphOutputASBD;
-	AudioBufferList				*currentInputAudioBufferList;
-    AUOutputBL                  *outputBufferList;
+    CABufferListPool            *inputBufferListPool;
+    CABufferListPool            *outputBufferListPool;
+    CAPCMConverter              *inputConverter;
+    CARingBuffer                *inputRingBuffer;
     
 	double						currentSampleTime;
+	double						renderSampleTime;
 	BOOL						didSetUpAudioUnits;
 }
 
@@ -89,4 +94,7 @@ Copyright (C) 2012 Apple Inc. All Rights Reserved.
 - (void)startRecording;
 - (void)stopRecording;
 
+// frames waiting in the ring buffer between capture and the effect, and how often it has over or under run
+- (void)getInputFillLevel:(UInt32 *)outFillLevel overruns:(UInt32 *)outOverruns underruns:(UInt32 *)outUnderruns;
+
 @end
@@ -58,6 +58,14 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 													UInt32						inNumberFrames,
 													AudioBufferList            *ioData);
 
+// lists in each pool, and the frames per list in the output pool
+static const UInt32 kBufferListPoolSize = 4;
+static const UInt32 kMaxFramesPerBuffer = 4096;
+
+// the delay renders this many frames at a time whatever the capture buffer size, out of a ring buffer that holds several capture buffers
+static const UInt32 kRenderQuantum = 256;
+static const UInt32 kInputRingBufferFrames = 4 * kMaxFramesPerBuffer;
+
 @implementation CaptureSessionController
 
 #pragma mark ======== Setup and teardown methods =========
@@ -69,7 +77,7 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 	if (self) {
         NSArray  *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
         NSString *documentsDirectory = [paths objectAtIndex:0];
-        NSString *destinationFilePath = [NSString stringWithFormat: @"%@/AudioRecording.aif", documentsDirectory];
+        NSString *destinationFilePath = [NSString stringWithFormat: @"%@/AudioRecording.caf", documentsDirectory];
         _outputFile = CFURLCreateWithFileSystemPath(kCFAllocatorDefault, (CFStringRef)destinationFilePath, kCFURLPOSIXPathStyle, false);
     
         [self registerForNotifications];
@@ -140,16 +148,16 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 	
     // AVFoundation does not currently provide a way to set the output format of the AVCaptureAudioDataOutput object,
     // therefore unlike OS X where you could simply use the delay AU and have AVCaptureAudioDataOutput return samples
-    // in a format that the delay AU can ingest by using the audioSettings method, for iOS you need to use the Converter AU
-    // along with the delay AU in a Graph. Note that we don't start or stop the graph and we don't use an output unit
-    // all we are doing is chaining two AUs together then pulling on the delay when we call render, this delivers data in
-    // the current AVCaptureAudioDataOutput format to the converter which then converts the format for the delay which
-    // performs the processing we want delivering the data into our output buffer list for recording if we choose
+    // in a format that the delay AU can ingest by using the audioSettings method, for iOS the samples need converting
+    // before the delay AU sees them. Rather than chaining a Converter AU in front of the delay, each buffer is converted
+    // to the delay's canonical format with a CAPCMConverter when it arrives, saving a hop through the graph per buffer.
+    // Note that we don't start or stop the graph and we don't use an output unit, all we are doing is pulling on the delay
+    // when we call render, which performs the processing we want delivering the data into our output buffer list for
+    // recording if we choose
     
-	// Create an AUGraph of the converter audio unit and the delay effect audio unit, the resulting effect is added to the audio when it is written to the file
+	// Create an AUGraph of the delay effect audio unit, the resulting effect is added to the audio when it is written to the file
 
     AUNode delayNode;
-    AUNode converterNode;
     
     // create a new AUGraph
 	OSStatus err = NewAUGraph(&auGraph);
@@ -158,39 +166,24 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
     // delay effect
     CAComponentDescription delay_EffectAudioUnitDescription(kAudioUnitType_Effect, kAudioUnitSubType_Delay, kAudioUnitManufacturer_Apple);
     
-    // converter
-    CAComponentDescription converter_desc(kAudioUnitType_FormatConverter, kAudioUnitSubType_AUConverter, kAudioUnitManufacturer_Apple);
-    
     // add nodes to graph
     err = AUGraphAddNode(auGraph, &delay_EffectAudioUnitDescription, &delayNode);
     if (err) { printf("AUGraphNewNode 2 result %lu %4.4s\n", (unsigned long)err, (char*)&err); return NO; }
-    
-    err = AUGraphAddNode(auGraph, &converter_desc, &converterNode);
-	if (err) { printf("AUGraphNewNode 3 result %lu %4.4s\n", (unsigned long)err, (char*)&err); return NO; }
-    
-    // connect a node's output to a node's input
-    // au converter -> delay
-    
-    err = AUGraphConnectNodeInput(auGraph, converterNode, 0, delayNode, 0);
-	if (err) { printf("AUGraphConnectNodeInput result %lu %4.4s\n", (unsigned long)err, (char*)&err); return NO; }
 	
     // open the graph -- AudioUnits are open but not initialized (no resource allocation occurs here)
 	err = AUGraphOpen(auGraph);
 	if (err) { printf("AUGraphOpen result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
 	
-    // grab audio unit instances from the nodes
-    err = AUGraphNodeInfo(auGraph, converterNode, NULL, &converterAudioUnit);
-    if (err) { printf("AUGraphNodeInfo result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
-
+    // grab the audio unit instance from the node
 	err = AUGraphNodeInfo(auGraph, delayNode, NULL, &delayAudioUnit);
     if (err) { printf("AUGraphNodeInfo result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
 
-    // Set a callback on the converter audio unit that will supply the audio buffers received from the capture audio data output
+    // Set a callback on the delay audio unit that will supply the converted audio buffers received from the capture audio data output
     AURenderCallbackStruct renderCallbackStruct;
     renderCallbackStruct.inputProc = PushCurrentInputBufferIntoAudioUnit;
     renderCallbackStruct.inputProcRefCon = self;
     
-    err = AUGraphSetNodeInputCallback(auGraph, converterNode, 0, &renderCallbackStruct);
+    err = AUGraphSetNodeInputCallback(auGraph, delayNode, 0, &renderCallbackStruct);
     if (err) { printf("AUGraphSetNodeInputCallback result %ld %08X %4.4s\n", (long)err, (unsigned int)err, (char*)&err); return NO; }
 	
     // add an observer for the interupted property, we simply log the result
@@ -272,8 +265,7 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 	
 	if (_outputFile) { CFRelease(_outputFile); _outputFile = NULL; }
 	
-	if (extAudioFile)
-        ExtAudioFileDispose(extAudioFile);
+	delete fileRecorder;
     
 	if (auGraph) {
 		if (didSetUpAudioUnits)
@@ -281,8 +273,10 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 		DisposeAUGraph(auGraph);
 	}
     
-    if (currentInputAudioBufferList) free(currentInputAudioBufferList);
-    if (outputBufferList) delete outputBufferList;
+    delete inputBufferListPool;
+    delete outputBufferListPool;
+    delete inputConverter;
+    delete inputRingBuffer;
 	
 	[super dealloc];
 }
@@ -301,12 +295,13 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 {
 	OSStatus err = noErr;
 	
-    // Get the sample buffer's AudioStreamBasicDescription which will be used to set the input format of the audio unit and ExtAudioFile
+    // Get the sample buffer's AudioStreamBasicDescription which will be used to set the input format of the audio unit and CAAudioFileRecorder
     CMFormatDescriptionRef formatDescription = CMSampleBufferGetFormatDescription(sampleBuffer);
     CAStreamBasicDescription sampleBufferASBD(*CMAudioFormatDescriptionGetStreamBasicDescription(formatDescription));
     if (kAudioFormatLinearPCM != sampleBufferASBD.mFormatID) { NSLog(@"Bad format or bogus ASBD!"); return; }
     
-    if ((sampleBufferASBD.mChannelsPerFrame != currentInputASBD.mChannelsPerFrame) || (sampleBufferASBD.mSampleRate != currentInputASBD.mSampleRate)) {
+    if ((sampleBufferASBD.mChannelsPerFrame != currentInputASBD.mChannelsPerFrame) || (sampleBufferASBD.mSampleRate != currentInputASBD.mSampleRate) ||
+        (sampleBufferASBD.mFormatFlags != currentInputASBD.mFormatFlags) || (sampleBufferASBD.mBytesPerFrame != currentInputASBD.mBytesPerFrame)) {
         NSLog(@"AVCaptureAudioDataOutput Audio Format:");
         sampleBufferASBD.Print();
         /* 
@@ -323,36 +318,58 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
             // The audio units were previously set up, so they must be uninitialized now
             err = AUGraphUninitialize(auGraph);
             NSLog(@"AUGraphUninitialize failed (%ld)", (long)err);
-			
-        if (outputBufferList) delete outputBufferList;
-            outputBufferList = NULL;
         } else {
             didSetUpAudioUnits = YES;
         }
         
-        // set the input stream format, this is the format of the audio for the converter input bus
-        err = AudioUnitSetProperty(converterAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &currentInputASBD, sizeof(currentInputASBD));
-		
-		if (noErr == err) {
-            CAStreamBasicDescription outputFormat(currentInputASBD.mSampleRate, currentInputASBD.mChannelsPerFrame, CAStreamBasicDescription::kPCMFormatFloat32, false);
-            NSLog(@"AUGraph Output Audio Format:");
-            outputFormat.Print();
-            
-            graphOutputASBD = outputFormat;
-            
-            // in an au graph, each nodes output stream format (including sample rate) needs to be set explicitly
-            // this stream format is propagated to its destination's input stream format
-    
-            // set the output stream format of the converter
-            err = AudioUnitSetProperty(converterAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &graphOutputASBD, sizeof(graphOutputASBD));
-            if (noErr == err)
-                // set the output stream format of the delay
-                err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &graphOutputASBD, sizeof(graphOutputASBD));
-        }
+        CAStreamBasicDescription outputFormat(currentInputASBD.mSampleRate, currentInputASBD.mChannelsPerFrame, CAStreamBasicDescription::kPCMFormatFloat32, false);
+        NSLog(@"AUGraph Output Audio Format:");
+        outputFormat.Print();
+        
+        graphOutputASBD = outputFormat;
+        
+        // the converter turns each captured buffer into the delay's format before it's rendered
+        if (NULL == inputConverter) inputConverter = new CAPCMConverter;
+        if (!inputConverter->Initialize(sampleBufferASBD, outputFormat, kMaxFramesPerBuffer))
+            err = kAudioFormatUnsupportedDataFormatError;
+        
+        // set the input and output stream formats of the delay
+        if (noErr == err)
+            err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &graphOutputASBD, sizeof(graphOutputASBD));
+        if (noErr == err)
+            err = AudioUnitSetProperty(delayAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &graphOutputASBD, sizeof(graphOutputASBD));
 		
         // Initialize the graph
 		if (noErr == err)
 			err = AUGraphInitialize(auGraph);
+        
+        /*
+         The buffer lists handed to CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer, the converter and AudioUnitRender come from pools
+         allocated here, on a format change, so that the per buffer path below never touches the heap. The input pool only holds
+         headers since the sample buffer supplies the data. If the new format fits the current allocation it's simply reused.
+        */
+        if (noErr == err) {
+            if (NULL == inputBufferListPool) inputBufferListPool = new CABufferListPool;
+            if (NULL == outputBufferListPool) outputBufferListPool = new CABufferListPool;
+            
+            CAStreamBasicDescription inputFormat(currentInputASBD);
+            inputBufferListPool->SetLive(false);
+            outputBufferListPool->SetLive(false);
+            if (!inputBufferListPool->SetFormat(inputFormat) && !inputBufferListPool->Allocate(inputFormat, 0, kBufferListPoolSize))
+                err = kAudio_MemFullError;
+            if (!outputBufferListPool->SetFormat(graphOutputASBD) && !outputBufferListPool->Allocate(graphOutputASBD, kMaxFramesPerBuffer, kBufferListPoolSize))
+                err = kAudio_MemFullError;
+            
+            // from here on only the per buffer path uses the pools, and in debug builds an Allocate asserts
+            inputBufferListPool->SetLive(true);
+            outputBufferListPool->SetLive(true);
+            
+            // the ring buffer starts out empty, with rendering picking up from the next frame captured
+            if (NULL == inputRingBuffer) inputRingBuffer = new CARingBuffer;
+            if (!inputRingBuffer->Allocate(outputFormat.NumberChannelStreams(), outputFormat.mBytesPerFrame, kInputRingBufferFrames))
+                err = kAudio_MemFullError;
+            renderSampleTime = currentSampleTime;
+        }
 		
 		if (noErr != err) {
 			NSLog(@"Failed to set up audio units (%ld)", (long)err);
@@ -364,82 +381,159 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
         CAShow(auGraph);
     }
 
-    CMItemCount numberOfFrames = CMSampleBufferGetNumSamples(sampleBuffer); // corresponds to the number of CoreAudio audio frames
-		
-    // In order to render continuously, the effect audio unit needs a new time stamp for each buffer
-    // Use the number of frames for each unit of time continuously incrementing
-    currentSampleTime += (double)numberOfFrames;
+    // nothing to render into unless the audio units are set up for the current format; after a failed
+    // set up the pools, converter and ring buffer are still there, but for the old one
+    if (!didSetUpAudioUnits || NULL == inputBufferListPool || NULL == outputBufferListPool || NULL == inputConverter || NULL == inputRingBuffer) return;
     
-    AudioTimeStamp timeStamp;
-    memset(&timeStamp, 0, sizeof(AudioTimeStamp));
-    timeStamp.mSampleTime = currentSampleTime;
-    timeStamp.mFlags |= kAudioTimeStampSampleTimeValid;		
-    
-    AudioUnitRenderActionFlags flags = 0;
-    
-    // Create an output AudioBufferList as the destination for the AU rendered audio
-    if (NULL == outputBufferList) {
-        outputBufferList = new AUOutputBL(graphOutputASBD, numberOfFrames);
-    }
-    outputBufferList->Prepare(numberOfFrames);
+    CMItemCount numberOfFrames = CMSampleBufferGetNumSamples(sampleBuffer); // corresponds to the number of CoreAudio audio frames
     
     /*
-     Get an audio buffer list from the sample buffer and assign it to the currentInputAudioBufferList instance variable.
-     The the audio unit render callback called PushCurrentInputBufferIntoAudioUnit can access this value by calling the
-     currentInputAudioBufferList method.
+     Get an audio buffer list from the sample buffer, convert it to the delay's format and store it in the input ring buffer
+     at the sample time it belongs to. The audio unit render callback called PushCurrentInputBufferIntoAudioUnit fetches it
+     from there by the sample time of each render, so the delay doesn't have to render in the capture buffer size.
     */
     
     // CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer requires a properly allocated AudioBufferList struct
-    currentInputAudioBufferList = CAAudioBufferList::Create(currentInputASBD.mChannelsPerFrame);
+    AudioBufferList *sampleBufferList = inputBufferListPool->Acquire(0, true);
+    AudioBufferList *sliceBufferList = inputBufferListPool->Acquire(0, true);
+    AudioBufferList *convertedBufferList = outputBufferListPool->Acquire(outputBufferListPool->MaxFrames());
+    if (NULL == sampleBufferList || NULL == sliceBufferList || NULL == convertedBufferList) {
+        inputBufferListPool->Release(sampleBufferList);
+        inputBufferListPool->Release(sliceBufferList);
+        outputBufferListPool->Release(convertedBufferList);
+        return;
+    }
     
     size_t bufferListSizeNeededOut;
     CMBlockBufferRef blockBufferOut = nil;
     
     err = CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer(sampleBuffer,
                                                                   &bufferListSizeNeededOut,
-                                                                  currentInputAudioBufferList,
-                                                                  CAAudioBufferList::CalculateByteSize(currentInputASBD.mChannelsPerFrame),
+                                                                  sampleBufferList,
+                                                                  inputBufferListPool->HeaderByteSize(),
                                                                   kCFAllocatorSystemDefault,
                                                                   kCFAllocatorSystemDefault,
                                                                   kCMSampleBufferFlag_AudioBufferList_Assure16ByteAlignment,
                                                                   &blockBufferOut);
     
     if (noErr == err) {
-        // Tell the effect audio unit to render -- This will synchronously call PushCurrentInputBufferIntoAudioUnit, which will
-        // feed currentInputAudioBufferList into the effect audio unit
-        err = AudioUnitRender(delayAudioUnit, &flags, &timeStamp, 0, numberOfFrames, outputBufferList->ABL());
-        if (err) {
-            // kAudioUnitErr_TooManyFramesToProcess may happen on a route change if CMSampleBufferGetNumSamples
-            // returns more than 1024 (the default) number of samples. This is ok and on the next cycle this error should not repeat
-            NSLog(@"AudioUnitRender failed! (%ld)", err);
+        /*
+         The output pool isn't grown here, so a capture buffer with more frames than its lists hold, as a route change can deliver,
+         is converted a list's worth at a time. The delay runs at the capture rate, so each slice converts to as many frames.
+        */
+        UInt32 maxSliceFrames = outputBufferListPool->MaxFrames();
+        UInt32 convertedBytes = outputBufferListPool->GetFormat().FramesToBytes(maxSliceFrames);
+        for (UInt32 offset = 0; offset < (UInt32)numberOfFrames; offset += maxSliceFrames) {
+            UInt32 sliceFrames = ((UInt32)numberOfFrames - offset < maxSliceFrames) ? (UInt32)numberOfFrames - offset : maxSliceFrames;
+            sliceBufferList->mNumberBuffers = sampleBufferList->mNumberBuffers;
+            for (UInt32 i = 0; i < sampleBufferList->mNumberBuffers; ++i) {
+                sliceBufferList->mBuffers[i].mNumberChannels = sampleBufferList->mBuffers[i].mNumberChannels;
+                sliceBufferList->mBuffers[i].mData = (Byte *)sampleBufferList->mBuffers[i].mData + (offset * currentInputASBD.mBytesPerFrame);
+                sliceBufferList->mBuffers[i].mDataByteSize = sliceFrames * currentInputASBD.mBytesPerFrame;
+            }
+            // Convert sets the byte sizes to what it wrote
+            for (UInt32 i = 0; i < convertedBufferList->mNumberBuffers; ++i)
+                convertedBufferList->mBuffers[i].mDataByteSize = convertedBytes;
+            
+            UInt32 convertedFrames = inputConverter->Convert(*sliceBufferList, sliceFrames, *convertedBufferList);
+            inputRingBuffer->Store(convertedBufferList, convertedFrames, (SampleTime)currentSampleTime);
+            currentSampleTime += (double)convertedFrames;
         }
-        
         CFRelease(blockBufferOut);
-        CAAudioBufferList::Destroy(currentInputAudioBufferList);
-        currentInputAudioBufferList = NULL;
     } else {
         NSLog(@"CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer failed! (%ld)", (long)err);
     }
-
-    if (noErr == err) {
-        @synchronized(self) {
-            if (extAudioFile) {
-                err = ExtAudioFileWriteAsync(extAudioFile, numberOfFrames, outputBufferList->ABL());
-            }
-        }// @synchronized
+    
+    inputBufferListPool->Release(sampleBufferList);
+    inputBufferListPool->Release(sliceBufferList);
+    outputBufferListPool->Release(convertedBufferList);
+    if (noErr != err) return;
+    
+    /*
+     Render the delay a fixed quantum at a time for as long as the ring buffer holds a whole one, appending the results to the
+     output buffer list and writing it out whenever it fills. Whatever is left over is rendered after the next capture buffer arrives.
+    */
+    AudioBufferList *outputBufferList = outputBufferListPool->Acquire(outputBufferListPool->MaxFrames());
+    AudioBufferList *renderBufferList = outputBufferListPool->Acquire(0, true);
+    if (NULL == outputBufferList || NULL == renderBufferList) {
+        NSLog(@"No output buffer list available, dropping %ld frames", (long)numberOfFrames);
+        outputBufferListPool->Release(outputBufferList);
+        outputBufferListPool->Release(renderBufferList);
+        return;
+    }
+    
+    UInt32 renderedFrames = 0;
+    while (inputRingBuffer->GetFillLevel() >= kRenderQuantum) {
+        // In order to render continuously, the effect audio unit needs a new time stamp for each slice, which is also
+        // the sample time PushCurrentInputBufferIntoAudioUnit fetches from
+        AudioTimeStamp timeStamp;
+        memset(&timeStamp, 0, sizeof(AudioTimeStamp));
+        timeStamp.mSampleTime = renderSampleTime;
+        timeStamp.mFlags |= kAudioTimeStampSampleTimeValid;
+        
+        AudioUnitRenderActionFlags flags = 0;
+        
+        // render into the output buffer list at the frames rendered so far
+        for (UInt32 i = 0; i < renderBufferList->mNumberBuffers; ++i) {
+            renderBufferList->mBuffers[i].mData = (Byte *)outputBufferList->mBuffers[i].mData + (renderedFrames * graphOutputASBD.mBytesPerFrame);
+            renderBufferList->mBuffers[i].mDataByteSize = kRenderQuantum * graphOutputASBD.mBytesPerFrame;
+        }
+        
+        // Tell the effect audio unit to render -- This will synchronously call PushCurrentInputBufferIntoAudioUnit, which will
+        // feed the ring buffer's frames for this time stamp into the effect audio unit
+        err = AudioUnitRender(delayAudioUnit, &flags, &timeStamp, 0, kRenderQuantum, renderBufferList);
         if (err) {
-            NSLog(@"ExtAudioFileWriteAsync failed! (%ld)", (long)err);
+            NSLog(@"AudioUnitRender failed! (%ld)", (long)err);
+            break;
         }
+        
+        renderSampleTime += kRenderQuantum;
+        renderedFrames += kRenderQuantum;
+        
+        if (renderedFrames + kRenderQuantum > outputBufferListPool->MaxFrames()) {
+            [self writeRenderedFrames:renderedFrames fromBufferList:outputBufferList];
+            renderedFrames = 0;
+        }
+    }
+    
+    outputBufferListPool->Release(renderBufferList);
+    if (noErr == err && renderedFrames) {
+        [self writeRenderedFrames:renderedFrames fromBufferList:outputBufferList];
+    }
+    
+    // the recorder has copied the frames into one of its blocks by the time Write returns
+    outputBufferListPool->Release(outputBufferList);
+}
+
+- (OSStatus)writeRenderedFrames:(UInt32)renderedFrames fromBufferList:(AudioBufferList *)outputBufferList
+{
+    OSStatus err = noErr;
+    for (UInt32 i = 0; i < outputBufferList->mNumberBuffers; ++i)
+        outputBufferList->mBuffers[i].mDataByteSize = renderedFrames * graphOutputASBD.mBytesPerFrame;
+    
+    // fileRecorder is only set or cleared on this queue, so no lock is needed to write to it
+    if (fileRecorder) {
+        err = fileRecorder->Write(*outputBufferList, renderedFrames);
     }
+    if (err) {
+        NSLog(@"CAAudioFileRecorder::Write failed! (%ld)", (long)err);
+    }
+    return err;
 }
 
 /*
- Used by PushCurrentInputBufferIntoAudioUnit() to access the current audio buffer list
- that has been output by the AVCaptureAudioDataOutput.
+ Used by PushCurrentInputBufferIntoAudioUnit() to fetch the converted audio captured by the AVCaptureAudioDataOutput.
 */
-- (AudioBufferList *)currentInputAudioBufferList
+- (CARingBuffer *)inputRingBuffer
+{
+	return inputRingBuffer;
+}
+
+- (void)getInputFillLevel:(UInt32 *)outFillLevel overruns:(UInt32 *)outOverruns underruns:(UInt32 *)outUnderruns
 {
-	return currentInputAudioBufferList;
+    *outFillLevel = inputRingBuffer ? inputRingBuffer->GetFillLevel() : 0;
+    *outOverruns = inputRingBuffer ? inputRingBuffer->GetOverrunCount() : 0;
+    *outUnderruns = inputRingBuffer ? inputRingBuffer->GetUnderrunCount() : 0;
 }
 
 #pragma mark ======== AVCapture Session & Recording =========
@@ -490,42 +584,34 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 - (void)startRecording
 {
     if (!self.isRecording) {
-        OSErr err = kAudioFileUnspecifiedError;
-        @synchronized(self) {
-            if (!extAudioFile) {
-                /*
-                 Start recording by creating an ExtAudioFile and configuring it with the same sample rate and
-                 channel layout as those of the current sample buffer.
-                */
-                
-                // recording format is the format of the audio file itself
-                CAStreamBasicDescription recordingFormat(currentInputASBD.mSampleRate, currentInputASBD.mChannelsPerFrame, CAStreamBasicDescription::kPCMFormatInt16, true);
-                recordingFormat.mFormatFlags |= kAudioFormatFlagIsBigEndian;
-                
-                NSLog(@"Recording Audio Format:");
-                recordingFormat.Print();
-                       
-                err = ExtAudioFileCreateWithURL(_outputFile,
-                                                kAudioFileAIFFType,
-                                                &recordingFormat,
-                                                currentRecordingChannelLayout,
-                                                kAudioFileFlags_EraseFile,
-                                                &extAudioFile);
-                if (noErr == err)
-                    // client format is the output format from the delay unit
-                    err = ExtAudioFileSetProperty(extAudioFile, kExtAudioFileProperty_ClientDataFormat, sizeof(graphOutputASBD), &graphOutputASBD);
-                    
-                if (noErr != err) {
-                    if (extAudioFile) ExtAudioFileDispose(extAudioFile);
-                    extAudioFile = NULL;
-                }
-            }
-        } // @synchronized
+        OSStatus err = kAudioFileUnspecifiedError;
+        /*
+         Start recording by opening a CAAudioFileRecorder with the same sample rate and channel layout as those of the
+         current sample buffer. It converts and batches the rendered frames, and a thread of its own writes them to the file.
+        */
+        
+        // recording format is the format of the audio file itself
+        CAStreamBasicDescription recordingFormat(currentInputASBD.mSampleRate, currentInputASBD.mChannelsPerFrame, CAStreamBasicDescription::kPCMFormatInt16, true);
+        
+        NSLog(@"Recording Audio Format:");
+        recordingFormat.Print();
+        
+        char path[PATH_MAX];
+        CAAudioFileRecorder *recorder = new CAAudioFileRecorder;
+        if (CFURLGetFileSystemRepresentation(_outputFile, true, (UInt8 *)path, sizeof(path))) {
+            // client format is the output format from the delay unit
+            err = recorder->Open(path, graphOutputASBD, recordingFormat, currentRecordingChannelLayout);
+        }
         
         if (noErr == err) {
+            // hand the recorder to the capture queue, the only place it's written from
+            dispatch_sync(captureAudioDataOutput.sampleBufferCallbackQueue, ^{
+                fileRecorder = recorder;
+            });
             self.recording = YES;
             NSLog(@"Recording Started");
         } else {
+            delete recorder;
             NSLog(@"Failed to setup audio file! (%ld)", (long)err);
         }
     }
@@ -535,13 +621,21 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 {
     if (self.isRecording) {
         OSStatus err = kAudioFileNotOpenError;
-        @synchronized(self) {
-            if (extAudioFile) {
-                // Close the file by disposing the ExtAudioFile
-                err = ExtAudioFileDispose(extAudioFile);
-                extAudioFile = NULL;
-            }
-        } // @synchronized
+        
+        // take the recorder back from the capture queue, after which nothing else can write to it
+        __block CAAudioFileRecorder *recorder = NULL;
+        dispatch_sync(captureAudioDataOutput.sampleBufferCallbackQueue, ^{
+            recorder = fileRecorder;
+            fileRecorder = NULL;
+        });
+        
+        if (recorder) {
+            // Close the file, this waits for the recorder's writes to finish
+            err = recorder->Close();
+            NSLog(@"Recorded %lld frames, dropped %lld, write latency p50 %.0fus p99 %.0fus", (long long)recorder->GetFramesWritten(), (long long)recorder->GetFramesDropped(),
+                  recorder->GetWriteLatencyPercentile(50.), recorder->GetWriteLatencyPercentile(99.));
+            delete recorder;
+        }
 
         AudioUnitReset(delayAudioUnit, kAudioUnitScope_Global, 0);
         
@@ -639,7 +733,7 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void                       *
 
 /*
  Synchronously called by the effect audio unit whenever AudioUnitRender() is called.
- Used to feed the audio samples output by the ATCaptureAudioDataOutput to the AudioUnit.
+ Used to feed the audio samples output by the ATCaptureAudioDataOutput, by way of the input ring buffer, to the AudioUnit.
  */
 static OSStatus PushCurrentInputBufferIntoAudioUnit(void *							inRefCon,
 													AudioUnitRenderActionFlags *	ioActionFlags,
@@ -649,17 +743,10 @@ static OSStatus PushCurrentInputBufferIntoAudioUnit(void *							inRefCon,
 													AudioBufferList *				ioData)
 {
 	CaptureSessionController *self = (CaptureSessionController *)inRefCon;
-	AudioBufferList *currentInputAudioBufferList = [self currentInputAudioBufferList];
-	UInt32 bufferIndex, bufferCount = currentInputAudioBufferList->mNumberBuffers;
 	
-	if (bufferCount != ioData->mNumberBuffers) return kAudioFormatUnknownFormatError;
-	
-	// Fill the provided AudioBufferList with the data from the AudioBufferList output by the audio data output
-	for (bufferIndex = 0; bufferIndex < bufferCount; bufferIndex++) {
-		ioData->mBuffers[bufferIndex].mDataByteSize = currentInputAudioBufferList->mBuffers[bufferIndex].mDataByteSize;
-		ioData->mBuffers[bufferIndex].mData = currentInputAudioBufferList->mBuffers[bufferIndex].mData;
-		ioData->mBuffers[bufferIndex].mNumberChannels = currentInputAudioBufferList->mBuffers[bufferIndex].mNumberChannels;
-	}
+	// Fill the provided AudioBufferList with the frames captured for this render's sample time, silence if they're missing
+	if (kCARingBufferError_TooMuch == [self inputRingBuffer]->Fetch(ioData, inNumberFrames, (SampleTime)inTimeStamp->mSampleTime))
+		return kAudioUnitErr_TooManyFramesToProcess;
 	
 	return noErr;
 }
\ No newline at end of file
@@ -51,8 +51,507 @@
 #include "CAAudioBufferList.h"
 #include "CADebugMacros.h"
 #include "CALogMacros.h"
+#include "CAVectorUnit.h"
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define CA_USE_NEON 1
+#endif
+
+//=============================================================================
+//	Sample Kernels
+//
+//	Each operation has a scalar version, which is the reference, and vector
+//	versions that give the same results. The set to use is picked from
+//	CAVectorUnit on each call, so it can be changed for testing.
+//=============================================================================
+
+typedef void	(*SumFloat32Proc)(Float32* ioSum, const Float32* inSource, UInt32 inCount, Float32 inGain);
+typedef void	(*SumSInt16Proc)(SInt16* ioSum, const SInt16* inSource, UInt32 inCount, Float32 inGain);
+typedef void	(*SumFixed8_24Proc)(SInt32* ioSum, const SInt32* inSource, UInt32 inCount, Float32 inGain);
+typedef void	(*Interleave2Proc)(void* outInterleaved, const void* inLeft, const void* inRight, UInt32 inNumberFrames);
+typedef void	(*Deinterleave2Proc)(const void* inInterleaved, void* outLeft, void* outRight, UInt32 inNumberFrames);
+
+struct CASampleKernels
+{
+	SumFloat32Proc		mSumFloat32;
+	SumSInt16Proc		mSumSInt16;
+	SumFixed8_24Proc	mSumFixed8_24;
+	Interleave2Proc		mInterleave2_16;
+	Interleave2Proc		mInterleave2_32;
+	Deinterleave2Proc	mDeinterleave2_16;
+	Deinterleave2Proc	mDeinterleave2_32;
+};
+
+//	scaled integer sums are clamped as floats before rounding, so that every
+//	version saturates the same way
+static const Float32 kSInt16Min = -32768.f;
+static const Float32 kSInt16Max = 32767.f;
+static const Float32 kSInt32Min = -2147483648.f;
+static const Float32 kSInt32Max = 2147483520.f;	//	largest Float32 below 2^31
+
+static inline Float32	ClampFloat(Float32 inValue, Float32 inMin, Float32 inMax)
+{
+	return (inValue < inMin) ? inMin : ((inValue > inMax) ? inMax : inValue);
+}
+
+static void	SumFloat32_Scalar(Float32* ioSum, const Float32* inSource, UInt32 inCount, Float32 inGain)
+{
+	if(inGain == 1.f)
+	{
+		for(UInt32 i = 0; i < inCount; ++i)
+			ioSum[i] += inSource[i];
+	}
+	else
+	{
+		for(UInt32 i = 0; i < inCount; ++i)
+			ioSum[i] += inSource[i] * inGain;
+	}
+}
+
+static void	SumSInt16_Scalar(SInt16* ioSum, const SInt16* inSource, UInt32 inCount, Float32 inGain)
+{
+	if(inGain == 1.f)
+	{
+		for(UInt32 i = 0; i < inCount; ++i)
+		{
+			SInt32 theSum = ioSum[i] + inSource[i];
+			ioSum[i] = (theSum > 32767) ? 32767 : ((theSum < -32768) ? -32768 : (SInt16)theSum);
+		}
+	}
+	else
+	{
+		for(UInt32 i = 0; i < inCount; ++i)
+		{
+			Float32 theProduct = (Float32)inSource[i] * inGain;
+			Float32 theSum = (Float32)ioSum[i] + theProduct;
+			ioSum[i] = (SInt16)lrintf(ClampFloat(theSum, kSInt16Min, kSInt16Max));
+		}
+	}
+}
+
+static void	SumFixed8_24_Scalar(SInt32* ioSum, const SInt32* inSource, UInt32 inCount, Float32 inGain)
+{
+	if(inGain == 1.f)
+	{
+		for(UInt32 i = 0; i < inCount; ++i)
+			ioSum[i] = (SInt32)((UInt32)ioSum[i] + (UInt32)inSource[i]);
+	}
+	else
+	{
+		for(UInt32 i = 0; i < inCount; ++i)
+		{
+			SInt32 theScaled = (SInt32)lrintf(ClampFloat((Float32)inSource[i] * inGain, kSInt32Min, kSInt32Max));
+			ioSum[i] = (SInt32)((UInt32)ioSum[i] + (UInt32)theScaled);
+		}
+	}
+}
+
+template <typename T>
+static void	Interleave2_Scalar(void* outInterleaved, const void* inLeft, const void* inRight, UInt32 inNumberFrames)
+{
+	T* theDestination = static_cast<T*>(outInterleaved);
+	const T* theLeft = static_cast<const T*>(inLeft);
+	const T* theRight = static_cast<const T*>(inRight);
+	for(UInt32 i = 0; i < inNumberFrames; ++i)
+	{
+		theDestination[2*i] = theLeft[i];
+		theDestination[2*i + 1] = theRight[i];
+	}
+}
+
+template <typename T>
+static void	Deinterleave2_Scalar(const void* inInterleaved, void* outLeft, void* outRight, UInt32 inNumberFrames)
+{
+	const T* theSource = static_cast<const T*>(inInterleaved);
+	T* theLeft = static_cast<T*>(outLeft);
+	T* theRight = static_cast<T*>(outRight);
+	for(UInt32 i = 0; i < inNumberFrames; ++i)
+	{
+		theLeft[i] = theSource[2*i];
+		theRight[i] = theSource[2*i + 1];
+	}
+}
+
+static const CASampleKernels sScalarKernels =
+{
+	SumFloat32_Scalar,
+	SumSInt16_Scalar,
+	SumFixed8_24_Scalar,
+	Interleave2_Scalar<UInt16>,
+	Interleave2_Scalar<UInt32>,
+	Deinterleave2_Scalar<UInt16>,
+	Deinterleave2_Scalar<UInt32>
+};
+
+#if defined(__SSE2__)
+
+static void	SumFloat32_SSE2(Float32* ioSum, const Float32* inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	if(inGain == 1.f)
+	{
+		for(; i + 8 <= inCount; i += 8)
+		{
+			_mm_storeu_ps(ioSum + i, _mm_add_ps(_mm_loadu_ps(ioSum + i), _mm_loadu_ps(inSource + i)));
+			_mm_storeu_ps(ioSum + i + 4, _mm_add_ps(_mm_loadu_ps(ioSum + i + 4), _mm_loadu_ps(inSource + i + 4)));
+		}
+	}
+	else
+	{
+		__m128 theGain = _mm_set1_ps(inGain);
+		for(; i + 8 <= inCount; i += 8)
+		{
+			_mm_storeu_ps(ioSum + i, _mm_add_ps(_mm_loadu_ps(ioSum + i), _mm_mul_ps(_mm_loadu_ps(inSource + i), theGain)));
+			_mm_storeu_ps(ioSum + i + 4, _mm_add_ps(_mm_loadu_ps(ioSum + i + 4), _mm_mul_ps(_mm_loadu_ps(inSource + i + 4), theGain)));
+		}
+	}
+	SumFloat32_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static inline __m128	SumScaledSInt16_SSE2(__m128i inSum, __m128i inSource, __m128 inGain)
+{
+	__m128 theSum = _mm_add_ps(_mm_cvtepi32_ps(inSum), _mm_mul_ps(_mm_cvtepi32_ps(inSource), inGain));
+	return _mm_min_ps(_mm_max_ps(theSum, _mm_set1_ps(kSInt16Min)), _mm_set1_ps(kSInt16Max));
+}
+
+static void	SumSInt16_SSE2(SInt16* ioSum, const SInt16* inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	if(inGain == 1.f)
+	{
+		for(; i + 8 <= inCount; i += 8)
+		{
+			__m128i theSum = _mm_loadu_si128((const __m128i*)(ioSum + i));
+			__m128i theSource = _mm_loadu_si128((const __m128i*)(inSource + i));
+			_mm_storeu_si128((__m128i*)(ioSum + i), _mm_adds_epi16(theSum, theSource));
+		}
+	}
+	else
+	{
+		__m128 theGain = _mm_set1_ps(inGain);
+		for(; i + 8 <= inCount; i += 8)
+		{
+			__m128i theSum = _mm_loadu_si128((const __m128i*)(ioSum + i));
+			__m128i theSource = _mm_loadu_si128((const __m128i*)(inSource + i));
+			//	sign extend to 32 bits
+			__m128i theSumLo = _mm_srai_epi32(_mm_unpacklo_epi16(theSum, theSum), 16);
+			__m128i theSumHi = _mm_srai_epi32(_mm_unpackhi_epi16(theSum, theSum), 16);
+			__m128i theSourceLo = _mm_srai_epi32(_mm_unpacklo_epi16(theSource, theSource), 16);
+			__m128i theSourceHi = _mm_srai_epi32(_mm_unpackhi_epi16(theSource, theSource), 16);
+			__m128i theLo = _mm_cvtps_epi32(SumScaledSInt16_SSE2(theSumLo, theSourceLo, theGain));
+			__m128i theHi = _mm_cvtps_epi32(SumScaledSInt16_SSE2(theSumHi, theSourceHi, theGain));
+			_mm_storeu_si128((__m128i*)(ioSum + i), _mm_packs_epi32(theLo, theHi));
+		}
+	}
+	SumSInt16_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static void	SumFixed8_24_SSE2(SInt32* ioSum, const SInt32* inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	if(inGain == 1.f)
+	{
+		for(; i + 4 <= inCount; i += 4)
+		{
+			__m128i theSum = _mm_loadu_si128((const __m128i*)(ioSum + i));
+			_mm_storeu_si128((__m128i*)(ioSum + i), _mm_add_epi32(theSum, _mm_loadu_si128((const __m128i*)(inSource + i))));
+		}
+	}
+	else
+	{
+		__m128 theGain = _mm_set1_ps(inGain);
+		__m128 theMin = _mm_set1_ps(kSInt32Min);
+		__m128 theMax = _mm_set1_ps(kSInt32Max);
+		for(; i + 4 <= inCount; i += 4)
+		{
+			__m128 theScaled = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(inSource + i))), theGain);
+			theScaled = _mm_min_ps(_mm_max_ps(theScaled, theMin), theMax);
+			__m128i theSum = _mm_loadu_si128((const __m128i*)(ioSum + i));
+			_mm_storeu_si128((__m128i*)(ioSum + i), _mm_add_epi32(theSum, _mm_cvtps_epi32(theScaled)));
+		}
+	}
+	SumFixed8_24_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static void	Interleave2_16_SSE2(void* outInterleaved, const void* inLeft, const void* inRight, UInt32 inNumberFrames)
+{
+	SInt16* theDestination = static_cast<SInt16*>(outInterleaved);
+	const SInt16* theLeft = static_cast<const SInt16*>(inLeft);
+	const SInt16* theRight = static_cast<const SInt16*>(inRight);
+	UInt32 i = 0;
+	for(; i + 8 <= inNumberFrames; i += 8)
+	{
+		__m128i l = _mm_loadu_si128((const __m128i*)(theLeft + i));
+		__m128i r = _mm_loadu_si128((const __m128i*)(theRight + i));
+		_mm_storeu_si128((__m128i*)(theDestination + 2*i), _mm_unpacklo_epi16(l, r));
+		_mm_storeu_si128((__m128i*)(theDestination + 2*i + 8), _mm_unpackhi_epi16(l, r));
+	}
+	Interleave2_Scalar<UInt16>(theDestination + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static void	Interleave2_32_SSE2(void* outInterleaved, const void* inLeft, const void* inRight, UInt32 inNumberFrames)
+{
+	Float32* theDestination = static_cast<Float32*>(outInterleaved);
+	const Float32* theLeft = static_cast<const Float32*>(inLeft);
+	const Float32* theRight = static_cast<const Float32*>(inRight);
+	UInt32 i = 0;
+	for(; i + 4 <= inNumberFrames; i += 4)
+	{
+		__m128 l = _mm_loadu_ps(theLeft + i);
+		__m128 r = _mm_loadu_ps(theRight + i);
+		_mm_storeu_ps(theDestination + 2*i, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(theDestination + 2*i + 4, _mm_unpackhi_ps(l, r));
+	}
+	Interleave2_Scalar<UInt32>(theDestination + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static void	Deinterleave2_16_SSE2(const void* inInterleaved, void* outLeft, void* outRight, UInt32 inNumberFrames)
+{
+	const SInt16* theSource = static_cast<const SInt16*>(inInterleaved);
+	SInt16* theLeft = static_cast<SInt16*>(outLeft);
+	SInt16* theRight = static_cast<SInt16*>(outRight);
+	UInt32 i = 0;
+	for(; i + 8 <= inNumberFrames; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(theSource + 2*i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(theSource + 2*i + 8));
+		//	the even samples, sign extended, pack back without saturating
+		__m128i theLeftA = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		__m128i theLeftB = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		_mm_storeu_si128((__m128i*)(theLeft + i), _mm_packs_epi32(theLeftA, theLeftB));
+		_mm_storeu_si128((__m128i*)(theRight + i), _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+	}
+	Deinterleave2_Scalar<UInt16>(theSource + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static void	Deinterleave2_32_SSE2(const void* inInterleaved, void* outLeft, void* outRight, UInt32 inNumberFrames)
+{
+	const Float32* theSource = static_cast<const Float32*>(inInterleaved);
+	Float32* theLeft = static_cast<Float32*>(outLeft);
+	Float32* theRight = static_cast<Float32*>(outRight);
+	UInt32 i = 0;
+	for(; i + 4 <= inNumberFrames; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(theSource + 2*i);
+		__m128 b = _mm_loadu_ps(theSource + 2*i + 4);
+		_mm_storeu_ps(theLeft + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(theRight + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	Deinterleave2_Scalar<UInt32>(theSource + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static const CASampleKernels sSSE2Kernels =
+{
+	SumFloat32_SSE2,
+	SumSInt16_SSE2,
+	SumFixed8_24_SSE2,
+	Interleave2_16_SSE2,
+	Interleave2_32_SSE2,
+	Deinterleave2_16_SSE2,
+	Deinterleave2_32_SSE2
+};
+
+#endif // __SSE2__
+
+#if CA_USE_NEON
+
+static void	SumFloat32_Neon(Float32* ioSum, const Float32* inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	if(inGain == 1.f)
+	{
+		for(; i + 8 <= inCount; i += 8)
+		{
+			vst1q_f32(ioSum + i, vaddq_f32(vld1q_f32(ioSum + i), vld1q_f32(inSource + i)));
+			vst1q_f32(ioSum + i + 4, vaddq_f32(vld1q_f32(ioSum + i + 4), vld1q_f32(inSource + i + 4)));
+		}
+	}
+	else
+	{
+		for(; i + 8 <= inCount; i += 8)
+		{
+			vst1q_f32(ioSum + i, vaddq_f32(vld1q_f32(ioSum + i), vmulq_n_f32(vld1q_f32(inSource + i), inGain)));
+			vst1q_f32(ioSum + i + 4, vaddq_f32(vld1q_f32(ioSum + i + 4), vmulq_n_f32(vld1q_f32(inSource + i + 4), inGain)));
+		}
+	}
+	SumFloat32_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static void	SumSInt16_Neon(SInt16* ioSum, const SInt16* inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	if(inGain == 1.f)
+	{
+		for(; i + 8 <= inCount; i += 8)
+		{
+			vst1q_s16(ioSum + i, vqaddq_s16(vld1q_s16(ioSum + i), vld1q_s16(inSource + i)));
+		}
+	}
+#if defined(__aarch64__)
+	//	needs the round-to-nearest conversion that armv7 lacks
+	else
+	{
+		float32x4_t theMin = vdupq_n_f32(kSInt16Min);
+		float32x4_t theMax = vdupq_n_f32(kSInt16Max);
+		for(; i + 4 <= inCount; i += 4)
+		{
+			float32x4_t theSum = vcvtq_f32_s32(vmovl_s16(vld1_s16(ioSum + i)));
+			float32x4_t theSource = vcvtq_f32_s32(vmovl_s16(vld1_s16(inSource + i)));
+			theSum = vaddq_f32(theSum, vmulq_n_f32(theSource, inGain));
+			theSum = vminq_f32(vmaxq_f32(theSum, theMin), theMax);
+			vst1_s16(ioSum + i, vqmovn_s32(vcvtnq_s32_f32(theSum)));
+		}
+	}
+#endif
+	SumSInt16_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static void	SumFixed8_24_Neon(SInt32* ioSum, const SInt32* inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	if(inGain == 1.f)
+	{
+		for(; i + 4 <= inCount; i += 4)
+		{
+			vst1q_s32(ioSum + i, vaddq_s32(vld1q_s32(ioSum + i), vld1q_s32(inSource + i)));
+		}
+	}
+#if defined(__aarch64__)
+	else
+	{
+		float32x4_t theMin = vdupq_n_f32(kSInt32Min);
+		float32x4_t theMax = vdupq_n_f32(kSInt32Max);
+		for(; i + 4 <= inCount; i += 4)
+		{
+			float32x4_t theScaled = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(inSource + i)), inGain);
+			theScaled = vminq_f32(vmaxq_f32(theScaled, theMin), theMax);
+			vst1q_s32(ioSum + i, vaddq_s32(vld1q_s32(ioSum + i), vcvtnq_s32_f32(theScaled)));
+		}
+	}
+#endif
+	SumFixed8_24_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static void	Interleave2_16_Neon(void* outInterleaved, const void* inLeft, const void* inRight, UInt32 inNumberFrames)
+{
+	SInt16* theDestination = static_cast<SInt16*>(outInterleaved);
+	const SInt16* theLeft = static_cast<const SInt16*>(inLeft);
+	const SInt16* theRight = static_cast<const SInt16*>(inRight);
+	UInt32 i = 0;
+	for(; i + 8 <= inNumberFrames; i += 8)
+	{
+		int16x8x2_t theFrames = { { vld1q_s16(theLeft + i), vld1q_s16(theRight + i) } };
+		vst2q_s16(theDestination + 2*i, theFrames);
+	}
+	Interleave2_Scalar<UInt16>(theDestination + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static void	Interleave2_32_Neon(void* outInterleaved, const void* inLeft, const void* inRight, UInt32 inNumberFrames)
+{
+	Float32* theDestination = static_cast<Float32*>(outInterleaved);
+	const Float32* theLeft = static_cast<const Float32*>(inLeft);
+	const Float32* theRight = static_cast<const Float32*>(inRight);
+	UInt32 i = 0;
+	for(; i + 4 <= inNumberFrames; i += 4)
+	{
+		float32x4x2_t theFrames = { { vld1q_f32(theLeft + i), vld1q_f32(theRight + i) } };
+		vst2q_f32(theDestination + 2*i, theFrames);
+	}
+	Interleave2_Scalar<UInt32>(theDestination + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static void	Deinterleave2_16_Neon(const void* inInterleaved, void* outLeft, void* outRight, UInt32 inNumberFrames)
+{
+	const SInt16* theSource = static_cast<const SInt16*>(inInterleaved);
+	SInt16* theLeft = static_cast<SInt16*>(outLeft);
+	SInt16* theRight = static_cast<SInt16*>(outRight);
+	UInt32 i = 0;
+	for(; i + 8 <= inNumberFrames; i += 8)
+	{
+		int16x8x2_t theFrames = vld2q_s16(theSource + 2*i);
+		vst1q_s16(theLeft + i, theFrames.val[0]);
+		vst1q_s16(theRight + i, theFrames.val[1]);
+	}
+	Deinterleave2_Scalar<UInt16>(theSource + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static void	Deinterleave2_32_Neon(const void* inInterleaved, void* outLeft, void* outRight, UInt32 inNumberFrames)
+{
+	const Float32* theSource = static_cast<const Float32*>(inInterleaved);
+	Float32* theLeft = static_cast<Float32*>(outLeft);
+	Float32* theRight = static_cast<Float32*>(outRight);
+	UInt32 i = 0;
+	for(; i + 4 <= inNumberFrames; i += 4)
+	{
+		float32x4x2_t theFrames = vld2q_f32(theSource + 2*i);
+		vst1q_f32(theLeft + i, theFrames.val[0]);
+		vst1q_f32(theRight + i, theFrames.val[1]);
+	}
+	Deinterleave2_Scalar<UInt32>(theSource + 2*i, theLeft + i, theRight + i, inNumberFrames - i);
+}
+
+static const CASampleKernels sNeonKernels =
+{
+	SumFloat32_Neon,
+	SumSInt16_Neon,
+	SumFixed8_24_Neon,
+	Interleave2_16_Neon,
+	Interleave2_32_Neon,
+	Deinterleave2_16_Neon,
+	Deinterleave2_32_Neon
+};
+
+#endif // CA_USE_NEON
+
+static const CASampleKernels&	GetSampleKernels()
+{
+	switch(CAVectorUnit::GetVectorUnitType())
+	{
+#if defined(__SSE2__)
+		//	256 bit versions lost to these on the Float32 sum in the benchmark,
+		//	so AVX2 machines use the SSE2 ones
+		case kVecAVX2:
+		case kVecSSE2:
+			return sSSE2Kernels;
+#endif
+#if CA_USE_NEON
+		case kVecNeon:
+			return sNeonKernels;
+#endif
+		default:
+			break;
+	}
+	return sScalarKernels;
+}
+
+template <typename T>
+static void	CopyStrided(const T* inSource, UInt32 inSourceStride, T* outDestination, UInt32 inDestinationStride, UInt32 inNumberFrames)
+{
+	while(inNumberFrames >= 4)
+	{
+		outDestination[0] = inSource[0];
+		outDestination[inDestinationStride] = inSource[inSourceStride];
+		outDestination[2 * inDestinationStride] = inSource[2 * inSourceStride];
+		outDestination[3 * inDestinationStride] = inSource[3 * inSourceStride];
+		inSource += 4 * inSourceStride;
+		outDestination += 4 * inDestinationStride;
+		inNumberFrames -= 4;
+	}
+	while(inNumberFrames > 0)
+	{
+		*outDestination = *inSource;
+		inSource += inSourceStride;
+		outDestination += inDestinationStride;
+		--inNumberFrames;
+	}
+}
 
 //=============================================================================
 //	CAAudioBufferList
@@ -126,11 +625,11 @@ void	CAAudioBufferList::Clear(AudioBufferList& outBufferList)
 	}
 }
 
-void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel)
+void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel, UInt32 inBytesPerSample)
 {
 	//  This is a brute force copy method that can handle ABL's that have different buffer layouts
 	//  This means that this method is probably not the fastest way to do this for all cases.
-	//  This method also assumes that both the source and destination sample formats are Float32
+	//  Both lists must have the same sample format, inBytesPerSample bytes per sample
 
 	UInt32 theInputChannel = inStartingSourceChannel;
 	UInt32 theNumberInputChannels = GetTotalNumberChannels(inSource);
@@ -145,52 +644,123 @@ void	CAAudioBufferList::Copy(const AudioBufferList& inSource, UInt32 inStartingS
 	{
 		GetBufferForChannel(inSource, theInputChannel, theInputBufferIndex, theInputBufferChannel);
 		
-		GetBufferForChannel(inSource, theOutputChannel, theOutputBufferIndex, theOutputBufferChannel);
+		GetBufferForChannel(outDestination, theOutputChannel, theOutputBufferIndex, theOutputBufferChannel);
 		
-		CopyChannel(inSource.mBuffers[theInputBufferIndex], theInputBufferChannel, outDestination.mBuffers[theOutputBufferIndex], theOutputBufferChannel);
+		CopyChannel(inSource.mBuffers[theInputBufferIndex], theInputBufferChannel, outDestination.mBuffers[theOutputBufferIndex], theOutputBufferChannel, inBytesPerSample);
 		
 		++theInputChannel;
 		++theOutputChannel;
 	}
 }
 
-void	CAAudioBufferList::CopyChannel(const AudioBuffer& inSource, UInt32 inSourceChannel, AudioBuffer& outDestination, UInt32 inDestinationChannel)
+void	CAAudioBufferList::CopyChannel(const AudioBuffer& inSource, UInt32 inSourceChannel, AudioBuffer& outDestination, UInt32 inDestinationChannel, UInt32 inBytesPerSample)
 {
-	//  set up the stuff for the loop
-	UInt32 theNumberFramesToCopy = outDestination.mDataByteSize / (outDestination.mNumberChannels * SizeOf32(Float32));
-	const Float32* theSource = static_cast<const Float32*>(inSource.mData);
-	Float32* theDestination = static_cast<Float32*>(outDestination.mData);
+	//  copy no more frames than either buffer holds
+	UInt32 theNumberFramesToCopy = outDestination.mDataByteSize / (outDestination.mNumberChannels * inBytesPerSample);
+	UInt32 theNumberSourceFrames = inSource.mDataByteSize / (inSource.mNumberChannels * inBytesPerSample);
+	if(theNumberSourceFrames < theNumberFramesToCopy)
+	{
+		theNumberFramesToCopy = theNumberSourceFrames;
+	}
+	const Byte* theSource = static_cast<const Byte*>(inSource.mData) + (inSourceChannel * inBytesPerSample);
+	Byte* theDestination = static_cast<Byte*>(outDestination.mData) + (inDestinationChannel * inBytesPerSample);
 	
-	//  loop through the data and copy the samples
-	while(theNumberFramesToCopy > 0)
+	if((inSource.mNumberChannels == 1) && (outDestination.mNumberChannels == 1))
 	{
-		//  copy the data
-		theDestination[inDestinationChannel] = theSource[inSourceChannel];
-		
-		//  adjust the pointers
-		--theNumberFramesToCopy;
-		theSource += inSource.mNumberChannels;
-		theDestination += outDestination.mNumberChannels;
+		memcpy(theDestination, theSource, theNumberFramesToCopy * inBytesPerSample);
+		return;
+	}
+	
+	switch(inBytesPerSample)
+	{
+		case 2:
+			CopyStrided(reinterpret_cast<const UInt16*>(theSource), inSource.mNumberChannels, reinterpret_cast<UInt16*>(theDestination), outDestination.mNumberChannels, theNumberFramesToCopy);
+			break;
+		case 4:
+			CopyStrided(reinterpret_cast<const UInt32*>(theSource), inSource.mNumberChannels, reinterpret_cast<UInt32*>(theDestination), outDestination.mNumberChannels, theNumberFramesToCopy);
+			break;
+		default:
+			while(theNumberFramesToCopy > 0)
+			{
+				memcpy(theDestination, theSource, inBytesPerSample);
+				--theNumberFramesToCopy;
+				theSource += inSource.mNumberChannels * inBytesPerSample;
+				theDestination += outDestination.mNumberChannels * inBytesPerSample;
+			}
+			break;
 	}
 }
 
+void	CAAudioBufferList::Interleave(const AudioBufferList& inSource, AudioBuffer& outDestination, UInt32 inBytesPerSample)
+{
+	//	inSource is a list of mono buffers; stereo 16 and 32 bit samples have their own kernels
+	if((outDestination.mNumberChannels == 2) && (inSource.mNumberBuffers == 2) && (inSource.mBuffers[0].mNumberChannels == 1) && (inSource.mBuffers[1].mNumberChannels == 1) && ((inBytesPerSample == 2) || (inBytesPerSample == 4)))
+	{
+		UInt32 theNumberFrames = outDestination.mDataByteSize / (2 * inBytesPerSample);
+		theNumberFrames = std::min(theNumberFrames, inSource.mBuffers[0].mDataByteSize / inBytesPerSample);
+		theNumberFrames = std::min(theNumberFrames, inSource.mBuffers[1].mDataByteSize / inBytesPerSample);
+		const CASampleKernels& theKernels = GetSampleKernels();
+		Interleave2Proc theKernel = (inBytesPerSample == 2) ? theKernels.mInterleave2_16 : theKernels.mInterleave2_32;
+		theKernel(outDestination.mData, inSource.mBuffers[0].mData, inSource.mBuffers[1].mData, theNumberFrames);
+		return;
+	}
+	
+	AudioBufferList theDestination;
+	theDestination.mNumberBuffers = 1;
+	theDestination.mBuffers[0] = outDestination;
+	Copy(inSource, 0, theDestination, 0, inBytesPerSample);
+}
+
+void	CAAudioBufferList::Deinterleave(const AudioBuffer& inSource, AudioBufferList& outDestination, UInt32 inBytesPerSample)
+{
+	//	outDestination is a list of mono buffers
+	if((inSource.mNumberChannels == 2) && (outDestination.mNumberBuffers == 2) && (outDestination.mBuffers[0].mNumberChannels == 1) && (outDestination.mBuffers[1].mNumberChannels == 1) && ((inBytesPerSample == 2) || (inBytesPerSample == 4)))
+	{
+		UInt32 theNumberFrames = inSource.mDataByteSize / (2 * inBytesPerSample);
+		theNumberFrames = std::min(theNumberFrames, outDestination.mBuffers[0].mDataByteSize / inBytesPerSample);
+		theNumberFrames = std::min(theNumberFrames, outDestination.mBuffers[1].mDataByteSize / inBytesPerSample);
+		const CASampleKernels& theKernels = GetSampleKernels();
+		Deinterleave2Proc theKernel = (inBytesPerSample == 2) ? theKernels.mDeinterleave2_16 : theKernels.mDeinterleave2_32;
+		theKernel(inSource.mData, outDestination.mBuffers[0].mData, outDestination.mBuffers[1].mData, theNumberFrames);
+		return;
+	}
+	
+	AudioBufferList theSource;
+	theSource.mNumberBuffers = 1;
+	theSource.mBuffers[0] = inSource;
+	Copy(theSource, 0, outDestination, 0, inBytesPerSample);
+}
+
 void	CAAudioBufferList::Sum(const AudioBufferList& inSourceBufferList, AudioBufferList& ioSummedBufferList)
 {
-	//	assumes that the buffers are Float32 samples and the listst have the same layout
-	//	this is a lame algorithm, by the way. it could at least be unrolled a couple of times
-	for(UInt32 theBufferIndex = 0; theBufferIndex < ioSummedBufferList.mNumberBuffers; ++theBufferIndex)
+	//	assumes that the buffers are Float32 samples and the lists have the same layout
+	SumWithGain(inSourceBufferList, ioSummedBufferList, 1.f, kSampleFormat_Float32);
+}
+
+void	CAAudioBufferList::SumWithGain(const AudioBufferList& inSourceBufferList, AudioBufferList& ioSummedBufferList, Float32 inGain, UInt32 inSampleFormat)
+{
+	//	assumes that the lists have the same layout
+	const CASampleKernels& theKernels = GetSampleKernels();
+	UInt32 theBytesPerSample = (inSampleFormat == kSampleFormat_SInt16) ? SizeOf32(SInt16) : SizeOf32(Float32);
+	UInt32 theNumberBuffers = std::min(inSourceBufferList.mNumberBuffers, ioSummedBufferList.mNumberBuffers);
+	for(UInt32 theBufferIndex = 0; theBufferIndex < theNumberBuffers; ++theBufferIndex)
 	{
-		Float32* theSourceBuffer = static_cast<Float32*>(inSourceBufferList.mBuffers[theBufferIndex].mData);
-		Float32* theSummedBuffer = static_cast<Float32*>(ioSummedBufferList.mBuffers[theBufferIndex].mData);
-		UInt32 theNumberSamplesToMix = ioSummedBufferList.mBuffers[theBufferIndex].mDataByteSize / SizeOf32(Float32);
+		void* theSourceBuffer = inSourceBufferList.mBuffers[theBufferIndex].mData;
+		void* theSummedBuffer = ioSummedBufferList.mBuffers[theBufferIndex].mData;
+		UInt32 theNumberSamplesToMix = std::min(ioSummedBufferList.mBuffers[theBufferIndex].mDataByteSize, inSourceBufferList.mBuffers[theBufferIndex].mDataByteSize) / theBytesPerSample;
 		if((theSourceBuffer != NULL) && (theSummedBuffer != NULL) && (theNumberSamplesToMix > 0))
 		{
-			while(theNumberSamplesToMix > 0)
+			switch(inSampleFormat)
 			{
-				*theSummedBuffer += *theSourceBuffer;
-				++theSummedBuffer;
-				++theSourceBuffer;
-				--theNumberSamplesToMix;
+				case kSampleFormat_SInt16:
+					theKernels.mSumSInt16(static_cast<SInt16*>(theSummedBuffer), static_cast<const SInt16*>(theSourceBuffer), theNumberSamplesToMix, inGain);
+					break;
+				case kSampleFormat_Fixed8_24:
+					theKernels.mSumFixed8_24(static_cast<SInt32*>(theSummedBuffer), static_cast<const SInt32*>(theSourceBuffer), theNumberSamplesToMix, inGain);
+					break;
+				default:
+					theKernels.mSumFloat32(static_cast<Float32*>(theSummedBuffer), static_cast<const Float32*>(theSourceBuffer), theNumberSamplesToMix, inGain);
+					break;
 			}
 		}
 	}
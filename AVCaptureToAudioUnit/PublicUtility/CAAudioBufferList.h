@@ -71,6 +71,16 @@ typedef AudioBufferList*	AudioBufferListPtr;
 struct	CAAudioBufferList
 {
 
+//	Sample formats for SumWithGain. Int16 sums saturate; 8.24 fixed point
+//	has 7 bits of headroom and wraps like the scalar code always did.
+public:
+	enum
+	{
+		kSampleFormat_Float32	= 0,
+		kSampleFormat_SInt16	= 1,
+		kSampleFormat_Fixed8_24	= 2
+	};
+
 //	Construction/Destruction
 public:
 	static AudioBufferList*	Create(UInt32 inNumberBuffers);
@@ -82,9 +92,12 @@ public:
 	static UInt32			GetTotalNumberChannels(const AudioBufferList& inBufferList);
 	static bool				GetBufferForChannel(const AudioBufferList& inBufferList, UInt32 inChannel, UInt32& outBufferNumber, UInt32& outBufferChannel);
 	static void				Clear(AudioBufferList& outBufferList);
-	static void				Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel);
-	static void				CopyChannel(const AudioBuffer& inSource, UInt32 inSourceChannel, AudioBuffer& outDestination, UInt32 inDestinationChannel);
+	static void				Copy(const AudioBufferList& inSource, UInt32 inStartingSourceChannel, AudioBufferList& outDestination, UInt32 inStartingDestinationChannel, UInt32 inBytesPerSample = sizeof(Float32));
+	static void				CopyChannel(const AudioBuffer& inSource, UInt32 inSourceChannel, AudioBuffer& outDestination, UInt32 inDestinationChannel, UInt32 inBytesPerSample = sizeof(Float32));
+	static void				Interleave(const AudioBufferList& inSource, AudioBuffer& outDestination, UInt32 inBytesPerSample = sizeof(Float32));
+	static void				Deinterleave(const AudioBuffer& inSource, AudioBufferList& outDestination, UInt32 inBytesPerSample = sizeof(Float32));
 	static void				Sum(const AudioBufferList& inSourceBufferList, AudioBufferList& ioSummedBufferList);
+	static void				SumWithGain(const AudioBufferList& inSourceBufferList, AudioBufferList& ioSummedBufferList, Float32 inGain, UInt32 inSampleFormat = kSampleFormat_Float32);
 	static bool				HasData(AudioBufferList& inBufferList);
 #if	CoreAudio_Debug
 	static void				PrintToLog(const AudioBufferList& inBufferList);
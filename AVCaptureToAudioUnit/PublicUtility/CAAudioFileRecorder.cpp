@@ -0,0 +1,622 @@
+/*
+     File: CAAudioFileRecorder.cpp 
+ Abstract:  CAAudioFileRecorder.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#include "CAAudioFileRecorder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#if defined(__APPLE__)
+	#include <mach/mach_time.h>
+#else
+	#include <time.h>
+#endif
+
+// file offsets and the sizes of direct writes are multiples of this
+static const UInt32 kAlignment = 4096;
+static const UInt32 kMaxBlocksPerWrite = 64;
+
+static inline UInt32	AlignUp (UInt32 inSize, UInt32 inAlignment)
+{
+	return ((inSize + inAlignment - 1) / inAlignment) * inAlignment;
+}
+
+static UInt64	NowMicroseconds ()
+{
+#if defined(__APPLE__)
+	static mach_timebase_info_data_t sTimebase;
+	if (sTimebase.denom == 0)
+		mach_timebase_info (&sTimebase);
+	return mach_absolute_time() * sTimebase.numer / sTimebase.denom / 1000;
+#else
+	struct timespec theTime;
+	clock_gettime (CLOCK_MONOTONIC, &theTime);
+	return (UInt64)theTime.tv_sec * 1000000 + theTime.tv_nsec / 1000;
+#endif
+}
+
+static bool	IsLittleEndianHost ()
+{
+	UInt16 theValue = 1;
+	return *reinterpret_cast<Byte*>(&theValue) == 1;
+}
+
+// ____________________________________________________________________________
+//
+//	Header writing helpers. CAF is big endian throughout, RIFF little endian.
+
+static Byte*	PutBE (Byte *p, UInt64 inValue, UInt32 inBytes)
+{
+	for (UInt32 i = 0; i < inBytes; ++i)
+		p[i] = (Byte)(inValue >> (8 * (inBytes - 1 - i)));
+	return p + inBytes;
+}
+
+static Byte*	PutLE (Byte *p, UInt64 inValue, UInt32 inBytes)
+{
+	for (UInt32 i = 0; i < inBytes; ++i)
+		p[i] = (Byte)(inValue >> (8 * i));
+	return p + inBytes;
+}
+
+static Byte*	PutFourCC (Byte *p, const char *inCode)
+{
+	memcpy (p, inCode, 4);
+	return p + 4;
+}
+
+static Byte*	PutFloat64BE (Byte *p, Float64 inValue)
+{
+	UInt64 theBits;
+	memcpy (&theBits, &inValue, sizeof(theBits));
+	return PutBE (p, theBits, 8);
+}
+
+static Byte*	PutFloat32BE (Byte *p, Float32 inValue)
+{
+	UInt32 theBits;
+	memcpy (&theBits, &inValue, sizeof(theBits));
+	return PutBE (p, theBits, 4);
+}
+
+// ____________________________________________________________________________
+//
+bool	CAAudioFileRecorder::BlockQueue::Push (UInt32 inBlock)
+{
+	UInt32 theTail = mTail;
+	UInt32 theNext = (theTail + 1) % mSize;
+	if (theNext == mHead)
+		return false;
+	mSlots[theTail] = inBlock;
+	__sync_synchronize();
+	mTail = theNext;
+	return true;
+}
+
+UInt32	CAAudioFileRecorder::BlockQueue::Pop ()
+{
+	UInt32 theHead = mHead;
+	if (theHead == mTail)
+		return kNoBlock;
+	__sync_synchronize();
+	UInt32 theBlock = mSlots[theHead];
+	__sync_synchronize();
+	mHead = (theHead + 1) % mSize;
+	return theBlock;
+}
+
+void	CAAudioFileRecorder::Semaphore::Init ()
+{
+#if defined(__APPLE__)
+	mSemaphore = dispatch_semaphore_create (0);
+#else
+	sem_init (&mSemaphore, 0, 0);
+#endif
+}
+
+void	CAAudioFileRecorder::Semaphore::Destroy ()
+{
+#if defined(__APPLE__)
+	dispatch_release (mSemaphore);
+#else
+	sem_destroy (&mSemaphore);
+#endif
+}
+
+void	CAAudioFileRecorder::Semaphore::Signal ()
+{
+#if defined(__APPLE__)
+	dispatch_semaphore_signal (mSemaphore);
+#else
+	sem_post (&mSemaphore);
+#endif
+}
+
+void	CAAudioFileRecorder::Semaphore::Wait ()
+{
+#if defined(__APPLE__)
+	dispatch_semaphore_wait (mSemaphore, DISPATCH_TIME_FOREVER);
+#else
+	while (sem_wait (&mSemaphore) != 0 && errno == EINTR)
+		;
+#endif
+}
+
+// ____________________________________________________________________________
+//
+CAAudioFileRecorder::CAAudioFileRecorder ()
+		: mFile (-1),
+		  mPath (NULL),
+		  mLayout (NULL),
+		  mLayoutSize (0),
+		  mBlockMemory (NULL),
+		  mBlockFill (NULL),
+		  mQueueSlots (NULL),
+		  mBlockBytes (0),
+		  mDataOffset (0),
+		  mCurrentBlock (kNoBlock),
+		  mSourceView (NULL),
+		  mStopping (false),
+		  mWriteError (noErr),
+		  mFramesWritten (0),
+		  mFramesDropped (0),
+		  mBytesWritten (0),
+		  mWriteCount (0)
+{
+	memset ((void*)mLatency, 0, sizeof(mLatency));
+}
+
+CAAudioFileRecorder::~CAAudioFileRecorder()
+{
+	Close();
+}
+
+OSStatus	CAAudioFileRecorder::Open (const char *inPath,
+									   const CAStreamBasicDescription &inClientFormat,
+									   const CAStreamBasicDescription &inFileFormat,
+									   const AudioChannelLayout *inLayout,
+									   const Options &inOptions)
+{
+	if (IsOpen())
+		Close();
+
+	// the file gets whole frames of packed, native endian samples with no fractional bits
+	if (!inFileFormat.IsPCM() || !inFileFormat.IsInterleaved() || inFileFormat.mBytesPerFrame == 0
+		|| (inFileFormat.mFormatFlags & kLinearPCMFormatFlagsSampleFractionMask)
+		|| inFileFormat.mSampleRate != inClientFormat.mSampleRate || inOptions.mNumberBlocks < 2)
+		return kAudio_ParamError;
+	if (!mConverter.Initialize (inClientFormat, inFileFormat))
+		return kAudio_ParamError;
+
+	mOptions = inOptions;
+	mFileFormat = inFileFormat;
+
+	// blocks hold whole frames and keep the file offsets aligned
+	UInt32 theUnit = kAlignment;
+	while (theUnit % inFileFormat.mBytesPerFrame)
+		theUnit += kAlignment;
+	mBlockBytes = AlignUp (std::max (inOptions.mBlockBytes, theUnit), theUnit);
+
+	if (inLayout) {
+		mLayoutSize = offsetof(AudioChannelLayout, mChannelDescriptions) + inLayout->mNumberChannelDescriptions * sizeof(AudioChannelDescription);
+		mLayout = static_cast<AudioChannelLayout*>(malloc (mLayoutSize));
+		memcpy (mLayout, inLayout, mLayoutSize);
+	}
+	mDataOffset = AlignUp (256 + (mLayout ? 12 + 12 + mLayout->mNumberChannelDescriptions * 20 : 0), kAlignment);
+
+	void *theMemory = NULL;
+	UInt32 theStreams = inClientFormat.NumberChannelStreams();
+	if (posix_memalign (&theMemory, kAlignment, (size_t)mBlockBytes * inOptions.mNumberBlocks) != 0) {
+		Close();
+		return kAudio_MemFullError;
+	}
+	mBlockMemory = static_cast<Byte*>(theMemory);
+	mBlockFill = static_cast<UInt32*>(calloc (inOptions.mNumberBlocks, sizeof(UInt32)));
+	mQueueSlots = static_cast<UInt32*>(calloc (2 * (inOptions.mNumberBlocks + 1), sizeof(UInt32)));
+	mSourceView = static_cast<AudioBufferList*>(calloc (1, offsetof(AudioBufferList, mBuffers) + theStreams * sizeof(AudioBuffer)));
+	mPath = strdup (inPath);
+	if (!mBlockFill || !mQueueSlots || !mSourceView || !mPath) {
+		Close();
+		return kAudio_MemFullError;
+	}
+
+	int theFlags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+	if (inOptions.mDirectIO)
+		theFlags |= O_DIRECT;
+#endif
+	int theFile = open (inPath, theFlags, 0644);
+	if (theFile < 0) {
+		OSStatus theError = (errno == ENOENT) ? (OSStatus)kAudio_FileNotFoundError : ((errno == EACCES || errno == EPERM) ? (OSStatus)kAudio_FilePermissionError : (OSStatus)kCAAudioFileRecorderError_WriteFailed);
+		Close();
+		return theError;
+	}
+#if defined(__APPLE__)
+	if (inOptions.mDirectIO)
+		fcntl (theFile, F_NOCACHE, 1);
+#endif
+
+	// reserving the space is only a hint, so failures are ignored
+	if (inOptions.mPreallocateBytes) {
+#if defined(__APPLE__)
+		fstore_t theStore = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)inOptions.mPreallocateBytes, 0 };
+		if (fcntl (theFile, F_PREALLOCATE, &theStore) == -1) {
+			theStore.fst_flags = F_ALLOCATEALL;
+			fcntl (theFile, F_PREALLOCATE, &theStore);
+		}
+#else
+		posix_fallocate (theFile, 0, (off_t)inOptions.mPreallocateBytes);
+#endif
+	}
+
+	mFile = theFile;
+	OSStatus theError = WriteHeader (false);
+	if (theError == noErr && lseek (mFile, mDataOffset, SEEK_SET) != (off_t)mDataOffset)
+		theError = kCAAudioFileRecorderError_WriteFailed;
+	if (theError) {
+		Close();
+		return theError;
+	}
+
+	mFull.Init (mQueueSlots, inOptions.mNumberBlocks + 1);
+	mFree.Init (mQueueSlots + inOptions.mNumberBlocks + 1, inOptions.mNumberBlocks + 1);
+	for (UInt32 i = 0; i < inOptions.mNumberBlocks; ++i)
+		mFree.Push (i);
+	mFullSignal.Init();
+	mFreeSignal.Init();
+	mCurrentBlock = kNoBlock;
+	mStopping = false;
+	mWriteError = noErr;
+	mFramesWritten = mFramesDropped = mBytesWritten = 0;
+	mWriteCount = 0;
+	memset ((void*)mLatency, 0, sizeof(mLatency));
+
+	if (pthread_create (&mWriter, NULL, WriterEntry, this) != 0) {
+		mFullSignal.Destroy();
+		mFreeSignal.Destroy();
+		close (mFile);
+		mFile = -1;
+		Close();
+		return kAudio_MemFullError;
+	}
+	return noErr;
+}
+
+// ____________________________________________________________________________
+//
+OSStatus	CAAudioFileRecorder::Write (const AudioBufferList &inList, UInt32 inNumberFrames)
+{
+	if (!IsOpen())
+		return kCAAudioFileRecorderError_NotOpen;
+
+	const UInt32 theFileFrameBytes = mFileFormat.mBytesPerFrame;
+	const UInt32 theClientFrameBytes = mConverter.GetSourceFormat().mBytesPerFrame;
+	UInt32 theOffset = 0;
+
+	while (theOffset < inNumberFrames) {
+		if (mCurrentBlock == kNoBlock) {
+			mCurrentBlock = mFree.Pop();
+			while (mCurrentBlock == kNoBlock && mOptions.mOverflowPolicy == kOverflow_Wait) {
+				mFreeSignal.Wait();
+				mCurrentBlock = mFree.Pop();
+			}
+			if (mCurrentBlock == kNoBlock) {
+				mFramesDropped += inNumberFrames - theOffset;
+				break;
+			}
+			mBlockFill[mCurrentBlock] = 0;
+		}
+
+		UInt32 &theFill = mBlockFill[mCurrentBlock];
+		UInt32 theFrames = std::min (inNumberFrames - theOffset, (mBlockBytes - theFill) / theFileFrameBytes);
+
+		mSourceView->mNumberBuffers = std::min (inList.mNumberBuffers, mConverter.GetSourceFormat().NumberChannelStreams());
+		for (UInt32 i = 0; i < mSourceView->mNumberBuffers; ++i) {
+			mSourceView->mBuffers[i].mNumberChannels = inList.mBuffers[i].mNumberChannels;
+			mSourceView->mBuffers[i].mData = static_cast<Byte*>(inList.mBuffers[i].mData) + (theOffset * theClientFrameBytes);
+			mSourceView->mBuffers[i].mDataByteSize = theFrames * theClientFrameBytes;
+		}
+		AudioBufferList theDestination;
+		theDestination.mNumberBuffers = 1;
+		theDestination.mBuffers[0].mNumberChannels = mFileFormat.mChannelsPerFrame;
+		theDestination.mBuffers[0].mData = mBlockMemory + ((size_t)mCurrentBlock * mBlockBytes) + theFill;
+		theDestination.mBuffers[0].mDataByteSize = theFrames * theFileFrameBytes;
+		mConverter.Convert (*mSourceView, theFrames, theDestination);
+
+		theFill += theFrames * theFileFrameBytes;
+		theOffset += theFrames;
+		mFramesWritten += theFrames;
+		if (theFill + theFileFrameBytes > mBlockBytes)
+			CommitBlock();
+	}
+	return mWriteError;
+}
+
+bool	CAAudioFileRecorder::CommitBlock ()
+{
+	// there are never more blocks than the queue has room for
+	bool theResult = mFull.Push (mCurrentBlock);
+	mCurrentBlock = kNoBlock;
+	mFullSignal.Signal();
+	return theResult;
+}
+
+OSStatus	CAAudioFileRecorder::Close ()
+{
+	OSStatus theResult = kCAAudioFileRecorderError_NotOpen;
+
+	if (IsOpen()) {
+		// the last block goes out however full it is, and the writer stops once it has
+		if (mCurrentBlock != kNoBlock)
+			CommitBlock();
+		__sync_synchronize();
+		mStopping = true;
+		mFullSignal.Signal();
+		pthread_join (mWriter, NULL);
+		mFullSignal.Destroy();
+		mFreeSignal.Destroy();
+
+		theResult = WriteHeader (true);
+		// drops any padding from a direct write and any space preallocated past the end
+		if (ftruncate (mFile, (off_t)(mDataOffset + mBytesWritten)) != 0 && theResult == noErr)
+			theResult = kCAAudioFileRecorderError_WriteFailed;
+		if (close (mFile) != 0 && theResult == noErr)
+			theResult = kCAAudioFileRecorderError_WriteFailed;
+		if (mWriteError)
+			theResult = mWriteError;
+		mFile = -1;
+	}
+
+	free (mBlockMemory);
+	free (mBlockFill);
+	free (mQueueSlots);
+	free (mSourceView);
+	free (mLayout);
+	free (mPath);
+	mBlockMemory = NULL;
+	mBlockFill = NULL;
+	mQueueSlots = NULL;
+	mSourceView = NULL;
+	mLayout = NULL;
+	mLayoutSize = 0;
+	mPath = NULL;
+	mCurrentBlock = kNoBlock;
+	return theResult;
+}
+
+// ____________________________________________________________________________
+//
+void*	CAAudioFileRecorder::WriterEntry (void *inRecorder)
+{
+#if defined(__APPLE__)
+	pthread_setname_np ("CAAudioFileRecorder");
+#endif
+	static_cast<CAAudioFileRecorder*>(inRecorder)->WriterLoop();
+	return NULL;
+}
+
+void	CAAudioFileRecorder::WriterLoop ()
+{
+	struct iovec theVectors[kMaxBlocksPerWrite];
+	UInt32 theBlocks[kMaxBlocksPerWrite];
+
+	for (;;) {
+		mFullSignal.Wait();
+		// every block committed before the stop was asked for is drained below
+		bool theStopping = mStopping;
+		__sync_synchronize();
+
+		for (;;) {
+			// gather whatever is ready into one write. Only the last block is ever partly full
+			UInt32 theCount = 0;
+			size_t theBytes = 0, theWriteBytes = 0;
+			while (theCount < kMaxBlocksPerWrite) {
+				UInt32 theBlock = mFull.Pop();
+				if (theBlock == kNoBlock)
+					break;
+				Byte *theData = mBlockMemory + ((size_t)theBlock * mBlockBytes);
+				UInt32 theFill = mBlockFill[theBlock];
+				UInt32 theLength = theFill;
+				if (mOptions.mDirectIO && (theFill % kAlignment)) {
+					theLength = AlignUp (theFill, kAlignment);
+					memset (theData + theFill, 0, theLength - theFill);
+				}
+				theBlocks[theCount] = theBlock;
+				theVectors[theCount].iov_base = theData;
+				theVectors[theCount].iov_len = theLength;
+				theBytes += theFill;
+				theWriteBytes += theLength;
+				++theCount;
+				if (theFill < mBlockBytes)
+					break;
+			}
+			if (theCount == 0)
+				break;
+
+			if (mWriteError == noErr && theWriteBytes) {
+				UInt64 theStart = NowMicroseconds();
+				struct iovec *theVector = theVectors;
+				int theVectorCount = (int)theCount;
+				size_t theRemaining = theWriteBytes;
+				while (theRemaining) {
+					ssize_t theWritten = writev (mFile, theVector, theVectorCount);
+					if (theWritten < 0) {
+						if (errno == EINTR)
+							continue;
+						mWriteError = kCAAudioFileRecorderError_WriteFailed;
+						break;
+					}
+					theRemaining -= theWritten;
+					// a short write carries on from where it stopped
+					while (theVectorCount && (size_t)theWritten >= theVector->iov_len) {
+						theWritten -= theVector->iov_len;
+						++theVector;
+						--theVectorCount;
+					}
+					if (theVectorCount) {
+						theVector->iov_base = static_cast<Byte*>(theVector->iov_base) + theWritten;
+						theVector->iov_len -= theWritten;
+					}
+				}
+				UInt64 theElapsed = NowMicroseconds() - theStart;
+
+				if (mWriteError == noErr)
+					mBytesWritten += theBytes;
+				UInt32 theBucket = (theElapsed == 0) ? 0 : std::min ((UInt32)(4. * log2 ((double)theElapsed)) + 1, (UInt32)kLatencyBuckets - 1);
+				++mLatency[theBucket];
+				++mWriteCount;
+			}
+
+			for (UInt32 i = 0; i < theCount; ++i) {
+				mFree.Push (theBlocks[i]);
+				if (mOptions.mOverflowPolicy == kOverflow_Wait)
+					mFreeSignal.Signal();
+			}
+		}
+
+		if (theStopping)
+			break;
+	}
+}
+
+Float64	CAAudioFileRecorder::GetWriteLatencyPercentile (Float64 inPercentile) const
+{
+	UInt64 theTotal = 0;
+	for (UInt32 i = 0; i < kLatencyBuckets; ++i)
+		theTotal += mLatency[i];
+	if (theTotal == 0)
+		return 0.;
+
+	// bucket 0 is under a microsecond, bucket i up to 2^(i/4) microseconds
+	UInt64 theTarget = (UInt64)ceil (std::min (std::max (inPercentile, 0.), 100.) / 100. * theTotal);
+	UInt64 theCount = 0;
+	for (UInt32 i = 0; i < kLatencyBuckets; ++i) {
+		theCount += mLatency[i];
+		if (theCount >= theTarget && theCount)
+			return (i == 0) ? 1. : pow (2., i / 4.);
+	}
+	return pow (2., (kLatencyBuckets - 1) / 4.);
+}
+
+// ____________________________________________________________________________
+//
+//	The header fills everything before the sample data, with a free or JUNK chunk
+// padding it out. While recording, the sizes say the data runs to the end of the file
+// (CAF) or are zero (WAVE); Close fills in the real ones.
+OSStatus	CAAudioFileRecorder::WriteHeader (bool inFinal)
+{
+	void *theMemory = NULL;
+	if (posix_memalign (&theMemory, kAlignment, mDataOffset) != 0)
+		return kAudio_MemFullError;
+	Byte *theHeader = static_cast<Byte*>(theMemory);
+	memset (theHeader, 0, mDataOffset);
+
+	const bool theFloat = (mFileFormat.mFormatFlags & kAudioFormatFlagIsFloat) != 0;
+	const UInt64 theDataBytes = mBytesWritten;
+	Byte *p = theHeader;
+
+	if (mOptions.mFileType == kFileType_WAVE) {
+		UInt64 theRIFFSize = inFinal ? std::min (mDataOffset - 8 + theDataBytes, (UInt64)0xFFFFFFFF) : 0;
+		p = PutFourCC (p, "RIFF");
+		p = PutLE (p, theRIFFSize, 4);
+		p = PutFourCC (p, "WAVE");
+		p = PutFourCC (p, "fmt ");
+		p = PutLE (p, 16, 4);
+		p = PutLE (p, theFloat ? 3 : 1, 2);		// WAVE_FORMAT_IEEE_FLOAT or WAVE_FORMAT_PCM
+		p = PutLE (p, mFileFormat.mChannelsPerFrame, 2);
+		p = PutLE (p, (UInt32)mFileFormat.mSampleRate, 4);
+		p = PutLE (p, (UInt32)mFileFormat.mSampleRate * mFileFormat.mBytesPerFrame, 4);
+		p = PutLE (p, mFileFormat.mBytesPerFrame, 2);
+		p = PutLE (p, mFileFormat.mBitsPerChannel, 2);
+		p = PutFourCC (p, "JUNK");
+		p = PutLE (p, (theHeader + mDataOffset - 8) - (p + 4), 4);
+		p = PutFourCC (theHeader + mDataOffset - 8, "data");
+		p = PutLE (p, inFinal ? std::min (theDataBytes, (UInt64)0xFFFFFFFF) : 0, 4);
+	} else {
+		UInt32 theFlags = (theFloat ? 1 : 0) | (IsLittleEndianHost() ? 2 : 0);	// kCAFLinearPCMFormatFlagIsFloat, kCAFLinearPCMFormatFlagIsLittleEndian
+		p = PutFourCC (p, "caff");
+		p = PutBE (p, 1, 2);
+		p = PutBE (p, 0, 2);
+		p = PutFourCC (p, "desc");
+		p = PutBE (p, 32, 8);
+		p = PutFloat64BE (p, mFileFormat.mSampleRate);
+		p = PutFourCC (p, "lpcm");
+		p = PutBE (p, theFlags, 4);
+		p = PutBE (p, mFileFormat.mBytesPerFrame, 4);
+		p = PutBE (p, 1, 4);
+		p = PutBE (p, mFileFormat.mChannelsPerFrame, 4);
+		p = PutBE (p, mFileFormat.mBitsPerChannel, 4);
+		if (mLayout) {
+			p = PutFourCC (p, "chan");
+			p = PutBE (p, 12 + mLayout->mNumberChannelDescriptions * 20, 8);
+			p = PutBE (p, mLayout->mChannelLayoutTag, 4);
+			p = PutBE (p, mLayout->mChannelBitmap, 4);
+			p = PutBE (p, mLayout->mNumberChannelDescriptions, 4);
+			for (UInt32 i = 0; i < mLayout->mNumberChannelDescriptions; ++i) {
+				const AudioChannelDescription &theDescription = mLayout->mChannelDescriptions[i];
+				p = PutBE (p, theDescription.mChannelLabel, 4);
+				p = PutBE (p, theDescription.mChannelFlags, 4);
+				for (UInt32 c = 0; c < 3; ++c)
+					p = PutFloat32BE (p, theDescription.mCoordinates[c]);
+			}
+		}
+		// the data chunk header and its edit count end where the data starts
+		Byte *theDataChunk = theHeader + mDataOffset - 16;
+		p = PutFourCC (p, "free");
+		p = PutBE (p, (UInt64)(theDataChunk - (p + 8)), 8);
+		p = PutFourCC (theDataChunk, "data");
+		p = PutBE (p, inFinal ? 4 + theDataBytes : ~0ULL, 8);
+		p = PutBE (p, 0, 4);
+	}
+
+	OSStatus theResult = (pwrite (mFile, theHeader, mDataOffset, 0) == (ssize_t)mDataOffset) ? (OSStatus)noErr : (OSStatus)kCAAudioFileRecorderError_WriteFailed;
+	free (theMemory);
+	return theResult;
+}
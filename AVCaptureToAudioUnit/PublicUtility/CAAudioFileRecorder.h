@@ -0,0 +1,192 @@
+/*
+     File: CAAudioFileRecorder.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#ifndef __CAAudioFileRecorder_h__
+#define __CAAudioFileRecorder_h__
+
+#include "CAStreamBasicDescription.h"
+#include "CAPCMConverter.h"
+#include <pthread.h>
+#if defined(__APPLE__)
+	#include <dispatch/dispatch.h>
+#else
+	#include <semaphore.h>
+#endif
+
+enum {
+	kCAAudioFileRecorderError_NotOpen		= 'nopn',
+	kCAAudioFileRecorderError_WriteFailed	= 'wrt!'
+};
+
+// ____________________________________________________________________________
+//
+//	CAAudioFileRecorder - records linear PCM to a CAF or WAVE file from a dedicated writer thread.
+// Write converts the client's buffers straight into the file format, packing them into large
+// blocks that are handed to the writer through a lock-free queue; the writer issues one
+// aligned write for as many blocks as are ready. Memory is bounded by the block count:
+// when every block is waiting to be written, Write either drops the frames or waits for the
+// writer, as the overflow policy says. Sample data starts on a block aligned offset so the
+// file can be written with the buffer cache bypassed.
+class CAAudioFileRecorder {
+public:
+	enum {
+		kFileType_CAF,
+		kFileType_WAVE
+	};
+	enum {
+		kOverflow_DropFrames,			// never blocks the caller; the frames are counted and lost
+		kOverflow_Wait					// blocks the caller until the writer frees a block
+	};
+
+	struct Options {
+		UInt32		mFileType;
+		UInt32		mOverflowPolicy;
+		UInt32		mBlockBytes;		// rounded up to whole frames and the alignment
+		UInt32		mNumberBlocks;
+		bool		mDirectIO;			// bypass the buffer cache
+		UInt64		mPreallocateBytes;	// reserved on disk up front, for long recordings
+
+		Options () : mFileType (kFileType_CAF), mOverflowPolicy (kOverflow_DropFrames), mBlockBytes (256 * 1024),
+					 mNumberBlocks (16), mDirectIO (false), mPreallocateBytes (0) {}
+	};
+
+										CAAudioFileRecorder ();
+										~CAAudioFileRecorder();
+
+								// NOT real-time safe. inFileFormat must be packed, interleaved, native endian
+								// PCM; inClientFormat is anything CAPCMConverter takes at the same sample rate.
+								// inLayout, if any, is written to a CAF file's channel layout chunk
+	OSStatus							Open (const char *inPath,
+											  const CAStreamBasicDescription &inClientFormat,
+											  const CAStreamBasicDescription &inFileFormat,
+											  const AudioChannelLayout *inLayout = NULL,
+											  const Options &inOptions = Options());
+
+								// from one thread at a time. Doesn't allocate, lock or make system calls unless
+								// a block fills up (a semaphore signal) or the policy is kOverflow_Wait
+	OSStatus							Write (const AudioBufferList &inList, UInt32 inNumberFrames);
+
+								// NOT real-time safe. Writes out what's left, finishes the header and closes the
+								// file. Returns the first write error if there was one
+	OSStatus							Close ();
+
+	bool								IsOpen () const { return mFile >= 0; }
+	UInt64								GetFramesWritten () const { return mFramesWritten; }
+	UInt64								GetFramesDropped () const { return mFramesDropped; }
+	UInt64								GetBytesWritten () const { return mBytesWritten; }
+	UInt32								GetWriteCount () const { return mWriteCount; }
+								// the time within which inPercentile percent of the writes completed, in
+								// microseconds. Measured in quarter octaves, so to within 19%
+	Float64								GetWriteLatencyPercentile (Float64 inPercentile) const;
+
+private:
+	enum { kNoBlock = 0xFFFFFFFF, kLatencyBuckets = 128 };
+
+	// a single producer, single consumer queue of block indices
+	struct BlockQueue {
+		UInt32*				mSlots;
+		UInt32				mSize;
+		volatile UInt32		mHead;
+		volatile UInt32		mTail;
+
+		void				Init (UInt32 *inSlots, UInt32 inSize) { mSlots = inSlots; mSize = inSize; mHead = mTail = 0; }
+		bool				Push (UInt32 inBlock);
+		UInt32				Pop ();
+	};
+
+	struct Semaphore {
+#if defined(__APPLE__)
+		dispatch_semaphore_t	mSemaphore;
+#else
+		sem_t					mSemaphore;
+#endif
+		void				Init ();
+		void				Destroy ();
+		void				Signal ();
+		void				Wait ();
+	};
+
+	static void*				WriterEntry (void *inRecorder);
+	void						WriterLoop ();
+	OSStatus					WriteHeader (bool inFinal);
+	bool						CommitBlock ();
+
+	int							mFile;
+	char*						mPath;
+	Options						mOptions;
+	CAStreamBasicDescription	mFileFormat;
+	CAPCMConverter				mConverter;
+	AudioChannelLayout*			mLayout;
+	UInt32						mLayoutSize;
+
+	Byte*						mBlockMemory;
+	UInt32*						mBlockFill;				// bytes in each block
+	UInt32*						mQueueSlots;
+	UInt32						mBlockBytes;
+	UInt32						mDataOffset;			// where the sample data starts in the file
+	BlockQueue					mFull;					// filled by Write, emptied by the writer
+	BlockQueue					mFree;					// the other way round
+	Semaphore					mFullSignal;
+	Semaphore					mFreeSignal;
+	UInt32						mCurrentBlock;
+	AudioBufferList*			mSourceView;
+
+	pthread_t					mWriter;
+	volatile bool				mStopping;
+	volatile OSStatus			mWriteError;
+
+	volatile UInt64				mFramesWritten;
+	volatile UInt64				mFramesDropped;
+	volatile UInt64				mBytesWritten;
+	volatile UInt32				mWriteCount;
+	volatile UInt32				mLatency[kLatencyBuckets];
+
+// don't want to copy these
+	CAAudioFileRecorder (const CAAudioFileRecorder &c);
+	CAAudioFileRecorder& operator= (const CAAudioFileRecorder& c);
+};
+
+#endif // __CAAudioFileRecorder_h__
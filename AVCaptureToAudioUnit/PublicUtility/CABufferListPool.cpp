@@ -0,0 +1,213 @@
+/*
+     File: CABufferListPool.cpp 
+ Abstract:  CABufferListPool.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#include "CABufferListPool.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#if CABufferListPool_AssertLive
+	#include <assert.h>
+#endif
+
+// headers and sample memory are aligned for the vector kernels
+static const UInt32 kAlignment = 32;
+
+static inline size_t	AlignUp (size_t inSize)
+{
+	return (inSize + kAlignment - 1) & ~(size_t)(kAlignment - 1);
+}
+
+static inline UInt64	MakeHead (UInt64 inTag, UInt32 inIndex)
+{
+	return (inTag << 32) | inIndex;
+}
+
+// _____________________________________________________________________________
+//
+CABufferListPool::CABufferListPool ()
+		: mBlock (NULL),
+		  mMemory (NULL),
+		  mSlabs (NULL),
+		  mNext (NULL),
+		  mNumberLists (0),
+		  mMaxBuffers (0),
+		  mHeaderSize (0),
+		  mSlabSize (0),
+		  mMaxFrames (0),
+		  mBufferStride (0),
+		  mHead (kEndOfList),
+		  mAllocationCount (0),
+		  mFailedAcquireCount (0),
+		  mLive (false)
+{
+}
+
+CABufferListPool::~CABufferListPool()
+{
+	Deallocate();
+}
+
+// _____________________________________________________________________________
+//
+bool	CABufferListPool::Allocate (const CAStreamBasicDescription &inMaxFormat, UInt32 inMaxFrames, UInt32 inNumberLists)
+{
+#if CABufferListPool_AssertLive
+	assert (!mLive && "CABufferListPool::Allocate called on a live pool");
+#endif
+	Deallocate();
+	if (inNumberLists == 0)
+		return false;
+
+	// a buffer per channel, so the headers can describe any layout of up to that many channels
+	UInt32 maxBuffers = inMaxFormat.NumberChannels() ? inMaxFormat.NumberChannels() : 1;
+	size_t headerSize = AlignUp (offsetof(AudioBufferList, mBuffers) + (maxBuffers * sizeof(AudioBuffer)));
+	size_t slabSize = AlignUp (inMaxFormat.FramesToBytes (inMaxFrames)) * inMaxFormat.NumberChannelStreams();
+
+	// [headers][sample slabs][free list links], one block
+	size_t theSize = kAlignment + (headerSize + slabSize + sizeof(std::atomic<UInt32>)) * inNumberLists;
+	mBlock = malloc (theSize);
+	if (mBlock == NULL)
+		return false;
+	++mAllocationCount;
+
+	mMemory = reinterpret_cast<Byte*>(AlignUp (reinterpret_cast<uintptr_t>(mBlock)));
+	mSlabs = mMemory + headerSize * inNumberLists;
+	mNext = reinterpret_cast<std::atomic<UInt32>*>(mSlabs + slabSize * inNumberLists);
+	mNumberLists = inNumberLists;
+	mMaxBuffers = maxBuffers;
+	mHeaderSize = (UInt32)headerSize;
+	mSlabSize = (UInt32)slabSize;
+	mMaxFrames = inMaxFrames;
+
+	for (UInt32 i = 0; i < mNumberLists; ++i)
+		new (&mNext[i]) std::atomic<UInt32> ((i + 1 < mNumberLists) ? i + 1 : kEndOfList);
+	mHead.store (MakeHead (0, 0), std::memory_order_release);
+
+	return SetFormat (inMaxFormat);
+}
+
+void	CABufferListPool::Deallocate ()
+{
+	free (mBlock);
+	mBlock = NULL;
+	mMemory = NULL;
+	mSlabs = NULL;
+	mNext = NULL;
+	mNumberLists = 0;
+	mMaxBuffers = 0;
+	mHeaderSize = 0;
+	mSlabSize = 0;
+	mMaxFrames = 0;
+	mBufferStride = 0;
+	mHead.store (kEndOfList, std::memory_order_release);
+}
+
+bool	CABufferListPool::SetFormat (const CAStreamBasicDescription &inFormat)
+{
+	if (mNumberLists == 0 || inFormat.NumberChannelStreams() > mMaxBuffers)
+		return false;
+
+	UInt32 stride = (UInt32)AlignUp (inFormat.FramesToBytes (mMaxFrames));
+	if ((UInt64)stride * inFormat.NumberChannelStreams() > mSlabSize)
+		return false;
+
+	mFormat = inFormat;
+	mBufferStride = stride;
+	return true;
+}
+
+// _____________________________________________________________________________
+//
+AudioBufferList*	CABufferListPool::Acquire (UInt32 inNumFrames, bool inWantNullBuffers)
+{
+	if (inNumFrames > mMaxFrames) {
+		mFailedAcquireCount.fetch_add (1, std::memory_order_relaxed);
+		return NULL;
+	}
+
+	// pop; the tag in the high word changes on every swap, so a list that was
+	// taken and put back between our load and the swap can't be mistaken for the same head.
+	// A failed swap reloads the head, and the acquire pairs with the release that pushed the list
+	UInt64 oldHead = mHead.load (std::memory_order_acquire), newHead;
+	UInt32 index;
+	do {
+		index = (UInt32)oldHead;
+		if (index == kEndOfList) {
+			mFailedAcquireCount.fetch_add (1, std::memory_order_relaxed);
+			return NULL;
+		}
+		newHead = MakeHead ((oldHead >> 32) + 1, mNext[index].load (std::memory_order_relaxed));
+	} while (!mHead.compare_exchange_weak (oldHead, newHead, std::memory_order_acq_rel, std::memory_order_acquire));
+
+	AudioBufferList *abl = ListAt (index);
+	Byte *p = SlabAt (index);
+	UInt32 nStreams = mFormat.NumberChannelStreams();
+	UInt32 nBytes = inWantNullBuffers ? 0 : mFormat.FramesToBytes (inNumFrames);
+
+	abl->mNumberBuffers = nStreams;
+	for (UInt32 i = 0; i < nStreams; ++i) {
+		AudioBuffer &buf = abl->mBuffers[i];
+		buf.mNumberChannels = mFormat.NumberInterleavedChannels();
+		buf.mDataByteSize = nBytes;
+		buf.mData = inWantNullBuffers ? NULL : p;
+		p += mBufferStride;
+	}
+	return abl;
+}
+
+void	CABufferListPool::Release (AudioBufferList *inList)
+{
+	if (inList == NULL)
+		return;
+
+	UInt32 index = (UInt32)((reinterpret_cast<Byte*>(inList) - mMemory) / mHeaderSize);
+	UInt64 oldHead = mHead.load (std::memory_order_relaxed), newHead;
+	do {
+		mNext[index].store ((UInt32)oldHead, std::memory_order_relaxed);
+		newHead = MakeHead ((oldHead >> 32) + 1, index);
+	} while (!mHead.compare_exchange_weak (oldHead, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
@@ -0,0 +1,132 @@
+/*
+     File: CABufferListPool.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#ifndef __CABufferListPool_h__
+#define __CABufferListPool_h__
+
+#include "CAStreamBasicDescription.h"
+#include <atomic>
+
+// Define as 1 to have Allocate assert if it's called while the pool is marked live, so a heap
+// allocation that creeps onto the per buffer path is caught. On by default in debug builds
+#if !defined(CABufferListPool_AssertLive)
+	#if DEBUG || CoreAudio_Debug
+		#define CABufferListPool_AssertLive 1
+	#else
+		#define CABufferListPool_AssertLive 0
+	#endif
+#endif
+
+// ____________________________________________________________________________
+//
+//	CABufferListPool - a fixed set of AudioBufferLists, with their sample memory,
+// carved out of a single allocation made up front.
+// Acquire and Release are lock-free and never touch the heap, so they can be used
+// from the capture callback and render threads. The pool is sized for a largest
+// format; SetFormat switches to any format that fits without reallocating.
+// A pool allocated with no frames holds headers only, for calls such as
+// CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer that supply their own data.
+class CABufferListPool {
+public:
+										CABufferListPool ();
+										~CABufferListPool();
+
+								// NOT real-time safe: makes the pool's one allocation.
+								// inMaxFormat gives the most channels and bytes per frame that will be used
+	bool								Allocate (const CAStreamBasicDescription &inMaxFormat, UInt32 inMaxFrames, UInt32 inNumberLists);
+	void								Deallocate ();
+
+								// real-time safe. Returns false if inFormat doesn't fit the allocation.
+								// No lists may be out when the format changes
+	bool								SetFormat (const CAStreamBasicDescription &inFormat);
+
+								// real-time safe. Returns NULL if every list is in use, or inNumFrames is more than fits.
+								// With inWantNullBuffers the list is prepared with NULL mData and zero sizes
+	AudioBufferList*					Acquire (UInt32 inNumFrames, bool inWantNullBuffers = false);
+	void								Release (AudioBufferList *inList);
+
+	UInt32								MaxFrames() const { return mMaxFrames; }
+	UInt32								HeaderByteSize() const { return mHeaderSize; }
+	const CAStreamBasicDescription&		GetFormat() const { return mFormat; }
+
+								// Heap allocations and failed acquires over the pool's lifetime. Allocations
+								// only change in Allocate, so a caller can check that none happen per buffer
+	UInt32								AllocationCount() const { return mAllocationCount; }
+	UInt32								FailedAcquireCount() const { return mFailedAcquireCount.load (std::memory_order_relaxed); }
+
+								// Mark the pool live once it's set up for the real-time path, and not live before
+								// setting it up again. See CABufferListPool_AssertLive
+	void								SetLive (bool inLive) { mLive = inLive; }
+	bool								IsLive() const { return mLive; }
+
+private:
+	static const UInt32			kEndOfList = 0xFFFFFFFF;
+
+	AudioBufferList*			ListAt (UInt32 inIndex) const { return reinterpret_cast<AudioBufferList*>(mMemory + (inIndex * mHeaderSize)); }
+	Byte*						SlabAt (UInt32 inIndex) const { return mSlabs + (inIndex * mSlabSize); }
+
+	CAStreamBasicDescription	mFormat;
+	void*						mBlock;
+	Byte*						mMemory;
+	Byte*						mSlabs;
+	std::atomic<UInt32>*		mNext;			// the list after each free one, read by a pop that may lose its swap
+	UInt32						mNumberLists;
+	UInt32						mMaxBuffers;
+	UInt32						mHeaderSize;
+	UInt32						mSlabSize;
+	UInt32						mMaxFrames;
+	UInt32						mBufferStride;
+	std::atomic<UInt64>			mHead;			// tag in the high word against ABA, index in the low
+	UInt32						mAllocationCount;
+	std::atomic<UInt32>			mFailedAcquireCount;
+	bool						mLive;
+
+// don't want to copy these
+	CABufferListPool (const CABufferListPool &c);
+	CABufferListPool& operator= (const CABufferListPool& c);
+};
+
+#endif // __CABufferListPool_h__
@@ -0,0 +1,861 @@
+/*
+     File: CAPCMConverter.cpp 
+ Abstract:  CAPCMConverter.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#include "CAPCMConverter.h"
+#include "CAVectorUnit.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+	#if defined(__clang__) || defined(__GNUC__)
+		#include <immintrin.h>
+		#define CA_USE_AVX2 1
+	#endif
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define CA_USE_NEON 1
+#endif
+
+// ____________________________________________________________________________
+//
+//	Sample kernels. The scalar versions are the reference; the integer conversions
+// in the vector versions give the same results, the dot product differs only in the
+// order its sums are rounded.
+
+typedef void	(*SInt16ToFloatProc)(const SInt16 *inSource, Float32 *outDest, UInt32 inCount);
+typedef void	(*FloatToSInt16Proc)(const Float32 *inSource, SInt16 *outDest, UInt32 inCount);
+typedef void	(*SInt32ToFloatProc)(const SInt32 *inSource, Float32 *outDest, UInt32 inCount, Float32 inScale);
+typedef void	(*FloatToSInt32Proc)(const Float32 *inSource, SInt32 *outDest, UInt32 inCount, Float32 inScale);
+typedef void	(*MixAddProc)(Float32 *ioSum, const Float32 *inSource, UInt32 inCount, Float32 inGain);
+typedef Float32	(*DotProc)(const Float32 *inA, const Float32 *inB, UInt32 inCount);
+
+struct CAPCMKernels
+{
+	SInt16ToFloatProc	mSInt16ToFloat;
+	FloatToSInt16Proc	mFloatToSInt16;
+	SInt32ToFloatProc	mSInt32ToFloat;
+	FloatToSInt32Proc	mFloatToSInt32;
+	MixAddProc			mMixAdd;
+	DotProc				mDot;
+};
+
+static const Float32 kSInt16Scale = 32768.f;
+static const Float32 kSInt16Min = -32768.f;
+static const Float32 kSInt16Max = 32767.f;
+static const Float32 kSInt32Scale = 2147483648.f;
+static const Float32 kFixed8_24Scale = 16777216.f;
+static const Float32 kSInt32Min = -2147483648.f;
+static const Float32 kSInt32Max = 2147483520.f;	//	largest Float32 below 2^31
+
+static inline Float32	ClampFloat(Float32 inValue, Float32 inMin, Float32 inMax)
+{
+	return (inValue < inMin) ? inMin : ((inValue > inMax) ? inMax : inValue);
+}
+
+static void	SInt16ToFloat_Scalar(const SInt16 *inSource, Float32 *outDest, UInt32 inCount)
+{
+	for (UInt32 i = 0; i < inCount; ++i)
+		outDest[i] = (Float32)inSource[i] * (1.f / kSInt16Scale);
+}
+
+static void	FloatToSInt16_Scalar(const Float32 *inSource, SInt16 *outDest, UInt32 inCount)
+{
+	for (UInt32 i = 0; i < inCount; ++i)
+		outDest[i] = (SInt16)lrintf(ClampFloat(inSource[i] * kSInt16Scale, kSInt16Min, kSInt16Max));
+}
+
+static void	SInt32ToFloat_Scalar(const SInt32 *inSource, Float32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	for (UInt32 i = 0; i < inCount; ++i)
+		outDest[i] = (Float32)inSource[i] * inScale;
+}
+
+static void	FloatToSInt32_Scalar(const Float32 *inSource, SInt32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	for (UInt32 i = 0; i < inCount; ++i)
+		outDest[i] = (SInt32)lrintf(ClampFloat(inSource[i] * inScale, kSInt32Min, kSInt32Max));
+}
+
+static void	MixAdd_Scalar(Float32 *ioSum, const Float32 *inSource, UInt32 inCount, Float32 inGain)
+{
+	for (UInt32 i = 0; i < inCount; ++i)
+		ioSum[i] += inSource[i] * inGain;
+}
+
+static Float32	Dot_Scalar(const Float32 *inA, const Float32 *inB, UInt32 inCount)
+{
+	Float32 theSum = 0.f;
+	for (UInt32 i = 0; i < inCount; ++i)
+		theSum += inA[i] * inB[i];
+	return theSum;
+}
+
+static const CAPCMKernels sScalarKernels =
+{
+	SInt16ToFloat_Scalar,
+	FloatToSInt16_Scalar,
+	SInt32ToFloat_Scalar,
+	FloatToSInt32_Scalar,
+	MixAdd_Scalar,
+	Dot_Scalar
+};
+
+#if defined(__SSE2__)
+
+static void	SInt16ToFloat_SSE2(const SInt16 *inSource, Float32 *outDest, UInt32 inCount)
+{
+	UInt32 i = 0;
+	__m128 theScale = _mm_set1_ps(1.f / kSInt16Scale);
+	for (; i + 8 <= inCount; i += 8) {
+		__m128i theSource = _mm_loadu_si128((const __m128i*)(inSource + i));
+		//	sign extend to 32 bits
+		__m128i theLo = _mm_srai_epi32(_mm_unpacklo_epi16(theSource, theSource), 16);
+		__m128i theHi = _mm_srai_epi32(_mm_unpackhi_epi16(theSource, theSource), 16);
+		_mm_storeu_ps(outDest + i, _mm_mul_ps(_mm_cvtepi32_ps(theLo), theScale));
+		_mm_storeu_ps(outDest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(theHi), theScale));
+	}
+	SInt16ToFloat_Scalar(inSource + i, outDest + i, inCount - i);
+}
+
+static void	FloatToSInt16_SSE2(const Float32 *inSource, SInt16 *outDest, UInt32 inCount)
+{
+	UInt32 i = 0;
+	__m128 theScale = _mm_set1_ps(kSInt16Scale);
+	__m128 theMin = _mm_set1_ps(kSInt16Min);
+	__m128 theMax = _mm_set1_ps(kSInt16Max);
+	for (; i + 8 <= inCount; i += 8) {
+		__m128 theLo = _mm_mul_ps(_mm_loadu_ps(inSource + i), theScale);
+		__m128 theHi = _mm_mul_ps(_mm_loadu_ps(inSource + i + 4), theScale);
+		theLo = _mm_min_ps(_mm_max_ps(theLo, theMin), theMax);
+		theHi = _mm_min_ps(_mm_max_ps(theHi, theMin), theMax);
+		_mm_storeu_si128((__m128i*)(outDest + i), _mm_packs_epi32(_mm_cvtps_epi32(theLo), _mm_cvtps_epi32(theHi)));
+	}
+	FloatToSInt16_Scalar(inSource + i, outDest + i, inCount - i);
+}
+
+static void	SInt32ToFloat_SSE2(const SInt32 *inSource, Float32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	UInt32 i = 0;
+	__m128 theScale = _mm_set1_ps(inScale);
+	for (; i + 4 <= inCount; i += 4)
+		_mm_storeu_ps(outDest + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(inSource + i))), theScale));
+	SInt32ToFloat_Scalar(inSource + i, outDest + i, inCount - i, inScale);
+}
+
+static void	FloatToSInt32_SSE2(const Float32 *inSource, SInt32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	UInt32 i = 0;
+	__m128 theScale = _mm_set1_ps(inScale);
+	__m128 theMin = _mm_set1_ps(kSInt32Min);
+	__m128 theMax = _mm_set1_ps(kSInt32Max);
+	for (; i + 4 <= inCount; i += 4) {
+		__m128 theValue = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(inSource + i), theScale), theMin), theMax);
+		_mm_storeu_si128((__m128i*)(outDest + i), _mm_cvtps_epi32(theValue));
+	}
+	FloatToSInt32_Scalar(inSource + i, outDest + i, inCount - i, inScale);
+}
+
+static void	MixAdd_SSE2(Float32 *ioSum, const Float32 *inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	__m128 theGain = _mm_set1_ps(inGain);
+	for (; i + 4 <= inCount; i += 4)
+		_mm_storeu_ps(ioSum + i, _mm_add_ps(_mm_loadu_ps(ioSum + i), _mm_mul_ps(_mm_loadu_ps(inSource + i), theGain)));
+	MixAdd_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static Float32	Dot_SSE2(const Float32 *inA, const Float32 *inB, UInt32 inCount)
+{
+	UInt32 i = 0;
+	__m128 theSum0 = _mm_setzero_ps();
+	__m128 theSum1 = _mm_setzero_ps();
+	for (; i + 8 <= inCount; i += 8) {
+		theSum0 = _mm_add_ps(theSum0, _mm_mul_ps(_mm_loadu_ps(inA + i), _mm_loadu_ps(inB + i)));
+		theSum1 = _mm_add_ps(theSum1, _mm_mul_ps(_mm_loadu_ps(inA + i + 4), _mm_loadu_ps(inB + i + 4)));
+	}
+	theSum0 = _mm_add_ps(theSum0, theSum1);
+	theSum0 = _mm_add_ps(theSum0, _mm_movehl_ps(theSum0, theSum0));
+	theSum0 = _mm_add_ss(theSum0, _mm_shuffle_ps(theSum0, theSum0, 1));
+	return _mm_cvtss_f32(theSum0) + Dot_Scalar(inA + i, inB + i, inCount - i);
+}
+
+static const CAPCMKernels sSSE2Kernels =
+{
+	SInt16ToFloat_SSE2,
+	FloatToSInt16_SSE2,
+	SInt32ToFloat_SSE2,
+	FloatToSInt32_SSE2,
+	MixAdd_SSE2,
+	Dot_SSE2
+};
+
+#endif // __SSE2__
+
+#if CA_USE_AVX2
+
+//	built for AVX2 without FMA, so that products round as in the scalar code
+#define CA_AVX2_TARGET	__attribute__((target("avx2")))
+
+CA_AVX2_TARGET
+static void	SInt16ToFloat_AVX2(const SInt16 *inSource, Float32 *outDest, UInt32 inCount)
+{
+	UInt32 i = 0;
+	__m256 theScale = _mm256_set1_ps(1.f / kSInt16Scale);
+	for (; i + 8 <= inCount; i += 8) {
+		__m256i theSource = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(inSource + i)));
+		_mm256_storeu_ps(outDest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(theSource), theScale));
+	}
+	SInt16ToFloat_Scalar(inSource + i, outDest + i, inCount - i);
+}
+
+CA_AVX2_TARGET
+static void	SInt32ToFloat_AVX2(const SInt32 *inSource, Float32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	UInt32 i = 0;
+	__m256 theScale = _mm256_set1_ps(inScale);
+	for (; i + 8 <= inCount; i += 8)
+		_mm256_storeu_ps(outDest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(inSource + i))), theScale));
+	SInt32ToFloat_Scalar(inSource + i, outDest + i, inCount - i, inScale);
+}
+
+CA_AVX2_TARGET
+static void	FloatToSInt32_AVX2(const Float32 *inSource, SInt32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	UInt32 i = 0;
+	__m256 theScale = _mm256_set1_ps(inScale);
+	__m256 theMin = _mm256_set1_ps(kSInt32Min);
+	__m256 theMax = _mm256_set1_ps(kSInt32Max);
+	for (; i + 8 <= inCount; i += 8) {
+		__m256 theValue = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(inSource + i), theScale), theMin), theMax);
+		_mm256_storeu_si256((__m256i*)(outDest + i), _mm256_cvtps_epi32(theValue));
+	}
+	FloatToSInt32_Scalar(inSource + i, outDest + i, inCount - i, inScale);
+}
+
+CA_AVX2_TARGET
+static void	MixAdd_AVX2(Float32 *ioSum, const Float32 *inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	__m256 theGain = _mm256_set1_ps(inGain);
+	for (; i + 8 <= inCount; i += 8)
+		_mm256_storeu_ps(ioSum + i, _mm256_add_ps(_mm256_loadu_ps(ioSum + i), _mm256_mul_ps(_mm256_loadu_ps(inSource + i), theGain)));
+	MixAdd_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+CA_AVX2_TARGET
+static Float32	Dot_AVX2(const Float32 *inA, const Float32 *inB, UInt32 inCount)
+{
+	UInt32 i = 0;
+	__m256 theSum0 = _mm256_setzero_ps();
+	__m256 theSum1 = _mm256_setzero_ps();
+	for (; i + 16 <= inCount; i += 16) {
+		theSum0 = _mm256_add_ps(theSum0, _mm256_mul_ps(_mm256_loadu_ps(inA + i), _mm256_loadu_ps(inB + i)));
+		theSum1 = _mm256_add_ps(theSum1, _mm256_mul_ps(_mm256_loadu_ps(inA + i + 8), _mm256_loadu_ps(inB + i + 8)));
+	}
+	theSum0 = _mm256_add_ps(theSum0, theSum1);
+	__m128 theSum = _mm_add_ps(_mm256_castps256_ps128(theSum0), _mm256_extractf128_ps(theSum0, 1));
+	theSum = _mm_add_ps(theSum, _mm_movehl_ps(theSum, theSum));
+	theSum = _mm_add_ss(theSum, _mm_shuffle_ps(theSum, theSum, 1));
+	return _mm_cvtss_f32(theSum) + Dot_Scalar(inA + i, inB + i, inCount - i);
+}
+
+//	packing 16 bit results across the two AVX2 lanes needs a permute, so that one stays SSE2
+static const CAPCMKernels sAVX2Kernels =
+{
+	SInt16ToFloat_AVX2,
+	FloatToSInt16_SSE2,
+	SInt32ToFloat_AVX2,
+	FloatToSInt32_AVX2,
+	MixAdd_AVX2,
+	Dot_AVX2
+};
+
+#endif // CA_USE_AVX2
+
+#if CA_USE_NEON
+
+static void	SInt16ToFloat_Neon(const SInt16 *inSource, Float32 *outDest, UInt32 inCount)
+{
+	UInt32 i = 0;
+	for (; i + 8 <= inCount; i += 8) {
+		int16x8_t theSource = vld1q_s16(inSource + i);
+		vst1q_f32(outDest + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(theSource))), 1.f / kSInt16Scale));
+		vst1q_f32(outDest + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(theSource))), 1.f / kSInt16Scale));
+	}
+	SInt16ToFloat_Scalar(inSource + i, outDest + i, inCount - i);
+}
+
+static void	FloatToSInt16_Neon(const Float32 *inSource, SInt16 *outDest, UInt32 inCount)
+{
+	UInt32 i = 0;
+#if defined(__aarch64__)
+	//	needs the round-to-nearest conversion that armv7 lacks
+	float32x4_t theMin = vdupq_n_f32(kSInt16Min);
+	float32x4_t theMax = vdupq_n_f32(kSInt16Max);
+	for (; i + 4 <= inCount; i += 4) {
+		float32x4_t theValue = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(inSource + i), kSInt16Scale), theMin), theMax);
+		vst1_s16(outDest + i, vqmovn_s32(vcvtnq_s32_f32(theValue)));
+	}
+#endif
+	FloatToSInt16_Scalar(inSource + i, outDest + i, inCount - i);
+}
+
+static void	SInt32ToFloat_Neon(const SInt32 *inSource, Float32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	UInt32 i = 0;
+	for (; i + 4 <= inCount; i += 4)
+		vst1q_f32(outDest + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(inSource + i)), inScale));
+	SInt32ToFloat_Scalar(inSource + i, outDest + i, inCount - i, inScale);
+}
+
+static void	FloatToSInt32_Neon(const Float32 *inSource, SInt32 *outDest, UInt32 inCount, Float32 inScale)
+{
+	UInt32 i = 0;
+#if defined(__aarch64__)
+	float32x4_t theMin = vdupq_n_f32(kSInt32Min);
+	float32x4_t theMax = vdupq_n_f32(kSInt32Max);
+	for (; i + 4 <= inCount; i += 4) {
+		float32x4_t theValue = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(inSource + i), inScale), theMin), theMax);
+		vst1q_s32(outDest + i, vcvtnq_s32_f32(theValue));
+	}
+#endif
+	FloatToSInt32_Scalar(inSource + i, outDest + i, inCount - i, inScale);
+}
+
+static void	MixAdd_Neon(Float32 *ioSum, const Float32 *inSource, UInt32 inCount, Float32 inGain)
+{
+	UInt32 i = 0;
+	for (; i + 4 <= inCount; i += 4)
+		vst1q_f32(ioSum + i, vaddq_f32(vld1q_f32(ioSum + i), vmulq_n_f32(vld1q_f32(inSource + i), inGain)));
+	MixAdd_Scalar(ioSum + i, inSource + i, inCount - i, inGain);
+}
+
+static Float32	Dot_Neon(const Float32 *inA, const Float32 *inB, UInt32 inCount)
+{
+	UInt32 i = 0;
+	float32x4_t theSum0 = vdupq_n_f32(0.f);
+	float32x4_t theSum1 = vdupq_n_f32(0.f);
+	for (; i + 8 <= inCount; i += 8) {
+		theSum0 = vaddq_f32(theSum0, vmulq_f32(vld1q_f32(inA + i), vld1q_f32(inB + i)));
+		theSum1 = vaddq_f32(theSum1, vmulq_f32(vld1q_f32(inA + i + 4), vld1q_f32(inB + i + 4)));
+	}
+	theSum0 = vaddq_f32(theSum0, theSum1);
+	float32x2_t theSum = vadd_f32(vget_low_f32(theSum0), vget_high_f32(theSum0));
+	return vget_lane_f32(vpadd_f32(theSum, theSum), 0) + Dot_Scalar(inA + i, inB + i, inCount - i);
+}
+
+static const CAPCMKernels sNeonKernels =
+{
+	SInt16ToFloat_Neon,
+	FloatToSInt16_Neon,
+	SInt32ToFloat_Neon,
+	FloatToSInt32_Neon,
+	MixAdd_Neon,
+	Dot_Neon
+};
+
+#endif // CA_USE_NEON
+
+static const CAPCMKernels&	GetPCMKernels()
+{
+	switch (CAVectorUnit::GetVectorUnitType())
+	{
+#if CA_USE_AVX2
+		case kVecAVX2:
+			return sAVX2Kernels;
+#endif
+#if defined(__SSE2__)
+		case kVecSSE2:
+			return sSSE2Kernels;
+#endif
+#if CA_USE_NEON
+		case kVecNeon:
+			return sNeonKernels;
+#endif
+		default:
+			break;
+	}
+	return sScalarKernels;
+}
+
+// ____________________________________________________________________________
+//
+//	Filter design
+
+static const UInt32 kMaxPhases = 1024;
+static const UInt32 kMaxTaps = 1024;
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double	BesselI0 (double x)
+{
+	double theSum = 1., theTerm = 1., theHalfX = x / 2.;
+	for (int k = 1; k < 50; ++k) {
+		theTerm *= (theHalfX / k) * (theHalfX / k);
+		theSum += theTerm;
+		if (theTerm < theSum * 1e-12)
+			break;
+	}
+	return theSum;
+}
+
+static UInt64	GreatestCommonDivisor (UInt64 a, UInt64 b)
+{
+	while (b) {
+		UInt64 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// ____________________________________________________________________________
+//
+CAPCMConverter::CAPCMConverter ()
+		: mSourceSampleFormat (0),
+		  mDestinationSampleFormat (0),
+		  mSourceChannels (0),
+		  mDestinationChannels (0),
+		  mMaxSourceFrames (0),
+		  mMaxResampledFrames (0),
+		  mIdentityMatrix (true),
+		  mInterpolation (1),
+		  mDecimation (1),
+		  mQuality (kQuality_High),
+		  mTaps (0),
+		  mPhase (0),
+		  mPosition (0)
+{
+}
+
+CAPCMConverter::~CAPCMConverter()
+{
+}
+
+bool	CAPCMConverter::IdentifySampleFormat (const CAStreamBasicDescription &inFormat, UInt32 &outSampleFormat)
+{
+	CAStreamBasicDescription::CommonPCMFormat theFormat;
+	if (!inFormat.IdentifyCommonPCMFormat (theFormat))
+		return false;
+
+	switch (theFormat) {
+		case CAStreamBasicDescription::kPCMFormatFloat32:
+			outSampleFormat = kSample_Float32;
+			return true;
+		case CAStreamBasicDescription::kPCMFormatInt16:
+			outSampleFormat = kSample_SInt16;
+			return true;
+		case CAStreamBasicDescription::kPCMFormatFixed824:
+			outSampleFormat = kSample_Fixed8_24;
+			return true;
+		default:
+			break;
+	}
+
+	// IdentifyCommonPCMFormat has no SInt32, but has already checked the layout is sensible
+	UInt32 theFlags = inFormat.mFormatFlags;
+	if ((theFlags & kAudioFormatFlagIsBigEndian) == kAudioFormatFlagsNativeEndian && !(theFlags & kAudioFormatFlagIsFloat)
+		&& (theFlags & kAudioFormatFlagIsSignedInteger) && !(theFlags & kLinearPCMFormatFlagsSampleFractionMask)
+		&& inFormat.SampleWordSize() == 4 && inFormat.mBitsPerChannel == 32) {
+		outSampleFormat = kSample_SInt32;
+		return true;
+	}
+	return false;
+}
+
+bool	CAPCMConverter::Initialize (const CAStreamBasicDescription &inSourceFormat,
+									const CAStreamBasicDescription &inDestinationFormat,
+									UInt32 inMaxSourceFrames,
+									UInt32 inQuality)
+{
+	Deallocate();
+
+	if (!IdentifySampleFormat (inSourceFormat, mSourceSampleFormat) || !IdentifySampleFormat (inDestinationFormat, mDestinationSampleFormat))
+		return false;
+	if (inMaxSourceFrames == 0 || inSourceFormat.mSampleRate <= 0. || inDestinationFormat.mSampleRate <= 0.)
+		return false;
+
+	// the rate ratio reduced to interpolation over decimation, from whole sample rates
+	UInt64 theSourceRate = (UInt64)(inSourceFormat.mSampleRate + 0.5);
+	UInt64 theDestinationRate = (UInt64)(inDestinationFormat.mSampleRate + 0.5);
+	if (fabs (inSourceFormat.mSampleRate - theSourceRate) > 1e-6 || fabs (inDestinationFormat.mSampleRate - theDestinationRate) > 1e-6)
+		return false;
+	UInt64 theDivisor = GreatestCommonDivisor (theSourceRate, theDestinationRate);
+	if (theDestinationRate / theDivisor > kMaxPhases || theSourceRate / theDivisor > 0xFFFF)
+		return false;
+
+	mSourceFormat = inSourceFormat;
+	mDestinationFormat = inDestinationFormat;
+	mSourceChannels = inSourceFormat.NumberChannels();
+	mDestinationChannels = inDestinationFormat.NumberChannels();
+	mMaxSourceFrames = inMaxSourceFrames;
+	mInterpolation = (UInt32)(theDestinationRate / theDivisor);
+	mDecimation = (UInt32)(theSourceRate / theDivisor);
+	mQuality = (inQuality <= kQuality_Medium) ? kQuality_Medium : kQuality_High;
+	// the filter has to be as long at the output rate when decimating, so it gets proportionally more taps
+	mTaps = mQuality;
+	if (mDecimation > mInterpolation)
+		mTaps = (UInt32)((((UInt64)mQuality * mDecimation + mInterpolation - 1) / mInterpolation + 7) & ~7ULL);
+	if (IsSampleRateConverting() && mTaps > kMaxTaps) {
+		Deallocate();
+		return false;
+	}
+	mMaxResampledFrames = MaxDestinationFrames (inMaxSourceFrames);
+
+	UInt32 theHistory = IsSampleRateConverting() ? mTaps - 1 : 0;
+	UInt32 theMixedStride = theHistory + mMaxSourceFrames;
+
+	mInterleaved.resize (std::max (mSourceChannels * mMaxSourceFrames, mDestinationChannels * mMaxResampledFrames));
+	mSourceChannelData.resize (mSourceChannels * mMaxSourceFrames);
+	mMixed.resize (mDestinationChannels * theMixedStride);
+	mSourcePlanes.resize (mSourceChannels);
+	mMixedPlanes.resize (mDestinationChannels);
+	mOutputPlanes.resize (mDestinationChannels);
+	for (UInt32 i = 0; i < mSourceChannels; ++i)
+		mSourcePlanes[i] = &mSourceChannelData[i * mMaxSourceFrames];
+	for (UInt32 i = 0; i < mDestinationChannels; ++i)
+		mMixedPlanes[i] = &mMixed[i * theMixedStride];
+
+	if (IsSampleRateConverting()) {
+		mResampled.resize (mDestinationChannels * mMaxResampledFrames);
+		for (UInt32 i = 0; i < mDestinationChannels; ++i)
+			mOutputPlanes[i] = &mResampled[i * mMaxResampledFrames];
+		DesignFilter();
+	} else {
+		mOutputPlanes = mMixedPlanes;
+	}
+
+	mMatrix.resize (mDestinationChannels * mSourceChannels);
+	SetChannelMatrix (NULL);
+	Reset();
+	return true;
+}
+
+void	CAPCMConverter::Deallocate ()
+{
+	std::vector<Float32>().swap (mMatrix);
+	std::vector<Float32>().swap (mCoefficients);
+	std::vector<Float32>().swap (mInterleaved);
+	std::vector<Float32>().swap (mSourceChannelData);
+	std::vector<Float32>().swap (mMixed);
+	std::vector<Float32>().swap (mResampled);
+	std::vector<Float32*>().swap (mSourcePlanes);
+	std::vector<Float32*>().swap (mMixedPlanes);
+	std::vector<Float32*>().swap (mOutputPlanes);
+	mSourceChannels = mDestinationChannels = 0;
+	mMaxSourceFrames = mMaxResampledFrames = 0;
+	mInterpolation = mDecimation = 1;
+	mTaps = 0;
+}
+
+void	CAPCMConverter::Reset ()
+{
+	if (!IsSampleRateConverting())
+		return;
+	for (UInt32 i = 0; i < mDestinationChannels; ++i)
+		memset (mMixedPlanes[i], 0, (mTaps - 1) * sizeof(Float32));
+	mPhase = 0;
+	mPosition = mTaps - 1;
+}
+
+void	CAPCMConverter::SetChannelMatrix (const Float32 *inMatrix)
+{
+	if (mMatrix.empty())
+		return;
+
+	if (inMatrix) {
+		memcpy (&mMatrix[0], inMatrix, mMatrix.size() * sizeof(Float32));
+	} else {
+		for (UInt32 out = 0; out < mDestinationChannels; ++out) {
+			for (UInt32 in = 0; in < mSourceChannels; ++in) {
+				Float32 theGain;
+				if (mSourceChannels == 1)
+					theGain = 1.f;
+				else if (mDestinationChannels == 1)
+					theGain = 1.f / mSourceChannels;
+				else
+					theGain = (in == out) ? 1.f : 0.f;
+				mMatrix[out * mSourceChannels + in] = theGain;
+			}
+		}
+	}
+
+	mIdentityMatrix = (mSourceChannels == mDestinationChannels);
+	for (UInt32 out = 0; mIdentityMatrix && out < mDestinationChannels; ++out)
+		for (UInt32 in = 0; in < mSourceChannels; ++in)
+			if (mMatrix[out * mSourceChannels + in] != ((in == out) ? 1.f : 0.f))
+				mIdentityMatrix = false;
+}
+
+UInt32	CAPCMConverter::MaxDestinationFrames (UInt32 inSourceFrames) const
+{
+	if (!IsSampleRateConverting())
+		return inSourceFrames;
+	return (UInt32)(((UInt64)inSourceFrames * mInterpolation + mDecimation - 1) / mDecimation) + 1;
+}
+
+// ____________________________________________________________________________
+//
+//	A Kaiser windowed sinc low pass, designed at mInterpolation times the source rate and
+// split into that many phases. The transition band is placed so the stopband starts at
+// the lower of the two Nyquist rates. Each phase is stored time reversed so an output
+// sample is a dot product with the input history.
+void	CAPCMConverter::DesignFilter ()
+{
+	const UInt32 L = mInterpolation;
+	const UInt32 T = mTaps;
+	const UInt32 N = L * T;
+	const double theCenter = (N - 1) / 2.;
+	const double theAttenuation = (mQuality >= kQuality_High) ? 87. : 70.;		// dB
+	const double theBeta = 0.1102 * (theAttenuation - 8.7);
+	// Kaiser's estimate of the transition width, in cycles per sample at the lower rate
+	const double theTransition = (theAttenuation - 7.95) / (14.36 * mQuality);
+	const double theCutoff = (0.5 - theTransition / 2.) / std::max (mInterpolation, mDecimation);	// cycles per interpolated sample
+	const double theWindowScale = 1. / BesselI0 (theBeta);
+
+	std::vector<double> h (N);
+	for (UInt32 i = 0; i < N; ++i) {
+		double x = i - theCenter;
+		double theSinc = (x == 0.) ? 2. * theCutoff : sin (2. * M_PI * theCutoff * x) / (M_PI * x);
+		double r = 2. * x / (N - 1);
+		double theWindow = BesselI0 (theBeta * sqrt (std::max (0., 1. - r * r))) * theWindowScale;
+		h[i] = theSinc * theWindow;
+	}
+
+	mCoefficients.resize (N);
+	for (UInt32 p = 0; p < L; ++p) {
+		// each phase is normalized to unity gain at DC, which keeps the interpolation free of ripple
+		double theSum = 0.;
+		for (UInt32 k = 0; k < T; ++k)
+			theSum += h[p + k * L];
+		for (UInt32 k = 0; k < T; ++k)
+			mCoefficients[p * T + (T - 1 - k)] = (Float32)(h[p + k * L] / theSum);
+	}
+}
+
+// ____________________________________________________________________________
+//
+void	CAPCMConverter::Decode (const AudioBufferList &inSource, UInt32 inOffset, UInt32 inFrames, Float32 **outChannels)
+{
+	const CAPCMKernels &theKernels = GetPCMKernels();
+	const UInt32 theSampleSize = SampleSize (mSourceSampleFormat);
+	UInt32 theChannel = 0;
+
+	for (UInt32 b = 0; b < inSource.mNumberBuffers && theChannel < mSourceChannels; ++b) {
+		const AudioBuffer &theBuffer = inSource.mBuffers[b];
+		UInt32 theBufferChannels = std::min (theBuffer.mNumberChannels, mSourceChannels - theChannel);
+		UInt32 theStride = theBuffer.mNumberChannels;
+		if (theBufferChannels == 0)
+			continue;
+
+		// convert the whole run of samples in one pass, then spread interleaved ones out
+		const void *theData = (const Byte*)theBuffer.mData + (inOffset * theStride * theSampleSize);
+		UInt32 theCount = inFrames * theStride;
+		Float32 *theFloats = (theStride == 1) ? outChannels[theChannel] : &mInterleaved[0];
+
+		switch (mSourceSampleFormat) {
+			case kSample_Float32:
+				if (theStride == 1)
+					memcpy (theFloats, theData, theCount * sizeof(Float32));
+				else
+					theFloats = (Float32*)theData;
+				break;
+			case kSample_SInt16:
+				theKernels.mSInt16ToFloat ((const SInt16*)theData, theFloats, theCount);
+				break;
+			case kSample_SInt32:
+				theKernels.mSInt32ToFloat ((const SInt32*)theData, theFloats, theCount, 1.f / kSInt32Scale);
+				break;
+			case kSample_Fixed8_24:
+				theKernels.mSInt32ToFloat ((const SInt32*)theData, theFloats, theCount, 1.f / kFixed8_24Scale);
+				break;
+		}
+
+		if (theStride > 1) {
+			for (UInt32 c = 0; c < theBufferChannels; ++c) {
+				const Float32 *theSource = theFloats + c;
+				Float32 *theDest = outChannels[theChannel + c];
+				for (UInt32 i = 0; i < inFrames; ++i, theSource += theStride)
+					theDest[i] = *theSource;
+			}
+		}
+		theChannel += theBufferChannels;
+	}
+
+	// a list with fewer channels than the format says is read as silence
+	for (; theChannel < mSourceChannels; ++theChannel)
+		memset (outChannels[theChannel], 0, inFrames * sizeof(Float32));
+}
+
+UInt32	CAPCMConverter::Resample (UInt32 inFrames, UInt32 inMaxFrames)
+{
+	const DotProc theDot = GetPCMKernels().mDot;
+	const UInt32 theHistory = mTaps - 1;
+	const UInt32 theEnd = theHistory + inFrames;
+	UInt32 thePosition = mPosition;
+	UInt32 thePhase = mPhase;
+	UInt32 theFrames = 0;
+
+	while (thePosition < theEnd && theFrames < inMaxFrames) {
+		const Float32 *theCoefficients = &mCoefficients[thePhase * mTaps];
+		for (UInt32 c = 0; c < mDestinationChannels; ++c)
+			mOutputPlanes[c][theFrames] = theDot (mMixedPlanes[c] + thePosition - theHistory, theCoefficients, mTaps);
+		++theFrames;
+		thePhase += mDecimation;
+		thePosition += thePhase / mInterpolation;
+		thePhase %= mInterpolation;
+	}
+
+	// keep the last inputs as history for the next slice
+	for (UInt32 c = 0; c < mDestinationChannels; ++c)
+		memmove (mMixedPlanes[c], mMixedPlanes[c] + inFrames, theHistory * sizeof(Float32));
+	mPosition = std::max (thePosition, theEnd) - inFrames;
+	mPhase = thePhase;
+	return theFrames;
+}
+
+void	CAPCMConverter::Encode (Float32 *const *inChannels, UInt32 inFrames, AudioBufferList &ioDestination, UInt32 inOffset)
+{
+	const CAPCMKernels &theKernels = GetPCMKernels();
+	const UInt32 theSampleSize = SampleSize (mDestinationSampleFormat);
+	UInt32 theChannel = 0;
+
+	for (UInt32 b = 0; b < ioDestination.mNumberBuffers && theChannel < mDestinationChannels; ++b) {
+		AudioBuffer &theBuffer = ioDestination.mBuffers[b];
+		UInt32 theBufferChannels = std::min (theBuffer.mNumberChannels, mDestinationChannels - theChannel);
+		UInt32 theStride = theBuffer.mNumberChannels;
+		if (theBufferChannels == 0)
+			continue;
+
+		void *theData = (Byte*)theBuffer.mData + (inOffset * theStride * theSampleSize);
+		UInt32 theCount = inFrames * theStride;
+		const Float32 *theFloats = inChannels[theChannel];
+
+		if (theStride > 1) {
+			// interleave straight into a Float32 destination, otherwise into scratch to convert in one pass
+			Float32 *theInterleaved = (mDestinationSampleFormat == kSample_Float32) ? (Float32*)theData : &mInterleaved[0];
+			if (theBufferChannels < theStride)
+				memset (theInterleaved, 0, theCount * sizeof(Float32));
+			for (UInt32 c = 0; c < theBufferChannels; ++c) {
+				const Float32 *theSource = inChannels[theChannel + c];
+				Float32 *theDest = theInterleaved + c;
+				for (UInt32 i = 0; i < inFrames; ++i, theDest += theStride)
+					*theDest = theSource[i];
+			}
+			theFloats = theInterleaved;
+		}
+
+		switch (mDestinationSampleFormat) {
+			case kSample_Float32:
+				if (theFloats != theData)
+					memcpy (theData, theFloats, theCount * sizeof(Float32));
+				break;
+			case kSample_SInt16:
+				theKernels.mFloatToSInt16 (theFloats, (SInt16*)theData, theCount);
+				break;
+			case kSample_SInt32:
+				theKernels.mFloatToSInt32 (theFloats, (SInt32*)theData, theCount, kSInt32Scale);
+				break;
+			case kSample_Fixed8_24:
+				theKernels.mFloatToSInt32 (theFloats, (SInt32*)theData, theCount, kFixed8_24Scale);
+				break;
+		}
+		theBuffer.mDataByteSize = (inOffset + inFrames) * theStride * theSampleSize;
+		theChannel += theBufferChannels;
+	}
+}
+
+UInt32	CAPCMConverter::Convert (const AudioBufferList &inSource, UInt32 inSourceFrames, AudioBufferList &ioDestination)
+{
+	if (mMaxSourceFrames == 0)
+		return 0;
+
+	// how many frames the destination buffers have room for
+	const UInt32 theSampleSize = SampleSize (mDestinationSampleFormat);
+	UInt32 theCapacity = 0xFFFFFFFF;
+	for (UInt32 b = 0; b < ioDestination.mNumberBuffers; ++b) {
+		UInt32 theFrameSize = ioDestination.mBuffers[b].mNumberChannels * theSampleSize;
+		if (theFrameSize)
+			theCapacity = std::min (theCapacity, ioDestination.mBuffers[b].mDataByteSize / theFrameSize);
+	}
+
+	const CAPCMKernels &theKernels = GetPCMKernels();
+	const UInt32 theHistory = IsSampleRateConverting() ? mTaps - 1 : 0;
+	UInt32 theSourceOffset = 0, theDestinationOffset = 0;
+
+	while (theSourceOffset < inSourceFrames) {
+		UInt32 theFrames = std::min (inSourceFrames - theSourceOffset, mMaxSourceFrames);
+
+		// decode straight into the mix when the matrix is the identity
+		if (mIdentityMatrix) {
+			for (UInt32 c = 0; c < mDestinationChannels; ++c)
+				mSourcePlanes[c] = mMixedPlanes[c] + theHistory;
+			Decode (inSource, theSourceOffset, theFrames, &mSourcePlanes[0]);
+		} else {
+			for (UInt32 c = 0; c < mSourceChannels; ++c)
+				mSourcePlanes[c] = &mSourceChannelData[c * mMaxSourceFrames];
+			Decode (inSource, theSourceOffset, theFrames, &mSourcePlanes[0]);
+			for (UInt32 out = 0; out < mDestinationChannels; ++out) {
+				Float32 *theMix = mMixedPlanes[out] + theHistory;
+				memset (theMix, 0, theFrames * sizeof(Float32));
+				for (UInt32 in = 0; in < mSourceChannels; ++in) {
+					Float32 theGain = mMatrix[out * mSourceChannels + in];
+					if (theGain != 0.f)
+						theKernels.mMixAdd (theMix, mSourcePlanes[in], theFrames, theGain);
+				}
+			}
+		}
+
+		UInt32 theRoom = (theCapacity > theDestinationOffset) ? theCapacity - theDestinationOffset : 0;
+		UInt32 theOutputFrames = IsSampleRateConverting() ? Resample (theFrames, theRoom) : std::min (theFrames, theRoom);
+
+		Encode (&mOutputPlanes[0], theOutputFrames, ioDestination, theDestinationOffset);
+		theDestinationOffset += theOutputFrames;
+		theSourceOffset += theFrames;
+	}
+	return theDestinationOffset;
+}
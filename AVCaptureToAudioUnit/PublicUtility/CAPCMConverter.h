@@ -0,0 +1,152 @@
+/*
+     File: CAPCMConverter.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#ifndef __CAPCMConverter_h__
+#define __CAPCMConverter_h__
+
+#include "CAStreamBasicDescription.h"
+#include <vector>
+
+// ____________________________________________________________________________
+//
+//	CAPCMConverter - a streaming converter between two linear PCM formats.
+// Handles native endian, packed SInt16, SInt32, Float32 and 8.24 samples, interleaved
+// or not, a channel matrix for up and down mixing, and a polyphase windowed sinc
+// sample rate converter for rates with a rational ratio.
+// Initialize does all the allocation; Convert can be called from a render thread.
+class CAPCMConverter {
+public:
+								// filter length in samples at the lower of the two rates; High reaches about
+								// 87 dB of stopband at its Nyquist rate, Medium about 70
+	enum {
+		kQuality_Medium = 32,
+		kQuality_High = 64
+	};
+
+										CAPCMConverter ();
+										~CAPCMConverter();
+
+								// NOT real-time safe. Returns false if either format isn't one of the supported
+								// PCM formats or the sample rate ratio needs too many filter phases.
+								// inMaxSourceFrames is the slice size; Convert takes longer runs in slices
+	bool								Initialize (const CAStreamBasicDescription &inSourceFormat,
+													const CAStreamBasicDescription &inDestinationFormat,
+													UInt32 inMaxSourceFrames = 4096,
+													UInt32 inQuality = kQuality_High);
+	void								Deallocate ();
+
+								// real-time safe. Clears the sample rate converter's history
+	void								Reset ();
+
+								// inMatrix has destination channels rows of source channels gains.
+								// The default copies matching channels, spreads mono to every output and
+								// averages down to mono
+	void								SetChannelMatrix (const Float32 *inMatrix);
+
+								// the most frames Convert can write for inSourceFrames of input
+	UInt32								MaxDestinationFrames (UInt32 inSourceFrames) const;
+
+								// real-time safe. Converts inSourceFrames from inSource, writes the result to
+								// ioDestination's buffers, sets their byte sizes and returns the frames written.
+								// ioDestination needs room for MaxDestinationFrames (inSourceFrames); output that
+								// doesn't fit in its byte sizes is dropped
+	UInt32								Convert (const AudioBufferList &inSource, UInt32 inSourceFrames, AudioBufferList &ioDestination);
+
+	bool								IsSampleRateConverting() const { return mInterpolation != mDecimation; }
+								// source frames of delay added by the sample rate converter
+	UInt32								GetLatencyFrames() const { return IsSampleRateConverting() ? mTaps / 2 : 0; }
+	const CAStreamBasicDescription&		GetSourceFormat() const { return mSourceFormat; }
+	const CAStreamBasicDescription&		GetDestinationFormat() const { return mDestinationFormat; }
+
+private:
+	enum {
+		kSample_Float32,
+		kSample_SInt16,
+		kSample_SInt32,
+		kSample_Fixed8_24
+	};
+	static UInt32				SampleSize (UInt32 inSampleFormat) { return (inSampleFormat == kSample_SInt16) ? sizeof(SInt16) : sizeof(SInt32); }
+	static bool					IdentifySampleFormat (const CAStreamBasicDescription &inFormat, UInt32 &outSampleFormat);
+	void						DesignFilter ();
+	void						Decode (const AudioBufferList &inSource, UInt32 inOffset, UInt32 inFrames, Float32 **outChannels);
+	UInt32						Resample (UInt32 inFrames, UInt32 inMaxFrames);
+	void						Encode (Float32 *const *inChannels, UInt32 inFrames, AudioBufferList &ioDestination, UInt32 inOffset);
+
+	CAStreamBasicDescription	mSourceFormat;
+	CAStreamBasicDescription	mDestinationFormat;
+	UInt32						mSourceSampleFormat;
+	UInt32						mDestinationSampleFormat;
+	UInt32						mSourceChannels;
+	UInt32						mDestinationChannels;
+	UInt32						mMaxSourceFrames;
+	UInt32						mMaxResampledFrames;
+
+	std::vector<Float32>		mMatrix;
+	bool						mIdentityMatrix;
+
+	// sample rate conversion by mInterpolation / mDecimation, with mTaps per phase
+	UInt32						mInterpolation;
+	UInt32						mDecimation;
+	UInt32						mQuality;
+	UInt32						mTaps;
+	UInt32						mPhase;
+	UInt32						mPosition;			// next input sample, counting the history
+	std::vector<Float32>		mCoefficients;		// mInterpolation phases of mTaps, time reversed
+
+	std::vector<Float32>		mInterleaved;		// scratch for interleaved buffers
+	std::vector<Float32>		mSourceChannelData;	// decoded source channels when mixing
+	std::vector<Float32>		mMixed;				// per destination channel: history then the slice
+	std::vector<Float32>		mResampled;			// per destination channel, when converting the rate
+	std::vector<Float32*>		mSourcePlanes;
+	std::vector<Float32*>		mMixedPlanes;
+	std::vector<Float32*>		mOutputPlanes;
+
+// don't want to copy these
+	CAPCMConverter (const CAPCMConverter &c);
+	CAPCMConverter& operator= (const CAPCMConverter& c);
+};
+
+#endif // __CAPCMConverter_h__
@@ -0,0 +1,323 @@
+/*
+     File: CARingBuffer.cpp 
+ Abstract:  CARingBuffer.h  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#include "CARingBuffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#if defined(__APPLE__)
+	#include <libkern/OSAtomic.h>
+#endif
+
+CARingBuffer::CARingBuffer ()
+		: mBuffers (NULL),
+		  mNumberBuffers (0),
+		  mBytesPerFrame (0),
+		  mBytesPerBuffer (0),
+		  mCapacityFrames (0),
+		  mCapacityMask (0),
+		  mStartTime (0),
+		  mEndTime (0),
+		  mReadTime (0),
+		  mOverruns (0),
+		  mUnderruns (0),
+		  mRestartTime (0),
+		  mRestarts (0),
+		  mRestartsHandled (0)
+{
+}
+
+CARingBuffer::~CARingBuffer()
+{
+	Deallocate();
+}
+
+// _____________________________________________________________________________
+//
+bool	CARingBuffer::Allocate (UInt32 inNumberBuffers, UInt32 inBytesPerFrame, UInt32 inCapacityFrames)
+{
+	Deallocate();
+	if (inNumberBuffers == 0 || inBytesPerFrame == 0 || inCapacityFrames == 0 || inCapacityFrames > 0x40000000)
+		return false;
+
+	// a power of 2 so a sample time maps to a frame with a mask
+	UInt32 theCapacity = 1;
+	while (theCapacity < inCapacityFrames)
+		theCapacity <<= 1;
+
+	mBuffers = static_cast<Byte*>(calloc (inNumberBuffers, (size_t)theCapacity * inBytesPerFrame));
+	if (mBuffers == NULL)
+		return false;
+
+	mNumberBuffers = inNumberBuffers;
+	mBytesPerFrame = inBytesPerFrame;
+	mBytesPerBuffer = theCapacity * inBytesPerFrame;
+	mCapacityFrames = theCapacity;
+	mCapacityMask = theCapacity - 1;
+	mStartTime = mEndTime = mReadTime = mRestartTime = 0;
+	mRestarts = mRestartsHandled = 0;
+	ResetCounts();
+	return true;
+}
+
+void	CARingBuffer::Deallocate ()
+{
+	free (mBuffers);
+	mBuffers = NULL;
+	mNumberBuffers = 0;
+	mBytesPerFrame = 0;
+	mBytesPerBuffer = 0;
+	mCapacityFrames = 0;
+	mCapacityMask = 0;
+	mStartTime = mEndTime = mReadTime = mRestartTime = 0;
+	mRestarts = mRestartsHandled = 0;
+}
+
+// _____________________________________________________________________________
+//
+//	64 bit loads and stores aren't atomic on every architecture we build for, so the
+// sample times always go through these; both have barriers.
+SampleTime	CARingBuffer::LoadTime (const volatile SampleTime *inTime)
+{
+	volatile SampleTime *theTime = const_cast<volatile SampleTime*>(inTime);
+#if defined(__APPLE__)
+	return OSAtomicAdd64Barrier (0, (volatile int64_t*)theTime);
+#else
+	return __sync_add_and_fetch (theTime, 0);
+#endif
+}
+
+void	CARingBuffer::StoreTime (volatile SampleTime *ioTime, SampleTime inValue)
+{
+	SampleTime theOld;
+	do {
+		theOld = *ioTime;
+#if defined(__APPLE__)
+	} while (!OSAtomicCompareAndSwap64Barrier (theOld, inValue, (volatile int64_t*)ioTime));
+#else
+	} while (!__sync_bool_compare_and_swap (ioTime, theOld, inValue));
+#endif
+}
+
+// _____________________________________________________________________________
+//
+//	A span of frames never crosses the end of the buffers more than once, as it is
+// never longer than the capacity.
+void	CARingBuffer::CopyIn (const AudioBufferList *inList, UInt32 inListOffset, SampleTime inStartTime, UInt32 inNumberFrames)
+{
+	UInt32 theFrame = (UInt32)(inStartTime & mCapacityMask);
+	UInt32 theFirst = std::min (inNumberFrames, mCapacityFrames - theFrame);
+	UInt32 theBuffers = std::min (inList->mNumberBuffers, mNumberBuffers);
+
+	for (UInt32 b = 0; b < theBuffers; ++b) {
+		const Byte *theSource = static_cast<const Byte*>(inList->mBuffers[b].mData) + (inListOffset * mBytesPerFrame);
+		Byte *theDest = BufferAt (b);
+		memcpy (theDest + (theFrame * mBytesPerFrame), theSource, theFirst * mBytesPerFrame);
+		memcpy (theDest, theSource + (theFirst * mBytesPerFrame), (inNumberFrames - theFirst) * mBytesPerFrame);
+	}
+}
+
+void	CARingBuffer::CopyOut (AudioBufferList *ioList, UInt32 inListOffset, SampleTime inStartTime, UInt32 inNumberFrames) const
+{
+	UInt32 theFrame = (UInt32)(inStartTime & mCapacityMask);
+	UInt32 theFirst = std::min (inNumberFrames, mCapacityFrames - theFrame);
+	UInt32 theBuffers = std::min (ioList->mNumberBuffers, mNumberBuffers);
+
+	for (UInt32 b = 0; b < theBuffers; ++b) {
+		Byte *theDest = static_cast<Byte*>(ioList->mBuffers[b].mData) + (inListOffset * mBytesPerFrame);
+		const Byte *theSource = BufferAt (b);
+		memcpy (theDest, theSource + (theFrame * mBytesPerFrame), theFirst * mBytesPerFrame);
+		memcpy (theDest + (theFirst * mBytesPerFrame), theSource, (inNumberFrames - theFirst) * mBytesPerFrame);
+	}
+}
+
+void	CARingBuffer::ZeroOut (AudioBufferList *ioList, UInt32 inListOffset, UInt32 inNumberFrames) const
+{
+	for (UInt32 b = 0; b < ioList->mNumberBuffers; ++b)
+		memset (static_cast<Byte*>(ioList->mBuffers[b].mData) + (inListOffset * mBytesPerFrame), 0, inNumberFrames * mBytesPerFrame);
+}
+
+void	CARingBuffer::ZeroRange (SampleTime inStartTime, UInt32 inNumberFrames)
+{
+	UInt32 theFrame = (UInt32)(inStartTime & mCapacityMask);
+	UInt32 theFirst = std::min (inNumberFrames, mCapacityFrames - theFrame);
+
+	for (UInt32 b = 0; b < mNumberBuffers; ++b) {
+		memset (BufferAt (b) + (theFrame * mBytesPerFrame), 0, theFirst * mBytesPerFrame);
+		memset (BufferAt (b), 0, (inNumberFrames - theFirst) * mBytesPerFrame);
+	}
+}
+
+// _____________________________________________________________________________
+//
+CARingBufferError	CARingBuffer::Store (const AudioBufferList *inList, UInt32 inNumberFrames, SampleTime inStartTime)
+{
+	if (inNumberFrames == 0)
+		return kCARingBufferError_OK;
+	if (inNumberFrames > mCapacityFrames)
+		return kCARingBufferError_TooMuch;
+
+	// only this side writes the bounds, so they can't change under us
+	SampleTime theStart = mStartTime;
+	SampleTime theEnd = mEndTime;
+	SampleTime theNewEnd = inStartTime + inNumberFrames;
+
+	if (theStart >= theEnd || inStartTime < theEnd || inStartTime - theEnd >= mCapacityFrames) {
+		// empty, time went backwards, or a gap longer than the buffer: start over at inStartTime.
+		// Publish an empty buffer at the old end first, then move the bound on the far side of
+		// inStartTime before the other, so a fetch never sees a span holding stale frames. A
+		// fetch that overlaps the move sees mRestarts change, and the consumer's read time,
+		// which could be left ahead of the new data, goes to mRestartTime
+		StoreTime (&mRestartTime, inStartTime);
+		__sync_fetch_and_add (&mRestarts, 1);
+		StoreTime (&mStartTime, theEnd);
+		if (inStartTime < theEnd) {
+			StoreTime (&mEndTime, inStartTime);
+			StoreTime (&mStartTime, inStartTime);
+		} else {
+			StoreTime (&mStartTime, inStartTime);
+			StoreTime (&mEndTime, inStartTime);
+		}
+		__sync_fetch_and_add (&mRestarts, 1);
+		theStart = theEnd = inStartTime;
+	}
+
+	// make room, before overwriting anything a fetch could be copying
+	SampleTime theNewStart = std::max (theStart, theNewEnd - (SampleTime)mCapacityFrames);
+	if (theNewStart > theStart) {
+		if (GetReadTime() < theNewStart)
+			__sync_fetch_and_add (&mOverruns, 1);
+		StoreTime (&mStartTime, theNewStart);
+	}
+
+	// a short gap since the last store reads as silence
+	if (inStartTime > theEnd)
+		ZeroRange (theEnd, (UInt32)(inStartTime - theEnd));
+	CopyIn (inList, 0, inStartTime, inNumberFrames);
+
+	StoreTime (&mEndTime, theNewEnd);
+	return kCARingBufferError_OK;
+}
+
+CARingBufferError	CARingBuffer::Fetch (AudioBufferList *ioList, UInt32 inNumberFrames, SampleTime inStartTime)
+{
+	if (inNumberFrames > mCapacityFrames)
+		return kCARingBufferError_TooMuch;
+
+	// a restart in progress reads as nothing stored; a finished one that we haven't seen yet
+	// moves our read time to where the producer started over
+	UInt32 theRestarts = __sync_add_and_fetch (&mRestarts, 0);
+	if (!(theRestarts & 1) && theRestarts != mRestartsHandled) {
+		StoreTime (&mReadTime, LoadTime (&mRestartTime));
+		mRestartsHandled = theRestarts;
+	}
+
+	CARingBufferError theResult = kCARingBufferError_OK;
+	SampleTime theEnd = LoadTime (&mEndTime);
+	SampleTime theStart = LoadTime (&mStartTime);
+	if (theRestarts & 1)
+		theStart = theEnd;
+	SampleTime theFetchEnd = inStartTime + inNumberFrames;
+	SampleTime theValidStart = std::max (inStartTime, theStart);
+	SampleTime theValidEnd = std::min (theFetchEnd, theEnd);
+	bool theMissedFrames = (theValidStart != inStartTime || theValidEnd != theFetchEnd);
+
+	if (theValidStart >= theValidEnd) {
+		ZeroOut (ioList, 0, inNumberFrames);
+	} else {
+		UInt32 theHead = (UInt32)(theValidStart - inStartTime);
+		UInt32 theValidFrames = (UInt32)(theValidEnd - theValidStart);
+		ZeroOut (ioList, 0, theHead);
+		CopyOut (ioList, theHead, theValidStart, theValidFrames);
+		ZeroOut (ioList, theHead + theValidFrames, (UInt32)(theFetchEnd - theValidEnd));
+
+		// anything the producer made room over while we were copying may be torn, and after a
+		// restart all of it may be
+		SampleTime theStartNow = LoadTime (&mStartTime);
+		if (__sync_add_and_fetch (&mRestarts, 0) != theRestarts) {
+			ZeroOut (ioList, theHead, theValidFrames);
+			theMissedFrames = true;
+			theResult = kCARingBufferError_CPUOverload;
+		} else if (theStartNow > theValidStart) {
+			ZeroOut (ioList, theHead, (UInt32)(std::min (theStartNow, theValidEnd) - theValidStart));
+			theMissedFrames = true;
+			theResult = kCARingBufferError_CPUOverload;
+		}
+	}
+
+	if (theMissedFrames)
+		__sync_fetch_and_add (&mUnderruns, 1);
+	if (theFetchEnd > mReadTime)
+		StoreTime (&mReadTime, theFetchEnd);
+
+	for (UInt32 b = 0; b < ioList->mNumberBuffers; ++b)
+		ioList->mBuffers[b].mDataByteSize = inNumberFrames * mBytesPerFrame;
+	return theResult;
+}
+
+// _____________________________________________________________________________
+//
+void	CARingBuffer::GetTimeBounds (SampleTime &outStartTime, SampleTime &outEndTime) const
+{
+	// the end is read first, so the span is never one the producer hasn't written yet
+	outEndTime = LoadTime (&mEndTime);
+	outStartTime = std::min (LoadTime (&mStartTime), outEndTime);
+}
+
+UInt32	CARingBuffer::GetFillLevel () const
+{
+	SampleTime theStart, theEnd;
+	GetTimeBounds (theStart, theEnd);
+	SampleTime theFrom = std::max (theStart, GetReadTime());
+	return (theEnd > theFrom) ? (UInt32)(theEnd - theFrom) : 0;
+}
+
+SampleTime	CARingBuffer::GetReadTime () const
+{
+	// the consumer stores mReadTime before it marks the restart handled
+	UInt32 theRestarts = __sync_add_and_fetch (const_cast<volatile UInt32*>(&mRestarts), 0);
+	return (theRestarts != mRestartsHandled) ? LoadTime (&mRestartTime) : LoadTime (&mReadTime);
+}
@@ -0,0 +1,144 @@
+/*
+     File: CARingBuffer.h 
+ Abstract:  Part of CoreAudio Utility Classes  
+  Version: 1.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2012 Apple Inc. All Rights Reserved. 
+  
+*/
+#ifndef __CARingBuffer_h__
+#define __CARingBuffer_h__
+
+#if !defined(__COREAUDIO_USE_FLAT_INCLUDES__)
+	#include <CoreAudio/CoreAudioTypes.h>
+#else
+	#include <CoreAudioTypes.h>
+#endif
+
+typedef SInt64 SampleTime;
+
+enum {
+	kCARingBufferError_OK = 0,
+	kCARingBufferError_TooMuch = 3,		// fetch/store size is greater than the buffer capacity
+	kCARingBufferError_CPUOverload = 4	// the writer overwrote some of the frames while they were being fetched
+};
+typedef SInt32 CARingBufferError;
+
+// ____________________________________________________________________________
+//
+//	CARingBuffer - a single producer, single consumer audio FIFO addressed by sample time.
+// The producer stores each buffer at the sample time it belongs to; the consumer fetches
+// whatever span of time it needs, in whatever slice size it likes, so the two sides don't
+// have to agree on a buffer size. Store and Fetch are lock-free and don't allocate.
+// When the producer gets more than the capacity ahead the oldest frames are overwritten;
+// frames that are fetched before they have been stored, or after they were overwritten,
+// come back as silence. Both cases are counted. When the producer's time goes backwards or
+// jumps by more than the capacity it starts over, and posts the new start to the consumer,
+// which moves its read time there with its next fetch.
+class CARingBuffer {
+public:
+										CARingBuffer ();
+										~CARingBuffer();
+
+								// NOT real-time safe. inNumberBuffers buffers of inBytesPerFrame each, as in the
+								// AudioBufferLists that will be stored; the capacity is rounded up to a power of 2
+	bool								Allocate (UInt32 inNumberBuffers, UInt32 inBytesPerFrame, UInt32 inCapacityFrames);
+	void								Deallocate ();
+
+								// producer side
+	CARingBufferError					Store (const AudioBufferList *inList, UInt32 inNumberFrames, SampleTime inStartTime);
+
+								// consumer side. ioList's buffers need inNumberFrames of room; their byte sizes are set
+	CARingBufferError					Fetch (AudioBufferList *ioList, UInt32 inNumberFrames, SampleTime inStartTime);
+
+								// either side. The span of sample times currently held, empty if start == end
+	void								GetTimeBounds (SampleTime &outStartTime, SampleTime &outEndTime) const;
+								// frames stored after the end of the last fetch
+	UInt32								GetFillLevel () const;
+								// the end of the last fetch, where a consumer reading in order carries on, or the
+								// producer's new start time if it has started over since
+	SampleTime							GetReadTime () const;
+
+	UInt32								GetCapacityFrames () const { return mCapacityFrames; }
+								// Stores that overwrote frames the consumer hadn't fetched yet
+	UInt32								GetOverrunCount () const { return mOverruns; }
+								// Fetches that got silence for frames not stored yet, or overwritten
+	UInt32								GetUnderrunCount () const { return mUnderruns; }
+	void								ResetCounts () { mOverruns = mUnderruns = 0; }
+
+private:
+	Byte*						BufferAt (UInt32 inBuffer) const { return mBuffers + (inBuffer * mBytesPerBuffer); }
+	void						CopyIn (const AudioBufferList *inList, UInt32 inListOffset, SampleTime inStartTime, UInt32 inNumberFrames);
+	void						CopyOut (AudioBufferList *ioList, UInt32 inListOffset, SampleTime inStartTime, UInt32 inNumberFrames) const;
+	void						ZeroOut (AudioBufferList *ioList, UInt32 inListOffset, UInt32 inNumberFrames) const;
+	void						ZeroRange (SampleTime inStartTime, UInt32 inNumberFrames);
+
+	static SampleTime			LoadTime (const volatile SampleTime *inTime);
+	static void					StoreTime (volatile SampleTime *ioTime, SampleTime inValue);
+
+	Byte*						mBuffers;
+	UInt32						mNumberBuffers;
+	UInt32						mBytesPerFrame;
+	UInt32						mBytesPerBuffer;
+	UInt32						mCapacityFrames;
+	UInt32						mCapacityMask;
+
+	// the producer moves mStartTime up before it overwrites frames and mEndTime up after it
+	// has written them; the consumer publishes mReadTime so overruns can be counted
+	volatile SampleTime			mStartTime;
+	volatile SampleTime			mEndTime;
+	volatile SampleTime			mReadTime;
+	volatile UInt32				mOverruns;
+	volatile UInt32				mUnderruns;
+
+	// a restart sets mRestartTime and then bumps mRestarts before and after it moves the bounds,
+	// so it's odd while they move. Only the consumer writes mReadTime: it moves it to
+	// mRestartTime when mRestarts differs from mRestartsHandled
+	volatile SampleTime			mRestartTime;
+	volatile UInt32				mRestarts;
+	volatile UInt32				mRestartsHandled;
+
+// don't want to copy these
+	CARingBuffer (const CARingBuffer &c);
+	CARingBuffer& operator= (const CARingBuffer& c);
+};
+
+#endif // __CARingBuffer_h__
@@ -0,0 +1,230 @@
+/*
+     File: MYAudioStats.c
+ Abstract: Single pass RMS, peak, DC offset and zero crossing statistics for all channels of a buffer.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+#include "MYAudioStats.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "MYVec4.h"
+
+#pragma mark - Statistics
+
+typedef struct ChannelSums {
+	float sum;
+	float sumOfSquares;
+	float peak;
+	uint32_t zeroCrossings;
+} ChannelSums;
+
+static inline void AccumulateSample(ChannelSums *sums, float sample, float previous)
+{
+	sums->sum += sample;
+	sums->sumOfSquares += sample * sample;
+	sums->peak = fmaxf(sums->peak, fabsf(sample));
+	sums->zeroCrossings += ((sample < 0.0f) != (previous < 0.0f));
+}
+
+static void FinishStats(const ChannelSums *sums, uint32_t channelCount, uint32_t frameCount, MYChannelStats *outStats)
+{
+	float scale = (frameCount > 0) ? 1.0f / frameCount : 0.0f;
+	for (uint32_t channel = 0; channel < channelCount; channel++)
+	{
+		outStats[channel].rms = sqrtf(sums[channel].sumOfSquares * scale);
+		outStats[channel].peak = sums[channel].peak;
+		outStats[channel].dcOffset = sums[channel].sum * scale;
+		outStats[channel].zeroCrossings = sums[channel].zeroCrossings;
+	}
+}
+
+static inline uint32_t GreatestCommonDivisor(uint32_t a, uint32_t b)
+{
+	while (b) { uint32_t t = a % b; a = b; b = t; }
+	return a;
+}
+
+/*
+ Walks the samples after the first frame in groups of a whole number of frames that is also a whole number of vectors, so each
+ vector in a group always holds the same channels in the same lanes. That works for any channel count: stereo is two frames per
+ vector, six channels three vectors per two frames. The lanes are folded back into channels at the end. Returns the index of
+ the first sample left over.
+*/
+static inline __attribute__((always_inline)) uint32_t AccumulateGroups(const float *samples, uint32_t channelCount, uint32_t sampleCount, const uint32_t vectorsPerGroup, ChannelSums *sums)
+{
+	const uint32_t groupLength = 4 * vectorsPerGroup;
+	Vec4 sum[vectorsPerGroup], sumOfSquares[vectorsPerGroup], peak[vectorsPerGroup];
+	VecCount4 crossings[vectorsPerGroup];
+	for (uint32_t v = 0; v < vectorsPerGroup; v++)
+	{
+		sum[v] = sumOfSquares[v] = peak[v] = VZero();
+		crossings[v] = VCountZero();
+	}
+	
+	uint32_t index = channelCount;
+	for (; index + groupLength <= sampleCount; index += groupLength)
+	{
+		const float *group = samples + index;
+		for (uint32_t v = 0; v < vectorsPerGroup; v++)
+		{
+			Vec4 x = VLoad(group + 4 * v);
+			Vec4 previous = VLoad(group + 4 * v - channelCount);
+			sum[v] = VAdd(sum[v], x);
+			sumOfSquares[v] = VMulAdd(sumOfSquares[v], x, x);
+			peak[v] = VMaxAbs(peak[v], x);
+			crossings[v] = VCountCrossings(crossings[v], x, previous);
+		}
+	}
+	
+	for (uint32_t v = 0; v < vectorsPerGroup; v++)
+	{
+		float laneSum[4], laneSumOfSquares[4], lanePeak[4];
+		uint32_t laneCrossings[4];
+		VStore(laneSum, sum[v]);
+		VStore(laneSumOfSquares, sumOfSquares[v]);
+		VStore(lanePeak, peak[v]);
+		VCountStore(laneCrossings, crossings[v]);
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			ChannelSums *channelSums = &sums[(4 * v + lane) % channelCount];
+			channelSums->sum += laneSum[lane];
+			channelSums->sumOfSquares += laneSumOfSquares[lane];
+			channelSums->peak = fmaxf(channelSums->peak, lanePeak[lane]);
+			channelSums->zeroCrossings += laneCrossings[lane];
+		}
+	}
+	return index;
+}
+
+void MYAudioStatsComputeInterleaved(const float *samples, uint32_t channelCount, uint32_t frameCount, float *ioPreviousSamples, MYChannelStats *outStats)
+{
+	if (channelCount == 0)
+		return;
+	
+	ChannelSums sums[channelCount];
+	memset(sums, 0, sizeof(sums));
+	
+	if (frameCount > 0)
+	{
+		// The first frame is compared with the previous buffer; every later sample with the one channelCount floats before it.
+		for (uint32_t channel = 0; channel < channelCount; channel++)
+			AccumulateSample(&sums[channel], samples[channel], ioPreviousSamples[channel]);
+		
+		const uint32_t sampleCount = frameCount * channelCount;
+		uint32_t index = channelCount;
+		
+		if (channelCount <= kMYAudioStatsMaxChannels)
+		{
+			// Use at least four vectors per group so the adds in each lane's chain overlap, and pass the count as a constant
+			// so the accumulators stay in registers.
+			uint32_t vectorsPerGroup = channelCount / GreatestCommonDivisor(channelCount, 4);
+			vectorsPerGroup *= (4 + vectorsPerGroup - 1) / vectorsPerGroup;
+			
+			switch (vectorsPerGroup)
+			{
+				case 4:		index = AccumulateGroups(samples, channelCount, sampleCount, 4, sums); break;
+				case 5:		index = AccumulateGroups(samples, channelCount, sampleCount, 5, sums); break;
+				case 6:		index = AccumulateGroups(samples, channelCount, sampleCount, 6, sums); break;
+				case 7:		index = AccumulateGroups(samples, channelCount, sampleCount, 7, sums); break;
+				case 9:		index = AccumulateGroups(samples, channelCount, sampleCount, 9, sums); break;
+				case 11:	index = AccumulateGroups(samples, channelCount, sampleCount, 11, sums); break;
+				case 13:	index = AccumulateGroups(samples, channelCount, sampleCount, 13, sums); break;
+				case 15:	index = AccumulateGroups(samples, channelCount, sampleCount, 15, sums); break;
+			}
+		}
+		
+		// Whatever doesn't fill a whole group.
+		for (; index < sampleCount; index++)
+			AccumulateSample(&sums[index % channelCount], samples[index], samples[index - channelCount]);
+		
+		memcpy(ioPreviousSamples, samples + sampleCount - channelCount, channelCount * sizeof(float));
+	}
+	
+	FinishStats(sums, channelCount, frameCount, outStats);
+}
+
+void MYAudioStatsComputeNonInterleaved(const float * const *channels, uint32_t channelCount, uint32_t frameCount, float *ioPreviousSamples, MYChannelStats *outStats)
+{
+	// A single channel is the interleaved case with every vector holding four frames of it.
+	for (uint32_t channel = 0; channel < channelCount; channel++)
+		MYAudioStatsComputeInterleaved(channels[channel], 1, frameCount, &ioPreviousSamples[channel], &outStats[channel]);
+}
+
+#pragma mark - Publishing
+
+void MYAudioStatsPublish(MYAudioStatsPublisher *publisher, const MYChannelStats *stats, uint32_t channelCount)
+{
+	if (channelCount > kMYAudioStatsMaxChannels)
+		channelCount = kMYAudioStatsMaxChannels;
+	
+	publisher->sequence++;
+	__sync_synchronize();
+	publisher->channelCount = channelCount;
+	memcpy(publisher->stats, stats, channelCount * sizeof(MYChannelStats));
+	__sync_synchronize();
+	publisher->sequence++;
+}
+
+uint32_t MYAudioStatsRead(const MYAudioStatsPublisher *publisher, MYChannelStats *outStats, uint32_t maxChannels, uint32_t *outSequence)
+{
+	uint32_t sequence, channelCount;
+	do
+	{
+		sequence = publisher->sequence;
+		__sync_synchronize();
+		channelCount = publisher->channelCount;
+		if (channelCount > maxChannels)
+			channelCount = maxChannels;
+		memcpy(outStats, publisher->stats, channelCount * sizeof(MYChannelStats));
+		__sync_synchronize();
+	}
+	while ((sequence & 1) || sequence != publisher->sequence);
+	
+	if (outSequence)
+		*outSequence = sequence;
+	return channelCount;
+}
@@ -0,0 +1,95 @@
+/*
+     File: MYAudioStats.h
+ Abstract: Single pass RMS, peak, DC offset and zero crossing statistics for all channels of a buffer.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+#ifndef MYAudioStats_h
+#define MYAudioStats_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	kMYAudioStatsMaxChannels = 16
+};
+
+// Statistics of one channel of one buffer.
+typedef struct MYChannelStats {
+	float rms;
+	float peak;				// largest absolute sample value
+	float dcOffset;			// mean sample value
+	uint32_t zeroCrossings;	// sign changes, including the one from the previous buffer's last sample
+} MYChannelStats;
+
+// Compute the statistics of every channel in one pass over the samples. ioPreviousSamples holds each channel's last sample
+// from the previous buffer for counting zero crossings, and is updated with this buffer's; start it at zero. Up to
+// kMYAudioStatsMaxChannels channels are vectorized, more than that fall back to a scalar loop. Safe to call on a real-time
+// thread: no allocation, locks or system calls.
+void MYAudioStatsComputeInterleaved(const float *samples, uint32_t channelCount, uint32_t frameCount, float *ioPreviousSamples, MYChannelStats *outStats);
+void MYAudioStatsComputeNonInterleaved(const float * const *channels, uint32_t channelCount, uint32_t frameCount, float *ioPreviousSamples, MYChannelStats *outStats);
+
+// Hands the latest statistics from one writer thread to any number of readers without locks. The writer never waits; a
+// reader that overlaps a write just copies again. Zero it before use.
+typedef struct MYAudioStatsPublisher {
+	volatile uint32_t sequence;		// odd while a write is in progress
+	uint32_t channelCount;
+	MYChannelStats stats[kMYAudioStatsMaxChannels];
+} MYAudioStatsPublisher;
+
+void MYAudioStatsPublish(MYAudioStatsPublisher *publisher, const MYChannelStats *stats, uint32_t channelCount);
+
+// Copies up to maxChannels channels of the newest statistics and returns how many were copied, 0 if nothing has been
+// published yet. outSequence, if not NULL, gets a number that changes with every publish.
+uint32_t MYAudioStatsRead(const MYAudioStatsPublisher *publisher, MYChannelStats *outStats, uint32_t maxChannels, uint32_t *outSequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,6 +47,8 @@
 
 #import <Foundation/Foundation.h>
 
+#include "MYAudioStats.h"
+
 @class AVAudioMix;
 @class AVAssetTrack;
 
@@ -65,6 +67,9 @@
 @property (nonatomic) float centerFrequency; // [0 .. 1]
 @property (nonatomic) float bandwidth; // [0 .. 1]
 
+// Copies the stats for each channel of the most recently processed buffer. Returns the number of channels copied.
+- (NSUInteger)getChannelStats:(MYChannelStats *)outStats maxCount:(NSUInteger)maxCount;
+
 @end
 
 #pragma mark - Protocols
@@ -49,15 +49,18 @@
 
 #import <AVFoundation/AVFoundation.h>
 
+#include "MYFilterChain.h"
+
 // This struct is used to pass along data between the MTAudioProcessingTap callbacks.
 typedef struct AVAudioTapProcessorContext {
 	Boolean supportedTapProcessingFormat;
 	Boolean isNonInterleaved;
 	Float64 sampleRate;
-	AudioUnit audioUnit;
-	Float64 sampleCount;
-	float leftChannelVolume;
-	float rightChannelVolume;
+	UInt32 channelCount;
+	MYFilterChain *filterChain;
+	float previousSamples[kMYAudioStatsMaxChannels];
+	MYChannelStats stats[kMYAudioStatsMaxChannels];
+	MYAudioStatsPublisher statsPublisher;
 	void *self;
 } AVAudioTapProcessorContext;
 
@@ -68,12 +71,25 @@ static void tap_PrepareCallback(MTAudioProcessingTapRef tap, CMItemCount maxFram
 static void tap_UnprepareCallback(MTAudioProcessingTapRef tap);
 static void tap_ProcessCallback(MTAudioProcessingTapRef tap, CMItemCount numberFrames, MTAudioProcessingTapFlags flags, AudioBufferList *bufferListInOut, CMItemCount *numberFramesOut, MTAudioProcessingTapFlags *flagsOut);
 
-// Audio Unit callbacks.
-static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData);
+// Interval at which the published channel stats are forwarded to the delegate.
+static const NSTimeInterval kMYStatsUpdateInterval = 1.0 / 30.0;
+
+// Map the [0 .. 1] centerFrequency and bandwidth properties to the bandpass filter parameters.
+static inline float MYBandpassCenterFrequency(float centerFrequency, Float64 sampleRate)
+{
+	return (20.0f + ((sampleRate * 0.5f) - 20.0f) * centerFrequency); // Hz, 20->(SampleRate/2), 5000
+}
+
+static inline float MYBandpassBandwidth(float bandwidth)
+{
+	return (100.0f + 11900.0f * bandwidth); // Cents, 100->12000, 600
+}
 
 @interface MYAudioTapProcessor ()
 {
 	AVAudioMix *_audioMix;
+	dispatch_source_t _statsTimer;
+	uint32_t _lastStatsSequence;
 }
 @end
 
@@ -95,6 +111,12 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 	return self;
 }
 
+- (void)dealloc
+{
+	if (_statsTimer)
+		dispatch_source_cancel(_statsTimer);
+}
+
 #pragma mark - Properties
 
 - (AVAudioMix *)audioMix
@@ -127,6 +149,8 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 					audioMix.inputParameters = @[audioMixInputParameters];
 					
 					_audioMix = audioMix;
+					
+					[self startStatsTimer];
 				}
 			}
 		}
@@ -135,6 +159,28 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 	return _audioMix;
 }
 
+- (void)setEnableBandpassFilter:(BOOL)enableBandpassFilter
+{
+	if (_enableBandpassFilter != enableBandpassFilter)
+	{
+		_enableBandpassFilter = enableBandpassFilter;
+		
+		AVAudioMix *audioMix = self.audioMix;
+		if (audioMix)
+		{
+			// Get pointer to filter chain stored in MTAudioProcessingTap context.
+			MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)audioMix.inputParameters[0]).audioTapProcessor;
+			AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
+			MYFilterChain *filterChain = context->filterChain;
+			if (filterChain)
+			{
+				// Enable or disable the bandpass (the chain crossfades it in or out).
+				MYFilterChainSetBandpassEnabled(filterChain, self.isBandpassFilterEnabled);
+			}
+		}
+	}
+}
+
 - (void)setCenterFrequency:(float)centerFrequency
 {
 	if (_centerFrequency != centerFrequency)
@@ -144,17 +190,14 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 		AVAudioMix *audioMix = self.audioMix;
 		if (audioMix)
 		{
-			// Get pointer to Audio Unit stored in MTAudioProcessingTap context.
+			// Get pointer to filter chain stored in MTAudioProcessingTap context.
 			MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)audioMix.inputParameters[0]).audioTapProcessor;
 			AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
-			AudioUnit audioUnit = context->audioUnit;
-			if (audioUnit)
+			MYFilterChain *filterChain = context->filterChain;
+			if (filterChain)
 			{
-				// Update center frequency of bandpass filter Audio Unit.
-				Float32 newCenterFrequency = (20.0f + ((context->sampleRate * 0.5f) - 20.0f) * self.centerFrequency); // Global, Hz, 20->(SampleRate/2), 5000
-				OSStatus status = AudioUnitSetParameter(audioUnit, kBandpassParam_CenterFrequency, kAudioUnitScope_Global, 0, newCenterFrequency, 0);
-				if (noErr != status)
-					NSLog(@"AudioUnitSetParameter(kBandpassParam_CenterFrequency): %d", (int)status);
+				// Update center frequency of bandpass filter (the chain glides to it).
+				MYFilterChainSetBandpassCenterFrequency(filterChain, MYBandpassCenterFrequency(self.centerFrequency, context->sampleRate));
 			}
 		}
 	}
@@ -169,17 +212,14 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 		AVAudioMix *audioMix = self.audioMix;
 		if (audioMix)
 		{
-			// Get pointer to Audio Unit stored in MTAudioProcessingTap context.
+			// Get pointer to filter chain stored in MTAudioProcessingTap context.
 			MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)audioMix.inputParameters[0]).audioTapProcessor;
 			AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
-			AudioUnit audioUnit = context->audioUnit;
-			if (audioUnit)
+			MYFilterChain *filterChain = context->filterChain;
+			if (filterChain)
 			{
-				// Update bandwidth of bandpass filter Audio Unit.
-				Float32 newBandwidth = (100.0f + 11900.0f * self.bandwidth);
-				OSStatus status = AudioUnitSetParameter(audioUnit, kBandpassParam_Bandwidth, kAudioUnitScope_Global, 0, newBandwidth, 0); // Global, Cents, 100->12000, 600
-				if (noErr != status)
-					NSLog(@"AudioUnitSetParameter(kBandpassParam_Bandwidth): %d", (int)status);
+				// Update bandwidth of bandpass filter (the chain glides to it).
+				MYFilterChainSetBandpassBandwidth(filterChain, MYBandpassBandwidth(self.bandwidth));
 			}
 		}
 	}
@@ -187,18 +227,53 @@ static OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *io
 
 #pragma mark -
 
-- (void)updateLeftChannelVolume:(float)leftChannelVolume rightChannelVolume:(float)rightChannelVolume
+- (NSUInteger)getChannelStats:(MYChannelStats *)outStats maxCount:(NSUInteger)maxCount
 {
-	@autoreleasepool
+	if (!_audioMix)
+		return 0;
+	
+	// Copy the stats last published by the process callback, without blocking it.
+	MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)_audioMix.inputParameters[0]).audioTapProcessor;
+	AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
+	return MYAudioStatsRead(&context->statsPublisher, outStats, (uint32_t)MIN(maxCount, (NSUInteger)kMYAudioStatsMaxChannels), NULL);
+}
+
+- (void)startStatsTimer
+{
+	// Poll the published stats from the main queue rather than messaging it from the real-time audio thread.
+	_statsTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+	if (_statsTimer)
 	{
-		dispatch_async(dispatch_get_main_queue(), ^{
-			// Forward left and right channel volume to delegate.
-			if (self.delegate && [self.delegate respondsToSelector:@selector(audioTabProcessor:hasNewLeftChannelValue:rightChannelValue:)])
-				[self.delegate audioTabProcessor:self hasNewLeftChannelValue:leftChannelVolume rightChannelValue:rightChannelVolume];
+		__weak MYAudioTapProcessor *weakSelf = self;
+		dispatch_source_set_timer(_statsTimer, DISPATCH_TIME_NOW, (uint64_t)(kMYStatsUpdateInterval * NSEC_PER_SEC), (uint64_t)(kMYStatsUpdateInterval * NSEC_PER_SEC / 10));
+		dispatch_source_set_event_handler(_statsTimer, ^{
+			[weakSelf updateChannelVolumes];
 		});
+		dispatch_resume(_statsTimer);
 	}
 }
 
+- (void)updateChannelVolumes
+{
+	MTAudioProcessingTapRef audioProcessingTap = ((AVMutableAudioMixInputParameters *)_audioMix.inputParameters[0]).audioTapProcessor;
+	AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(audioProcessingTap);
+	
+	MYChannelStats stats[2];
+	uint32_t sequence;
+	uint32_t channelCount = MYAudioStatsRead(&context->statsPublisher, stats, 2, &sequence);
+	
+	// Nothing new since the last update (or nothing processed yet).
+	if (0 == channelCount || sequence == _lastStatsSequence)
+		return;
+	_lastStatsSequence = sequence;
+	
+	// Forward left and right channel volume to delegate; mono feeds both.
+	float leftChannelVolume = stats[0].rms;
+	float rightChannelVolume = (channelCount > 1) ? stats[1].rms : stats[0].rms;
+	if (self.delegate && [self.delegate respondsToSelector:@selector(audioTabProcessor:hasNewLeftChannelValue:rightChannelValue:)])
+		[self.delegate audioTabProcessor:self hasNewLeftChannelValue:leftChannelVolume rightChannelValue:rightChannelVolume];
+}
+
 @end
 
 #pragma mark - MTAudioProcessingTap Callbacks
@@ -211,10 +286,8 @@ static void tap_InitCallback(MTAudioProcessingTapRef tap, void *clientInfo, void
 	context->supportedTapProcessingFormat = false;
 	context->isNonInterleaved = false;
 	context->sampleRate = NAN;
-	context->audioUnit = NULL;
-	context->sampleCount = 0.0f;
-	context->leftChannelVolume = 0.0f;
-	context->rightChannelVolume = 0.0f;
+	context->channelCount = 0;
+	context->filterChain = NULL;
 	context->self = clientInfo;
 	
 	*tapStorageOut = context;
@@ -237,7 +310,7 @@ static void tap_PrepareCallback(MTAudioProcessingTapRef tap, CMItemCount maxFram
 	// Store sample rate for -setCenterFrequency:.
 	context->sampleRate = processingFormat->mSampleRate;
 	
-	/* Verify processing format (this is not needed for Audio Unit, but for RMS calculation). */
+	/* Verify processing format (both the filter chain and the RMS calculation need float samples). */
 	
 	context->supportedTapProcessingFormat = true;
 	
@@ -258,64 +331,28 @@ static void tap_PrepareCallback(MTAudioProcessingTapRef tap, CMItemCount maxFram
 		context->isNonInterleaved = true;
 	}
 	
-	/* Create bandpass filter Audio Unit */
-	
-	AudioUnit audioUnit;
+	/* Create bandpass filter chain */
 	
-	AudioComponentDescription audioComponentDescription;
-	audioComponentDescription.componentType = kAudioUnitType_Effect;
-	audioComponentDescription.componentSubType = kAudioUnitSubType_BandPassFilter;
-	audioComponentDescription.componentManufacturer = kAudioUnitManufacturer_Apple;
-	audioComponentDescription.componentFlags = 0;
-	audioComponentDescription.componentFlagsMask = 0;
+	context->channelCount = processingFormat->mChannelsPerFrame;
 	
-	AudioComponent audioComponent = AudioComponentFindNext(NULL, &audioComponentDescription);
-	if (audioComponent)
+	if (context->supportedTapProcessingFormat)
 	{
-		if (noErr == AudioComponentInstanceNew(audioComponent, &audioUnit))
+		MYFilterChain *filterChain = MYFilterChainCreate(processingFormat->mSampleRate, processingFormat->mChannelsPerFrame);
+		if (filterChain)
 		{
-			OSStatus status = noErr;
-			
-			// Set audio unit input/output stream format to processing format.
-			if (noErr == status)
-			{
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, processingFormat, sizeof(AudioStreamBasicDescription));
-			}
-			if (noErr == status)
-			{
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, processingFormat, sizeof(AudioStreamBasicDescription));
-			}
-			
-			// Set audio unit render callback.
-			if (noErr == status)
-			{
-				AURenderCallbackStruct renderCallbackStruct;
-				renderCallbackStruct.inputProc = AU_RenderCallback;
-				renderCallbackStruct.inputProcRefCon = (void *)tap;
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &renderCallbackStruct, sizeof(AURenderCallbackStruct));
-			}
-			
-			// Set audio unit maximum frames per slice to max frames.
-			if (noErr == status)
-			{
-				UInt32 maximumFramesPerSlice = maxFrames;
-				status = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maximumFramesPerSlice, (UInt32)sizeof(UInt32));
-			}
-			
-			// Initialize audio unit.
-			if (noErr == status)
-			{
-				status = AudioUnitInitialize(audioUnit);
-			}
-			
-			if (noErr != status)
-			{
-				AudioComponentInstanceDispose(audioUnit);
-				audioUnit = NULL;
-			}
-			
-			context->audioUnit = audioUnit;
+			// Start from the current settings without gliding to them.
+			MYAudioTapProcessor *self = ((__bridge MYAudioTapProcessor *)context->self);
+			MYFilterChainSetBandpassEnabled(filterChain, self.isBandpassFilterEnabled);
+			MYFilterChainSetBandpassCenterFrequency(filterChain, MYBandpassCenterFrequency(self.centerFrequency, context->sampleRate));
+			MYFilterChainSetBandpassBandwidth(filterChain, MYBandpassBandwidth(self.bandwidth));
+			MYFilterChainReset(filterChain);
 		}
+		else
+		{
+			NSLog(@"Unsupported channel count for bandpass filter: %u", (unsigned)processingFormat->mChannelsPerFrame);
+		}
+		
+		context->filterChain = filterChain;
 	}
 }
 
@@ -323,13 +360,12 @@ static void tap_UnprepareCallback(MTAudioProcessingTapRef tap)
 {
 	AVAudioTapProcessorContext *context = (AVAudioTapProcessorContext *)MTAudioProcessingTapGetStorage(tap);
 	
-	/* Release bandpass filter Audio Unit */
+	/* Release bandpass filter chain */
 	
-	if (context->audioUnit)
+	if (context->filterChain)
 	{
-		AudioUnitUninitialize(context->audioUnit);
-		AudioComponentInstanceDispose(context->audioUnit);
-		context->audioUnit = NULL;
+		MYFilterChainDispose(context->filterChain);
+		context->filterChain = NULL;
 	}
 }
 
@@ -346,79 +382,52 @@ static void tap_ProcessCallback(MTAudioProcessingTapRef tap, CMItemCount numberF
 		return;
 	}
 	
-	MYAudioTapProcessor *self = ((__bridge MYAudioTapProcessor *)context->self);
+	// Get actual audio buffers from MTAudioProcessingTap.
+	status = MTAudioProcessingTapGetSourceAudio(tap, numberFrames, bufferListInOut, flagsOut, NULL, numberFramesOut);
+	if (noErr != status)
+	{
+		NSLog(@"MTAudioProcessingTapGetSourceAudio: %d", (int)status);
+		return;
+	}
 	
-	if (self.isBandpassFilterEnabled)
+	// Apply bandpass filter chain in place. It crossfades the bandpass in and out, and leaves the audio untouched while disabled.
+	// Its settings, including whether the bandpass is enabled, are pushed in by the property setters.
+	MYFilterChain *filterChain = context->filterChain;
+	if (filterChain)
 	{
-		// Apply bandpass filter Audio Unit.
-		AudioUnit audioUnit = context->audioUnit;
-		if (audioUnit)
+		if (context->isNonInterleaved && bufferListInOut->mNumberBuffers == context->channelCount)
 		{
-			AudioTimeStamp audioTimeStamp;
-			audioTimeStamp.mSampleTime = context->sampleCount;
-			audioTimeStamp.mFlags = kAudioTimeStampSampleTimeValid;
-			
-			status = AudioUnitRender(audioUnit, 0, &audioTimeStamp, 0, (UInt32)numberFrames, bufferListInOut);
-			if (noErr != status)
-			{
-				NSLog(@"AudioUnitRender(): %d", (int)status);
-				return;
-			}
-			
-			// Increment sample count for audio unit.
-			context->sampleCount += numberFrames;
-			
-			// Set number of frames out.
-			*numberFramesOut = numberFrames;
+			float *channels[kMYFilterChainMaxChannels];
+			for (UInt32 i = 0; i < context->channelCount; i++)
+				channels[i] = (float *)bufferListInOut->mBuffers[i].mData;
+			MYFilterChainProcessNonInterleaved(filterChain, channels, (uint32_t)*numberFramesOut);
 		}
-	}
-	else
-	{
-		// Get actual audio buffers from MTAudioProcessingTap (AudioUnitRender() will fill bufferListInOut otherwise).
-		status = MTAudioProcessingTapGetSourceAudio(tap, numberFrames, bufferListInOut, flagsOut, NULL, numberFramesOut);
-		if (noErr != status)
+		else if (!context->isNonInterleaved && bufferListInOut->mNumberBuffers == 1 && bufferListInOut->mBuffers[0].mNumberChannels == context->channelCount)
 		{
-			NSLog(@"MTAudioProcessingTapGetSourceAudio: %d", (int)status);
-			return;
+			MYFilterChainProcessInterleaved(filterChain, (float *)bufferListInOut->mBuffers[0].mData, (uint32_t)*numberFramesOut);
 		}
 	}
 	
-	// Calculate root mean square (RMS) for left and right audio channel.
-	for (UInt32 i = 0; i < bufferListInOut->mNumberBuffers; i++)
+	// Calculate RMS, peak, DC offset and zero crossings for every channel in one pass, and publish them for the main queue.
+	UInt32 channelCount = 0;
+	if (context->isNonInterleaved)
 	{
-		AudioBuffer *pBuffer = &bufferListInOut->mBuffers[i];
-		UInt32 cSamples = numberFrames * (context->isNonInterleaved ? 1 : pBuffer->mNumberChannels);
-		
-		float *pData = (float *)pBuffer->mData;
-		
-		float rms = 0.0f;
-		for (UInt32 j = 0; j < cSamples; j++)
-		{
-			rms += pData[j] * pData[j];
-		}
-		if (cSamples > 0)
-		{
-			rms = sqrtf(rms / cSamples);
-		}
-		
-		if (0 == i)
-		{
-			context->leftChannelVolume = rms;
-		}
-		if (1 == i || (0 == i && 1 == bufferListInOut->mNumberBuffers))
+		channelCount = bufferListInOut->mNumberBuffers;
+		if (channelCount <= kMYAudioStatsMaxChannels)
 		{
-			context->rightChannelVolume = rms;
+			const float *channels[kMYAudioStatsMaxChannels];
+			for (UInt32 i = 0; i < channelCount; i++)
+				channels[i] = (const float *)bufferListInOut->mBuffers[i].mData;
+			MYAudioStatsComputeNonInterleaved(channels, channelCount, (uint32_t)*numberFramesOut, context->previousSamples, context->stats);
 		}
 	}
+	else if (bufferListInOut->mNumberBuffers > 0)
+	{
+		channelCount = bufferListInOut->mBuffers[0].mNumberChannels;
+		if (channelCount <= kMYAudioStatsMaxChannels)
+			MYAudioStatsComputeInterleaved((const float *)bufferListInOut->mBuffers[0].mData, channelCount, (uint32_t)*numberFramesOut, context->previousSamples, context->stats);
+	}
 	
-	// Pass calculated left and right channel volume to VU meters.
-	[self updateLeftChannelVolume:context->leftChannelVolume rightChannelVolume:context->rightChannelVolume];
-}
-
-#pragma mark - Audio Unit Callbacks
-
-OSStatus AU_RenderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData)
-{
-	// Just return audio buffers from MTAudioProcessingTap.
-	return MTAudioProcessingTapGetSourceAudio(inRefCon, inNumberFrames, ioData, NULL, NULL, NULL);
+	if (channelCount <= kMYAudioStatsMaxChannels)
+		MYAudioStatsPublish(&context->statsPublisher, context->stats, channelCount);
 }
@@ -0,0 +1,609 @@
+/*
+     File: MYFilterChain.cpp
+ Abstract: Allocation free bandpass, parametric EQ and gain chain for the audio tap, vectorized across channels.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+#include "MYFilterChain.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "MYVec4.h"
+
+#pragma mark - Filter design
+
+namespace {
+
+enum {
+	kRampFrames = 32,		// parameters glide and coefficients are redesigned once per this many frames
+	kMaxGroups = (kMYFilterChainMaxChannels + 3) / 4,
+	kBandpassSlot = 0,		// the two bandpass sections use slots 0 and 1, the EQ bands the slots after them
+	kEQSlot = 2,
+	kSlotCount = kEQSlot + kMYFilterChainMaxEQBands
+};
+
+const double kGlideSeconds = 0.02;
+
+// Read in place of a missing channel, long enough for a block at the largest interleaved stride.
+const float kSilence[kRampFrames * kMYFilterChainMaxChannels] = { 0.0f };
+
+// Normalized so a0 is 1: y = b0 x + b1 x[-1] + b2 x[-2] - a1 y[-1] - a2 y[-2].
+struct BiquadCoefficients {
+	float b0, b1, b2, a1, a2;
+};
+
+// Transposed direct form II state for four channels.
+struct BiquadState {
+	Vec4 s1, s2;
+};
+
+// One stage of a block: coefficients at its start and the change per frame when they are gliding.
+struct BlockStage {
+	Vec4 b0, b1, b2, a1, a2;
+	Vec4 db0, db1, db2, da1, da2;
+	uint32_t slot;
+};
+
+inline double ClampHertz(double hertz, double sampleRate)
+{
+	// The bandwidth warping below blows up approaching Nyquist.
+	return fmin(fmax(hertz, 10.0), 0.45 * sampleRate);
+}
+
+// Bandpass from the Audio EQ Cookbook (constant 0 dB peak), with the Q of each section narrowed so that two in cascade are
+// 3 dB down at the band edges rather than 6 dB.
+BiquadCoefficients DesignBandpassSection(double sampleRate, double hertz, double cents)
+{
+	double w0 = 2.0 * M_PI * ClampHertz(hertz, sampleRate) / sampleRate;
+	double octaves = fmin(fmax(cents, 1.0), 12000.0) / 1200.0;
+	double cascadeQ = 1.0 / (2.0 * sinh(M_LN2 / 2.0 * octaves * w0 / sin(w0)));
+	double alpha = sin(w0) / (2.0 * cascadeQ * sqrt(M_SQRT2 - 1.0));
+	double a0 = 1.0 + alpha;
+	
+	BiquadCoefficients c;
+	c.b0 = alpha / a0;
+	c.b1 = 0.0f;
+	c.b2 = -alpha / a0;
+	c.a1 = -2.0 * cos(w0) / a0;
+	c.a2 = (1.0 - alpha) / a0;
+	return c;
+}
+
+// Peaking EQ from the Audio EQ Cookbook.
+BiquadCoefficients DesignPeakingEQ(double sampleRate, double hertz, double q, double gainDB)
+{
+	double w0 = 2.0 * M_PI * ClampHertz(hertz, sampleRate) / sampleRate;
+	double A = pow(10.0, gainDB / 40.0);
+	double alpha = sin(w0) / (2.0 * fmax(q, 0.05));
+	double a0 = 1.0 + alpha / A;
+	
+	BiquadCoefficients c;
+	c.b0 = (1.0 + alpha * A) / a0;
+	c.b1 = -2.0 * cos(w0) / a0;
+	c.b2 = (1.0 - alpha * A) / a0;
+	c.a1 = c.b1;
+	c.a2 = (1.0 - alpha / A) / a0;
+	return c;
+}
+
+// |H| squared at w radians per sample.
+double MagnitudeSquared(const BiquadCoefficients &c, double w)
+{
+	double cos1 = cos(w), sin1 = sin(w), cos2 = cos(2.0 * w), sin2 = sin(2.0 * w);
+	double numeratorReal = c.b0 + c.b1 * cos1 + c.b2 * cos2, numeratorImaginary = c.b1 * sin1 + c.b2 * sin2;
+	double denominatorReal = 1.0 + c.a1 * cos1 + c.a2 * cos2, denominatorImaginary = c.a1 * sin1 + c.a2 * sin2;
+	return (numeratorReal * numeratorReal + numeratorImaginary * numeratorImaginary) / (denominatorReal * denominatorReal + denominatorImaginary * denominatorImaginary);
+}
+
+// A parameter that follows its target with a one pole lowpass, snapping to it once the rest would be inaudible.
+struct Glide {
+	float value;
+	float target;
+	float linearTarget;		// what target is the log2 of, so it is only recomputed when that changes
+	
+	void Snap() { value = target; }
+	void SetLog2Target(float newLinearTarget, float minimum)
+	{
+		if (newLinearTarget != linearTarget)
+		{
+			linearTarget = newLinearTarget;
+			target = log2f(fmaxf(newLinearTarget, minimum));
+		}
+	}
+	bool Step(float coefficient, float threshold)
+	{
+		if (value == target)
+			return false;
+		value += (target - value) * coefficient;
+		if (fabsf(target - value) <= threshold)
+			value = target;
+		return true;
+	}
+};
+
+inline BlockStage MakeBlockStage(uint32_t slot, const BiquadCoefficients &from, const BiquadCoefficients &to, float perFrame)
+{
+	BlockStage stage;
+	stage.b0 = VSplat(from.b0);
+	stage.b1 = VSplat(from.b1);
+	stage.b2 = VSplat(from.b2);
+	stage.a1 = VSplat(from.a1);
+	stage.a2 = VSplat(from.a2);
+	stage.db0 = VSplat((to.b0 - from.b0) * perFrame);
+	stage.db1 = VSplat((to.b1 - from.b1) * perFrame);
+	stage.db2 = VSplat((to.b2 - from.b2) * perFrame);
+	stage.da1 = VSplat((to.a1 - from.a1) * perFrame);
+	stage.da2 = VSplat((to.a2 - from.a2) * perFrame);
+	stage.slot = slot;
+	return stage;
+}
+
+/*
+ Runs one group of four channels through every active stage a frame at a time, rather than each stage over the whole block,
+ so that the next frame of an earlier stage can overlap the recursion of a later one. The stage count is a template
+ parameter so the loop over stages unrolls and the filter state stays in registers for the whole block. Frame i of the
+ block uses the coefficients, bandpass mix and gain reached after i + 1 steps, which lands each ramp exactly on its end value.
+*/
+template <bool kGliding, uint32_t kStageCount>
+void RunStages(float *block, uint32_t frameCount, const BlockStage *stages, BiquadState *states, uint32_t bandpassStageCount, float mixFrom, float mixStep, float gainFrom, float gainStep)
+{
+	Vec4 s1[kStageCount + 1], s2[kStageCount + 1];
+	for (uint32_t s = 0; s < kStageCount; s++)
+	{
+		s1[s] = states[stages[s].slot].s1;
+		s2[s] = states[stages[s].slot].s2;
+	}
+	
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		Vec4 x = VLoad(block + 4 * i);
+		Vec4 dry = x;
+		Vec4 steps = VSplat((float)(i + 1));
+		
+		for (uint32_t s = 0; s < kStageCount; s++)
+		{
+			const BlockStage &stage = stages[s];
+			Vec4 b0 = stage.b0, b1 = stage.b1, b2 = stage.b2, a1 = stage.a1, a2 = stage.a2;
+			if (kGliding)
+			{
+				b0 = VMulAdd(b0, stage.db0, steps);
+				b1 = VMulAdd(b1, stage.db1, steps);
+				b2 = VMulAdd(b2, stage.db2, steps);
+				a1 = VMulAdd(a1, stage.da1, steps);
+				a2 = VMulAdd(a2, stage.da2, steps);
+			}
+			
+			Vec4 y = VMulAdd(s1[s], b0, x);
+			s1[s] = VMulSub(VMulAdd(s2[s], b1, x), a1, y);
+			s2[s] = VMulSub(VMul(b2, x), a2, y);
+			x = y;
+			
+			// Crossfade between the input and the bandpass output while it is being switched on or off.
+			if (s + 1 == bandpassStageCount)
+				x = VMulAdd(dry, VSub(x, dry), VSplat(mixFrom + mixStep * (float)(i + 1)));
+		}
+		
+		VStore(block + 4 * i, VMul(x, VSplat(gainFrom + gainStep * (float)(i + 1))));
+	}
+	
+	for (uint32_t s = 0; s < kStageCount; s++)
+	{
+		states[stages[s].slot].s1 = s1[s];
+		states[stages[s].slot].s2 = s2[s];
+	}
+}
+
+template <bool kGliding>
+void RunStages(float *block, uint32_t frameCount, const BlockStage *stages, uint32_t stageCount, BiquadState *states, uint32_t bandpassStageCount, float mixFrom, float mixStep, float gainFrom, float gainStep)
+{
+	switch (stageCount)
+	{
+		case 0: RunStages<kGliding, 0>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+		case 1: RunStages<kGliding, 1>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+		case 2: RunStages<kGliding, 2>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+		case 3: RunStages<kGliding, 3>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+		case 4: RunStages<kGliding, 4>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+		case 5: RunStages<kGliding, 5>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+		case 6: RunStages<kGliding, 6>(block, frameCount, stages, states, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep); break;
+	}
+}
+
+} // namespace
+
+#pragma mark - MYFilterChain
+
+struct MYFilterChain {
+	MYFilterChain(double inSampleRate, uint32_t inChannelCount);
+	
+	void Process(float *samples, float * const *channels, uint32_t frameCount);
+	float MagnitudeResponse(float hertz);
+	
+	// Written by the setters on any thread, read once per block by the render thread.
+	volatile float		targetBandpassMix;
+	volatile float		targetBandpassHertz;
+	volatile float		targetBandpassCents;
+	volatile float		targetEQHertz[kMYFilterChainMaxEQBands];
+	volatile float		targetEQQ[kMYFilterChainMaxEQBands];
+	volatile float		targetEQGainDB[kMYFilterChainMaxEQBands];
+	volatile float		targetGainDB;
+	volatile uint32_t	resetRequests;
+	
+private:
+	uint32_t PrepareBlock(uint32_t frameCount, BlockStage *outStages, bool &outGliding, uint32_t &outBandpassStageCount, float &outMixFrom, float &outMixStep, float &outGainFrom, float &outGainStep);
+	void ClearSlot(uint32_t slot);
+	
+	double				sampleRate;
+	uint32_t			channelCount;
+	uint32_t			groupCount;
+	float				blockGlideCoefficient;
+	uint32_t			resetsHandled;
+	
+	// Render thread only. Frequencies and Q glide on a log2 scale, so a sweep moves evenly through the octaves.
+	Glide				bandpassMix;
+	Glide				bandpassLog2Hertz;
+	Glide				bandpassCents;
+	Glide				eqLog2Hertz[kMYFilterChainMaxEQBands];
+	Glide				eqLog2Q[kMYFilterChainMaxEQBands];
+	Glide				eqGainDB[kMYFilterChainMaxEQBands];
+	Glide				gainDB;
+	float				gain;
+	
+	bool				slotActive[kSlotCount];
+	BiquadCoefficients	coefficients[kSlotCount];
+	BiquadState			states[kMaxGroups][kSlotCount];
+};
+
+MYFilterChain::MYFilterChain(double inSampleRate, uint32_t inChannelCount)
+	: targetBandpassMix(0.0f), targetBandpassHertz(1000.0f), targetBandpassCents(1200.0f), targetGainDB(0.0f), resetRequests(0),
+	  sampleRate(inSampleRate), channelCount(inChannelCount), groupCount((inChannelCount + 3) / 4), resetsHandled(0), gain(1.0f)
+{
+	blockGlideCoefficient = 1.0 - exp(-kRampFrames / (kGlideSeconds * sampleRate));
+	
+	for (uint32_t band = 0; band < kMYFilterChainMaxEQBands; band++)
+	{
+		targetEQHertz[band] = 1000.0f;
+		targetEQQ[band] = 0.7071f;
+		targetEQGainDB[band] = 0.0f;
+	}
+	
+	bandpassMix.value = bandpassMix.target = targetBandpassMix;
+	bandpassLog2Hertz.linearTarget = targetBandpassHertz;
+	bandpassLog2Hertz.value = bandpassLog2Hertz.target = log2f(targetBandpassHertz);
+	bandpassCents.value = bandpassCents.target = targetBandpassCents;
+	for (uint32_t band = 0; band < kMYFilterChainMaxEQBands; band++)
+	{
+		eqLog2Hertz[band].linearTarget = targetEQHertz[band];
+		eqLog2Hertz[band].value = eqLog2Hertz[band].target = log2f(targetEQHertz[band]);
+		eqLog2Q[band].linearTarget = targetEQQ[band];
+		eqLog2Q[band].value = eqLog2Q[band].target = log2f(targetEQQ[band]);
+		eqGainDB[band].value = eqGainDB[band].target = 0.0f;
+	}
+	gainDB.value = gainDB.target = 0.0f;
+	
+	for (uint32_t slot = 0; slot < kSlotCount; slot++)
+		ClearSlot(slot);
+}
+
+void MYFilterChain::ClearSlot(uint32_t slot)
+{
+	slotActive[slot] = false;
+	for (uint32_t group = 0; group < kMaxGroups; group++)
+		states[group][slot].s1 = states[group][slot].s2 = VSplat(0.0f);
+}
+
+/*
+ Steps every glide once for the block and works out what the block has to run: returns the number of stages written to
+ outStages, bandpass sections first, and the start and per frame step of the bandpass mix and the output gain. outGliding
+ is false when no coefficients change during the block. A stage that has faded out is cleared and skipped, and one that
+ comes back starts from its current design with no ramp: a bandpass at zero mix and a peaking EQ at 0 dB can't be heard.
+*/
+uint32_t MYFilterChain::PrepareBlock(uint32_t frameCount, BlockStage *outStages, bool &outGliding, uint32_t &outBandpassStageCount, float &outMixFrom, float &outMixStep, float &outGainFrom, float &outGainStep)
+{
+	float perFrame = 1.0f / frameCount;
+	float coefficient = (frameCount == kRampFrames) ? blockGlideCoefficient : (float)(1.0 - exp(-(double)frameCount / (kGlideSeconds * sampleRate)));
+	uint32_t stageCount = 0;
+	outGliding = false;
+	
+	// Pick up the latest targets.
+	bandpassMix.target = targetBandpassMix;
+	bandpassLog2Hertz.SetLog2Target(targetBandpassHertz, 1.0f);
+	bandpassCents.target = targetBandpassCents;
+	for (uint32_t band = 0; band < kMYFilterChainMaxEQBands; band++)
+	{
+		eqLog2Hertz[band].SetLog2Target(targetEQHertz[band], 1.0f);
+		eqLog2Q[band].SetLog2Target(targetEQQ[band], 0.05f);
+		eqGainDB[band].target = targetEQGainDB[band];
+	}
+	gainDB.target = targetGainDB;
+	
+	uint32_t requests = resetRequests;
+	if (requests != resetsHandled)
+	{
+		resetsHandled = requests;
+		bandpassMix.Snap();
+		bandpassLog2Hertz.Snap();
+		bandpassCents.Snap();
+		for (uint32_t band = 0; band < kMYFilterChainMaxEQBands; band++)
+		{
+			eqLog2Hertz[band].Snap();
+			eqLog2Q[band].Snap();
+			eqGainDB[band].Snap();
+		}
+		gainDB.Snap();
+		gain = powf(10.0f, gainDB.value / 20.0f);
+		for (uint32_t slot = 0; slot < kSlotCount; slot++)
+			ClearSlot(slot);
+	}
+	
+	// Bandpass.
+	outBandpassStageCount = 0;
+	outMixFrom = bandpassMix.value;
+	bandpassMix.Step(coefficient, 1e-4f);
+	if (bandpassMix.value > 0.0f || bandpassMix.target > 0.0f)
+	{
+		bool changed = bandpassLog2Hertz.Step(coefficient, 1e-4f);
+		changed |= bandpassCents.Step(coefficient, 0.1f);
+		
+		if (changed || !slotActive[kBandpassSlot])
+		{
+			BiquadCoefficients design = DesignBandpassSection(sampleRate, exp2f(bandpassLog2Hertz.value), bandpassCents.value);
+			const BiquadCoefficients &from = slotActive[kBandpassSlot] ? coefficients[kBandpassSlot] : design;
+			outGliding |= slotActive[kBandpassSlot];
+			outStages[0] = MakeBlockStage(kBandpassSlot, from, design, perFrame);
+			outStages[1] = MakeBlockStage(kBandpassSlot + 1, from, design, perFrame);
+			coefficients[kBandpassSlot] = coefficients[kBandpassSlot + 1] = design;
+			slotActive[kBandpassSlot] = slotActive[kBandpassSlot + 1] = true;
+		}
+		else
+		{
+			outStages[0] = MakeBlockStage(kBandpassSlot, coefficients[kBandpassSlot], coefficients[kBandpassSlot], 0.0f);
+			outStages[1] = MakeBlockStage(kBandpassSlot + 1, coefficients[kBandpassSlot], coefficients[kBandpassSlot], 0.0f);
+		}
+		stageCount = outBandpassStageCount = 2;
+	}
+	else
+	{
+		if (slotActive[kBandpassSlot])
+		{
+			ClearSlot(kBandpassSlot);
+			ClearSlot(kBandpassSlot + 1);
+		}
+		bandpassLog2Hertz.Snap();
+		bandpassCents.Snap();
+	}
+	outMixStep = (bandpassMix.value - outMixFrom) * perFrame;
+	
+	// Parametric EQ.
+	for (uint32_t band = 0; band < kMYFilterChainMaxEQBands; band++)
+	{
+		uint32_t slot = kEQSlot + band;
+		bool changed = eqGainDB[band].Step(coefficient, 1e-3f);
+		if (eqGainDB[band].value != 0.0f || eqGainDB[band].target != 0.0f)
+		{
+			changed |= eqLog2Hertz[band].Step(coefficient, 1e-4f);
+			changed |= eqLog2Q[band].Step(coefficient, 1e-4f);
+			
+			if (changed || !slotActive[slot])
+			{
+				BiquadCoefficients design = DesignPeakingEQ(sampleRate, exp2f(eqLog2Hertz[band].value), exp2f(eqLog2Q[band].value), eqGainDB[band].value);
+				const BiquadCoefficients &from = slotActive[slot] ? coefficients[slot] : design;
+				outGliding |= slotActive[slot];
+				outStages[stageCount++] = MakeBlockStage(slot, from, design, perFrame);
+				coefficients[slot] = design;
+				slotActive[slot] = true;
+			}
+			else
+			{
+				outStages[stageCount++] = MakeBlockStage(slot, coefficients[slot], coefficients[slot], 0.0f);
+			}
+		}
+		else
+		{
+			if (slotActive[slot])
+				ClearSlot(slot);
+			eqLog2Hertz[band].Snap();
+			eqLog2Q[band].Snap();
+		}
+	}
+	
+	// Output gain, ramped linearly across the block.
+	outGainFrom = gain;
+	if (gainDB.Step(coefficient, 1e-3f))
+		gain = powf(10.0f, gainDB.value / 20.0f);
+	outGainStep = (gain - outGainFrom) * perFrame;
+	
+	return stageCount;
+}
+
+void MYFilterChain::Process(float *samples, float * const *channels, uint32_t frameCount)
+{
+	BlockStage stages[kSlotCount];
+	float block[kRampFrames * 4] __attribute__((aligned(16)));
+	
+	for (uint32_t start = 0; start < frameCount; start += kRampFrames)
+	{
+		uint32_t blockFrames = (frameCount - start < (uint32_t)kRampFrames) ? frameCount - start : (uint32_t)kRampFrames;
+		
+		bool gliding;
+		uint32_t bandpassStageCount;
+		float mixFrom, mixStep, gainFrom, gainStep;
+		uint32_t stageCount = PrepareBlock(blockFrames, stages, gliding, bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep);
+		
+		// Nothing to do while everything is flat.
+		if (stageCount == 0 && gainFrom == 1.0f && gainStep == 0.0f)
+			continue;
+		
+		for (uint32_t group = 0; group < groupCount; group++)
+		{
+			uint32_t firstChannel = 4 * group;
+			uint32_t lanes = (channelCount - firstChannel < 4) ? channelCount - firstChannel : 4;
+			
+			// Gather the group's channels into lanes, leaving any spare lanes silent. Each frame is assembled in a register and
+			// stored whole, because loading a vector back from four separate float stores stalls store forwarding.
+			const float *sources[4];
+			uint32_t stride = samples ? channelCount : 1;
+			for (uint32_t lane = 0; lane < 4; lane++)
+			{
+				if (lane >= lanes)
+					sources[lane] = kSilence;
+				else if (samples)
+					sources[lane] = samples + start * channelCount + firstChannel + lane;
+				else
+					sources[lane] = channels[firstChannel + lane] + start;
+			}
+			for (uint32_t i = 0; i < blockFrames; i++)
+			{
+				uint32_t index = i * stride;
+				VStore(block + 4 * i, VSet(sources[0][index], sources[1][index], sources[2][index], sources[3][index]));
+			}
+			
+			if (gliding)
+				RunStages<true>(block, blockFrames, stages, stageCount, states[group], bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep);
+			else
+				RunStages<false>(block, blockFrames, stages, stageCount, states[group], bandpassStageCount, mixFrom, mixStep, gainFrom, gainStep);
+			
+			if (samples)
+			{
+				float *destination = samples + start * channelCount + firstChannel;
+				for (uint32_t i = 0; i < blockFrames; i++, destination += channelCount)
+					for (uint32_t lane = 0; lane < lanes; lane++)
+						destination[lane] = block[4 * i + lane];
+			}
+			else
+			{
+				for (uint32_t lane = 0; lane < lanes; lane++)
+				{
+					float *destination = channels[firstChannel + lane] + start;
+					for (uint32_t i = 0; i < blockFrames; i++)
+						destination[i] = block[4 * i + lane];
+				}
+			}
+		}
+	}
+}
+
+float MYFilterChain::MagnitudeResponse(float hertz)
+{
+	double w = 2.0 * M_PI * hertz / sampleRate;
+	double magnitudeSquared = pow(10.0, targetGainDB / 10.0);
+	
+	if (targetBandpassMix > 0.0f)
+	{
+		double section = MagnitudeSquared(DesignBandpassSection(sampleRate, targetBandpassHertz, targetBandpassCents), w);
+		magnitudeSquared *= section * section;
+	}
+	for (uint32_t band = 0; band < kMYFilterChainMaxEQBands; band++)
+	{
+		if (targetEQGainDB[band] != 0.0f)
+			magnitudeSquared *= MagnitudeSquared(DesignPeakingEQ(sampleRate, targetEQHertz[band], targetEQQ[band], targetEQGainDB[band]), w);
+	}
+	
+	return 10.0 * log10(magnitudeSquared);
+}
+
+#pragma mark - C interface
+
+MYFilterChain *MYFilterChainCreate(double sampleRate, uint32_t channelCount)
+{
+	if (channelCount == 0 || channelCount > kMYFilterChainMaxChannels || !(sampleRate > 0.0))
+		return NULL;
+	return new MYFilterChain(sampleRate, channelCount);
+}
+
+void MYFilterChainDispose(MYFilterChain *chain)
+{
+	delete chain;
+}
+
+void MYFilterChainSetBandpassEnabled(MYFilterChain *chain, bool enabled)
+{
+	chain->targetBandpassMix = enabled ? 1.0f : 0.0f;
+}
+
+void MYFilterChainSetBandpassCenterFrequency(MYFilterChain *chain, float hertz)
+{
+	chain->targetBandpassHertz = hertz;
+}
+
+void MYFilterChainSetBandpassBandwidth(MYFilterChain *chain, float cents)
+{
+	chain->targetBandpassCents = cents;
+}
+
+void MYFilterChainSetEQBand(MYFilterChain *chain, uint32_t band, float hertz, float q, float gainDB)
+{
+	if (band >= kMYFilterChainMaxEQBands)
+		return;
+	chain->targetEQHertz[band] = hertz;
+	chain->targetEQQ[band] = q;
+	chain->targetEQGainDB[band] = gainDB;
+}
+
+void MYFilterChainSetGain(MYFilterChain *chain, float gainDB)
+{
+	chain->targetGainDB = gainDB;
+}
+
+void MYFilterChainProcessInterleaved(MYFilterChain *chain, float *samples, uint32_t frameCount)
+{
+	chain->Process(samples, NULL, frameCount);
+}
+
+void MYFilterChainProcessNonInterleaved(MYFilterChain *chain, float * const *channels, uint32_t frameCount)
+{
+	chain->Process(NULL, channels, frameCount);
+}
+
+void MYFilterChainReset(MYFilterChain *chain)
+{
+	// Handled by the render thread at the start of its next block.
+	__sync_fetch_and_add(&chain->resetRequests, 1);
+}
+
+float MYFilterChainGetMagnitudeResponse(MYFilterChain *chain, float hertz)
+{
+	return chain->MagnitudeResponse(hertz);
+}
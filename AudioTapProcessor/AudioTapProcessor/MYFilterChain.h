@@ -0,0 +1,96 @@
+/*
+     File: MYFilterChain.h
+ Abstract: Allocation free bandpass, parametric EQ and gain chain for the audio tap, vectorized across channels.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+#ifndef MYFilterChain_h
+#define MYFilterChain_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	kMYFilterChainMaxChannels = 16,
+	kMYFilterChainMaxEQBands = 4
+};
+
+// A bandpass made of two cascaded biquads, kMYFilterChainMaxEQBands peaking EQ bands and an output gain, applied in that
+// order. The bandpass starts disabled and the EQ bands and gain start flat, which passes audio through unchanged.
+typedef struct MYFilterChain MYFilterChain;
+
+// Create and dispose allocate and free, so call them outside the render thread (the tap's prepare and unprepare callbacks).
+// Returns NULL if channelCount is 0 or above kMYFilterChainMaxChannels.
+MYFilterChain *MYFilterChainCreate(double sampleRate, uint32_t channelCount);
+void MYFilterChainDispose(MYFilterChain *chain);
+
+// Parameter setters can be called from any thread while the chain is processing. The chain glides to the new values with a
+// 20 ms time constant instead of jumping, so moving a slider doesn't click. Enabling or disabling the bandpass crossfades it.
+void MYFilterChainSetBandpassEnabled(MYFilterChain *chain, bool enabled);
+void MYFilterChainSetBandpassCenterFrequency(MYFilterChain *chain, float hertz);
+void MYFilterChainSetBandpassBandwidth(MYFilterChain *chain, float cents);	// between the -3 dB points of the whole cascade
+void MYFilterChainSetEQBand(MYFilterChain *chain, uint32_t band, float hertz, float q, float gainDB);	// 0 dB turns the band off
+void MYFilterChainSetGain(MYFilterChain *chain, float gainDB);
+
+// Process in place. Safe to call on a real-time thread: no allocation, locks or system calls. Only one thread may process.
+void MYFilterChainProcessInterleaved(MYFilterChain *chain, float *samples, uint32_t frameCount);
+void MYFilterChainProcessNonInterleaved(MYFilterChain *chain, float * const *channels, uint32_t frameCount);
+
+// Clears the filter history and jumps straight to the current parameters, for example after a seek.
+void MYFilterChainReset(MYFilterChain *chain);
+
+// The gain in dB the chain settles to at a frequency for its current parameters, evaluated from the filter coefficients.
+// For checking the chain offline against a measured or reference response.
+float MYFilterChainGetMagnitudeResponse(MYFilterChain *chain, float hertz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+/*
+     File: MYVec4.h
+ Abstract: Four lane float vectors shared by the audio stats and the filter chain.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+#ifndef MYVec4_h
+#define MYVec4_h
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+// Four lane vectors for C and C++. NEON on devices, SSE2 in the simulator and on Linux, plain C otherwise.
+// Loads and stores don't need to be aligned.
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+typedef float32x4_t Vec4;
+typedef uint32x4_t VecCount4;
+static inline Vec4 VLoad(const float *p) { return vld1q_f32(p); }
+static inline void VStore(float *p, Vec4 a) { vst1q_f32(p, a); }
+static inline Vec4 VZero(void) { return vdupq_n_f32(0.0f); }
+static inline Vec4 VSplat(float a) { return vdupq_n_f32(a); }
+static inline Vec4 VSet(float a, float b, float c, float d) { Vec4 r = { a, b, c, d }; return r; }
+static inline Vec4 VAdd(Vec4 a, Vec4 b) { return vaddq_f32(a, b); }
+static inline Vec4 VSub(Vec4 a, Vec4 b) { return vsubq_f32(a, b); }
+static inline Vec4 VMul(Vec4 a, Vec4 b) { return vmulq_f32(a, b); }
+static inline Vec4 VMulAdd(Vec4 a, Vec4 b, Vec4 c) { return vmlaq_f32(a, b, c); }
+static inline Vec4 VMulSub(Vec4 a, Vec4 b, Vec4 c) { return vmlsq_f32(a, b, c); }
+static inline Vec4 VMaxAbs(Vec4 a, Vec4 b) { return vmaxq_f32(a, vabsq_f32(b)); }
+static inline VecCount4 VCountZero(void) { return vdupq_n_u32(0); }
+// Adds one to each lane where a and b have different signs. The comparison masks are all ones, so subtracting adds one.
+static inline VecCount4 VCountCrossings(VecCount4 count, Vec4 a, Vec4 b)
+{
+	uint32x4_t differ = veorq_u32(vcltq_f32(a, vdupq_n_f32(0.0f)), vcltq_f32(b, vdupq_n_f32(0.0f)));
+	return vsubq_u32(count, differ);
+}
+static inline void VCountStore(uint32_t *p, VecCount4 a) { vst1q_u32(p, a); }
+
+#elif defined(__SSE2__)
+
+typedef __m128 Vec4;
+typedef __m128i VecCount4;
+static inline Vec4 VLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline void VStore(float *p, Vec4 a) { _mm_storeu_ps(p, a); }
+static inline Vec4 VZero(void) { return _mm_setzero_ps(); }
+static inline Vec4 VSplat(float a) { return _mm_set1_ps(a); }
+static inline Vec4 VSet(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+static inline Vec4 VAdd(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+static inline Vec4 VSub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+static inline Vec4 VMul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+static inline Vec4 VMulAdd(Vec4 a, Vec4 b, Vec4 c) { return _mm_add_ps(a, _mm_mul_ps(b, c)); }
+static inline Vec4 VMulSub(Vec4 a, Vec4 b, Vec4 c) { return _mm_sub_ps(a, _mm_mul_ps(b, c)); }
+static inline Vec4 VMaxAbs(Vec4 a, Vec4 b) { return _mm_max_ps(a, _mm_andnot_ps(_mm_set1_ps(-0.0f), b)); }
+static inline VecCount4 VCountZero(void) { return _mm_setzero_si128(); }
+static inline VecCount4 VCountCrossings(VecCount4 count, Vec4 a, Vec4 b)
+{
+	__m128 differ = _mm_xor_ps(_mm_cmplt_ps(a, _mm_setzero_ps()), _mm_cmplt_ps(b, _mm_setzero_ps()));
+	return _mm_sub_epi32(count, _mm_castps_si128(differ));
+}
+static inline void VCountStore(uint32_t *p, VecCount4 a) { _mm_storeu_si128((__m128i *)p, a); }
+
+#else
+
+typedef struct Vec4 { float v[4]; } Vec4;
+typedef struct VecCount4 { uint32_t v[4]; } VecCount4;
+static inline Vec4 VLoad(const float *p) { Vec4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+static inline void VStore(float *p, Vec4 a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline Vec4 VZero(void) { Vec4 r = { { 0.0f, 0.0f, 0.0f, 0.0f } }; return r; }
+static inline Vec4 VSplat(float a) { Vec4 r = { { a, a, a, a } }; return r; }
+static inline Vec4 VSet(float a, float b, float c, float d) { Vec4 r = { { a, b, c, d } }; return r; }
+static inline Vec4 VAdd(Vec4 a, Vec4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline Vec4 VSub(Vec4 a, Vec4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline Vec4 VMul(Vec4 a, Vec4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline Vec4 VMulAdd(Vec4 a, Vec4 b, Vec4 c) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i] * c.v[i]; return a; }
+static inline Vec4 VMulSub(Vec4 a, Vec4 b, Vec4 c) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i] * c.v[i]; return a; }
+static inline Vec4 VMaxAbs(Vec4 a, Vec4 b) { for (int i = 0; i < 4; i++) a.v[i] = fmaxf(a.v[i], fabsf(b.v[i])); return a; }
+static inline VecCount4 VCountZero(void) { VecCount4 r = { { 0, 0, 0, 0 } }; return r; }
+static inline VecCount4 VCountCrossings(VecCount4 count, Vec4 a, Vec4 b)
+{
+	for (int i = 0; i < 4; i++) count.v[i] += ((a.v[i] < 0.0f) != (b.v[i] < 0.0f));
+	return count;
+}
+static inline void VCountStore(uint32_t *p, VecCount4 a) { memcpy(p, a.v, sizeof(a.v)); }
+
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+/*
+     File: MYAudioStatsBenchmark.c
+ Abstract: Command line benchmark and self check for MYAudioStats, for any host with a C99 compiler.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+/*
+ Build and run from this directory with:
+ 
+	cc -std=gnu99 -O2 -I../AudioTapProcessor -o MYAudioStatsBenchmark MYAudioStatsBenchmark.c ../AudioTapProcessor/MYAudioStats.c -lm
+	./MYAudioStatsBenchmark
+ 
+ For each channel count from 2 to 16 it checks the kernel against a plain scalar loop, then reports the time per frame
+ for both interleaved and non-interleaved buffers of a typical tap size.
+*/
+
+#include "MYAudioStats.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum {
+	kFrameCount = 1024,
+	kIterations = 20000
+};
+
+static double NowNanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void ReferenceStats(const float *samples, uint32_t channelCount, uint32_t frameCount, const float *previousSamples, MYChannelStats *outStats)
+{
+	for (uint32_t channel = 0; channel < channelCount; channel++)
+	{
+		double sum = 0.0, sumOfSquares = 0.0;
+		float peak = 0.0f, previous = previousSamples[channel];
+		uint32_t crossings = 0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			float x = samples[frame * channelCount + channel];
+			sum += x;
+			sumOfSquares += (double)x * x;
+			peak = fmaxf(peak, fabsf(x));
+			crossings += ((x < 0.0f) != (previous < 0.0f));
+			previous = x;
+		}
+		outStats[channel].rms = sqrt(sumOfSquares / frameCount);
+		outStats[channel].peak = peak;
+		outStats[channel].dcOffset = sum / frameCount;
+		outStats[channel].zeroCrossings = crossings;
+	}
+}
+
+static int SameStats(const MYChannelStats *a, const MYChannelStats *b)
+{
+	return fabsf(a->rms - b->rms) <= 1e-4f * (1.0f + b->rms) && a->peak == b->peak
+		&& fabsf(a->dcOffset - b->dcOffset) <= 1e-4f && a->zeroCrossings == b->zeroCrossings;
+}
+
+int main(void)
+{
+	int failures = 0;
+	
+	printf("channels  interleaved ns/frame  non-interleaved ns/frame\n");
+	for (uint32_t channelCount = 2; channelCount <= kMYAudioStatsMaxChannels; channelCount++)
+	{
+		float *interleaved = malloc(kFrameCount * channelCount * sizeof(float));
+		float *planar = malloc(kFrameCount * channelCount * sizeof(float));
+		const float *channels[kMYAudioStatsMaxChannels];
+		float previous[kMYAudioStatsMaxChannels], previousCopy[kMYAudioStatsMaxChannels];
+		MYChannelStats stats[kMYAudioStatsMaxChannels], expected[kMYAudioStatsMaxChannels];
+		
+		// a different tone, level and DC offset in each channel, with some noise
+		for (uint32_t channel = 0; channel < channelCount; channel++)
+		{
+			channels[channel] = planar + channel * kFrameCount;
+			previous[channel] = (channel & 1) ? -0.25f : 0.25f;
+			for (uint32_t frame = 0; frame < kFrameCount; frame++)
+			{
+				float x = (0.1f + 0.05f * channel) * sinf(0.01f * (channel + 1) * frame) + 0.01f * channel + 0.001f * ((rand() % 2001) - 1000) / 1000.0f;
+				interleaved[frame * channelCount + channel] = x;
+				planar[channel * kFrameCount + frame] = x;
+			}
+		}
+		
+		// check both layouts against the reference, including an odd frame count that leaves a remainder
+		uint32_t frameCounts[2] = { kFrameCount, kFrameCount - 3 };
+		for (int f = 0; f < 2; f++)
+		{
+			ReferenceStats(interleaved, channelCount, frameCounts[f], previous, expected);
+			for (int layout = 0; layout < 2; layout++)
+			{
+				for (uint32_t channel = 0; channel < channelCount; channel++) previousCopy[channel] = previous[channel];
+				if (layout == 0)
+					MYAudioStatsComputeInterleaved(interleaved, channelCount, frameCounts[f], previousCopy, stats);
+				else
+					MYAudioStatsComputeNonInterleaved(channels, channelCount, frameCounts[f], previousCopy, stats);
+				for (uint32_t channel = 0; channel < channelCount; channel++)
+				{
+					if (!SameStats(&stats[channel], &expected[channel]) || previousCopy[channel] != interleaved[(frameCounts[f] - 1) * channelCount + channel])
+					{
+						printf("MISMATCH: %u channels, %u frames, %s, channel %u\n", channelCount, frameCounts[f], layout ? "non-interleaved" : "interleaved", channel);
+						failures++;
+					}
+				}
+			}
+		}
+		
+		double start = NowNanoseconds();
+		for (int i = 0; i < kIterations; i++)
+			MYAudioStatsComputeInterleaved(interleaved, channelCount, kFrameCount, previous, stats);
+		double interleavedTime = (NowNanoseconds() - start) / ((double)kIterations * kFrameCount);
+		
+		start = NowNanoseconds();
+		for (int i = 0; i < kIterations; i++)
+			MYAudioStatsComputeNonInterleaved(channels, channelCount, kFrameCount, previous, stats);
+		double nonInterleavedTime = (NowNanoseconds() - start) / ((double)kIterations * kFrameCount);
+		
+		printf("%8u  %20.2f  %24.2f\n", channelCount, interleavedTime, nonInterleavedTime);
+		
+		free(interleaved);
+		free(planar);
+	}
+	
+	printf(failures ? "FAILED\n" : "all results match the scalar reference\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+/*
+     File: MYFilterChainBenchmark.cpp
+ Abstract: Command line benchmark and frequency response check for MYFilterChain, for any host with a C++ compiler.
+  Version: 1.0.1
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+
+/*
+ Build and run from this directory with:
+ 
+	c++ -std=gnu++0x -O2 -I../AudioTapProcessor -o MYFilterChainBenchmark MYFilterChainBenchmark.cpp ../AudioTapProcessor/MYFilterChain.cpp
+	./MYFilterChainBenchmark
+ 
+ It measures the gain of sine waves through the chain for several channel counts and both layouts and compares it with
+ the response evaluated from the coefficients, checks the bandpass and EQ against their design points, checks that
+ parameter changes don't click, and reports the time per frame of a typical setting,
+ including copying in the input.
+*/
+
+#include "MYFilterChain.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static const double kSampleRate = 48000.0;
+static int failures = 0;
+
+static double NowNanoseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void Check(bool ok, const char *what, double value, double expected)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s: got %.3f, expected %.3f\n", what, value, expected);
+		failures++;
+	}
+}
+
+// Feeds the same sine to every channel, scaled differently per channel, in buffers of an awkward size, and returns the gain
+// in dB of each channel over the second half once the filters have settled.
+static void MeasureGain(MYFilterChain *chain, uint32_t channelCount, bool interleaved, double hertz, double *outGainDB)
+{
+	const uint32_t frameCount = 24000, bufferFrames = 1000;
+	std::vector<float> samples(bufferFrames * channelCount);
+	std::vector<double> sumOfSquares(channelCount, 0.0);
+	float *channels[kMYFilterChainMaxChannels];
+	double phaseStep = 2.0 * M_PI * hertz / kSampleRate;
+	
+	for (uint32_t start = 0; start < frameCount; start += bufferFrames)
+	{
+		for (uint32_t channel = 0; channel < channelCount; channel++)
+		{
+			channels[channel] = &samples[channel * bufferFrames];
+			for (uint32_t i = 0; i < bufferFrames; i++)
+			{
+				float x = (channel + 1.0) / channelCount * sin(phaseStep * (start + i));
+				samples[interleaved ? i * channelCount + channel : channel * bufferFrames + i] = x;
+			}
+		}
+		
+		if (interleaved)
+			MYFilterChainProcessInterleaved(chain, &samples[0], bufferFrames);
+		else
+			MYFilterChainProcessNonInterleaved(chain, channels, bufferFrames);
+		
+		if (start >= frameCount / 2)
+		{
+			for (uint32_t channel = 0; channel < channelCount; channel++)
+				for (uint32_t i = 0; i < bufferFrames; i++)
+				{
+					double y = samples[interleaved ? i * channelCount + channel : channel * bufferFrames + i];
+					sumOfSquares[channel] += y * y;
+				}
+		}
+	}
+	
+	for (uint32_t channel = 0; channel < channelCount; channel++)
+	{
+		double amplitude = (channel + 1.0) / channelCount;
+		double inputPower = amplitude * amplitude / 2.0 * (frameCount / 2);
+		outGainDB[channel] = 10.0 * log10(sumOfSquares[channel] / inputPower);
+	}
+}
+
+static void ConfigureTypical(MYFilterChain *chain)
+{
+	MYFilterChainSetBandpassEnabled(chain, true);
+	MYFilterChainSetBandpassCenterFrequency(chain, 5000.0f);
+	MYFilterChainSetBandpassBandwidth(chain, 2400.0f);
+	MYFilterChainSetEQBand(chain, 0, 4000.0f, 1.0f, 6.0f);
+	MYFilterChainSetEQBand(chain, 1, 8000.0f, 2.0f, -9.0f);
+	MYFilterChainSetGain(chain, -3.0f);
+}
+
+int main()
+{
+	// Measured against evaluated response, for every lane arrangement.
+	uint32_t channelCounts[] = { 1, 2, 3, 6, 16 };
+	double frequencies[] = { 100.0, 1000.0, 2500.0, 3535.0, 5000.0, 7071.0, 10000.0, 16000.0 };
+	double worstError = 0.0;
+	for (uint32_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); c++)
+	{
+		for (int interleaved = 0; interleaved < 2; interleaved++)
+		{
+			for (uint32_t f = 0; f < sizeof(frequencies) / sizeof(frequencies[0]); f++)
+			{
+				MYFilterChain *chain = MYFilterChainCreate(kSampleRate, channelCounts[c]);
+				ConfigureTypical(chain);
+				MYFilterChainReset(chain);
+				
+				double gains[kMYFilterChainMaxChannels];
+				MeasureGain(chain, channelCounts[c], interleaved, frequencies[f], gains);
+				double expected = MYFilterChainGetMagnitudeResponse(chain, frequencies[f]);
+				for (uint32_t channel = 0; channel < channelCounts[c]; channel++)
+				{
+					double error = fabs(gains[channel] - expected);
+					worstError = fmax(worstError, error);
+					Check(error < 0.05, "measured vs evaluated gain (dB)", gains[channel], expected);
+				}
+				MYFilterChainDispose(chain);
+			}
+		}
+	}
+	printf("measured response within %.4f dB of the evaluated response\n", worstError);
+	
+	// Design points: the bandpass cascade peaks at 0 dB and is 3 dB down at the band edges, the EQ band reaches its gain at
+	// its center frequency, and the gain stage is flat.
+	{
+		MYFilterChain *chain = MYFilterChainCreate(kSampleRate, 2);
+		MYFilterChainSetBandpassEnabled(chain, true);
+		MYFilterChainSetBandpassCenterFrequency(chain, 1000.0f);
+		MYFilterChainSetBandpassBandwidth(chain, 1200.0f);
+		double edge = pow(2.0, 0.5);
+		Check(fabs(MYFilterChainGetMagnitudeResponse(chain, 1000.0f)) < 0.01, "bandpass center (dB)", MYFilterChainGetMagnitudeResponse(chain, 1000.0f), 0.0);
+		Check(fabs(MYFilterChainGetMagnitudeResponse(chain, 1000.0f / edge) + 3.01) < 0.1, "bandpass lower edge (dB)", MYFilterChainGetMagnitudeResponse(chain, 1000.0f / edge), -3.01);
+		Check(fabs(MYFilterChainGetMagnitudeResponse(chain, 1000.0f * edge) + 3.01) < 0.1, "bandpass upper edge (dB)", MYFilterChainGetMagnitudeResponse(chain, 1000.0f * edge), -3.01);
+		
+		MYFilterChainSetBandpassEnabled(chain, false);
+		MYFilterChainSetEQBand(chain, 2, 3000.0f, 1.4f, 6.0f);
+		Check(fabs(MYFilterChainGetMagnitudeResponse(chain, 3000.0f) - 6.0) < 0.01, "EQ center (dB)", MYFilterChainGetMagnitudeResponse(chain, 3000.0f), 6.0);
+		Check(fabs(MYFilterChainGetMagnitudeResponse(chain, 50.0f)) < 0.05, "EQ far below (dB)", MYFilterChainGetMagnitudeResponse(chain, 50.0f), 0.0);
+		
+		MYFilterChainSetEQBand(chain, 2, 3000.0f, 1.4f, 0.0f);
+		MYFilterChainSetGain(chain, -6.0f);
+		double gains[2];
+		MeasureGain(chain, 2, true, 440.0, gains);
+		Check(fabs(gains[0] + 6.0) < 0.01, "gain stage (dB)", gains[0], -6.0);
+		MYFilterChainDispose(chain);
+	}
+	
+	// Clicks: switch the bandpass on and off and sweep its center frequency under a sine that sits off center, so the filtered
+	// and dry signals differ in level and phase. A hard switch or a jump in the coefficients shows up as a kink: a second
+	// difference between samples well beyond what the sine itself can produce.
+	{
+		const double hertz = 700.0;
+		MYFilterChain *chain = MYFilterChainCreate(kSampleRate, 1);
+		MYFilterChainSetBandpassCenterFrequency(chain, 2000.0f);
+		MYFilterChainSetBandpassBandwidth(chain, 600.0f);
+		float buffer[512], previous[2] = { 0.0f, 0.0f }, largestKink = 0.0f;
+		for (uint32_t buffers = 0; buffers < 400; buffers++)
+		{
+			if (buffers % 50 == 10)
+				MYFilterChainSetBandpassEnabled(chain, (buffers / 50) % 2 == 0);
+			if (buffers % 50 == 35)
+				MYFilterChainSetBandpassCenterFrequency(chain, (buffers / 50) % 2 ? 2000.0f : 350.0f);
+			for (uint32_t i = 0; i < 512; i++)
+				buffer[i] = sin(2.0 * M_PI * hertz * (buffers * 512 + i) / kSampleRate);
+			MYFilterChainProcessInterleaved(chain, buffer, 512);
+			for (uint32_t i = 0; i < 512; i++)
+			{
+				if (buffers > 0 || i > 1)
+					largestKink = fmaxf(largestKink, fabsf(buffer[i] - 2.0f * previous[1] + previous[0]));
+				previous[0] = previous[1];
+				previous[1] = buffer[i];
+			}
+		}
+		double sineKink = 4.0 * pow(sin(M_PI * hertz / kSampleRate), 2.0);
+		Check(largestKink < 1.5 * sineKink, "largest second difference", largestKink, sineKink);
+		printf("largest second difference while switching and sweeping %.5f (a full scale sine's is %.5f)\n", largestKink, sineKink);
+		MYFilterChainDispose(chain);
+	}
+	
+	// Time per frame for the typical setting, in tap sized buffers.
+	printf("channels  interleaved ns/frame  non-interleaved ns/frame\n");
+	for (uint32_t channelCount = 1; channelCount <= 8; channelCount *= 2)
+	{
+		const uint32_t frameCount = 1024, iterations = 2000;
+		std::vector<float> input(frameCount * channelCount), samples(frameCount * channelCount);
+		float *channels[kMYFilterChainMaxChannels];
+		for (uint32_t i = 0; i < input.size(); i++)
+			input[i] = 0.001f * ((rand() % 2001) - 1000);
+		for (uint32_t channel = 0; channel < channelCount; channel++)
+			channels[channel] = &samples[channel * frameCount];
+		
+		double times[2];
+		for (int interleaved = 0; interleaved < 2; interleaved++)
+		{
+			MYFilterChain *chain = MYFilterChainCreate(kSampleRate, channelCount);
+			ConfigureTypical(chain);
+			MYFilterChainReset(chain);
+			double start = NowNanoseconds();
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				// Fresh input every time, since processing the same buffer over and over would decay it into denormals.
+				memcpy(&samples[0], &input[0], samples.size() * sizeof(float));
+				if (interleaved)
+					MYFilterChainProcessInterleaved(chain, &samples[0], frameCount);
+				else
+					MYFilterChainProcessNonInterleaved(chain, channels, frameCount);
+			}
+			times[interleaved] = (NowNanoseconds() - start) / ((double)iterations * frameCount);
+			MYFilterChainDispose(chain);
+		}
+		printf("%8u  %20.2f  %24.2f\n", channelCount, times[1], times[0]);
+	}
+	
+	printf(failures ? "FAILED\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
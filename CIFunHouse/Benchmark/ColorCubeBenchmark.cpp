@@ -0,0 +1,452 @@
+/*
+     File: ColorCubeBenchmark.cpp
+ Abstract: Checks ColorCube against the original cube builder and plain interpolation code, and times it.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+/*
+ Build and run from this directory with:
+ 
+    c++ -std=c++11 -O2 -pthread -I"../CIFunHouse/Custom Filters" -o ColorCubeBenchmark ColorCubeBenchmark.cpp "../CIFunHouse/Custom Filters/ColorCube.cpp"
+    ./ColorCubeBenchmark
+ 
+ It checks hue window cubes against the cube builder ChromaKey.m used to have, and applied cubes against double
+ precision trilinear and tetrahedral interpolation on BGRA and biplanar 420, odd sizes included. Then it times
+ building cubes the old way, cold, when only the window changes and from the cache, and applying them to 1080p
+ frames on one thread and on every core.
+*/
+
+#include "ColorCube.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what)
+{
+    if ( ! ok ) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+#pragma mark The original builder
+
+// rgbToHSV and buildCubeData's float path from ChromaKey.m, as they were
+static void rgbToHSV(const float *rgb, float *hsv)
+{
+    float minV = std::min(rgb[0], std::min(rgb[1], rgb[2]));
+    float maxV = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+    
+    float chroma = maxV - minV;
+    
+    hsv[0] = hsv[1] = 0.0;
+    hsv[2] = maxV;
+    
+    if ( maxV != 0.0 )
+        hsv[1] = chroma / maxV;
+    
+    if ( hsv[1] != 0.0 )
+    {
+        if ( rgb[0] == maxV )
+            hsv[0] = (rgb[1] - rgb[2])/chroma;
+        else if ( rgb[1] == maxV )
+            hsv[0] = 2.0 + (rgb[2] - rgb[0])/chroma;
+        else
+            hsv[0] = 4.0 + (rgb[0] - rgb[1])/chroma;
+        
+        hsv[0] /= 6.0;
+        if ( hsv[0] < 0.0 )
+            hsv[0] += 1.0;
+    }
+}
+
+static void buildCubeData(float *cFloat, unsigned int cubeSize, float centerAngle, float angleWidth, ColorCubeHueWindowOperation op)
+{
+    centerAngle *= 180.0 / M_PI;
+    angleWidth *= 180.0 / M_PI;
+    
+    for(int z = 0; z < cubeSize; z++) {
+        float blueValue = ((double)z)/(cubeSize-1);
+        for(int y = 0; y < cubeSize; y++) {
+            float greenValue = ((double)y)/(cubeSize-1);
+            for(int x = 0; x < cubeSize; x++) {
+                float redValue = ((double)x)/(cubeSize-1);
+                
+                float hsv[3] = { 0.0, 0.0, 0.0 };
+                float rgb[3] = { redValue, greenValue, blueValue };
+                
+                rgbToHSV(rgb, hsv);
+                
+                double hueValue = hsv[0] * 360.0;
+                float alphaValue = 1.0;
+                float delta = fmodf(hueValue - centerAngle, 360.0);
+                delta = delta < 0.0 ? delta + 360.0 : delta;
+                bool shouldProcessPixels = delta < (angleWidth / 2.0);
+                
+                if ( op == kColorCubeHueWindowMakeTransparent ) {
+                    if ( shouldProcessPixels )
+                        alphaValue = 0.0;
+                }
+                else if ( ! shouldProcessPixels ) {
+                    rgb[0] = rgb[1] = rgb[2] = 0.299f * rgb[0] + 0.587f * rgb[1] + 0.114f * rgb[2];
+                }
+                
+                *cFloat++ = rgb[0] * alphaValue;
+                *cFloat++ = rgb[1] * alphaValue;
+                *cFloat++ = rgb[2] * alphaValue;
+                *cFloat++ = alphaValue;
+            }
+        }
+    }
+}
+
+static ColorCubeRef CopyCube(unsigned size, double centerDegrees, double widthDegrees, ColorCubeHueWindowOperation op)
+{
+    ColorCubeHueWindow window = { size, (float)(centerDegrees * M_PI / 180.0), (float)(widthDegrees * M_PI / 180.0), op };
+    return ColorCubeCopyForHueWindow(&window);
+}
+
+static void CheckBuilding()
+{
+    const unsigned sizes[] = { 2, 3, 17, 32, 64 };
+    const double windows[][2] = { { 120.0, 100.0 }, { 0.0, 60.0 }, { -90.0, 30.0 }, { 300.0, 200.0 } };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+            for (int op = 0; op < 2; op++) {
+                ColorCubeRef cube = CopyCube(sizes[s], windows[w][0], windows[w][1], (ColorCubeHueWindowOperation)op);
+                ColorCubeHueWindow window = { sizes[s], (float)(windows[w][0] * M_PI / 180.0), (float)(windows[w][1] * M_PI / 180.0), (ColorCubeHueWindowOperation)op };
+                std::vector<float> expected(sizes[s] * sizes[s] * sizes[s] * 4);
+                buildCubeData(&expected[0], window.cubeSize, window.centerAngle, window.angleWidth, window.operation);
+                
+                char what[128];
+                snprintf(what, sizeof(what), "cube of %u, %g degrees wide at %g, operation %d", sizes[s], windows[w][1], windows[w][0], op);
+                Check(cube && ColorCubeGetDataLength(cube) == expected.size() * sizeof(float) &&
+                      memcmp(ColorCubeGetData(cube), &expected[0], ColorCubeGetDataLength(cube)) == 0, what);
+                ColorCubeRelease(cube);
+            }
+        }
+    }
+    
+    ColorCubeRef a = CopyCube(32, 120.0, 100.0, kColorCubeHueWindowMakeTransparent);
+    ColorCubeRef b = CopyCube(32, 120.0, 100.0, kColorCubeHueWindowMakeTransparent);
+    Check(a == b, "the same parameters give the cached cube");
+    ColorCubeRelease(a);
+    ColorCubeRelease(b);
+    Check(CopyCube(1, 0.0, 60.0, kColorCubeHueWindowMakeGrayscale) == NULL && CopyCube(65, 0.0, 60.0, kColorCubeHueWindowMakeGrayscale) == NULL, "sizes out of range are refused");
+}
+
+#pragma mark Applying
+
+static double Clamp01(double x)
+{
+    return x < 0.0 ? 0.0 : (x > 1.0 ? 1.0 : x);
+}
+
+static uint8_t ToByte(double x)
+{
+    x = x * 255.0 + 0.5;
+    return x <= 0.0 ? 0 : (x >= 255.0 ? 255 : (uint8_t)x);
+}
+
+// Double precision interpolation straight from the definitions
+static void ReferenceLook(ColorCubeRef cube, ColorCubeInterpolation interpolation, const double rgb[3], double out[4])
+{
+    unsigned n = ColorCubeGetSize(cube);
+    const float *data = ColorCubeGetData(cube);
+    int base[3];
+    double t[3];
+    for (int i = 0; i < 3; i++) {
+        double x = Clamp01(rgb[i]) * (n - 1);
+        base[i] = std::min((int)x, (int)n - 2);
+        t[i] = x - base[i];
+    }
+    for (int c = 0; c < 4; c++)
+        out[c] = 0.0;
+    
+    for (int corner = 0; corner < 8; corner++) {
+        int d[3] = { corner & 1, (corner >> 1) & 1, (corner >> 2) & 1 };
+        double weight;
+        if ( interpolation == kColorCubeInterpolationTrilinear ) {
+            weight = 1.0;
+            for (int i = 0; i < 3; i++)
+                weight *= d[i] ? t[i] : 1.0 - t[i];
+        }
+        else {
+            // barycentric weights in the tetrahedron of the lower corner, the upper corner and two between that
+            // the sorted fractions pick out
+            int order[3] = { 0, 1, 2 };
+            std::stable_sort(order, order + 3, [&](int p, int q) { return t[p] > t[q]; });
+            int path[4][3] = { { 0, 0, 0 } };
+            for (int step = 1; step < 4; step++) {
+                memcpy(path[step], path[step - 1], sizeof(path[step]));
+                path[step][order[step - 1]] = 1;
+            }
+            double w[4] = { 1.0 - t[order[0]], t[order[0]] - t[order[1]], t[order[1]] - t[order[2]], t[order[2]] };
+            weight = 0.0;
+            for (int step = 0; step < 4; step++) {
+                if ( path[step][0] == d[0] && path[step][1] == d[1] && path[step][2] == d[2] )
+                    weight += w[step];
+            }
+        }
+        const float *p = data + 4 * ((base[2] + d[2]) * n * n + (base[1] + d[1]) * n + base[0] + d[0]);
+        for (int c = 0; c < 4; c++)
+            out[c] += weight * p[c];
+    }
+}
+
+static bool Near(uint8_t a, uint8_t b)
+{
+    return abs((int)a - (int)b) <= 1;
+}
+
+static void Fill(std::vector<uint8_t> &bytes, uint32_t seed)
+{
+    for (size_t i = 0; i < bytes.size(); i++) {
+        seed = seed * 1664525u + 1013904223u;
+        bytes[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+static void CheckBGRA(ColorCubeRef cube, ColorCubeInterpolation interpolation, size_t width, size_t height)
+{
+    size_t bytesPerRow = width * 4 + 32;
+    std::vector<uint8_t> pixels(bytesPerRow * height);
+    Fill(pixels, 7);
+    std::vector<uint8_t> original = pixels;
+    ColorCubeImage image = { kColorCubeFormat_32BGRA, width, height, { &pixels[0], NULL }, { bytesPerRow, 0 } };
+    
+    bool ok = ColorCubeApply(cube, &image, interpolation, 3);
+    for (size_t i = 0; ok && i < pixels.size(); i++) {
+        size_t x = i % bytesPerRow;
+        if ( x >= width * 4 ) {
+            ok = pixels[i] == original[i];
+            continue;
+        }
+        const uint8_t *in = &original[i - x % 4];
+        double rgb[3] = { in[2] / 255.0, in[1] / 255.0, in[0] / 255.0 }, out[4];
+        ReferenceLook(cube, interpolation, rgb, out);
+        const int channel[4] = { 2, 1, 0, 3 };
+        ok = Near(pixels[i], ToByte(out[channel[x % 4]]));
+    }
+    
+    char what[128];
+    snprintf(what, sizeof(what), "BGRA %s at %zux%zu", interpolation == kColorCubeInterpolationTrilinear ? "trilinear" : "tetrahedral", width, height);
+    Check(ok, what);
+}
+
+static void Check420(ColorCubeRef cube, ColorCubeInterpolation interpolation, uint32_t format, ColorCubeYCbCrMatrix matrix, size_t width, size_t height)
+{
+    size_t chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    size_t lumaBytesPerRow = width + 16, chromaBytesPerRow = chromaWidth * 2 + 16;
+    std::vector<uint8_t> luma(lumaBytesPerRow * height), chroma(chromaBytesPerRow * chromaHeight), alpha(width * height, 7);
+    Fill(luma, 3);
+    Fill(chroma, 5);
+    std::vector<uint8_t> originalLuma = luma, originalChroma = chroma;
+    ColorCubeImage image = { format, width, height, { &luma[0], &chroma[0] }, { lumaBytesPerRow, chromaBytesPerRow }, matrix, &alpha[0], width };
+    bool ok = ColorCubeApply(cube, &image, interpolation, 3);
+    
+    bool full = format == kColorCubeFormat_420YpCbCr8BiPlanarFullRange;
+    double kr = matrix == kColorCubeYCbCrMatrix_ITU_R_709 ? 0.2126 : 0.299, kb = matrix == kColorCubeYCbCrMatrix_ITU_R_709 ? 0.0722 : 0.114, kg = 1.0 - kr - kb;
+    double yOffset = full ? 0.0 : 16.0, yScale = full ? 255.0 : 219.0, cScale = full ? 255.0 : 224.0;
+    
+    for (size_t by = 0; ok && by < chromaHeight; by++) {
+        for (size_t bx = 0; ok && bx < chromaWidth; bx++) {
+            const uint8_t *c = &originalChroma[by * chromaBytesPerRow + bx * 2];
+            double pb = (c[0] - 128.0) / cScale, pr = (c[1] - 128.0) / cScale;
+            double sum[3] = { 0.0, 0.0, 0.0 };
+            int count = 0;
+            for (size_t y = by * 2; y < std::min(by * 2 + 2, height); y++) {
+                for (size_t x = bx * 2; x < std::min(bx * 2 + 2, width); x++) {
+                    double yn = (originalLuma[y * lumaBytesPerRow + x] - yOffset) / yScale;
+                    double rgb[3], out[4];
+                    rgb[0] = yn + 2.0 * (1.0 - kr) * pr;
+                    rgb[2] = yn + 2.0 * (1.0 - kb) * pb;
+                    rgb[1] = (yn - kr * rgb[0] - kb * rgb[2]) / kg;
+                    ReferenceLook(cube, interpolation, rgb, out);
+                    for (int i = 0; i < 3; i++)
+                        sum[i] += out[i];
+                    count++;
+                    double y2 = yOffset + yScale * (kr * out[0] + kg * out[1] + kb * out[2]);
+                    ok = ok && Near(luma[y * lumaBytesPerRow + x], ToByte(y2 / 255.0)) && Near(alpha[y * width + x], ToByte(out[3]));
+                }
+            }
+            double r = sum[0] / count, g = sum[1] / count, b = sum[2] / count, yn = kr * r + kg * g + kb * b;
+            double cb = 128.0 + cScale * (b - yn) / (2.0 * (1.0 - kb)), cr = 128.0 + cScale * (r - yn) / (2.0 * (1.0 - kr));
+            const uint8_t *c2 = &chroma[by * chromaBytesPerRow + bx * 2];
+            ok = ok && Near(c2[0], ToByte(cb / 255.0)) && Near(c2[1], ToByte(cr / 255.0));
+        }
+    }
+    
+    char what[128];
+    snprintf(what, sizeof(what), "%s %s %s at %zux%zu", full ? "420f" : "420v", matrix == kColorCubeYCbCrMatrix_ITU_R_709 ? "709" : "601",
+             interpolation == kColorCubeInterpolationTrilinear ? "trilinear" : "tetrahedral", width, height);
+    Check(ok, what);
+}
+
+static void CheckApplying()
+{
+    ColorCubeRef key = CopyCube(17, 120.0, 100.0, kColorCubeHueWindowMakeTransparent);
+    ColorCubeRef accent = CopyCube(32, 0.0, 60.0, kColorCubeHueWindowMakeGrayscale);
+    const size_t sizes[][2] = { { 1, 1 }, { 3, 3 }, { 37, 11 }, { 64, 8 } };
+    for (int i = 0; i < 2; i++) {
+        ColorCubeInterpolation interpolation = (ColorCubeInterpolation)i;
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            CheckBGRA(key, interpolation, sizes[s][0], sizes[s][1]);
+            CheckBGRA(accent, interpolation, sizes[s][0], sizes[s][1]);
+            Check420(key, interpolation, kColorCubeFormat_420YpCbCr8BiPlanarVideoRange, kColorCubeYCbCrMatrix_ITU_R_601, sizes[s][0], sizes[s][1]);
+            Check420(accent, interpolation, kColorCubeFormat_420YpCbCr8BiPlanarFullRange, kColorCubeYCbCrMatrix_ITU_R_709, sizes[s][0], sizes[s][1]);
+        }
+    }
+    
+    // a pure green screen pixel is keyed out, a red one isn't
+    uint8_t pixels[8] = { 0, 255, 0, 255, 0, 0, 255, 255 };
+    ColorCubeImage image = { kColorCubeFormat_32BGRA, 2, 1, { pixels, NULL }, { 8, 0 } };
+    ColorCubeApply(key, &image, kColorCubeInterpolationTetrahedral, 1);
+    Check(pixels[3] == 0 && pixels[1] == 0 && pixels[7] == 255 && pixels[6] == 255, "green is keyed out");
+    
+    ColorCubeRelease(key);
+    ColorCubeRelease(accent);
+}
+
+#pragma mark Timing
+
+static void TimeBuilding()
+{
+    std::vector<float> data(64 * 64 * 64 * 4);
+    double start = NowSeconds();
+    buildCubeData(&data[0], 64, 120.0 * M_PI / 180.0, 100.0 * M_PI / 180.0, kColorCubeHueWindowMakeTransparent);
+    double original = NowSeconds() - start;
+    
+    // a size nothing else has used, then the same size with another window, then the first again
+    start = NowSeconds();
+    ColorCubeRef cold = CopyCube(63, 120.0, 100.0, kColorCubeHueWindowMakeTransparent);
+    double coldSeconds = NowSeconds() - start;
+    start = NowSeconds();
+    ColorCubeRef window = CopyCube(63, 130.0, 90.0, kColorCubeHueWindowMakeTransparent);
+    double windowSeconds = NowSeconds() - start;
+    start = NowSeconds();
+    ColorCubeRef cached = CopyCube(63, 120.0, 100.0, kColorCubeHueWindowMakeTransparent);
+    double cachedSeconds = NowSeconds() - start;
+    ColorCubeRelease(cold);
+    ColorCubeRelease(window);
+    ColorCubeRelease(cached);
+    
+    printf("building a 64 cube the old way   %8.3f ms\n", original * 1e3);
+    printf("building a 63 cube cold          %8.3f ms\n", coldSeconds * 1e3);
+    printf("with only the window changed     %8.3f ms\n", windowSeconds * 1e3);
+    printf("from the cache                   %8.3f ms\n\n", cachedSeconds * 1e3);
+}
+
+static double MegapixelsPerSecond(ColorCubeRef cube, ColorCubeImage *image, ColorCubeInterpolation interpolation, size_t threads)
+{
+    double best = 1e9;
+    for (int run = 0; run < 5; run++) {
+        const int kFrames = 4;
+        double start = NowSeconds();
+        for (int frame = 0; frame < kFrames; frame++)
+            ColorCubeApply(cube, image, interpolation, threads);
+        best = std::min(best, (NowSeconds() - start) / kFrames);
+    }
+    return image->width * image->height / best * 1e-6;
+}
+
+static void TimeApplying()
+{
+    const size_t width = 1920, height = 1080;
+    std::vector<uint8_t> bgra(width * 4 * height), luma(width * height), chroma(width * height / 2), alpha(width * height);
+    // smooth gradients with a little noise, more like a camera frame than noise is
+    std::vector<uint8_t> noise(width * height * 4);
+    Fill(noise, 1);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t *pixel = &bgra[(y * width + x) * 4], *n = &noise[(y * width + x) * 4];
+            pixel[0] = (uint8_t)(((x + y) * 255 / (width + height)) ^ (n[0] & 7));
+            pixel[1] = (uint8_t)((y * 255 / height) ^ (n[1] & 7));
+            pixel[2] = (uint8_t)((x * 255 / width) ^ (n[2] & 7));
+            pixel[3] = 255;
+            luma[y * width + x] = (uint8_t)((16 + x * 219 / width) ^ (n[3] & 7));
+            if ( y % 2 == 0 && x % 2 == 0 ) {
+                chroma[y / 2 * width + x] = (uint8_t)(16 + y * 224 / height);
+                chroma[y / 2 * width + x + 1] = (uint8_t)(16 + (width - x) * 224 / width);
+            }
+        }
+    }
+    ColorCubeImage bgraImage = { kColorCubeFormat_32BGRA, width, height, { &bgra[0], NULL }, { width * 4, 0 } };
+    ColorCubeImage biplanarImage = { kColorCubeFormat_420YpCbCr8BiPlanarVideoRange, width, height, { &luma[0], &chroma[0] }, { width, width },
+                                     kColorCubeYCbCrMatrix_ITU_R_709, &alpha[0], width };
+    
+    ColorCubeRef cube = CopyCube(32, 120.0, 100.0, kColorCubeHueWindowMakeTransparent);
+    printf("1080p Mpix/s            1T        NT\n");
+    for (int i = 0; i < 2; i++) {
+        ColorCubeInterpolation interpolation = (ColorCubeInterpolation)i;
+        const char *name = i == 0 ? "trilinear" : "tetrahedral";
+        printf("BGRA %-12s %9.0f %9.0f\n", name, MegapixelsPerSecond(cube, &bgraImage, interpolation, 1), MegapixelsPerSecond(cube, &bgraImage, interpolation, 0));
+        printf("420v %-12s %9.0f %9.0f\n", name, MegapixelsPerSecond(cube, &biplanarImage, interpolation, 1), MegapixelsPerSecond(cube, &biplanarImage, interpolation, 0));
+    }
+    ColorCubeRelease(cube);
+}
+
+int main()
+{
+    CheckBuilding();
+    CheckApplying();
+    printf("checks %s\n\n", failures ? "FAILED" : "passed");
+    TimeBuilding();
+    TimeApplying();
+    return failures ? 1 : 0;
+}
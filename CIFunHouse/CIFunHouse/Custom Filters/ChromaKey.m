@@ -50,6 +50,7 @@
 #else
 #import <QuartzCore/QuartzCore.h>
 #endif
+#import "ColorCube.h"
 
 @interface ChromaKey : CIFilter
 {
@@ -86,140 +87,61 @@ static const unsigned int maxCubeSize = 64;
 static const unsigned int defaultCubeSize = 32;
 
 
-typedef enum cubeOperation {
-    cubeMakeTransparent = 0,
-    cubeMakeGrayscale // this is "color accent" mode
-} cubeOperation;
+static const void *retainCube(const void *info)
+{
+    return ColorCubeRetain((ColorCubeRef)info);
+}
 
-    
-static void rgbToHSV(const float *rgb,float *hsv)
+static void releaseCube(const void *info)
 {
-    float minV = MIN(rgb[0], MIN(rgb[1], rgb[2]));
-    float maxV = MAX(rgb[0], MAX(rgb[1], rgb[2]));
-    
-    float chroma = maxV - minV;
-    
-    hsv[0] = hsv[1] = 0.0;
-    hsv[2] = maxV;
-    
-    if ( maxV != 0.0 )
-        hsv[1] = chroma / maxV;
-    
-    if ( hsv[1] != 0.0 )
-    {
-        if ( rgb[0] == maxV )
-            hsv[0] = (rgb[1] - rgb[2])/chroma;
-        else if ( rgb[1] == maxV )
-            hsv[0] = 2.0 + (rgb[2] - rgb[0])/chroma;
-        else
-            hsv[0] = 4.0 + (rgb[0] - rgb[1])/chroma;
-        
-        hsv[0] /= 6.0;
-        if ( hsv[0] < 0.0 )
-            hsv[0] += 1.0;
-    }
+    ColorCubeRelease((ColorCubeRef)info);
 }
 
+static void *allocateNothing(CFIndex size, CFOptionFlags hint, void *info)
+{
+    return NULL;
+}
 
-static
-BOOL buildCubeData(NSMutableData *cubeData, unsigned int cubeSize, float centerAngle,float angleWidth,enum cubeOperation op)
+static void deallocateCube(void *bytes, void *info)
 {
-    // input angles are in radians but let's make this function work with degrees instead
-    centerAngle *= 180.0 / M_PI;
-    angleWidth *= 180.0 / M_PI;
-    
-    uint8_t *c = (uint8_t *)[cubeData mutableBytes];
-    float *cFloat = (float *)c;
-    
-    BOOL useFloat = FALSE;
-    
-    size_t baseMultiplier = cubeSize * cubeSize * cubeSize * 4;
-    
-    if ( [cubeData length] == (baseMultiplier * sizeof(uint8_t)) )
-        useFloat = FALSE;
-    else if ( [cubeData length] == (baseMultiplier * sizeof(float)) )
-        useFloat = TRUE;
-    else
-        return FALSE;
-    
-    for(int z = 0; z < cubeSize; z++) {
-        float blueValue = ((double)z)/(cubeSize-1);
-        for(int y = 0; y < cubeSize; y++) {
-            float greenValue = ((double)y)/(cubeSize-1);
-            for(int x = 0; x < cubeSize; x++) {
-                float redValue = ((double)x)/(cubeSize-1);
-                
-                float hsv[3] = { 0.0, 0.0, 0.0 };
-                float rgb[3] = { redValue, greenValue, blueValue };
-                
-                rgbToHSV(rgb, hsv);
-                
-                // should have decent HSV values now. (H goes from [0 .. 1])
-                // we should have the test for what colors we render as transparent
-                // based on some set of hue angles; this not a chroma threshold.
-                
-                double hueValue = hsv[0] * 360.0;
-                
-                float alphaValue = 1.0;
-                
-                float delta = fmodf(hueValue - centerAngle, 360.0);
+    ColorCubeRelease((ColorCubeRef)info);
+}
 
-                delta = delta < 0.0 ? delta + 360.0 : delta;
-                
-                BOOL shouldProcessPixels = delta < (angleWidth / 2.0);
-                
-                switch ( op ) {
-                    case cubeMakeTransparent:
-                        if ( shouldProcessPixels )
-                            alphaValue = 0.0;
-                        break;
-                        
-                    case cubeMakeGrayscale:
-                        if ( ! shouldProcessPixels ) // convert from RGB to luminance value
-                            rgb[0] = rgb[1] = rgb[2] = 0.299f * rgb[0] + 0.587f * rgb[1] + 0.114f * rgb[2];
-                        
-                        break;
-                        
-                    default:
-                        // no-op
-                        break;
-                }
-                
-                // RGBA channel order.
-                
-                if ( useFloat ) {
-                    *cFloat++ = rgb[0] * alphaValue;
-                    *cFloat++ = rgb[1] * alphaValue;
-                    *cFloat++ = rgb[2] * alphaValue;
-                    *cFloat++ = alphaValue;
-                } else {
-                    *c++ = (uint8_t) (255.0 * rgb[0] * 1); //alphaValue);
-                    *c++ = (uint8_t) (255.0 * rgb[1] * 1); // alphaValue);
-                    *c++ = (uint8_t) (255.0 * rgb[2] * 1); //alphaValue);
-                    *c++ = (uint8_t) (255.0 * alphaValue);
-                }
-            }
-        }
-    }
-    
-    return TRUE;
+// The cube comes from ColorCube's cache, so unchanged parameters don't rebuild it. The data wraps the cached
+// floats rather than copying them, and holds a reference to the cube until Core Image is done with it.
+static
+NSData *cubeDataForHueWindow(unsigned int cubeSize, float centerAngle, float angleWidth, ColorCubeHueWindowOperation op)
+{
+    ColorCubeHueWindow window = { cubeSize, centerAngle, angleWidth, op };
+    ColorCubeRef cube = ColorCubeCopyForHueWindow(&window);
+    if ( ! cube )
+        return nil;
+    
+    CFAllocatorContext context = { 0, cube, retainCube, releaseCube, NULL, allocateNothing, NULL, deallocateCube, NULL };
+    CFAllocatorRef deallocator = CFAllocatorCreate(kCFAllocatorDefault, &context);
+    CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, (const UInt8 *)ColorCubeGetData(cube), ColorCubeGetDataLength(cube), deallocator);
+    CFRelease(deallocator);
+    if ( ! data )
+        ColorCubeRelease(cube);
+    
+    return CFBridgingRelease(data);
 }
 
 static
-NSDictionary *customAttrs(cubeOperation op)
+NSDictionary *customAttrs(ColorCubeHueWindowOperation op)
 {
     CGFloat centerAngle = 0.0;
     CGFloat angleWidth = 0.0;
     NSString *displayName = @"";
     
     switch ( op ) {
-        case cubeMakeTransparent:
+        case kColorCubeHueWindowMakeTransparent:
             centerAngle = 120.0;
             angleWidth = 100.0;
             displayName = @"Chroma Key";
             break;
             
-        case cubeMakeGrayscale:
+        case kColorCubeHueWindowMakeGrayscale:
             centerAngle = 0.0;
             angleWidth = 60.0;
             displayName = @"Color Accent";
@@ -273,7 +195,7 @@ NSDictionary *customAttrs(cubeOperation op)
 
 + (NSDictionary *)customAttributes
 {
-    return customAttrs(cubeMakeTransparent);
+    return customAttrs(kColorCubeHueWindowMakeTransparent);
 }
 
 - (void)setDefaults
@@ -293,18 +215,10 @@ NSDictionary *customAttrs(cubeOperation op)
     CIFilter *colorCube = [CIFilter filterWithName:@"CIColorCube"];
     
     const unsigned int cubeSize = MAX(MIN(inputCubeDimension.intValue, maxCubeSize), minCubeSize);
-    size_t baseMultiplier = cubeSize * cubeSize * cubeSize * 4;
-    
-    // you can use either uint8 data or float data by just setting this variable
-    BOOL useFloat = FALSE;    
-    NSMutableData *cubeData = [NSMutableData dataWithLength:baseMultiplier * (useFloat ? sizeof(float) : sizeof(uint8_t))];
-    
+    NSData *cubeData = cubeDataForHueWindow(cubeSize, [inputCenterAngle floatValue], [inputAngleWidth floatValue], kColorCubeHueWindowMakeTransparent);
     if ( ! cubeData )
         return inputImage;
     
-    if ( ! buildCubeData(cubeData, cubeSize, [inputCenterAngle floatValue], [inputAngleWidth floatValue], cubeMakeTransparent) )
-        return inputImage;
-    
     // don't just use inputCubeSize directly because it is a float and we want to use an int.
     [colorCube setValue:[NSNumber numberWithInt:cubeSize] forKey:@"inputCubeDimension"];
     [colorCube setValue:cubeData forKey:@"inputCubeData"];
@@ -336,7 +250,7 @@ NSDictionary *customAttrs(cubeOperation op)
 
 + (NSDictionary *)customAttributes
 {
-    return customAttrs(cubeMakeGrayscale);
+    return customAttrs(kColorCubeHueWindowMakeGrayscale);
 }
 
 - (void)setDefaults
@@ -357,18 +271,10 @@ NSDictionary *customAttrs(cubeOperation op)
     
     const unsigned int cubeSize = MAX(MIN(inputCubeDimension.intValue, maxCubeSize), minCubeSize);
  
-    size_t baseMultiplier = cubeSize * cubeSize * cubeSize * 4;
-
-    // you can use either uint8 data or float data by just setting this variable
-    BOOL useFloat = FALSE;    
-    NSMutableData *cubeData = [NSMutableData dataWithLength:baseMultiplier * (useFloat ? sizeof(float) : sizeof(uint8_t))];
-    
+    NSData *cubeData = cubeDataForHueWindow(cubeSize, [inputCenterAngle floatValue], [inputAngleWidth floatValue], kColorCubeHueWindowMakeGrayscale);
     if ( ! cubeData )
         return inputImage;
     
-    if ( ! buildCubeData(cubeData, cubeSize, [inputCenterAngle floatValue], [inputAngleWidth floatValue], cubeMakeGrayscale) )
-        return inputImage;
-    
     // don't just use inputCubeSize directly because it is a float and we want to use an int.
     [colorCube setValue:[NSNumber numberWithInt:cubeSize] forKey:@"inputCubeDimension"];
     [colorCube setValue:cubeData forKey:@"inputCubeData"];
@@ -0,0 +1,671 @@
+/*
+     File: ColorCube.cpp
+ Abstract: Builds, caches and applies 3D color lookup cubes on the CPU.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+#include "ColorCube.h"
+
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <thread>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t Float4;
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 Float4;
+#else
+typedef struct { float f[4]; } Float4;
+#endif
+
+// How many recently used cubes and HSV bases are kept
+static const size_t kCachedCubeCount = 8;
+static const size_t kCachedBasisCount = 2;
+
+struct ColorCube {
+    std::atomic<int> retainCount;
+    unsigned size;
+    std::vector<float> data;
+};
+
+#pragma mark Four lane floats
+
+// One lattice point's RGBA is one vector, so the interpolation runs on all four channels at once
+
+static inline Float4 Load4(const float *p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vld1q_f32(p);
+#elif defined(__SSE2__)
+    return _mm_loadu_ps(p);
+#else
+    Float4 v; memcpy(v.f, p, 16); return v;
+#endif
+}
+
+static inline Float4 Splat4(float x)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vdupq_n_f32(x);
+#elif defined(__SSE2__)
+    return _mm_set1_ps(x);
+#else
+    Float4 v; for (int i = 0; i < 4; ++i) v.f[i] = x;
+    return v;
+#endif
+}
+
+static inline Float4 Sub4(Float4 a, Float4 b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vsubq_f32(a, b);
+#elif defined(__SSE2__)
+    return _mm_sub_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) a.f[i] -= b.f[i];
+    return a;
+#endif
+}
+
+// a + b * c
+static inline Float4 MulAdd4(Float4 a, Float4 b, Float4 c)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vmlaq_f32(a, b, c);
+#elif defined(__SSE2__)
+    return _mm_add_ps(a, _mm_mul_ps(b, c));
+#else
+    for (int i = 0; i < 4; ++i) a.f[i] += b.f[i] * c.f[i];
+    return a;
+#endif
+}
+
+// 0...1 to bytes, rounded and clamped, packed in lane order: RGBA in memory
+static inline uint32_t ToBytes4(Float4 v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    v = vminq_f32(vmaxq_f32(vmlaq_f32(vdupq_n_f32(0.5f), v, vdupq_n_f32(255.f)), vdupq_n_f32(0.f)), vdupq_n_f32(255.f));
+    uint16x4_t halves = vmovn_u32(vcvtq_u32_f32(v));
+    return vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(halves, halves))), 0);
+#elif defined(__SSE2__)
+    v = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)), _mm_setzero_ps()), _mm_set1_ps(255.f));
+    __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+    return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+#else
+    uint8_t bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        float x = v.f[i] * 255.f + 0.5f;
+        bytes[i] = (uint8_t)(x < 0.f ? 0.f : (x > 255.f ? 255.f : x));
+    }
+    uint32_t packed;
+    memcpy(&packed, bytes, 4);
+    return packed;
+#endif
+}
+
+static inline void Store4(float *p, Float4 v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    vst1q_f32(p, v);
+#elif defined(__SSE2__)
+    _mm_storeu_ps(p, v);
+#else
+    memcpy(p, v.f, 16);
+#endif
+}
+
+#pragma mark Work splitter
+
+struct BandJob {
+    void (*function)(void *context, size_t firstRow, size_t rowCount);
+    void *context;
+    size_t rowCount;
+    size_t rowsPerBand;
+#if !__APPLE__
+    std::atomic<size_t> nextBand;
+    size_t bandCount;
+#endif
+};
+
+static void RunBand(void *context, size_t band)
+{
+    BandJob *job = (BandJob *)context;
+    size_t firstRow = band * job->rowsPerBand;
+    size_t rowCount = job->rowCount - firstRow < job->rowsPerBand ? job->rowCount - firstRow : job->rowsPerBand;
+    job->function(job->context, firstRow, rowCount);
+}
+
+#if !__APPLE__
+static void RunBands(BandJob *job)
+{
+    for (size_t band; (band = job->nextBand++) < job->bandCount; )
+        RunBand(job, band);
+}
+#endif
+
+// Calls function on bands of rows starting on multiples of rowAlignment, concurrently, and waits for them all
+static void ForEachBand(size_t rowCount, size_t rowAlignment, size_t maxThreads, void (*function)(void *, size_t, size_t), void *context)
+{
+    long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threadCount = maxThreads ? maxThreads : (size_t)(processorCount > 0 ? processorCount : 1);
+    
+    // a few bands per thread, so a core that starts late doesn't hold everything up
+    size_t bandCount = threadCount * 4;
+    size_t rowsPerBand = (rowCount + bandCount - 1) / bandCount;
+    rowsPerBand = (rowsPerBand + rowAlignment - 1) / rowAlignment * rowAlignment;
+    if ( rowsPerBand < rowAlignment )
+        rowsPerBand = rowAlignment;
+    bandCount = (rowCount + rowsPerBand - 1) / rowsPerBand;
+    
+    if ( threadCount <= 1 || bandCount <= 1 ) {
+        function(context, 0, rowCount);
+        return;
+    }
+    
+    BandJob job;
+    job.function = function;
+    job.context = context;
+    job.rowCount = rowCount;
+    job.rowsPerBand = rowsPerBand;
+#if __APPLE__
+    dispatch_apply_f(bandCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &job, RunBand);
+#else
+    job.nextBand = 0;
+    job.bandCount = bandCount;
+    size_t helperCount = (threadCount < bandCount ? threadCount : bandCount) - 1;
+    std::vector<std::thread> helpers;
+    for (size_t i = 0; i < helperCount; i++)
+        helpers.push_back(std::thread(RunBands, &job));
+    RunBands(&job);
+    for (size_t i = 0; i < helperCount; i++)
+        helpers[i].join();
+#endif
+}
+
+#pragma mark Building
+
+// The hue of every lattice point of one cube size, which is the expensive part of building a hue window cube and
+// doesn't depend on the window
+struct HueBasis {
+    unsigned size;
+    std::vector<float> hues;        // 0...1
+};
+
+static float LatticeValue(unsigned i, unsigned size)
+{
+    return ((double)i) / (size - 1);
+}
+
+static float HueOf(const float *rgb)
+{
+    float minV = fminf(rgb[0], fminf(rgb[1], rgb[2]));
+    float maxV = fmaxf(rgb[0], fmaxf(rgb[1], rgb[2]));
+    float chroma = maxV - minV;
+    
+    if ( maxV == 0.0f || chroma / maxV == 0.0f )
+        return 0.0f;
+    
+    float hue;
+    if ( rgb[0] == maxV )
+        hue = (rgb[1] - rgb[2]) / chroma;
+    else if ( rgb[1] == maxV )
+        hue = 2.0 + (rgb[2] - rgb[0]) / chroma;
+    else
+        hue = 4.0 + (rgb[0] - rgb[1]) / chroma;
+    
+    hue /= 6.0;
+    if ( hue < 0.0 )
+        hue += 1.0;
+    return hue;
+}
+
+static void BuildBasisSlices(void *context, size_t firstSlice, size_t sliceCount)
+{
+    HueBasis *basis = (HueBasis *)context;
+    unsigned size = basis->size;
+    for (size_t z = firstSlice; z < firstSlice + sliceCount; z++) {
+        float *hue = &basis->hues[z * size * size];
+        for (unsigned y = 0; y < size; y++) {
+            for (unsigned x = 0; x < size; x++) {
+                float rgb[3] = { LatticeValue(x, size), LatticeValue(y, size), LatticeValue((unsigned)z, size) };
+                *hue++ = HueOf(rgb);
+            }
+        }
+    }
+}
+
+struct WindowJob {
+    const HueBasis *basis;
+    ColorCube *cube;
+    float centerDegrees;
+    float halfWidthDegrees;
+    ColorCubeHueWindowOperation operation;
+};
+
+static void BuildWindowSlices(void *context, size_t firstSlice, size_t sliceCount)
+{
+    const WindowJob *job = (const WindowJob *)context;
+    unsigned size = job->cube->size;
+    for (size_t z = firstSlice; z < firstSlice + sliceCount; z++) {
+        const float *hue = &job->basis->hues[z * size * size];
+        float *c = &job->cube->data[z * size * size * 4];
+        for (unsigned y = 0; y < size; y++) {
+            for (unsigned x = 0; x < size; x++) {
+                float rgb[3] = { LatticeValue(x, size), LatticeValue(y, size), LatticeValue((unsigned)z, size) };
+                
+                // the same arithmetic ChromaKey.m always did, but fmodf only runs when it would change something
+                float delta = *hue++ * 360.0 - job->centerDegrees;
+                if ( delta >= 360.0f || delta <= -360.0f )
+                    delta = fmodf(delta, 360.0);
+                delta = delta < 0.0 ? delta + 360.0 : delta;
+                bool inWindow = delta < job->halfWidthDegrees;
+                
+                float alpha = 1.0f;
+                if ( job->operation == kColorCubeHueWindowMakeTransparent ) {
+                    if ( inWindow )
+                        alpha = 0.0f;
+                }
+                else if ( ! inWindow ) {
+                    rgb[0] = rgb[1] = rgb[2] = 0.299f * rgb[0] + 0.587f * rgb[1] + 0.114f * rgb[2];
+                }
+                
+                *c++ = rgb[0] * alpha;
+                *c++ = rgb[1] * alpha;
+                *c++ = rgb[2] * alpha;
+                *c++ = alpha;
+            }
+        }
+    }
+}
+
+#pragma mark Cache
+
+struct CubeKey {
+    unsigned size;
+    ColorCubeHueWindowOperation operation;
+    float centerAngle;
+    float angleWidth;
+    
+    bool operator==(const CubeKey &other) const
+    {
+        return size == other.size && operation == other.operation &&
+            memcmp(&centerAngle, &other.centerAngle, sizeof(float)) == 0 && memcmp(&angleWidth, &other.angleWidth, sizeof(float)) == 0;
+    }
+};
+
+// FNV-1a over the parameters' bits
+struct CubeKeyHash {
+    size_t operator()(const CubeKey &key) const
+    {
+        uint32_t words[4] = { key.size, (uint32_t)key.operation, 0, 0 };
+        memcpy(&words[2], &key.centerAngle, sizeof(float));
+        memcpy(&words[3], &key.angleWidth, sizeof(float));
+        uint64_t hash = 14695981039346656037ull;
+        const uint8_t *bytes = (const uint8_t *)words;
+        for (size_t i = 0; i < sizeof(words); i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return (size_t)hash;
+    }
+};
+
+class CubeCache {
+public:
+    ColorCubeRef CopyCube(const CubeKey &key)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto found = mIndex.find(key);
+            if ( found != mIndex.end() ) {
+                mRecent.splice(mRecent.begin(), mRecent, found->second);
+                return ColorCubeRetain(found->second->second);
+            }
+        }
+        
+        // built without the lock, so lookups of other cubes don't wait on it
+        ColorCubeRef cube = Build(key, Basis(key.size));
+        
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto found = mIndex.find(key);
+        if ( found != mIndex.end() ) {
+            // someone else built it meanwhile
+            ColorCubeRelease(cube);
+            mRecent.splice(mRecent.begin(), mRecent, found->second);
+            return ColorCubeRetain(found->second->second);
+        }
+        mRecent.push_front(std::make_pair(key, ColorCubeRetain(cube)));
+        mIndex[key] = mRecent.begin();
+        if ( mRecent.size() > kCachedCubeCount ) {
+            mIndex.erase(mRecent.back().first);
+            ColorCubeRelease(mRecent.back().second);
+            mRecent.pop_back();
+        }
+        return cube;
+    }
+    
+private:
+    typedef std::list<std::pair<CubeKey, ColorCubeRef> > CubeList;
+    
+    std::shared_ptr<const HueBasis> Basis(unsigned size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (auto basis = mBases.begin(); basis != mBases.end(); ++basis) {
+                if ( (*basis)->size == size ) {
+                    mBases.splice(mBases.begin(), mBases, basis);
+                    return mBases.front();
+                }
+            }
+        }
+        
+        std::shared_ptr<HueBasis> basis = std::make_shared<HueBasis>();
+        basis->size = size;
+        basis->hues.resize(size * size * size);
+        ForEachBand(size, 1, 0, BuildBasisSlices, basis.get());
+        
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBases.push_front(basis);
+        if ( mBases.size() > kCachedBasisCount )
+            mBases.pop_back();
+        return basis;
+    }
+    
+    static ColorCubeRef Build(const CubeKey &key, std::shared_ptr<const HueBasis> basis)
+    {
+        ColorCube *cube = new ColorCube;
+        cube->retainCount = 1;
+        cube->size = key.size;
+        cube->data.resize(key.size * key.size * key.size * 4);
+        
+        WindowJob job;
+        job.basis = basis.get();
+        job.cube = cube;
+        // the angles come in radians, the window test works in degrees
+        job.centerDegrees = key.centerAngle * (180.0 / M_PI);
+        job.halfWidthDegrees = (float)(key.angleWidth * (180.0 / M_PI)) / 2.0;
+        job.operation = key.operation;
+        ForEachBand(key.size, 1, 0, BuildWindowSlices, &job);
+        return cube;
+    }
+    
+    std::mutex mMutex;
+    CubeList mRecent;       // most recently used first
+    std::unordered_map<CubeKey, CubeList::iterator, CubeKeyHash> mIndex;
+    std::list<std::shared_ptr<const HueBasis> > mBases;
+};
+
+ColorCubeRef ColorCubeCopyForHueWindow(const ColorCubeHueWindow *window)
+{
+    if ( window->cubeSize < kColorCubeMinSize || window->cubeSize > kColorCubeMaxSize )
+        return NULL;
+    
+    static CubeCache *cache = new CubeCache;     // never destroyed, so it outlives any cube a static holds
+    CubeKey key = { window->cubeSize, window->operation, window->centerAngle, window->angleWidth };
+    return cache->CopyCube(key);
+}
+
+ColorCubeRef ColorCubeRetain(ColorCubeRef cube)
+{
+    cube->retainCount.fetch_add(1, std::memory_order_relaxed);
+    return cube;
+}
+
+void ColorCubeRelease(ColorCubeRef cube)
+{
+    if ( cube && cube->retainCount.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+        delete cube;
+}
+
+unsigned ColorCubeGetSize(ColorCubeRef cube)
+{
+    return cube->size;
+}
+
+const float *ColorCubeGetData(ColorCubeRef cube)
+{
+    return &cube->data[0];
+}
+
+size_t ColorCubeGetDataLength(ColorCubeRef cube)
+{
+    return cube->data.size() * sizeof(float);
+}
+
+#pragma mark Applying
+
+// Where a value falls in the lattice: the lower point and how far towards the next one. The lower point stops
+// one short of the end, so the next one always exists.
+struct Coordinate {
+    int offset;     // in floats
+    float fraction;
+};
+
+static inline Coordinate CoordinateOf(float value, unsigned size, int stride)
+{
+    float x = (value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value)) * (size - 1);
+    int i = (int)x;
+    if ( i > (int)size - 2 )
+        i = size - 2;
+    Coordinate c = { i * stride, x - i };
+    return c;
+}
+
+struct ApplyJob {
+    const ColorCubeImage *image;
+    const float *data;
+    unsigned size;
+    int strides[3];                 // red, green, blue, in floats
+    Coordinate byteCoordinates[3][256];
+    ColorCubeInterpolation interpolation;
+    // biplanar 420
+    float kr, kb, yOffset, yScale, cScale;
+};
+
+static inline Float4 Trilinear(const ApplyJob *job, Coordinate r, Coordinate g, Coordinate b)
+{
+    const float *p = job->data + r.offset + g.offset + b.offset;
+    int dx = job->strides[0], dy = job->strides[1], dz = job->strides[2];
+    Float4 tx = Splat4(r.fraction), ty = Splat4(g.fraction), tz = Splat4(b.fraction);
+    
+    Float4 c000 = Load4(p), c100 = Load4(p + dx), c010 = Load4(p + dy), c110 = Load4(p + dx + dy);
+    Float4 c001 = Load4(p + dz), c101 = Load4(p + dx + dz), c011 = Load4(p + dy + dz), c111 = Load4(p + dx + dy + dz);
+    
+    Float4 c00 = MulAdd4(c000, Sub4(c100, c000), tx);
+    Float4 c10 = MulAdd4(c010, Sub4(c110, c010), tx);
+    Float4 c01 = MulAdd4(c001, Sub4(c101, c001), tx);
+    Float4 c11 = MulAdd4(c011, Sub4(c111, c011), tx);
+    Float4 c0 = MulAdd4(c00, Sub4(c10, c00), ty);
+    Float4 c1 = MulAdd4(c01, Sub4(c11, c01), ty);
+    return MulAdd4(c0, Sub4(c1, c0), tz);
+}
+
+// The axes in order of decreasing fraction, indexed by whether r >= g, g >= b and r >= b, so picking the
+// tetrahedron doesn't branch
+static const uint8_t kTetrahedronAxes[8][3] = {
+    { 2, 1, 0 },    // b > g > r
+    { 2, 0, 1 },    // b > r >= g
+    { 1, 2, 0 },    // g >= b > r
+    { 0, 1, 2 },    // can't happen
+    { 0, 1, 2 },    // can't happen
+    { 0, 2, 1 },    // r >= b > g
+    { 1, 0, 2 },    // g > r >= b
+    { 0, 1, 2 }     // r >= g >= b
+};
+
+static inline Float4 Tetrahedral(const ApplyJob *job, Coordinate r, Coordinate g, Coordinate b)
+{
+    const float *p = job->data + r.offset + g.offset + b.offset;
+    const float t[3] = { r.fraction, g.fraction, b.fraction };
+    const uint8_t *axes = kTetrahedronAxes[(t[0] >= t[1]) | ((t[1] >= t[2]) << 1) | ((t[0] >= t[2]) << 2)];
+    
+    // walk from the lower corner to the upper one along the axes in that order
+    int o1 = job->strides[axes[0]], o2 = o1 + job->strides[axes[1]], o3 = job->strides[0] + job->strides[1] + job->strides[2];
+    Float4 c0 = Load4(p), c1 = Load4(p + o1), c2 = Load4(p + o2), c3 = Load4(p + o3);
+    Float4 c = MulAdd4(c0, Sub4(c1, c0), Splat4(t[axes[0]]));
+    c = MulAdd4(c, Sub4(c2, c1), Splat4(t[axes[1]]));
+    return MulAdd4(c, Sub4(c3, c2), Splat4(t[axes[2]]));
+}
+
+static inline Float4 Look(const ApplyJob *job, Coordinate r, Coordinate g, Coordinate b)
+{
+    if ( job->interpolation == kColorCubeInterpolationTetrahedral )
+        return Tetrahedral(job, r, g, b);
+    return Trilinear(job, r, g, b);
+}
+
+static void ApplyRowsBGRA(void *context, size_t firstRow, size_t rowCount)
+{
+    const ApplyJob *job = (const ApplyJob *)context;
+    const ColorCubeImage *image = job->image;
+    
+    for (size_t row = firstRow; row < firstRow + rowCount; row++) {
+        uint8_t *pixel = image->planes[0] + row * image->bytesPerRow[0];
+        for (size_t x = 0; x < image->width; x++, pixel += 4) {
+            Float4 c = Look(job, job->byteCoordinates[0][pixel[2]], job->byteCoordinates[1][pixel[1]], job->byteCoordinates[2][pixel[0]]);
+            // RGBA to BGRA
+            uint32_t rgba = ToBytes4(c);
+            uint32_t bgra = (rgba & 0xFF00FF00) | ((rgba >> 16) & 0xFF) | ((rgba & 0xFF) << 16);
+            memcpy(pixel, &bgra, 4);
+        }
+    }
+}
+
+static void ApplyRows420(void *context, size_t firstRow, size_t rowCount)
+{
+    const ApplyJob *job = (const ApplyJob *)context;
+    const ColorCubeImage *image = job->image;
+    float kr = job->kr, kb = job->kb, kg = 1.0f - kr - kb;
+    float lumaToUnit = 1.0f / job->yScale, chromaToUnit = 1.0f / job->cScale;
+    float rFromPr = 2.0f * (1.0f - kr), bFromPb = 2.0f * (1.0f - kb);
+    float unitToCb = job->cScale / bFromPb, unitToCr = job->cScale / rFromPr;
+    
+    for (size_t row = firstRow; row < firstRow + rowCount; row += 2) {
+        uint8_t *chroma = image->planes[1] + (row / 2) * image->bytesPerRow[1];
+        size_t rows = row + 1 < image->height ? 2 : 1;
+        
+        for (size_t x = 0; x < image->width; x += 2, chroma += 2) {
+            size_t columns = x + 1 < image->width ? 2 : 1;
+            
+            // what the block's chroma adds to each pixel's red, green and blue
+            float rOffset = rFromPr * (chroma[1] - 128.0f) * chromaToUnit;
+            float bOffset = bFromPb * (chroma[0] - 128.0f) * chromaToUnit;
+            float gOffset = -(kr * rOffset + kb * bOffset) / kg;
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            
+            for (size_t dy = 0; dy < rows; dy++) {
+                uint8_t *luma = image->planes[0] + (row + dy) * image->bytesPerRow[0] + x;
+                uint8_t *alpha = image->alpha ? image->alpha + (row + dy) * image->alphaBytesPerRow + x : NULL;
+                for (size_t dx = 0; dx < columns; dx++) {
+                    float yn = (luma[dx] - job->yOffset) * lumaToUnit;
+                    float out[4];
+                    Store4(out, Look(job, CoordinateOf(yn + rOffset, job->size, job->strides[0]),
+                                     CoordinateOf(yn + gOffset, job->size, job->strides[1]),
+                                     CoordinateOf(yn + bOffset, job->size, job->strides[2])));
+                    for (int i = 0; i < 4; i++)
+                        sum[i] += out[i];
+                    
+                    float y2 = job->yOffset + job->yScale * (kr * out[0] + kg * out[1] + kb * out[2]);
+                    luma[dx] = (uint8_t)(y2 < 0.0f ? 0.0f : (y2 > 255.0f ? 255.0f : y2 + 0.5f));
+                    if ( alpha )
+                        alpha[dx] = (uint8_t)(out[3] < 0.0f ? 0.0f : (out[3] > 1.0f ? 255.0f : out[3] * 255.0f + 0.5f));
+                }
+            }
+            
+            float scale = 1.0f / (rows * columns);
+            float r = sum[0] * scale, g = sum[1] * scale, b = sum[2] * scale;
+            float yn = kr * r + kg * g + kb * b;
+            float cb = 128.0f + unitToCb * (b - yn);
+            float cr = 128.0f + unitToCr * (r - yn);
+            chroma[0] = (uint8_t)(cb < 0.0f ? 0.0f : (cb > 255.0f ? 255.0f : cb + 0.5f));
+            chroma[1] = (uint8_t)(cr < 0.0f ? 0.0f : (cr > 255.0f ? 255.0f : cr + 0.5f));
+        }
+    }
+}
+
+bool ColorCubeApply(ColorCubeRef cube, const ColorCubeImage *image, ColorCubeInterpolation interpolation, size_t maxThreads)
+{
+    bool biplanar = image->format == kColorCubeFormat_420YpCbCr8BiPlanarVideoRange || image->format == kColorCubeFormat_420YpCbCr8BiPlanarFullRange;
+    if ( image->format != kColorCubeFormat_32BGRA && ! biplanar )
+        return false;
+    
+    std::unique_ptr<ApplyJob> job(new ApplyJob);
+    job->image = image;
+    job->data = ColorCubeGetData(cube);
+    job->size = cube->size;
+    job->strides[0] = 4;
+    job->strides[1] = 4 * cube->size;
+    job->strides[2] = 4 * cube->size * cube->size;
+    job->interpolation = interpolation;
+    
+    if ( ! biplanar ) {
+        for (int channel = 0; channel < 3; channel++) {
+            for (int i = 0; i < 256; i++)
+                job->byteCoordinates[channel][i] = CoordinateOf(i / 255.0f, cube->size, job->strides[channel]);
+        }
+        ForEachBand(image->height, 1, maxThreads, ApplyRowsBGRA, job.get());
+        return true;
+    }
+    
+    bool fullRange = image->format == kColorCubeFormat_420YpCbCr8BiPlanarFullRange;
+    job->kr = image->yCbCrMatrix == kColorCubeYCbCrMatrix_ITU_R_709 ? 0.2126f : 0.299f;
+    job->kb = image->yCbCrMatrix == kColorCubeYCbCrMatrix_ITU_R_709 ? 0.0722f : 0.114f;
+    job->yOffset = fullRange ? 0.0f : 16.0f;
+    job->yScale = fullRange ? 255.0f : 219.0f;
+    job->cScale = fullRange ? 255.0f : 224.0f;
+    ForEachBand(image->height, 2, maxThreads, ApplyRows420, job.get());
+    return true;
+}
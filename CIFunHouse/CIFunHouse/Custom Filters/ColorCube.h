@@ -0,0 +1,137 @@
+/*
+     File: ColorCube.h
+ Abstract: Builds, caches and applies 3D color lookup cubes on the CPU.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+#ifndef ColorCube_h
+#define ColorCube_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What a hue window cube does: make the colors inside the window transparent (Chroma Key), or make the colors
+// outside it gray (Color Accent).
+typedef enum ColorCubeHueWindowOperation {
+    kColorCubeHueWindowMakeTransparent = 0,
+    kColorCubeHueWindowMakeGrayscale
+} ColorCubeHueWindowOperation;
+
+// A hue is in the window when it is less than half of angleWidth past centerAngle, going up.
+typedef struct ColorCubeHueWindow {
+    unsigned cubeSize;          // 2...64 lattice points per side
+    float centerAngle;          // radians
+    float angleWidth;           // radians
+    ColorCubeHueWindowOperation operation;
+} ColorCubeHueWindow;
+
+enum {
+    kColorCubeMinSize = 2,
+    kColorCubeMaxSize = 64
+};
+
+// An immutable cube, reference counted.
+typedef struct ColorCube *ColorCubeRef;
+
+// Returns the cube for a hue window, which the caller must release. Cubes are cached by their parameters, so
+// asking again for a recent one is a hash lookup. A new cube is built across all cores, and when a cube of the
+// same size was built lately only the window test is redone, not the HSV conversion. Thread safe. Returns NULL
+// if cubeSize is out of range.
+ColorCubeRef ColorCubeCopyForHueWindow(const ColorCubeHueWindow *window);
+
+ColorCubeRef ColorCubeRetain(ColorCubeRef cube);
+void ColorCubeRelease(ColorCubeRef cube);
+
+unsigned ColorCubeGetSize(ColorCubeRef cube);
+
+// Premultiplied RGBA floats, red varying fastest, then green, then blue: what CIColorCube takes as inputCubeData.
+const float *ColorCubeGetData(ColorCubeRef cube);
+size_t ColorCubeGetDataLength(ColorCubeRef cube);
+
+typedef enum ColorCubeInterpolation {
+    kColorCubeInterpolationTrilinear = 0,       // the 8 lattice points around the color, as CIColorCube does
+    kColorCubeInterpolationTetrahedral          // 4 of them, cheaper and with fewer artifacts along the gray axis
+} ColorCubeInterpolation;
+
+// The CoreVideo pixel format types ColorCubeApply takes.
+enum {
+    kColorCubeFormat_32BGRA = 'BGRA',
+    kColorCubeFormat_420YpCbCr8BiPlanarVideoRange = '420v',
+    kColorCubeFormat_420YpCbCr8BiPlanarFullRange = '420f'
+};
+
+typedef enum ColorCubeYCbCrMatrix {
+    kColorCubeYCbCrMatrix_ITU_R_601 = 0,
+    kColorCubeYCbCrMatrix_ITU_R_709
+} ColorCubeYCbCrMatrix;
+
+// Pixels someone else owns, a locked CVPixelBuffer for instance. BGRA uses plane 0; biplanar 420 has luma in
+// plane 0 and interleaved Cb Cr at half the width and height in plane 1.
+typedef struct ColorCubeImage {
+    uint32_t format;
+    size_t width;
+    size_t height;
+    uint8_t *planes[2];
+    size_t bytesPerRow[2];
+    ColorCubeYCbCrMatrix yCbCrMatrix;
+    uint8_t *alpha;             // biplanar 420 only, optional: one byte per pixel for the cube's alpha, a key matte
+    size_t alphaBytesPerRow;
+} ColorCubeImage;
+
+// Runs every pixel through the cube, in place, in row bands across up to maxThreads cores (0 for all of them).
+// BGRA gets the cube's premultiplied color and alpha; its own alpha is ignored, as camera frames are opaque.
+// Biplanar 420 gets the premultiplied color, with each chroma sample from the mean of the 2x2 pixels it covers,
+// so keyed out pixels come out black; their alpha goes to the alpha plane. Returns false for other formats.
+bool ColorCubeApply(ColorCubeRef cube, const ColorCubeImage *image, ColorCubeInterpolation interpolation, size_t maxThreads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
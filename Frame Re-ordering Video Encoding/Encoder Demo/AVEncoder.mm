@@ -8,6 +8,7 @@
 
 #import "AVEncoder.h"
 #import "NALUnit.h"
+#import "FrameQueue.h"
 
 static unsigned int to_host(unsigned char* p)
 {
@@ -17,30 +18,9 @@ static unsigned int to_host(unsigned char* p)
 #define OUTPUT_FILE_SWITCH_POINT (50 * 1024 * 1024)  // 50 MB switch point
 #define MAX_FILENAME_INDEX  5                       // filenames "capture1.mp4" wraps at capture5.mp4
 
-// store the calculated POC with a frame ready for timestamp assessment
-// (recalculating POC out of order will get an incorrect result)
-@interface EncodedFrame : NSObject
-
-- (EncodedFrame*) initWithData:(NSArray*) nalus andPOC:(int) poc;
-
-@property int poc;
-@property NSArray* frame;
-
-@end
-
-@implementation EncodedFrame
-
-@synthesize poc;
-@synthesize frame;
-
-- (EncodedFrame*) initWithData:(NSArray*) nalus andPOC:(int) POC
-{
-    self.poc = POC;
-    self.frame = nalus;
-    return self;
-}
-
-@end
+#define MAX_PENDING_TIMES   1024                    // capture may run well ahead of the extractor at startup
+#define MAX_PENDING_FRAMES  32                      // > largest possible reorder depth (16)
+#define READ_BUFFER_SIZE    (1024 * 1024)           // initial size of the mdat read buffer
 
 
 @interface AVEncoder ()
@@ -57,6 +37,12 @@ static unsigned int to_host(unsigned char* p)
     dispatch_queue_t _readQueue;
     dispatch_source_t _readSource;
     
+    // data read from the file but not yet parsed
+    NSMutableData* _readBuffer;
+    size_t _cBuffered;
+    size_t _idxParse;
+    uint64_t _posRead;
+    
     // index of current file name
     BOOL _swapping;
     int _currentFile;
@@ -66,15 +52,18 @@ static unsigned int to_host(unsigned char* p)
     // param set data
     NSData* _avcC;
     int _lengthSize;
+    NSData* _spsInband;
+    NSData* _ppsInband;
+    // NALUs read before the param sets were known
+    NSMutableArray* _waitingNALU;
     
     // POC
     POCState _pocState;
-    int _prevPOC;
     
     // location of mdat
     BOOL _foundMDAT;
     uint64_t _posMDAT;
-    int _bytesToNextAtom;
+    uint64_t _bytesToNextAtom;
     BOOL _needParams;
     
     // tracking if NALU is next frame
@@ -83,11 +72,12 @@ static unsigned int to_host(unsigned char* p)
     // array of NSData comprising a single frame. each data is one nalu with no start code
     NSMutableArray* _pendingNALU;
     
-    // FIFO for frame times
-    NSMutableArray* _times;
+    // FIFO for frame times, filled by the capture thread
+    // and emptied by the extractor
+    SPSCQueue<double, MAX_PENDING_TIMES> _times;
     
-    // FIFO for frames awaiting time assigment
-    NSMutableArray* _frames;
+    // frames awaiting time assigment, with their POC
+    ReorderBuffer<NSArray*, MAX_PENDING_FRAMES> _frames;
     
     encoder_handler_t _outputBlock;
     param_handler_t _paramsBlock;
@@ -124,7 +114,12 @@ static unsigned int to_host(unsigned char* p)
     _width = width;
     NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"params.mp4"];
     _headerWriter = [VideoEncoder encoderForPath:path Height:height andWidth:width];
-    _times = [NSMutableArray arrayWithCapacity:10];
+    _readQueue = dispatch_queue_create("uk.co.gdcl.avencoder.read", DISPATCH_QUEUE_SERIAL);
+    _readBuffer = [NSMutableData dataWithLength:READ_BUFFER_SIZE];
+    
+    // AVAssetWriter always uses 4-byte lengths; the avcC
+    // record will confirm this if it is read from the header file
+    _lengthSize = 4;
     
     // swap between 3 filenames
     _currentFile = 1;
@@ -221,26 +216,73 @@ static unsigned int to_host(unsigned char* p)
 
 - (void) onParamsCompletion
 {
-    // the initial one-frame-only file has been completed
-    // Extract the avcC structure and then start monitoring the
-    // main file to extract video from the mdat chunk.
-    if ([self parseParams:_headerWriter.path])
+    // the initial one-frame-only file has been completed.
+    // Extract the avcC structure, unless in-band parameter sets
+    // in the main file have already given us what we need.
+    if ((_avcC == nil) && [self parseParams:_headerWriter.path])
     {
-        if (_paramsBlock)
-        {
-            _paramsBlock(_avcC);
-        }
-        _headerWriter = nil;
-        _swapping = NO;
-        _inputFile = [NSFileHandle fileHandleForReadingAtPath:_writer.path];
-        _readQueue = dispatch_queue_create("uk.co.gdcl.avencoder.read", DISPATCH_QUEUE_SERIAL);
-        
-        _readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, [_inputFile fileDescriptor], 0, _readQueue);
-        dispatch_source_set_event_handler(_readSource, ^{
-            [self onFileUpdate];
-        });
-        dispatch_resume(_readSource);
+        [self onParamsReady];
     }
+    _headerWriter = nil;
+}
+
+- (void) setParamsFromSPS:(NSData*) sps andPPS:(NSData*) pps
+{
+    // build an avcC record from in-band parameter sets
+    const unsigned char* pSPS = (const unsigned char*)[sps bytes];
+    unsigned char hdr[] = {
+        1,                                  // version
+        pSPS[1], pSPS[2], pSPS[3],          // profile, compatibility, level
+        (unsigned char)(0xfc | (_lengthSize - 1)),
+        0xe1,                               // one sps
+        (unsigned char)([sps length] >> 8), (unsigned char)([sps length] & 0xff),
+    };
+    unsigned char hdrPPS[] = {
+        1,                                  // one pps
+        (unsigned char)([pps length] >> 8), (unsigned char)([pps length] & 0xff),
+    };
+    NSMutableData* avcC = [NSMutableData dataWithCapacity:sizeof(hdr) + [sps length] + sizeof(hdrPPS) + [pps length]];
+    [avcC appendBytes:hdr length:sizeof(hdr)];
+    [avcC appendData:sps];
+    [avcC appendBytes:hdrPPS length:sizeof(hdrPPS)];
+    [avcC appendData:pps];
+    _avcC = avcC;
+    
+    avcCHeader avc((const BYTE*)[_avcC bytes], (int)[_avcC length]);
+    _pocState.SetHeader(&avc);
+}
+
+- (void) onParamsReady
+{
+    if (_paramsBlock)
+    {
+        _paramsBlock(_avcC);
+    }
+    
+    // NALUs that arrived before the params can now be processed
+    NSArray* waiting = _waitingNALU;
+    _waitingNALU = nil;
+    for (NSData* nalu in waiting)
+    {
+        [self onNALU:nalu];
+    }
+}
+
+- (void) startReading
+{
+    // called on the first frame, once the writer has created the main file
+    _inputFile = [NSFileHandle fileHandleForReadingAtPath:_writer.path];
+    _posRead = 0;
+    _cBuffered = 0;
+    _idxParse = 0;
+    _foundMDAT = NO;
+    _bytesToNextAtom = 0;
+    
+    _readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, [_inputFile fileDescriptor], 0, _readQueue);
+    dispatch_source_set_event_handler(_readSource, ^{
+        [self onFileUpdate];
+    });
+    dispatch_resume(_readSource);
 }
 
 - (void) encodeFrame:(CMSampleBufferRef) sampleBuffer
@@ -252,29 +294,30 @@ static unsigned int to_host(unsigned char* p)
             // the avcC record is needed for decoding and it's not written to the file until
             // completion. We get round that by writing the first frame to two files; the first
             // file (containing only one frame) is then finished, so we can extract the avcC record.
-            // Only when we've got that do we start reading from the main file.
+            // If the encoder puts parameter sets in-band, we pick them up from the main
+            // file instead, whichever comes first.
             _needParams = NO;
             if ([_headerWriter encodeFrame:sampleBuffer])
             {
                 [_headerWriter finishWithCompletionHandler:^{
-                    [self onParamsCompletion];
+                    dispatch_async(_readQueue, ^{
+                        [self onParamsCompletion];
+                    });
                 }];
             }
         }
     }
     CMTime prestime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
     double dPTS = (double)(prestime.value) / prestime.timescale;
-    NSNumber* pts = [NSNumber numberWithDouble:dPTS];
-    
-    @synchronized(_times)
+    if (!_times.Push(dPTS))
     {
-        [_times addObject:pts];
+        NSLog(@"Timestamp queue full");
     }
     @synchronized(self)
     {
         // switch output files when we reach a size limit
         // to avoid runaway storage use.
-        if (!_swapping)
+        if ((_inputFile != nil) && !_swapping)
         {
             struct stat st;
             fstat([_inputFile fileDescriptor], &st);
@@ -301,116 +344,144 @@ static unsigned int to_host(unsigned char* p)
                     // since we don't yet know where the mdat ends
                     _readSource = nil;
                     [oldVideo finishWithCompletionHandler:^{
-                        [self swapFiles:oldVideo.path];
+                        dispatch_async(_readQueue, ^{
+                            [self swapFiles:oldVideo.path];
+                        });
                     }];
                 });
             }
         }
         [_writer encodeFrame:sampleBuffer];
+        if (_inputFile == nil)
+        {
+            [self startReading];
+        }
     }
 }
 
 - (void) swapFiles:(NSString*) oldPath
 {
-    // save current position
-    uint64_t pos = [_inputFile offsetInFile];
-    
-    // re-read mdat length
-    [_inputFile seekToFileOffset:_posMDAT];
-    NSData* hdr = [_inputFile readDataOfLength:4];
-    unsigned char* p = (unsigned char*) [hdr bytes];
-    int lenMDAT = to_host(p);
-
-    // extract nalus from saved position to mdat end
-    uint64_t posEnd = _posMDAT + lenMDAT;
-    uint32_t cRead = (uint32_t)(posEnd - pos);
-    [_inputFile seekToFileOffset:pos];
-    [self readAndDeliver:cRead];
+    // the mdat size is only filled in when the writer finishes the file,
+    // so fetch it directly without disturbing the buffered data
+    unsigned char hdr[4];
+    if (pread([_inputFile fileDescriptor], hdr, sizeof(hdr), (off_t)_posMDAT) == sizeof(hdr))
+    {
+        // extract nalus from the buffered position to mdat end
+        [self readAndDeliver:_posMDAT + to_host(hdr)];
+    }
     
     // close and remove file
     [_inputFile closeFile];
-    _foundMDAT = false;
-    _bytesToNextAtom = 0;
     [[NSFileManager defaultManager] removeItemAtPath:oldPath error:nil];
     
-    
     // open new file and set up dispatch source
-    _inputFile = [NSFileHandle fileHandleForReadingAtPath:_writer.path];
-    _readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, [_inputFile fileDescriptor], 0, _readQueue);
-    dispatch_source_set_event_handler(_readSource, ^{
-        [self onFileUpdate];
-    });
-    dispatch_resume(_readSource);
-    _swapping = NO;
+    @synchronized(self)
+    {
+        [self startReading];
+        _swapping = NO;
+    }
 }
 
-
-- (void) readAndDeliver:(uint32_t) cReady
+- (void) readAndDeliver:(uint64_t) posEnd
 {
-    // Identify the individual NALUs and extract them
-    while (cReady > _lengthSize)
+    // read everything up to posEnd in large blocks, extracting
+    // the NALUs from each block as it arrives
+    while (_posRead < posEnd)
     {
-        NSData* lenField = [_inputFile readDataOfLength:_lengthSize];
-        cReady -= _lengthSize;
-        unsigned char* p = (unsigned char*) [lenField bytes];
-        unsigned int lenNALU = to_host(p);
+        // move any partial NALU to the start of the buffer
+        if (_idxParse > 0)
+        {
+            unsigned char* pBuffer = (unsigned char*)[_readBuffer mutableBytes];
+            memmove(pBuffer, pBuffer + _idxParse, _cBuffered - _idxParse);
+            _cBuffered -= _idxParse;
+            _idxParse = 0;
+        }
+        if (_cBuffered == [_readBuffer length])
+        {
+            // a single NALU is larger than the buffer
+            [_readBuffer setLength:[_readBuffer length] * 2];
+        }
         
-        if (lenNALU > cReady)
+        size_t cSpace = [_readBuffer length] - _cBuffered;
+        uint64_t cAvail = posEnd - _posRead;
+        size_t cThis = (cAvail < cSpace) ? (size_t)cAvail : cSpace;
+        unsigned char* pBuffer = (unsigned char*)[_readBuffer mutableBytes];
+        ssize_t cRead = pread([_inputFile fileDescriptor], pBuffer + _cBuffered, cThis, (off_t)_posRead);
+        if (cRead <= 0)
         {
-            // whole NALU not present -- seek back to start of NALU and wait for more
-            [_inputFile seekToFileOffset:[_inputFile offsetInFile] - 4];
             break;
         }
-        NSData* nalu = [_inputFile readDataOfLength:lenNALU];
-        cReady -= lenNALU;
+        _cBuffered += cRead;
+        _posRead += cRead;
         
-        [self onNALU:nalu];
+        [self parseBuffer];
     }
 }
 
-- (void) onFileUpdate
+- (void) parseBuffer
 {
-    // called whenever there is more data to read in the main encoder output file.
-    
-    struct stat s;
-    fstat([_inputFile fileDescriptor], &s);
-    int cReady = (int)(s.st_size - [_inputFile offsetInFile]);
+    const unsigned char* pBuffer = (const unsigned char*)[_readBuffer bytes];
     
     // locate the mdat atom if needed
-    while (!_foundMDAT && (cReady > 8))
+    while (!_foundMDAT)
     {
-        if (_bytesToNextAtom == 0)
+        if (_bytesToNextAtom > 0)
         {
-            NSData* hdr = [_inputFile readDataOfLength:8];
-            cReady -= 8;
-            unsigned char* p = (unsigned char*) [hdr bytes];
-            int lenAtom = to_host(p);
-            unsigned int nameAtom = to_host(p+4);
-            if (nameAtom == (unsigned int)('mdat'))
-            {
-                _foundMDAT = true;
-                _posMDAT = [_inputFile offsetInFile] - 8;
-            }
-            else
+            uint64_t cThis = _cBuffered - _idxParse;
+            if (cThis > _bytesToNextAtom)
             {
-                _bytesToNextAtom = lenAtom - 8;
+                cThis = _bytesToNextAtom;
             }
+            _bytesToNextAtom -= cThis;
+            _idxParse += cThis;
         }
-        if (_bytesToNextAtom > 0)
+        if ((_bytesToNextAtom > 0) || ((_cBuffered - _idxParse) < 8))
         {
-            int cThis = cReady < _bytesToNextAtom ? cReady :_bytesToNextAtom;
-            _bytesToNextAtom -= cThis;
-            [_inputFile seekToFileOffset:[_inputFile offsetInFile]+cThis];
-            cReady -= cThis;
+            return;
         }
+        
+        const unsigned char* p = pBuffer + _idxParse;
+        unsigned int lenAtom = to_host((unsigned char*)p);
+        unsigned int nameAtom = to_host((unsigned char*)p+4);
+        if (nameAtom == (unsigned int)('mdat'))
+        {
+            _foundMDAT = YES;
+            _posMDAT = (_posRead - _cBuffered) + _idxParse;
+        }
+        else
+        {
+            _bytesToNextAtom = lenAtom - 8;
+        }
+        _idxParse += 8;
     }
-    if (!_foundMDAT)
+    
+    // the mdat must be just encoded video: identify the individual NALUs and extract them
+    while ((_cBuffered - _idxParse) > (size_t)_lengthSize)
     {
-        return;
+        const unsigned char* p = pBuffer + _idxParse;
+        unsigned int lenNALU = 0;
+        for (int i = 0; i < _lengthSize; i++)
+        {
+            lenNALU = (lenNALU << 8) + p[i];
+        }
+        if ((_lengthSize + lenNALU) > (_cBuffered - _idxParse))
+        {
+            // whole NALU not present -- wait for more
+            break;
+        }
+        NSData* nalu = [NSData dataWithBytes:p + _lengthSize length:lenNALU];
+        _idxParse += _lengthSize + lenNALU;
+        
+        [self onNALU:nalu];
     }
-    
-    // the mdat must be just encoded video.
-    [self readAndDeliver:cReady];
+}
+
+- (void) onFileUpdate
+{
+    // called whenever there is more data to read in the main encoder output file.
+    struct stat s;
+    fstat([_inputFile fileDescriptor], &s);
+    [self readAndDeliver:s.st_size];
 }
 
 - (void) deliverFrame: (NSArray*) frame withTime:(double) pts
@@ -437,37 +508,34 @@ static unsigned int to_host(unsigned char* p)
     
 }
 
-- (void) processStoredFrames
+- (void) processStoredFrames:(int) depth
 {
-    // first has the last timestamp and rest use up timestamps from the start
-    int n = 0;
-    for (EncodedFrame* f in _frames)
+    // timestamps are in presentation order. Once more than depth frames
+    // are waiting, the one with the lowest POC cannot be preceded by
+    // any frame still to come, so it takes the next timestamp.
+    while (_frames.Untimed() > depth)
     {
-        int index = 0;
-        if (n == 0)
+        double pts;
+        if (_times.Pop(&pts))
         {
-            index = (int) [_frames count] - 1;
+            _frames.AssignNext(pts);
         }
         else
         {
-            index = n-1;
-        }
-        double pts = 0;
-        @synchronized(_times)
-        {
-            if ([_times count] > 0)
-            {
-                pts = [_times[index] doubleValue];
-            }
+            // the timestamp was lost when the queue was full: without
+            // it the frame cannot be delivered
+            NSLog(@"No timestamp for frame: dropped");
+            _frames.DropNext();
         }
-        [self deliverFrame:f.frame withTime:pts];
-        n++;
     }
-    @synchronized(_times)
+    
+    // frames are delivered in decoding order
+    NSArray* frame;
+    double pts;
+    while (_frames.PopReady(&frame, &pts))
     {
-        [_times removeObjectsInRange:NSMakeRange(0, [_frames count])];
+        [self deliverFrame:frame withTime:pts];
     }
-    [_frames removeAllObjects];
 }
 
 - (void) onEncodedFrame
@@ -482,38 +550,19 @@ static unsigned int to_host(unsigned char* p)
         }
     }
     
-    if (poc == 0)
+    if (_pocState.isReset())
     {
-        [self processStoredFrames];
-        double pts = 0;
-        int index = 0;
-        @synchronized(_times)
-        {
-            if ([_times count] > 0)
-            {
-                pts = [_times[index] doubleValue];
-                [_times removeObjectAtIndex:index];
-            }
-        }
-        [self deliverFrame:_pendingNALU withTime:pts];
-        _prevPOC = 0;
+        // IDR or mmco 5: all stored frames come before this one
+        [self processStoredFrames:0];
     }
-    else
+    if (!_frames.Add(_pendingNALU, poc))
     {
-        EncodedFrame* f = [[EncodedFrame alloc] initWithData:_pendingNALU andPOC:poc];
-        if (poc > _prevPOC)
-        {
-            // all pending frames come before this, so share out the
-            // timestamps in order of POC
-            [self processStoredFrames];
-            _prevPOC = poc;
-        }
-        if (_frames == nil)
-        {
-            _frames = [NSMutableArray arrayWithCapacity:2];
-        }
-        [_frames addObject:f];
+        // stream reorders further than the spec allows: release the
+        // oldest frames with the timestamps we have
+        [self processStoredFrames:0];
+        _frames.Add(_pendingNALU, poc);
     }
+    [self processStoredFrames:_pocState.ReorderDepth()];
 }
 
 // combine multiple NALUs into a single frame, and in the process, convert to BSF
@@ -523,6 +572,31 @@ static unsigned int to_host(unsigned char* p)
     unsigned char* pNal = (unsigned char*)[nalu bytes];
     int idc = pNal[0] & 0x60;
     int naltype = pNal[0] & 0x1f;
+    
+    if (_avcC == nil)
+    {
+        // frames cannot be timed until we have the param sets:
+        // look for them in-band while we wait for the header file.
+        if (naltype == NALUnit::NAL_Sequence_Params)
+        {
+            _spsInband = nalu;
+        }
+        else if (naltype == NALUnit::NAL_Picture_Params)
+        {
+            _ppsInband = nalu;
+        }
+        if (_waitingNALU == nil)
+        {
+            _waitingNALU = [NSMutableArray arrayWithCapacity:16];
+        }
+        [_waitingNALU addObject:nalu];
+        if ((_spsInband != nil) && (_ppsInband != nil) && ([_spsInband length] >= 4))
+        {
+            [self setParamsFromSPS:_spsInband andPPS:_ppsInband];
+            [self onParamsReady];
+        }
+        return;
+    }
 
     if (_pendingNALU)
     {
@@ -0,0 +1,236 @@
+//
+// FrameQueueBenchmark.cpp
+//
+// Stress tests SPSCQueue across two threads and checks ReorderBuffer's
+// timestamp assignment
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+/*
+ Build and run from this directory with:
+
+    c++ -std=gnu++0x -O2 -pthread -I.. -o FrameQueueBenchmark FrameQueueBenchmark.cpp
+    ./FrameQueueBenchmark
+
+ It pushes tens of millions of items through small SPSCQueues from one
+ thread to another, checking that each arrives once, whole and in order,
+ and reports items per second. Then it feeds ReorderBuffer frames of an
+ IBBP stream in decoding order the way AVEncoder does, timestamps arriving
+ in presentation order, and checks every frame comes out in decoding order
+ with its own time, and that a lost timestamp costs one frame rather
+ than stamping one with zero.
+*/
+
+#include "FrameQueue.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// --- SPSCQueue ---------------------------------------------
+
+// two words that must always agree, to show up torn reads
+struct Item
+{
+    unsigned long long seq;
+    unsigned long long check;
+};
+
+template<unsigned int Capacity>
+static void StressQueue(unsigned long long cItems)
+{
+    SPSCQueue<Item, Capacity>* pQueue = new SPSCQueue<Item, Capacity>;
+    unsigned long long cFull = 0;
+
+    double start = NowSeconds();
+    std::thread producer([pQueue, cItems, &cFull]() {
+        for (unsigned long long i = 0; i < cItems; i++)
+        {
+            Item item = { i, ~i };
+            while (!pQueue->Push(item))
+            {
+                cFull++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    bool bInOrder = true;
+    unsigned long long cEmpty = 0;
+    for (unsigned long long i = 0; i < cItems; i++)
+    {
+        Item item;
+        while (!pQueue->Pop(&item))
+        {
+            cEmpty++;
+            std::this_thread::yield();
+        }
+        bInOrder = bInOrder && (item.seq == i) && (item.check == ~i);
+    }
+    producer.join();
+    double elapsed = NowSeconds() - start;
+
+    Item item;
+    char what[96];
+    snprintf(what, sizeof(what), "capacity %u: every item arrives once, whole and in order", Capacity);
+    Check(bInOrder && !pQueue->Pop(&item) && (pQueue->Count() == 0), what);
+    printf("capacity %-4u %9.1f M items/s, full %llu times, empty %llu times\n",
+           Capacity, cItems / elapsed * 1e-6, cFull, cEmpty);
+    delete pQueue;
+}
+
+// --- ReorderBuffer -----------------------------------------
+
+// AVEncoder's processStoredFrames, with frames as presentation indexes
+struct Extractor
+{
+    SPSCQueue<double, 64> times;
+    ReorderBuffer<int, 16> frames;
+    std::vector<int> delivered;
+    std::vector<double> deliveredPTS;
+    int cDropped;
+
+    Extractor()
+    : cDropped(0)
+    {
+    }
+
+    void ProcessStoredFrames(int depth)
+    {
+        while (frames.Untimed() > depth)
+        {
+            double pts;
+            if (times.Pop(&pts))
+            {
+                frames.AssignNext(pts);
+            }
+            else
+            {
+                frames.DropNext();
+                cDropped++;
+            }
+        }
+        int frame;
+        double pts;
+        while (frames.PopReady(&frame, &pts))
+        {
+            delivered.push_back(frame);
+            deliveredPTS.push_back(pts);
+        }
+    }
+};
+
+// IDR B B P B B P ... in GOPs of cGOP frames, as presentation indexes in
+// decoding order: each P comes before the two Bs shown ahead of it
+static std::vector<int> DecodingOrder(int cFrames, int cGOP)
+{
+    std::vector<int> order;
+    for (int gop = 0; gop < cFrames; gop += cGOP)
+    {
+        int cThis = (cFrames - gop < cGOP) ? cFrames - gop : cGOP;
+        order.push_back(gop);
+        int anchor = 0;
+        while (anchor + 1 < cThis)
+        {
+            int next = (anchor + 3 < cThis) ? anchor + 3 : cThis - 1;
+            order.push_back(gop + next);
+            for (int b = anchor + 1; b < next; b++)
+            {
+                order.push_back(gop + b);
+            }
+            anchor = next;
+        }
+    }
+    return order;
+}
+
+static void CheckReorder(int cFrames, int cGOP, int lostTimestamp)
+{
+    Extractor extractor;
+    std::vector<int> order = DecodingOrder(cFrames, cGOP);
+    int cTimestamps = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        // capture runs ahead of the encoder, so the timestamps of every
+        // frame up to this one in presentation order are in
+        while (cTimestamps <= order[i])
+        {
+            if (cTimestamps != lostTimestamp)
+            {
+                extractor.times.Push(cTimestamps / 30.0);
+            }
+            cTimestamps++;
+        }
+
+        int frame = order[i];
+        bool bIDR = (frame % cGOP) == 0;
+        if (bIDR)
+        {
+            extractor.ProcessStoredFrames(0);
+        }
+        extractor.frames.Add(frame, (frame % cGOP) * 2);
+        extractor.ProcessStoredFrames(2);
+    }
+    extractor.ProcessStoredFrames(0);
+
+    // nothing ties a timestamp to its frame, so after a lost one each frame
+    // takes the next frame's time, until the last has none and is dropped
+    int dropped = (lostTimestamp >= 0) ? cFrames - 1 : -1;
+
+    bool bOK = (extractor.cDropped == ((dropped >= 0) ? 1 : 0));
+    size_t iDelivered = 0;
+    for (size_t i = 0; (i < order.size()) && bOK; i++)
+    {
+        if (order[i] == dropped)
+        {
+            continue;
+        }
+        bOK = (iDelivered < extractor.delivered.size()) && (extractor.delivered[iDelivered] == order[i]);
+        int expected = order[i];
+        if ((lostTimestamp >= 0) && (expected >= lostTimestamp))
+        {
+            expected++;
+        }
+        bOK = bOK && (extractor.deliveredPTS[iDelivered] == expected / 30.0);
+        iDelivered++;
+    }
+    bOK = bOK && (iDelivered == extractor.delivered.size());
+
+    char what[128];
+    snprintf(what, sizeof(what), "%d frames in GOPs of %d%s: decoding order, each with its time", cFrames, cGOP,
+             (lostTimestamp >= 0) ? ", one timestamp lost" : "");
+    Check(bOK, what);
+}
+
+int main()
+{
+    StressQueue<2>(1 << 22);
+    StressQueue<16>(1 << 24);
+    StressQueue<256>(1 << 25);
+
+    CheckReorder(300, 30, -1);
+    CheckReorder(301, 10, -1);
+    CheckReorder(100, 30, 44);
+    CheckReorder(100, 30, 59);
+    printf("checks %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
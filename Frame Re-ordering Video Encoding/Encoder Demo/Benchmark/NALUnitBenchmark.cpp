@@ -0,0 +1,607 @@
+//
+// NALUnitBenchmark.cpp
+//
+// Checks and times NALUnit's bit reader and start code scan against the
+// code they replaced
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+/*
+ Build and run from this directory with:
+
+    c++ -std=gnu++0x -O2 -I.. -o NALUnitBenchmark NALUnitBenchmark.cpp ../NALUnit.cpp
+    ./NALUnitBenchmark
+
+ It checks GetBit, GetWord, GetUE, GetSE and Skip against the byte at a time
+ reader NALUnit used to have, on random exp-Golomb streams with emulation
+ prevention bytes in them, reading past the end included. Then it times
+ both readers on a stream of small UE codes, as slice headers have, and on
+ fixed width words.
+
+ It also checks that Parse finds the same NAL units in Annex-B streams as
+ the byte loop did, over random zero densities and every buffer end, and
+ times the scan in GB/s on typical slice data and on data heavy with
+ emulation prevention bytes.
+*/
+
+#include "NALUnit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// --- the original reader -----------------------------------
+
+// NALUnit's bitstream access as it was, apart from Skip, which now also
+// drops the bits left over when a skip ends on a byte boundary. That was
+// a bug fixed along with the rewrite, and the two readers disagree
+// without it.
+class OldNALUnit
+{
+public:
+    OldNALUnit(const BYTE* pStart, int len)
+    : m_pStart(pStart),
+      m_cBytes(len),
+      m_idx(0),
+      m_nBits(0),
+      m_byte(0),
+      m_cZeros(0)
+    {
+    }
+
+    void Skip(int nBits);
+    unsigned long GetWord(int nBits);
+    unsigned long GetUE();
+    long GetSE();
+    BYTE GetBYTE();
+    unsigned long GetBit();
+    bool NoMoreBits()   { return (m_idx >= m_cBytes) && (m_nBits == 0); }
+
+private:
+    const BYTE* m_pStart;
+    int m_cBytes;
+    int m_idx;
+    int m_nBits;
+    BYTE m_byte;
+    int m_cZeros;
+};
+
+void
+OldNALUnit::Skip(int nBits)
+{
+    if (nBits < m_nBits)
+    {
+        m_nBits -= nBits;
+    } else {
+        nBits -= m_nBits;
+        m_nBits = 0;
+        while (nBits >= 8)
+        {
+            GetBYTE();
+            nBits -= 8;
+        }
+        if (nBits)
+        {
+            m_byte = GetBYTE();
+            m_nBits = 8;
+
+            m_nBits -= nBits;
+        }
+    }
+}
+
+BYTE
+OldNALUnit::GetBYTE()
+{
+    if (m_idx >= m_cBytes)
+    {
+        return 0;
+    }
+
+    BYTE b = m_pStart[m_idx++];
+
+    // to avoid start-code emulation, a byte 0x03 is inserted
+    // after any 00 00 pair. Discard that here.
+    if (b == 0)
+    {
+        m_cZeros++;
+        if ((m_idx < m_cBytes) && (m_cZeros == 2) && (m_pStart[m_idx] == 0x03))
+        {
+            m_idx++;
+            m_cZeros=0;
+        }
+    } else {
+        m_cZeros = 0;
+    }
+    return b;
+}
+
+unsigned long
+OldNALUnit::GetBit()
+{
+    if (m_nBits == 0)
+    {
+        m_byte = GetBYTE();
+        m_nBits = 8;
+    }
+    m_nBits--;
+    return (m_byte >> m_nBits) & 0x1;
+}
+
+unsigned long
+OldNALUnit::GetWord(int nBits)
+{
+    unsigned long u = 0;
+    while (nBits > 0)
+    {
+        u <<= 1;
+        u |= GetBit();
+        nBits--;
+    }
+    return u;
+}
+
+unsigned long
+OldNALUnit::GetUE()
+{
+    int cZeros = 0;
+    while (GetBit() == 0)
+    {
+        // check for partial data (Dmitri Vasilyev)
+        if (NoMoreBits())
+        {
+            return 0;
+        }
+        cZeros++;
+    }
+    return GetWord(cZeros) + ((1 << cZeros)-1);
+}
+
+long
+OldNALUnit::GetSE()
+{
+    unsigned long UE = GetUE();
+    bool bPositive = UE & 1;
+    long SE = (UE + 1) >> 1;
+    if (!bPositive)
+    {
+        SE = -SE;
+    }
+    return SE;
+}
+
+// GetStartCode and the start code half of Parse as they were, scanning
+// a byte at a time
+static bool
+OldGetStartCode(const BYTE*& pBegin, const BYTE*& pStart, int& cRemain)
+{
+    const BYTE* pThis = pStart;
+    int cBytes = cRemain;
+
+    pBegin = NULL;
+    while (cBytes>= 4)
+    {
+        if (pThis[0] == 0)
+        {
+            // remember first 00
+            if (pBegin == NULL)
+            {
+                pBegin = pThis;
+            }
+            if ((pThis[1] == 0) &&
+                (pThis[2] == 1))
+            {
+                // point to type byte of NAL unit
+                pStart = pThis + 3;
+                cRemain = cBytes - 3;
+                return true;
+            }
+        } else {
+            pBegin = NULL;
+        }
+        cBytes--;
+        pThis++;
+    }
+    return false;
+}
+
+struct ParsedNALU
+{
+    const BYTE* pStart;
+    const BYTE* pStartCodeStart;
+    int cBytes;
+
+    bool operator==(const ParsedNALU& r) const
+    {
+        return (pStart == r.pStart) && (pStartCodeStart == r.pStartCodeStart) && (cBytes == r.cBytes);
+    }
+};
+
+static bool
+OldParse(const BYTE* pBuffer, int cSpace, bool bEnd, ParsedNALU* pnalu)
+{
+    const BYTE* pBegin;
+    if (OldGetStartCode(pBegin, pBuffer, cSpace))
+    {
+        pnalu->pStart = pBuffer;
+        pnalu->pStartCodeStart = pBegin;
+
+        if (OldGetStartCode(pBegin, pBuffer, cSpace))
+        {
+            pnalu->cBytes = int(pBegin - pnalu->pStart);
+            return true;
+        } else if (bEnd)
+        {
+            pnalu->cBytes = cSpace;
+            return true;
+        }
+    }
+    return false;
+}
+
+// every NALU in the buffer, the way a reader walks through a stream
+static std::vector<ParsedNALU> OldSplit(const BYTE* pBuffer, int cSpace, bool bEnd)
+{
+    std::vector<ParsedNALU> nalus;
+    const BYTE* pEnd = pBuffer + cSpace;
+    ParsedNALU nalu;
+    while (OldParse(pBuffer, int(pEnd - pBuffer), bEnd, &nalu))
+    {
+        nalus.push_back(nalu);
+        pBuffer = nalu.pStart + nalu.cBytes;
+    }
+    return nalus;
+}
+
+static std::vector<ParsedNALU> Split(const BYTE* pBuffer, int cSpace, bool bEnd)
+{
+    std::vector<ParsedNALU> nalus;
+    const BYTE* pEnd = pBuffer + cSpace;
+    NALUnit nalu;
+    while (nalu.Parse(pBuffer, int(pEnd - pBuffer), 0, bEnd))
+    {
+        ParsedNALU parsed = { nalu.Start(), nalu.StartCodeStart(), nalu.Length() };
+        nalus.push_back(parsed);
+        pBuffer = nalu.Start() + nalu.Length();
+    }
+    return nalus;
+}
+
+// --- test streams ------------------------------------------
+
+class BitWriter
+{
+public:
+    BitWriter()
+    : m_cBits(0)
+    {
+    }
+
+    void PutBits(unsigned long long value, int nBits)
+    {
+        for (int i = nBits - 1; i >= 0; i--)
+        {
+            if ((m_cBits % 8) == 0)
+            {
+                m_bytes.push_back(0);
+            }
+            if ((value >> i) & 1)
+            {
+                m_bytes.back() |= 0x80 >> (m_cBits % 8);
+            }
+            m_cBits++;
+        }
+    }
+
+    void PutUE(unsigned long value)
+    {
+        int cZeros = 0;
+        while ((value + 1) >> (cZeros + 1))
+        {
+            cZeros++;
+        }
+        PutBits(0, cZeros);
+        PutBits(value + 1, cZeros + 1);
+    }
+
+    // the NALU payload, with an 03 after every 00 00 that is followed
+    // by a byte of 03 or less
+    std::vector<BYTE> Escaped() const
+    {
+        std::vector<BYTE> out;
+        int cZeros = 0;
+        for (size_t i = 0; i < m_bytes.size(); i++)
+        {
+            if ((cZeros == 2) && (m_bytes[i] <= 3))
+            {
+                out.push_back(3);
+                cZeros = 0;
+            }
+            out.push_back(m_bytes[i]);
+            cZeros = (m_bytes[i] == 0) ? cZeros + 1 : 0;
+        }
+        return out;
+    }
+
+private:
+    std::vector<BYTE> m_bytes;
+    long long m_cBits;
+};
+
+static unsigned long RandomUE()
+{
+    // mostly small, as in real headers, with the occasional long code
+    switch (rand() % 4)
+    {
+    case 0:     return rand() % 4;
+    case 1:     return rand() % 64;
+    case 2:     return rand() % 4096;
+    default:    return (unsigned long)rand() % (1UL << (rand() % 30));
+    }
+}
+
+static std::vector<BYTE> RandomStream(int cItems)
+{
+    BitWriter writer;
+    for (int i = 0; i < cItems; i++)
+    {
+        switch (rand() % 4)
+        {
+        case 0:
+            writer.PutUE(RandomUE());
+            break;
+        case 1:
+            writer.PutBits(rand(), 1 + rand() % 16);
+            break;
+        case 2:
+            // zero runs bring out the emulation prevention bytes
+            writer.PutBits(0, 8 + rand() % 40);
+            writer.PutBits(rand() % 4, 2 + rand() % 6);
+            break;
+        default:
+            writer.PutBits((unsigned long long)rand() << 31 | rand(), 1 + rand() % 62);
+            break;
+        }
+    }
+    return writer.Escaped();
+}
+
+// An Annex-B stream of cNALUs units of up to cMaxBytes, each with a 3 or
+// 4 byte start code. In the payload about one byte in zeroOneIn is 00,
+// and the writer escapes the runs of them.
+static std::vector<BYTE> AnnexBStream(int cNALUs, int cMaxBytes, int zeroOneIn)
+{
+    std::vector<BYTE> stream;
+    for (int i = 0; i < cNALUs; i++)
+    {
+        BitWriter writer;
+        writer.PutBits(0x65, 8);
+        int cBytes = rand() % cMaxBytes;
+        for (int j = 0; j < cBytes; j++)
+        {
+            writer.PutBits((rand() % zeroOneIn) ? 1 + rand() % 255 : 0, 8);
+        }
+        // a NALU never ends in 00
+        writer.PutBits(0x80, 8);
+
+        static const BYTE startCode[] = { 0, 0, 0, 1 };
+        int cStartCode = (rand() % 2) ? 3 : 4;
+        stream.insert(stream.end(), startCode + 4 - cStartCode, startCode + 4);
+        std::vector<BYTE> payload = writer.Escaped();
+        stream.insert(stream.end(), payload.begin(), payload.end());
+    }
+    return stream;
+}
+
+// --- checks ------------------------------------------------
+
+// The old GetUE overflows an int on codes of 31 or more leading zeros,
+// which H.264 never uses but random data is full of, so those aren't
+// compared.
+static bool FitsOldUE(OldNALUnit old)
+{
+    for (int cZeros = 0; cZeros < 31; cZeros++)
+    {
+        if (old.GetBit() || old.NoMoreBits())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void CheckReader()
+{
+    bool same = true;
+    for (int trial = 0; (trial < 3000) && same; trial++)
+    {
+        std::vector<BYTE> data = RandomStream(1 + rand() % 64);
+        NALUnit nalu(&data[0], (int)data.size());
+        OldNALUnit old(&data[0], (int)data.size());
+
+        // keep going past the end, where both should read zeros
+        for (int op = 0; (op < 400) && same; op++)
+        {
+            switch (rand() % 6)
+            {
+            case 0:
+                same = nalu.GetBit() == old.GetBit();
+                break;
+            case 1:
+            {
+                int nBits = 1 + rand() % 32;
+                same = nalu.GetWord(nBits) == old.GetWord(nBits);
+                break;
+            }
+            case 2:
+            {
+                // as many bits as unsigned long holds
+                int nBits = 33 + rand() % (sizeof(unsigned long) * 8 - 32);
+                same = nalu.GetWord(nBits) == old.GetWord(nBits);
+                break;
+            }
+            case 3:
+                if (FitsOldUE(old))
+                {
+                    same = nalu.GetUE() == old.GetUE();
+                }
+                break;
+            case 4:
+                if (FitsOldUE(old))
+                {
+                    same = nalu.GetSE() == old.GetSE();
+                }
+                break;
+            default:
+            {
+                int nBits = rand() % 80;
+                nalu.Skip(nBits);
+                old.Skip(nBits);
+                break;
+            }
+            }
+            // Past the end the old reader makes up a zero byte at a time
+            // and says there are bits left in it, so only its "no more"
+            // has to agree.
+            same = same && (!old.NoMoreBits() || nalu.NoMoreBits());
+        }
+    }
+    Check(same, "bit reader matches the original");
+}
+
+static void CheckStartCodes()
+{
+    bool same = true;
+    const int zeroDensities[] = { 2, 4, 16, 256, 100000 };
+    for (int trial = 0; (trial < 2000) && same; trial++)
+    {
+        std::vector<BYTE> stream = AnnexBStream(1 + rand() % 4, 1 + rand() % 200, zeroDensities[trial % 5]);
+
+        // stray zeros before a start code belong to it
+        if (trial % 3 == 0)
+        {
+            stream.insert(stream.begin(), rand() % 6, 0);
+        }
+
+        // every way the buffer can end, mid start code included, with the
+        // data copied so reading past the end would show up under ASan
+        for (size_t cSpace = 0; (cSpace <= stream.size()) && same; cSpace++)
+        {
+            std::vector<BYTE> buffer(stream.begin(), stream.begin() + cSpace);
+            const BYTE* p = buffer.empty() ? NULL : &buffer[0];
+            bool bEnd = (cSpace % 2) == 0;
+            same = Split(p, (int)cSpace, bEnd) == OldSplit(p, (int)cSpace, bEnd);
+        }
+    }
+    Check(same, "start code scan matches the byte loop");
+}
+
+// --- timing ------------------------------------------------
+
+static volatile unsigned long sink;
+
+template<class Reader>
+static double CodesPerSecond(const std::vector<BYTE>& data, int cCodes, bool bUE)
+{
+    double best = 1e9;
+    for (int run = 0; run < 5; run++)
+    {
+        double start = NowSeconds();
+        Reader reader(&data[0], (int)data.size());
+        unsigned long sum = 0;
+        for (int i = 0; i < cCodes; i++)
+        {
+            sum += bUE ? reader.GetUE() : reader.GetWord(1 + (i & 15));
+        }
+        sink = sum;
+        double elapsed = NowSeconds() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+    return cCodes / best;
+}
+
+static void TimeReader()
+{
+    const int cCodes = 1 << 20;
+
+    BitWriter ue;
+    for (int i = 0; i < cCodes; i++)
+    {
+        ue.PutUE(rand() % ((rand() % 8) ? 8 : 512));
+    }
+    std::vector<BYTE> ueData = ue.Escaped();
+
+    BitWriter words;
+    for (int i = 0; i < cCodes; i++)
+    {
+        words.PutBits(rand(), 1 + (i & 15));
+    }
+    std::vector<BYTE> wordData = words.Escaped();
+
+    printf("M codes/s                   old       new\n");
+    printf("GetUE, small codes     %8.1f  %8.1f\n",
+           CodesPerSecond<OldNALUnit>(ueData, cCodes, true) * 1e-6,
+           CodesPerSecond<NALUnit>(ueData, cCodes, true) * 1e-6);
+    printf("GetWord, 1-16 bits     %8.1f  %8.1f\n",
+           CodesPerSecond<OldNALUnit>(wordData, cCodes, false) * 1e-6,
+           CodesPerSecond<NALUnit>(wordData, cCodes, false) * 1e-6);
+}
+
+static void TimeStartCodes()
+{
+    printf("\nGB/s                         old       new\n");
+    const char* names[] = { "slice data", "emulation heavy" };
+    const int zeroOneIn[] = { 256, 3 };
+    for (int kind = 0; kind < 2; kind++)
+    {
+        // about 64 MB, in NALUs the size of a 720p slice
+        std::vector<BYTE> stream = AnnexBStream(1400, 96 * 1024, zeroOneIn[kind]);
+        int cNALUs[2] = { 0, 0 };
+        double best[2] = { 1e9, 1e9 };
+        for (int run = 0; run < 3; run++)
+        {
+            double start = NowSeconds();
+            cNALUs[0] = (int)OldSplit(&stream[0], (int)stream.size(), true).size();
+            double elapsed = NowSeconds() - start;
+            best[0] = (elapsed < best[0]) ? elapsed : best[0];
+
+            start = NowSeconds();
+            cNALUs[1] = (int)Split(&stream[0], (int)stream.size(), true).size();
+            elapsed = NowSeconds() - start;
+            best[1] = (elapsed < best[1]) ? elapsed : best[1];
+        }
+        Check(cNALUs[0] == 1400 && cNALUs[1] == 1400, "all the NALUs are found");
+        printf("%-22s %9.2f %9.2f\n", names[kind], stream.size() / best[0] * 1e-9, stream.size() / best[1] * 1e-9);
+    }
+}
+
+int main()
+{
+    srand(1);
+    CheckReader();
+    CheckStartCodes();
+    printf("checks %s\n\n", failures ? "FAILED" : "passed");
+    TimeReader();
+    TimeStartCodes();
+    return failures ? 1 : 0;
+}
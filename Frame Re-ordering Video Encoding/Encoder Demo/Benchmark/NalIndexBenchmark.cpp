@@ -0,0 +1,398 @@
+//
+// NalIndexBenchmark.cpp
+//
+// Checks and times NalIndex on synthetic elementary stream files
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+/*
+ Build and run from this directory with:
+
+    c++ -std=gnu++0x -O2 -I.. -o NalIndexBenchmark NalIndexBenchmark.cpp ../NalIndex.cpp ../NALUnit.cpp
+    ./NalIndexBenchmark
+
+ It writes random streams of NAL units to a temporary file, with 4 and 2
+ byte big-endian length fields as in an mdat and with Annex-B start codes
+ of 3 and 4 bytes, and checks that Open indexes every one of them: offset,
+ length, type, nal_ref_idc and, for slices, first_mb_in_slice, which is
+ written as an exp-Golomb code with emulation prevention bytes around it.
+ Empty length-prefixed NALUs must be left out of the index and a NALU cut
+ short by the end of the file must end it. Next has to agree with a plain
+ search for every type from every index. A file with no NALUs in it must
+ fail to open and leave the index empty.
+
+ Then it times Open, and a Next walk over every IDR slice, on about 64 MB
+ of NALUs the size of 720p slices, with length fields and with start codes.
+*/
+
+#include "NalIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// --- synthetic streams -------------------------------------
+
+class BitWriter
+{
+public:
+    BitWriter()
+    : m_cBits(0)
+    {
+    }
+
+    void PutBits(unsigned long long value, int nBits)
+    {
+        for (int i = nBits - 1; i >= 0; i--)
+        {
+            if ((m_cBits % 8) == 0)
+            {
+                m_bytes.push_back(0);
+            }
+            if ((value >> i) & 1)
+            {
+                m_bytes.back() |= 0x80 >> (m_cBits % 8);
+            }
+            m_cBits++;
+        }
+    }
+
+    void PutUE(unsigned long value)
+    {
+        int cZeros = 0;
+        while ((value + 1) >> (cZeros + 1))
+        {
+            cZeros++;
+        }
+        PutBits(0, cZeros);
+        PutBits(value + 1, cZeros + 1);
+    }
+
+    void PutByte(BYTE b)
+    {
+        PutBits(b, 8);
+    }
+
+    // rbsp_stop_one_bit and the zeros up to the byte boundary, so the
+    // NALU never ends in 00
+    void PutTrailingBits()
+    {
+        PutBits(1, 1);
+        while ((m_cBits % 8) != 0)
+        {
+            PutBits(0, 1);
+        }
+    }
+
+    // the NALU, with an 03 after every 00 00 that is followed by a byte
+    // of 03 or less
+    std::vector<BYTE> Escaped() const
+    {
+        std::vector<BYTE> out;
+        int cZeros = 0;
+        for (size_t i = 0; i < m_bytes.size(); i++)
+        {
+            if ((cZeros == 2) && (m_bytes[i] <= 3))
+            {
+                out.push_back(3);
+                cZeros = 0;
+            }
+            out.push_back(m_bytes[i]);
+            cZeros = (m_bytes[i] == 0) ? cZeros + 1 : 0;
+        }
+        return out;
+    }
+
+private:
+    std::vector<BYTE> m_bytes;
+    long long m_cBits;
+};
+
+struct Expected
+{
+    unsigned long long offset;
+    unsigned int length;
+    unsigned int type;
+    unsigned int nal_ref_idc;
+    unsigned int first_mb;
+};
+
+static const NALUnit::eNALType kTypes[] =
+{
+    NALUnit::NAL_Slice, NALUnit::NAL_IDR_Slice, NALUnit::NAL_SEI,
+    NALUnit::NAL_Sequence_Params, NALUnit::NAL_Picture_Params, NALUnit::NAL_AUD,
+};
+static const int kTypeCount = sizeof(kTypes) / sizeof(kTypes[0]);
+
+// one NALU of the given type and about cPayload bytes, escaped; slices
+// start with first_mb_in_slice, mostly small, with the occasional large one
+static std::vector<BYTE> MakeNALU(NALUnit::eNALType type, int nal_ref_idc, int cPayload, unsigned int* pfirst_mb)
+{
+    BitWriter writer;
+    writer.PutByte((BYTE)((nal_ref_idc << 5) | type));
+    *pfirst_mb = 0;
+    if ((type == NALUnit::NAL_Slice) || (type == NALUnit::NAL_IDR_Slice))
+    {
+        *pfirst_mb = (rand() % 4) ? rand() % 8160 : rand() % (1 << 23);
+        writer.PutUE(*pfirst_mb);
+    }
+    for (int i = 0; i < cPayload; i++)
+    {
+        // zeros often enough to need escaping
+        writer.PutByte((rand() % 4) ? (BYTE)rand() : 0);
+    }
+    writer.PutTrailingBits();
+    return writer.Escaped();
+}
+
+// cNALUs of random type and size; LengthSize 0 gives start codes
+static std::vector<BYTE> MakeStream(int cNALUs, int cMaxPayload, int LengthSize, std::vector<Expected>& expected)
+{
+    std::vector<BYTE> stream;
+    expected.clear();
+    for (int i = 0; i < cNALUs; i++)
+    {
+        NALUnit::eNALType type = kTypes[rand() % kTypeCount];
+        int nal_ref_idc = rand() % 4;
+        Expected e;
+        std::vector<BYTE> nalu = MakeNALU(type, nal_ref_idc, rand() % cMaxPayload, &e.first_mb);
+
+        if (LengthSize > 0)
+        {
+            // an empty NALU now and then, which isn't indexed
+            if ((rand() % 16) == 0)
+            {
+                stream.insert(stream.end(), LengthSize, 0);
+            }
+            for (int b = LengthSize - 1; b >= 0; b--)
+            {
+                stream.push_back((BYTE)(nalu.size() >> (8 * b)));
+            }
+        }
+        else
+        {
+            if (rand() % 2)
+            {
+                stream.push_back(0);
+            }
+            stream.push_back(0);
+            stream.push_back(0);
+            stream.push_back(1);
+        }
+        e.offset = stream.size();
+        e.length = (unsigned int)nalu.size();
+        e.type = type;
+        e.nal_ref_idc = nal_ref_idc;
+        stream.insert(stream.end(), nalu.begin(), nalu.end());
+        expected.push_back(e);
+    }
+    return stream;
+}
+
+static std::string WriteFile(const std::vector<BYTE>& stream)
+{
+    char path[] = "/tmp/NalIndexBenchmark.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return "";
+    }
+    size_t cDone = 0;
+    while (cDone < stream.size())
+    {
+        ssize_t cWritten = write(fd, &stream[cDone], stream.size() - cDone);
+        if (cWritten <= 0)
+        {
+            break;
+        }
+        cDone += cWritten;
+    }
+    close(fd);
+    return path;
+}
+
+// --- checks ------------------------------------------------
+
+static bool SameEntries(NalIndex& index, const std::vector<Expected>& expected, size_t cExpected)
+{
+    if ((size_t)index.Count() != cExpected)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < cExpected; i++)
+    {
+        const NalIndex::Entry& e = index.At((int)i);
+        const Expected& x = expected[i];
+        NALUnit nalu = index.NALU((int)i);
+        if ((e.offset != x.offset) || (e.length != x.length) || (e.type != x.type) ||
+            (e.nal_ref_idc != x.nal_ref_idc) || (e.first_mb != x.first_mb) ||
+            (nalu.Start() != index.Data() + x.offset) || (nalu.Length() != (int)x.length) ||
+            (nalu.Type() != (int)x.type))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool SameNext(NalIndex& index, const std::vector<Expected>& expected)
+{
+    for (int t = 0; t < kTypeCount; t++)
+    {
+        for (int from = 0; from <= index.Count(); from++)
+        {
+            int found = -1;
+            for (int i = from; i < (int)expected.size(); i++)
+            {
+                if (expected[i].type == (unsigned int)kTypes[t])
+                {
+                    found = i;
+                    break;
+                }
+            }
+            if (index.Next(from, kTypes[t]) != found)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void CheckIndex()
+{
+    const int lengthSizes[] = { 4, 2, 0 };
+    const char* names[] = { "4 byte lengths", "2 byte lengths", "start codes" };
+    for (int k = 0; k < 3; k++)
+    {
+        int LengthSize = lengthSizes[k];
+        bool sameEntries = true, sameNext = true, truncated = true, opened = true;
+        for (int trial = 0; trial < 50; trial++)
+        {
+            std::vector<Expected> expected;
+            std::vector<BYTE> stream = MakeStream(1 + rand() % 200, (trial % 5) ? 200 : 20000, LengthSize, expected);
+            std::string path = WriteFile(stream);
+
+            NalIndex index;
+            opened = opened && index.Open(path.c_str(), LengthSize);
+            sameEntries = sameEntries && SameEntries(index, expected, expected.size());
+            sameNext = sameNext && SameNext(index, expected);
+
+            // cut into the last NALU; with start codes it just ends sooner
+            if (LengthSize > 0)
+            {
+                std::vector<BYTE> cut(stream.begin(), stream.end() - 1 - rand() % expected.back().length);
+                unlink(path.c_str());
+                path = WriteFile(cut);
+                bool bOpen = index.Open(path.c_str(), LengthSize);
+                truncated = truncated && (bOpen == (expected.size() > 1)) && SameEntries(index, expected, expected.size() - 1);
+            }
+            index.Close();
+            unlink(path.c_str());
+        }
+        char what[128];
+        snprintf(what, sizeof(what), "%s: every file opens", names[k]);
+        Check(opened, what);
+        snprintf(what, sizeof(what), "%s: every NALU is indexed", names[k]);
+        Check(sameEntries, what);
+        snprintf(what, sizeof(what), "%s: Next finds the first of each type", names[k]);
+        Check(sameNext, what);
+        if (LengthSize > 0)
+        {
+            snprintf(what, sizeof(what), "%s: a NALU cut short ends the index", names[k]);
+            Check(truncated, what);
+        }
+    }
+
+    // nothing to index: a short length field, and bytes with no start code
+    const BYTE junk[] = { 0x12, 0x34, 0x56 };
+    std::string path = WriteFile(std::vector<BYTE>(junk, junk + sizeof(junk)));
+    NalIndex index;
+    bool bLengths = index.Open(path.c_str(), 4);
+    bool bEmptyAfterLengths = (index.Count() == 0) && (index.Data() == NULL) && (index.Size() == 0);
+    bool bStartCodes = index.Open(path.c_str(), 0);
+    bool bEmptyAfterStartCodes = (index.Count() == 0) && (index.Data() == NULL) && (index.Size() == 0);
+    unlink(path.c_str());
+    Check(!bLengths && !bStartCodes, "a file with no NALUs doesn't open");
+    Check(bEmptyAfterLengths && bEmptyAfterStartCodes, "a file that doesn't open leaves the index empty");
+    Check(!index.Open("/nonexistent/NalIndexBenchmark", 4), "a missing file doesn't open");
+}
+
+// --- timing ------------------------------------------------
+
+static void TimeIndex()
+{
+    printf("about 64 MB in NALUs the size of a 720p slice\n");
+    const int lengthSizes[] = { 4, 0 };
+    const char* names[] = { "4 byte lengths", "start codes" };
+    for (int k = 0; k < 2; k++)
+    {
+        std::vector<Expected> expected;
+        std::vector<BYTE> stream = MakeStream(1400, 96 * 1024, lengthSizes[k], expected);
+        std::string path = WriteFile(stream);
+        int cIDR = 0;
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            cIDR += (expected[i].type == NALUnit::NAL_IDR_Slice) ? 1 : 0;
+        }
+
+        double bestOpen = 1e9, bestNext = 1e9;
+        bool same = true;
+        for (int run = 0; run < 5; run++)
+        {
+            NalIndex index;
+            double start = NowSeconds();
+            index.Open(path.c_str(), lengthSizes[k]);
+            double elapsed = NowSeconds() - start;
+            bestOpen = (elapsed < bestOpen) ? elapsed : bestOpen;
+            same = same && SameEntries(index, expected, expected.size());
+
+            start = NowSeconds();
+            int cFound = 0;
+            for (int i = index.Next(0, NALUnit::NAL_IDR_Slice); i >= 0; i = index.Next(i + 1, NALUnit::NAL_IDR_Slice))
+            {
+                cFound++;
+            }
+            elapsed = NowSeconds() - start;
+            bestNext = (elapsed < bestNext) ? elapsed : bestNext;
+            same = same && (cFound == cIDR);
+        }
+        unlink(path.c_str());
+        Check(same, "the timed file is indexed in full");
+
+        // with length fields Open only reads the headers, so its GB/s is of the file, not of bytes scanned
+        printf("%-16s Open %7.2f ms %8.2f GB/s, Next over %d IDR slices %6.2f us\n", names[k],
+               bestOpen * 1e3, stream.size() / bestOpen * 1e-9, cIDR, bestNext * 1e6);
+    }
+}
+
+int main()
+{
+    srand(1);
+    CheckIndex();
+    printf("checks %s\n\n", failures ? "FAILED" : "passed");
+    TimeIndex();
+    return failures ? 1 : 0;
+}
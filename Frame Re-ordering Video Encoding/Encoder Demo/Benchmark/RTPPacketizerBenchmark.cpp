@@ -0,0 +1,352 @@
+//
+// RTPPacketizerBenchmark.cpp
+//
+// Checks RTPPacketizer over loopback UDP and times it against sending
+// one packet at a time
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+/*
+ Build and run from this directory with:
+
+    c++ -std=gnu++0x -O2 -pthread -I.. -o RTPPacketizerBenchmark RTPPacketizerBenchmark.cpp ../RTPPacketizer.cpp ../NALUnit.cpp
+    ./RTPPacketizerBenchmark
+
+ It packetizes access units of small and large NAL units, sends them to
+ a socket on 127.0.0.1 and checks that the datagrams arrive one per packet
+ with consecutive sequence numbers (across the 16-bit wrap), the marker bit
+ on the last packet only, and FU-A fragments that rebuild the original NAL
+ units. That covers UDP GSO too, where the kernel supports it, since
+ loopback splits each GSO message back into datagrams.
+
+ Then it sends a stream of 1080p-sized GOPs both ways: as
+ RTSPClientConnection used to, building each packet on the stack and
+ copying it into a new allocation for one sendto, and with
+ RTPPacketizer::Send. For each it reports packets per second, the
+ sending thread's CPU time per Mbit sent, and the share the receiver saw.
+*/
+
+#include "RTPPacketizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// CPU time of the calling thread where the platform can tell us,
+// otherwise of the whole process
+static double CPUSeconds()
+{
+    struct rusage usage;
+#if defined(RUSAGE_THREAD)
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static void Check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static unsigned int Random(unsigned int* pSeed)
+{
+    *pSeed = *pSeed * 1103515245 + 12345;
+    return *pSeed >> 8;
+}
+
+typedef std::vector<BYTE> NALU;
+
+static NALU MakeNALU(BYTE header, int cBytes, unsigned int* pSeed)
+{
+    NALU nalu(cBytes);
+    nalu[0] = header;
+    for (int i = 1; i < cBytes; i++)
+    {
+        nalu[i] = (BYTE)Random(pSeed);
+    }
+    return nalu;
+}
+
+// SPS, PPS and an IDR slice, or a single P slice
+static std::vector<NALU> MakeAccessUnit(bool bIDR, int cSlice, unsigned int* pSeed)
+{
+    std::vector<NALU> nalus;
+    if (bIDR)
+    {
+        nalus.push_back(MakeNALU(0x67, 14, pSeed));
+        nalus.push_back(MakeNALU(0x68, 4, pSeed));
+        nalus.push_back(MakeNALU(0x65, cSlice, pSeed));
+    }
+    else
+    {
+        nalus.push_back(MakeNALU(0x41, cSlice, pSeed));
+    }
+    return nalus;
+}
+
+static void Packetize(RTPPacketizer* pPacketizer, const std::vector<NALU>& nalus)
+{
+    pPacketizer->Reset();
+    for (size_t i = 0; i < nalus.size(); i++)
+    {
+        pPacketizer->AddNALU(&nalus[i][0], (int)nalus[i].size(), (i + 1) == nalus.size());
+    }
+}
+
+static int OpenReceiver(struct sockaddr_in* pAddr)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int cbBuffer = 16 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &cbBuffer, sizeof(cbBuffer));
+    struct timeval tv = { 0, 200 * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(pAddr, 0, sizeof(*pAddr));
+    pAddr->sin_family = AF_INET;
+    pAddr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr*)pAddr, sizeof(*pAddr));
+    socklen_t cbAddr = sizeof(*pAddr);
+    getsockname(fd, (struct sockaddr*)pAddr, &cbAddr);
+    return fd;
+}
+
+// --- loopback check ----------------------------------------
+
+static void CheckLoopback(int fdSend, int fdReceive, const struct sockaddr_in& addr, int maxPacket, int cSlice)
+{
+    unsigned int seed = cSlice;
+    std::vector<NALU> nalus = MakeAccessUnit(true, cSlice, &seed);
+    RTPPacketizer packetizer(maxPacket);
+    Packetize(&packetizer, nalus);
+
+    const unsigned short seqStart = 65530;
+    const unsigned long rtpTime = 0x12345678;
+    const unsigned long ssrc = 0xcafef00d;
+    packetizer.StampHeaders(0, seqStart, rtpTime, ssrc);
+    int cSent = packetizer.Send(fdSend, (const struct sockaddr*)&addr, sizeof(addr), 0);
+
+    std::vector<NALU> rebuilt;
+    std::vector<BYTE> datagram(65536);
+    int cPackets = 0;
+    bool bOK = (cSent == packetizer.Count()) && (packetizer.FirstIDRPacket() == 2);
+    while (bOK && (cPackets < packetizer.Count()))
+    {
+        ssize_t cBytes = recv(fdReceive, &datagram[0], datagram.size(), 0);
+        if (cBytes < RTPPacketizer::RTPHeaderSize + 1)
+        {
+            bOK = false;
+            break;
+        }
+        const BYTE* p = &datagram[0];
+        unsigned short seq = (p[2] << 8) | p[3];
+        unsigned long time = ((unsigned long)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+        unsigned long source = ((unsigned long)p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+        bool bMarker = (p[1] & 0x80) != 0;
+        bOK = (p[0] == 0x80) && ((p[1] & 0x7f) == RTPPacketizer::PayloadTypeH264) &&
+              (seq == (unsigned short)(seqStart + cPackets)) && (time == rtpTime) && (source == ssrc) &&
+              (cBytes <= maxPacket) && (bMarker == ((cPackets + 1) == packetizer.Count()));
+
+        const BYTE* pPayload = p + RTPPacketizer::RTPHeaderSize;
+        int cPayload = (int)cBytes - RTPPacketizer::RTPHeaderSize;
+        if ((pPayload[0] & 0x1f) == 28)
+        {
+            // FU-A: rebuild the NALU header from the indicator and FU header
+            bool bStart = (pPayload[1] & 0x80) != 0;
+            if (bStart)
+            {
+                rebuilt.push_back(NALU(1, (pPayload[0] & 0xe0) | (pPayload[1] & 0x1f)));
+            }
+            bOK = bOK && !rebuilt.empty();
+            if (bOK)
+            {
+                rebuilt.back().insert(rebuilt.back().end(), pPayload + 2, pPayload + cPayload);
+            }
+        }
+        else
+        {
+            rebuilt.push_back(NALU(pPayload, pPayload + cPayload));
+        }
+        cPackets++;
+    }
+    bOK = bOK && (rebuilt == nalus);
+
+    char what[128];
+    snprintf(what, sizeof(what), "%d byte IDR slice in packets of %d: arrives whole and in sequence", cSlice, maxPacket);
+    Check(bOK, what);
+}
+
+// --- timing ------------------------------------------------
+
+// what RTSPClientConnection did before: each packet built on the stack,
+// then copied into its own allocation (a CFData) for one send
+static int SendPerPacket(int fd, const struct sockaddr_in& addr, const std::vector<NALU>& nalus,
+                         unsigned short* pSeq, unsigned long rtpTime, unsigned long ssrc)
+{
+    const int max_packet_size = RTPPacketizer::DefaultMaxPacket;
+    const int rtp_header_size = RTPPacketizer::RTPHeaderSize;
+    const int max_single_packet = max_packet_size - rtp_header_size;
+    const int max_fragment_packet = max_single_packet - 2;
+    BYTE packet[max_packet_size];
+    int cPackets = 0;
+
+    for (size_t i = 0; i < nalus.size(); i++)
+    {
+        const BYTE* pSource = &nalus[i][0];
+        int cBytes = (int)nalus[i].size();
+        bool bLast = (i + 1) == nalus.size();
+        BYTE NALU_Header = pSource[0];
+        bool bFragment = (cBytes >= max_single_packet);
+        if (bFragment)
+        {
+            pSource++;
+            cBytes--;
+        }
+        bool bStart = true;
+        while (cBytes)
+        {
+            int cThis = bFragment ? ((cBytes < max_fragment_packet) ? cBytes : max_fragment_packet) : cBytes;
+            bool bEnd = (cThis == cBytes);
+            packet[0] = 0x80;
+            packet[1] = RTPPacketizer::PayloadTypeH264 | ((bLast && bEnd) ? 0x80 : 0);
+            packet[2] = (*pSeq >> 8) & 0xff;
+            packet[3] = *pSeq & 0xff;
+            (*pSeq)++;
+            for (int b = 0; b < 4; b++)
+            {
+                packet[4 + b] = (rtpTime >> (24 - 8 * b)) & 0xff;
+                packet[8 + b] = (ssrc >> (24 - 8 * b)) & 0xff;
+            }
+            BYTE* pDest = packet + rtp_header_size;
+            if (bFragment)
+            {
+                *pDest++ = (NALU_Header & 0xe0) + 28;
+                *pDest++ = (NALU_Header & 0x1f) | (bStart ? 0x80 : (bEnd ? 0x40 : 0));
+                bStart = false;
+            }
+            memcpy(pDest, pSource, cThis);
+            pDest += cThis;
+            pSource += cThis;
+            cBytes -= cThis;
+
+            int cPacket = (int)(pDest - packet);
+            BYTE* pCopy = (BYTE*)malloc(cPacket);
+            memcpy(pCopy, packet, cPacket);
+            sendto(fd, pCopy, cPacket, 0, (const struct sockaddr*)&addr, sizeof(addr));
+            free(pCopy);
+            cPackets++;
+        }
+    }
+    return cPackets;
+}
+
+static void TimeSend(int fdSend, int fdReceive, const struct sockaddr_in& addr, bool bBatched)
+{
+    // 30 frame GOPs at about 8 Mbit/s: a 200 KB IDR frame then 20 KB P frames
+    const int cGOPs = 200;
+    const int cGOP = 30;
+    unsigned int seed = 1;
+    std::vector<NALU> idr = MakeAccessUnit(true, 200 * 1024, &seed);
+    std::vector<NALU> p = MakeAccessUnit(false, 20 * 1024, &seed);
+
+    std::atomic<bool> bStop(false);
+    std::atomic<long long> cReceived(0);
+    std::thread receiver([fdReceive, &bStop, &cReceived]() {
+        std::vector<BYTE> datagram(65536);
+        for (;;)
+        {
+            if (recv(fdReceive, &datagram[0], datagram.size(), 0) > 0)
+            {
+                cReceived++;
+            }
+            else if (bStop)
+            {
+                break;
+            }
+        }
+    });
+
+    RTPPacketizer packetizer;
+    unsigned short seq = 0;
+    long long cPackets = 0;
+    long long cBytes = 0;
+    double start = NowSeconds();
+    double cpuStart = CPUSeconds();
+    for (int i = 0; i < cGOPs * cGOP; i++)
+    {
+        const std::vector<NALU>& nalus = ((i % cGOP) == 0) ? idr : p;
+        unsigned long rtpTime = i * 3000;
+        for (size_t n = 0; n < nalus.size(); n++)
+        {
+            cBytes += nalus[n].size();
+        }
+        if (bBatched)
+        {
+            Packetize(&packetizer, nalus);
+            packetizer.StampHeaders(0, seq, rtpTime, 0x1234);
+            int cSent = packetizer.Send(fdSend, (const struct sockaddr*)&addr, sizeof(addr), 0);
+            seq += packetizer.Count();
+            cPackets += (cSent > 0) ? cSent : 0;
+        }
+        else
+        {
+            cPackets += SendPerPacket(fdSend, addr, nalus, &seq, rtpTime, 0x1234);
+        }
+    }
+    double cpu = CPUSeconds() - cpuStart;
+    double elapsed = NowSeconds() - start;
+
+    bStop = true;
+    receiver.join();
+
+    double mbits = cBytes * 8 / 1e6;
+    printf("%-12s %8.0f K packets/s %8.1f Mbit/s %8.3f ms CPU per Mbit, %5.1f%% received\n",
+           bBatched ? "batched" : "per packet", cPackets / elapsed * 1e-3, mbits / elapsed,
+           cpu * 1e3 / mbits, cReceived * 100.0 / cPackets);
+}
+
+int main()
+{
+    struct sockaddr_in addr;
+    int fdReceive = OpenReceiver(&addr);
+    int fdSend = socket(AF_INET, SOCK_DGRAM, 0);
+    int cbBuffer = 4 * 1024 * 1024;
+    setsockopt(fdSend, SOL_SOCKET, SO_SNDBUF, &cbBuffer, sizeof(cbBuffer));
+
+    CheckLoopback(fdSend, fdReceive, addr, RTPPacketizer::DefaultMaxPacket, 100);
+    CheckLoopback(fdSend, fdReceive, addr, RTPPacketizer::DefaultMaxPacket, RTPPacketizer::DefaultMaxPacket - 14);
+    CheckLoopback(fdSend, fdReceive, addr, RTPPacketizer::DefaultMaxPacket, RTPPacketizer::DefaultMaxPacket * 3 - 30);
+    CheckLoopback(fdSend, fdReceive, addr, RTPPacketizer::DefaultMaxPacket, 200 * 1024);
+    CheckLoopback(fdSend, fdReceive, addr, 500, 300 * 1024);
+
+    TimeSend(fdSend, fdReceive, addr, false);
+    TimeSend(fdSend, fdReceive, addr, true);
+
+    close(fdSend);
+    close(fdReceive);
+    printf("checks %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+//
+// RTSPMessageBenchmark.m
+//
+// Checks RTSPMessage's incremental parser on requests split across
+// reads, and times it on pipelined requests
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+/*
+ Build and run from this directory on a Mac with:
+
+    clang -fobjc-arc -O2 -framework Foundation -I.. -o RTSPMessageBenchmark RTSPMessageBenchmark.m ../RTSPMessage.m
+    ./RTSPMessageBenchmark
+
+ It feeds a pipelined client session to parseBytes:length:used: through a
+ receive buffer, the way RTSPClientConnection does: split in two at every
+ byte boundary, one byte at a time and in reads of every size up to 64
+ bytes. Each time the same requests must come out, with the same CSeq and
+ header values; a request with a body holding a blank line and a request
+ with no CSeq (which is skipped, and logged once per feed) are among them.
+ It also checks that overlong requests and bad lengths are stream errors,
+ and that the body of a request with no CSeq is skipped with it.
+
+ Then it reports requests per second parsed from one large buffer of
+ pipelined requests, and from the same bytes arriving in TCP-sized reads.
+*/
+
+#import <Foundation/Foundation.h>
+#import "RTSPMessage.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(BOOL ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static const char* kSession =
+    "OPTIONS rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 1\r\nUser-Agent: Check\r\n\r\n"
+    "DESCRIBE rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 2\r\nAccept: application/sdp\r\n\r\n"
+    "SETUP rtsp://10.0.0.2/streamid=0 RTSP/1.0\r\nCSeq: 3\r\n"
+        "Transport: RTP/AVP;unicast;client_port=5000-5001\r\n\r\n"
+    "PLAY rtsp://10.0.0.2/ RTSP/1.0\r\ncseq:4\r\nSession: \t12345678 \r\n\r\n"
+    "SET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 5\r\nContent-Length: 14\r\n"
+        "Session: 12345678\r\n\r\nx\r\n\r\nCSeq: 9\r\n"
+    "GET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nSession: 12345678\r\n\r\n"
+    "TEARDOWN rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 6\r\nSession: 12345678\r\n\r\n";
+
+typedef struct
+{
+    const char* command;
+    int cseq;
+    const char* option;
+    const char* value;      // NULL if the option should be missing
+} Expected;
+
+static const Expected kExpected[] =
+{
+    { "OPTIONS",        1, "User-Agent",    "Check" },
+    { "DESCRIBE",       2, "Session",       NULL },
+    { "SETUP",          3, "transport",     "RTP/AVP;unicast;client_port=5000-5001" },
+    { "PLAY",           4, "Session",       "12345678" },
+    { "SET_PARAMETER",  5, "Content-Length", "14" },
+    { "TEARDOWN",       6, "Session",       "12345678" },
+};
+static const int kcExpected = sizeof(kExpected) / sizeof(kExpected[0]);
+
+// Feed the bytes to the parser through a receive buffer as RTSPClientConnection
+// does: a first read of cFirst bytes (if not 0), then reads of cRead bytes.
+// Returns the requests parsed, or nil on a stream error.
+static NSArray* Feed(const uint8_t* p, int cBytes, int cFirst, int cRead)
+{
+    NSMutableArray* requests = [NSMutableArray array];
+    NSMutableData* buffer = [NSMutableData data];
+    int idx = 0;
+    while (idx < cBytes)
+    {
+        int cThis = ((idx == 0) && (cFirst > 0)) ? cFirst : cRead;
+        if (cThis > (cBytes - idx))
+        {
+            cThis = cBytes - idx;
+        }
+        [buffer appendBytes:(p + idx) length:cThis];
+        idx += cThis;
+
+        const uint8_t* pBuffer = (const uint8_t*)[buffer bytes];
+        int cBuffer = (int)[buffer length];
+        int cParsed = 0;
+        while (cParsed < cBuffer)
+        {
+            int cUsed;
+            RTSPMessage* msg = [RTSPMessage parseBytes:(pBuffer + cParsed) length:(cBuffer - cParsed) used:&cUsed];
+            if (cUsed < 0)
+            {
+                return nil;
+            }
+            if (cUsed == 0)
+            {
+                break;
+            }
+            cParsed += cUsed;
+            if (msg != nil)
+            {
+                [requests addObject:msg];
+            }
+        }
+        [buffer replaceBytesInRange:NSMakeRange(0, cParsed) withBytes:NULL length:0];
+    }
+    return ([buffer length] == 0) ? requests : nil;
+}
+
+static BOOL MatchesSession(NSArray* requests)
+{
+    if ((requests == nil) || ((int)[requests count] != kcExpected))
+    {
+        return NO;
+    }
+    for (int i = 0; i < kcExpected; i++)
+    {
+        RTSPMessage* msg = requests[i];
+        const Expected* e = &kExpected[i];
+        NSString* value = [msg valueForOption:@(e->option)];
+        if (![msg.command isEqualToString:@(e->command)] || (msg.sequence != e->cseq))
+        {
+            return NO;
+        }
+        if ((e->value == NULL) ? (value != nil) : ![value isEqualToString:@(e->value)])
+        {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+static void CheckSplits()
+{
+    const uint8_t* p = (const uint8_t*)kSession;
+    int cBytes = (int)strlen(kSession);
+
+    BOOL bOK = YES;
+    for (int split = 1; (split < cBytes) && bOK; split++)
+    {
+        @autoreleasepool
+        {
+            bOK = MatchesSession(Feed(p, cBytes, split, cBytes));
+        }
+    }
+    Check(bOK, "session split in two at every byte boundary");
+
+    bOK = YES;
+    for (int cRead = 1; (cRead <= 64) && bOK; cRead++)
+    {
+        @autoreleasepool
+        {
+            bOK = MatchesSession(Feed(p, cBytes, 0, cRead));
+        }
+    }
+    Check(bOK, "session in reads of 1 to 64 bytes");
+}
+
+static void CheckErrors()
+{
+    @autoreleasepool
+    {
+        NSMutableData* overlong = [NSMutableData dataWithLength:(MAX_RTSP_REQUEST + 1)];
+        memset([overlong mutableBytes], 'A', [overlong length]);
+        Check(Feed((const uint8_t*)[overlong bytes], (int)[overlong length], 0, 1000) == nil,
+              "request with no end longer than MAX_RTSP_REQUEST is a stream error");
+
+        const char* bad = "SET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 1\r\nContent-Length: -5\r\n\r\n";
+        Check(Feed((const uint8_t*)bad, (int)strlen(bad), 0, 1) == nil, "negative Content-Length is a stream error");
+
+        const char* huge = "SET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 1\r\nContent-Length: 99999999\r\n\r\n";
+        Check(Feed((const uint8_t*)huge, (int)strlen(huge), 0, 1) == nil, "oversized Content-Length is a stream error");
+
+        // a request we can't use still has its body skipped, rather than
+        // parsed as the next request
+        const char* nocseq = "SET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nContent-Length: 46\r\n\r\n"
+                             "OPTIONS rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 7\r\n\r\n";
+        NSArray* requests = Feed((const uint8_t*)nocseq, (int)strlen(nocseq), 0, 1);
+        Check((requests != nil) && ([requests count] == 0), "body of a request with no CSeq is skipped");
+
+        // still waiting for the rest of the body: nothing parsed, nothing used
+        const char* partial = "SET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 1\r\nContent-Length: 10\r\n\r\nabc";
+        int cUsed = -2;
+        RTSPMessage* msg = [RTSPMessage parseBytes:(const uint8_t*)partial length:(int)strlen(partial) used:&cUsed];
+        Check((msg == nil) && (cUsed == 0), "request is held until its body is complete");
+    }
+}
+
+static void TimeParse()
+{
+    const char* request =
+        "GET_PARAMETER rtsp://10.0.0.2/ RTSP/1.0\r\nCSeq: 12345\r\nSession: 12345678\r\n"
+        "User-Agent: LibVLC/2.0.5 (LIVE555 Streaming Media v2012.12.18)\r\n\r\n";
+    const int cRequests = 200000;
+    int cRequest = (int)strlen(request);
+    NSMutableData* stream = [NSMutableData dataWithCapacity:(cRequest * cRequests)];
+    for (int i = 0; i < cRequests; i++)
+    {
+        [stream appendBytes:request length:cRequest];
+    }
+    const uint8_t* p = (const uint8_t*)[stream bytes];
+    int cBytes = (int)[stream length];
+
+    double start = NowSeconds();
+    int cParsed = 0;
+    int cFound = 0;
+    @autoreleasepool
+    {
+        while (cParsed < cBytes)
+        {
+            int cUsed;
+            RTSPMessage* msg = [RTSPMessage parseBytes:(p + cParsed) length:(cBytes - cParsed) used:&cUsed];
+            if (cUsed <= 0)
+            {
+                break;
+            }
+            cParsed += cUsed;
+            cFound += (msg != nil) ? 1 : 0;
+        }
+    }
+    double elapsed = NowSeconds() - start;
+    Check(cFound == cRequests, "every pipelined request is parsed from one buffer");
+    printf("one buffer      %8.0f K requests/s\n", cFound / elapsed * 1e-3);
+
+    start = NowSeconds();
+    NSUInteger cFed = 0;
+    @autoreleasepool
+    {
+        cFed = [Feed(p, cBytes, 0, 1400) count];
+    }
+    elapsed = NowSeconds() - start;
+    Check(cFed == cRequests, "every pipelined request is parsed from 1400 byte reads");
+    printf("1400 byte reads %8.0f K requests/s\n", cFed / elapsed * 1e-3);
+}
+
+int main()
+{
+    @autoreleasepool
+    {
+        CheckSplits();
+        CheckErrors();
+        TimeParse();
+    }
+    printf("checks %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
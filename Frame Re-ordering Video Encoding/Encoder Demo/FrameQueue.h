@@ -0,0 +1,189 @@
+//
+// FrameQueue.h
+//
+// Fixed-capacity queues for passing frame timestamps between
+// the capture and extractor threads without locks or allocation.
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Single-producer, single-consumer ring buffer. Push must only be
+// called from one thread and Pop from one other thread.
+// Capacity must be a power of two.
+template<typename T, unsigned int Capacity>
+class SPSCQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SPSCQueue()
+    : m_head(0),
+      m_tail(0)
+    {
+    }
+
+    // producer: false if the queue is full
+    bool Push(const T& item)
+    {
+        unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        if ((tail - m_head.load(std::memory_order_acquire)) >= Capacity)
+        {
+            return false;
+        }
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer: false if the queue is empty
+    bool Pop(T* pItem)
+    {
+        unsigned int head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        *pItem = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate when called from a thread other than the consumer
+    unsigned int Count()
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_items[Capacity];
+
+    // free-running indexes: head is written only by the consumer,
+    // and tail only by the producer
+    std::atomic<unsigned int> m_head;
+    std::atomic<unsigned int> m_tail;
+};
+
+// Frames held in decoding order until their presentation time is known.
+// Timestamps arrive in presentation order, so each one belongs to the
+// frame with the lowest POC that does not yet have a time. Frames are
+// released in decoding order once they have been assigned a time.
+// This is used only from the extractor thread.
+template<typename T, int Capacity>
+class ReorderBuffer
+{
+public:
+    ReorderBuffer()
+    : m_head(0),
+      m_count(0),
+      m_cUntimed(0)
+    {
+    }
+
+    int Count()     { return m_count; }
+    int Untimed()   { return m_cUntimed; }
+
+    // false if the buffer is full
+    bool Add(const T& item, int poc)
+    {
+        if (m_count >= Capacity)
+        {
+            return false;
+        }
+        Entry& e = m_entries[(m_head + m_count) % Capacity];
+        e.item = item;
+        e.poc = poc;
+        e.bTimed = false;
+        e.bDropped = false;
+        m_count++;
+        m_cUntimed++;
+        return true;
+    }
+
+    // give the next presentation time to the earliest untimed frame
+    bool AssignNext(double pts)
+    {
+        Entry* pNext = NextUntimed();
+        if (pNext == NULL)
+        {
+            return false;
+        }
+        pNext->pts = pts;
+        pNext->bTimed = true;
+        m_cUntimed--;
+        return true;
+    }
+
+    // the earliest untimed frame will never get a time: PopReady
+    // discards it instead of returning it
+    bool DropNext()
+    {
+        Entry* pNext = NextUntimed();
+        if (pNext == NULL)
+        {
+            return false;
+        }
+        pNext->bTimed = true;
+        pNext->bDropped = true;
+        m_cUntimed--;
+        return true;
+    }
+
+    // remove the oldest frame, if its time is known
+    bool PopReady(T* pItem, double* pPTS)
+    {
+        while ((m_count > 0) && m_entries[m_head].bDropped)
+        {
+            RemoveHead();
+        }
+        if ((m_count == 0) || !m_entries[m_head].bTimed)
+        {
+            return false;
+        }
+        Entry& e = m_entries[m_head];
+        *pItem = e.item;
+        *pPTS = e.pts;
+        RemoveHead();
+        return true;
+    }
+
+private:
+    struct Entry
+    {
+        T item;
+        int poc;
+        double pts;
+        bool bTimed;
+        bool bDropped;
+    };
+
+    Entry* NextUntimed()
+    {
+        Entry* pNext = NULL;
+        for (int i = 0; i < m_count; i++)
+        {
+            Entry& e = m_entries[(m_head + i) % Capacity];
+            if (!e.bTimed && ((pNext == NULL) || (e.poc < pNext->poc)))
+            {
+                pNext = &e;
+            }
+        }
+        return pNext;
+    }
+
+    void RemoveHead()
+    {
+        m_entries[m_head].item = T();
+        m_head = (m_head + 1) % Capacity;
+        m_count--;
+    }
+
+    Entry m_entries[Capacity];
+    int m_head;
+    int m_count;
+    int m_cUntimed;
+};
@@ -12,6 +12,14 @@
 #include "StdAfx.h"
 #endif
 #include "NALUnit.h"
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 
 // --- core NAL Unit implementation ------------------------------
@@ -22,6 +30,72 @@ NALUnit::NALUnit()
 {
 }
 
+static inline int
+TrailingZeros32(unsigned int v)
+{
+    // v must be non-zero
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(v);
+#else
+    int n = 0;
+    while ((v & 1) == 0)
+    {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Returns the number of bytes at the start of p that are known
+// to be non-zero. Only whole vector blocks are examined, so the
+// result may be short of the first 00; the caller continues
+// byte-by-byte from there. Without vector support this returns 0.
+static inline int
+SkipNonZero(const BYTE* p, int cBytes)
+{
+    int n = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    while ((cBytes - n) >= 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + n));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if (mask != 0)
+        {
+            return n + TrailingZeros32(mask);
+        }
+        n += 32;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    while ((cBytes - n) >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + n));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if (mask != 0)
+        {
+            return n + TrailingZeros32(mask);
+        }
+        n += 16;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    while ((cBytes - n) >= 16)
+    {
+        uint8x16_t eq = vceqzq_u8(vld1q_u8(p + n));
+        if (vmaxvq_u8(eq) != 0)
+        {
+            // narrow to one nibble per byte to locate the first 00
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+            return n + (int)(__builtin_ctzll(mask) >> 2);
+        }
+        n += 16;
+    }
+#endif
+    (void)p;
+    return n;
+}
+
 bool
 NALUnit::GetStartCode(const BYTE*& pBegin, const BYTE*& pStart, int& cRemain)
 {
@@ -53,6 +127,12 @@ NALUnit::GetStartCode(const BYTE*& pBegin, const BYTE*& pStart, int& cRemain)
             }
         } else {
             pBegin = NULL;
+
+            // no start code can begin on a non-zero byte, so skip
+            // ahead to the next 00 a block at a time.
+            int cSkip = SkipNonZero(pThis + 1, cBytes - 1);
+            pThis += cSkip;
+            cBytes -= cSkip;
         }
         cBytes--;
         pThis++;
@@ -116,62 +196,141 @@ NALUnit::Parse(const BYTE* pBuffer, int cSpace, int LengthSize, bool bEnd)
 }
 
 // bitwise access to data
+
+static inline int
+LeadingZeros64(unsigned long long v)
+{
+    // v must be non-zero
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(v);
+#else
+    int n = 0;
+    while ((v & 0x8000000000000000ULL) == 0)
+    {
+        v <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline unsigned long long
+LoadBigEndian64(const BYTE* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+#else
+    unsigned long long v = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        v = (v << 8) | p[i];
+    }
+    return v;
+#endif
+}
+
+static inline bool
+HasZeroByte(unsigned long long v)
+{
+    return ((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0;
+}
+
 void
 NALUnit::ResetBitstream()
 {
     m_idx = 0;
     m_nBits = 0;
+    m_cache = 0;
     m_cZeros = 0;
 }
 
+// top up the bit cache from the NALU data, removing emulation
+// prevention bytes on the way in.
 void
-NALUnit::Skip(int nBits)
+NALUnit::FillCache()
 {
-    if (nBits < m_nBits)
+    while ((m_nBits <= 56) && (m_idx < m_cBytes))
     {
-        m_nBits -= nBits;
-    } else {
-        nBits -= m_nBits;
-        while (nBits >= 8)
+        int cWant = (64 - m_nBits) / 8;
+        if ((m_cBytes - m_idx) >= 8)
         {
-            GetBYTE();
-            nBits -= 8;
+            // a run with no zero bytes cannot contain an emulation
+            // prevention byte, so it can be copied in one step.
+            unsigned long long v = LoadBigEndian64(m_pStart + m_idx);
+            if (!HasZeroByte(v))
+            {
+                v >>= (64 - (cWant * 8));
+                m_cache |= v << (64 - m_nBits - (cWant * 8));
+                m_nBits += cWant * 8;
+                m_idx += cWant;
+                m_cZeros = 0;
+                continue;
+            }
         }
-        if (nBits)
-        {
-            m_byte = GetBYTE();
-            m_nBits = 8;
 
-        m_nBits -= nBits;
+        // to avoid start-code emulation, a byte 0x03 is inserted
+        // after any 00 00 pair. Discard that here.
+        BYTE b = m_pStart[m_idx++];
+        if (b == 0)
+        {
+            m_cZeros++;
+            if ((m_idx < m_cBytes) && (m_cZeros == 2) && (m_pStart[m_idx] == 0x03))
+            {
+                m_idx++;
+                m_cZeros = 0;
+            }
+        } else {
+            m_cZeros = 0;
+        }
+        m_cache |= ((unsigned long long)b) << (56 - m_nBits);
+        m_nBits += 8;
     }
 }
-}
 
-// get the next byte, removing emulation prevention bytes
-BYTE 
-NALUnit::GetBYTE()
+// discard bits from the top of the cache. Beyond the end of the
+// data, the cache reads as zero.
+void
+NALUnit::Consume(int nBits)
 {
-    if (m_idx >= m_cBytes)
+    if (nBits >= m_nBits)
     {
-        return 0;
+        m_cache = 0;
+        m_nBits = 0;
+    } else {
+        m_cache <<= nBits;
+        m_nBits -= nBits;
     }
+}
 
-    BYTE b = m_pStart[m_idx++];
-
-    // to avoid start-code emulation, a byte 0x03 is inserted
-    // after any 00 00 pair. Discard that here.
-    if (b == 0)
+void
+NALUnit::Skip(int nBits)
+{
+    while (nBits > 0)
     {
-        m_cZeros++;
-        if ((m_idx < m_cBytes) && (m_cZeros == 2) && (m_pStart[m_idx] == 0x03))
+        if (m_nBits == 0)
         {
-            m_idx++;
-            m_cZeros=0;
+            FillCache();
+            if (m_nBits == 0)
+            {
+                return;
+            }
         }
-    } else {
-        m_cZeros = 0;
+        int cThis = (nBits < m_nBits) ? nBits : m_nBits;
+        Consume(cThis);
+        nBits -= cThis;
     }
-    return b;
+}
+
+// get the next 8 bits
+BYTE 
+NALUnit::GetBYTE()
+{
+    return (BYTE)GetWord(8);
 }
 
 unsigned long 
@@ -179,23 +338,33 @@ NALUnit::GetBit()
 {
     if (m_nBits == 0)
     {
-        m_byte = GetBYTE();
-        m_nBits = 8;
+        FillCache();
     }
-    m_nBits--;
-    return (m_byte >> m_nBits) & 0x1;
+    unsigned long bit = (unsigned long)(m_cache >> 63);
+    Consume(1);
+    return bit;
 }
 
 unsigned long 
 NALUnit::GetWord(int nBits)
 {
-    unsigned long u = 0;
-    while (nBits > 0)
+    if (nBits <= 0)
+    {
+        return 0;
+    }
+    if (nBits > 32)
+    {
+        // shift through 64 bits: unsigned long is only 32 bits on
+        // armv7, where the top bits are dropped as they always were
+        unsigned long long u = GetWord(nBits - 32);
+        return (unsigned long)((u << 32) | GetWord(32));
+    }
+    if (m_nBits < nBits)
     {
-        u <<= 1;
-        u |= GetBit();
-        nBits--;
+        FillCache();
     }
+    unsigned long u = (unsigned long)(m_cache >> (64 - nBits));
+    Consume(nBits);
     return u;
 }
 
@@ -209,17 +378,37 @@ NALUnit::GetUE()
     //      0001010
     // You have three leading zeros, so there are three data bits (010)
     // counting up from a base of 111: thus 111 + 010 = 1001 = 9
-    int cZeros = 0;
+    if (m_nBits < 32)
+    {
+        FillCache();
+    }
+    int cZeros = (m_cache != 0) ? LeadingZeros64(m_cache) : 64;
+    if (cZeros < m_nBits)
+    {
+        if (cZeros <= 31)
+        {
+            Consume(cZeros + 1);
+            return GetWord(cZeros) + ((1UL << cZeros)-1);
+        }
+    }
+    else if (m_idx >= m_cBytes)
+    {
+		// partial data: no terminating 1 before the end (Dmitri Vasilyev)
+        Consume(m_nBits);
+        return 0;
+    }
+
+    // over-long code: step through the bits one at a time
+    cZeros = 0;
     while (GetBit() == 0)
     {
-		// check for partial data (Dmitri Vasilyev)
 		if (NoMoreBits())
 		{
 			return 0;
 		}
         cZeros++;
     }
-    return GetWord(cZeros) + ((1 << cZeros)-1);
+    return GetWord(cZeros) + ((1UL << cZeros)-1);
 }
 
 
@@ -247,7 +436,18 @@ NALUnit::GetSE()
 SeqParamSet::SeqParamSet()
 : m_cx(0),
   m_cy(0),
-  m_FrameBits(0)
+  m_FrameBits(0),
+  m_ChromaFormat(1),
+  m_bSeparatePlanes(false),
+  m_numRefFrames(0),
+  m_pocType(0),
+  m_pocLSBBits(4),
+  m_bDeltaAlwaysZero(false),
+  m_offsetNonRef(0),
+  m_offsetTopToBottom(0),
+  m_cRefInCycle(0),
+  m_bReorderSignalled(false),
+  m_maxReorderFrames(0)
 {
 #ifdef WIN32
     SetRect(&m_rcFrame, 0, 0, 0, 0);
@@ -290,14 +490,17 @@ SeqParamSet::Parse(NALUnit* pnalu)
 
 	/*int seq_param_id =*/ pnalu->GetUE();
 
+	m_ChromaFormat = 1;
+	m_bSeparatePlanes = false;
 	if ((m_Profile == 100) || (m_Profile == 110) || (m_Profile == 122) || (m_Profile == 244) ||
 		(m_Profile == 44) || (m_Profile == 83) || (m_Profile == 86) || (m_Profile == 118) || (m_Profile == 128)
 		)
 	{
 		int chroma_fmt = (int)pnalu->GetUE();
+		m_ChromaFormat = chroma_fmt;
 		if (chroma_fmt == 3)
 		{
-			pnalu->Skip(1);
+			m_bSeparatePlanes = pnalu->GetBit() ? true : false;
 		}
 		/* int bit_depth_luma_minus8 = */ pnalu->GetUE();
 		/* int bit_depth_chroma_minus8 = */ pnalu->GetUE();
@@ -333,13 +536,17 @@ SeqParamSet::Parse(NALUnit* pnalu)
         m_pocLSBBits = log2_minus4 + 4;
     } else if (m_pocType == 1)
     {
-        pnalu->Skip(1); // delta always zero
-        /*int nsp_offset =*/ pnalu->GetSE();
-        /*int nsp_top_to_bottom = */ pnalu->GetSE();
-        int num_ref_in_cycle = (int)pnalu->GetUE();
-        for (int i = 0; i < num_ref_in_cycle; i++)
+        m_bDeltaAlwaysZero = pnalu->GetBit() ? true : false;
+        m_offsetNonRef = (int)pnalu->GetSE();
+        m_offsetTopToBottom = (int)pnalu->GetSE();
+        m_cRefInCycle = (int)pnalu->GetUE();
+        if (m_cRefInCycle > 255)
+        {
+            return false;
+        }
+        for (int i = 0; i < m_cRefInCycle; i++)
         {
-            /*int sf_offset =*/ pnalu->GetSE();
+            m_offsetRefFrame[i] = (int)pnalu->GetSE();
         }
     } 
 	else if (m_pocType != 2)
@@ -348,7 +555,7 @@ SeqParamSet::Parse(NALUnit* pnalu)
 	}
 	// else for POCtype == 2, no additional data in stream
     
-    /*int num_ref_frames =*/ pnalu->GetUE();
+    m_numRefFrames = (int)pnalu->GetUE();
     /*int gaps_allowed =*/ pnalu->GetBit();
 
     int mbs_width = (int)pnalu->GetUE();
@@ -371,9 +578,9 @@ SeqParamSet::Parse(NALUnit* pnalu)
     }
     pnalu->Skip(1);     // direct 8x8
 
+    bool bCrop = pnalu->GetBit() ? true : false;
 #ifdef WIN32
     SetRect(&m_rcFrame, 0, 0, 0, 0);
-    bool bCrop = pnalu->GetBit() ? true : false;
     if (bCrop) {
         // get cropping rect 
         // store as exclusive, pixel parameters relative to frame
@@ -388,6 +595,14 @@ SeqParamSet::Parse(NALUnit* pnalu)
         m_rcFrame.right = m_cx - m_rcFrame.right;
         m_rcFrame.bottom = m_cy - m_rcFrame.bottom;
     }
+#else
+    if (bCrop)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            pnalu->GetUE();
+        }
+    }
 #endif
     // adjust rect from 2x2 units to pixels
 
@@ -401,14 +616,214 @@ SeqParamSet::Parse(NALUnit* pnalu)
 #endif
     }
 
+    m_bReorderSignalled = false;
+    if (pnalu->GetBit())
+    {
+        ParseVUI(pnalu);
+    }
+
     // .. rest are not interesting yet
     m_nalu = *pnalu;
     return true;
 }
 
+static void
+SkipHRD(NALUnit* pnalu)
+{
+    int cpb_cnt = (int)pnalu->GetUE() + 1;
+    pnalu->Skip(8);     // bit rate and cpb size scale
+    for (int i = 0; (i < cpb_cnt) && !pnalu->NoMoreBits(); i++)
+    {
+        /* bit_rate_value_minus1 */ pnalu->GetUE();
+        /* cpb_size_value_minus1 */ pnalu->GetUE();
+        pnalu->Skip(1); // cbr
+    }
+    pnalu->Skip(20);    // delay and time offset lengths
+}
+
+void
+SeqParamSet::ParseVUI(NALUnit* pnalu)
+{
+    // walk the vui to reach the bitstream restrictions
+    if (pnalu->GetBit())    // aspect ratio
+    {
+        if (pnalu->GetWord(8) == 255)
+        {
+            pnalu->Skip(32);    // sar width and height
+        }
+    }
+    if (pnalu->GetBit())    // overscan info
+    {
+        pnalu->Skip(1);
+    }
+    if (pnalu->GetBit())    // video signal type
+    {
+        pnalu->Skip(4);     // format and full range
+        if (pnalu->GetBit())
+        {
+            pnalu->Skip(24);    // colour description
+        }
+    }
+    if (pnalu->GetBit())    // chroma location
+    {
+        pnalu->GetUE();
+        pnalu->GetUE();
+    }
+    if (pnalu->GetBit())    // timing info
+    {
+        pnalu->Skip(65);
+    }
+    bool bNalHRD = pnalu->GetBit() ? true : false;
+    if (bNalHRD)
+    {
+        SkipHRD(pnalu);
+    }
+    bool bVclHRD = pnalu->GetBit() ? true : false;
+    if (bVclHRD)
+    {
+        SkipHRD(pnalu);
+    }
+    if (bNalHRD || bVclHRD)
+    {
+        pnalu->Skip(1);     // low delay
+    }
+    pnalu->Skip(1);     // pic struct present
+    if (pnalu->GetBit())    // bitstream restriction
+    {
+        pnalu->Skip(1);     // mvs over pic boundaries
+        pnalu->GetUE();     // max bytes per pic
+        pnalu->GetUE();     // max bits per mb
+        pnalu->GetUE();     // log2 max mv length horizontal
+        pnalu->GetUE();     // and vertical
+        m_maxReorderFrames = (int)pnalu->GetUE();
+        m_bReorderSignalled = !pnalu->NoMoreBits();
+    }
+}
+
+int
+SeqParamSet::MaxReorderFrames()
+{
+    if (m_bReorderSignalled)
+    {
+        return m_maxReorderFrames;
+    }
+
+    // not present: inferred to be the dpb size for the level (Table A-1)
+    int maxDpbMbs;
+    switch (m_Level)
+    {
+    case 9:
+    case 10:    maxDpbMbs = 396; break;
+    case 11:    maxDpbMbs = (m_Compatibility & 0x10) ? 396 : 900; break;
+    case 12:
+    case 13:
+    case 20:    maxDpbMbs = 2376; break;
+    case 21:    maxDpbMbs = 4752; break;
+    case 22:
+    case 30:    maxDpbMbs = 8100; break;
+    case 31:    maxDpbMbs = 18000; break;
+    case 32:    maxDpbMbs = 20480; break;
+    case 40:
+    case 41:    maxDpbMbs = 32768; break;
+    case 42:    maxDpbMbs = 34816; break;
+    case 50:    maxDpbMbs = 110400; break;
+    case 51:
+    case 52:    maxDpbMbs = 184320; break;
+    default:    maxDpbMbs = 696320; break;
+    }
+    long cMbs = (m_cx / 16) * (m_cy / 16);
+    if (cMbs <= 0)
+    {
+        return 16;
+    }
+    long cFrames = maxDpbMbs / cMbs;
+    return (cFrames < 16) ? (int)cFrames : 16;
+}
+
+// --- picture params parsing ---------------
+PicParamSet::PicParamSet()
+: m_bBottomPOCPresent(false),
+  m_numRefIdxL0(1),
+  m_numRefIdxL1(1),
+  m_bWeightedPred(false),
+  m_weightedBipredIdc(0),
+  m_bRedundantPicCnt(false)
+{
+}
+
+bool
+PicParamSet::Parse(NALUnit* pnalu)
+{
+    if (pnalu->Type() != NALUnit::NAL_Picture_Params)
+    {
+        return false;
+    }
+
+    pnalu->ResetBitstream();
+    pnalu->Skip(8);     // type
+    /* int ppsid = */ pnalu->GetUE();
+    /* int spsid = */ pnalu->GetUE();
+    pnalu->Skip(1);     // entropy coding mode
+    m_bBottomPOCPresent = pnalu->GetBit() ? true : false;
+
+    // slice groups: only needed to get past them
+    int num_slice_groups_minus1 = (int)pnalu->GetUE();
+    if (num_slice_groups_minus1 > 0)
+    {
+        int map_type = (int)pnalu->GetUE();
+        if (map_type == 0)
+        {
+            for (int i = 0; i <= num_slice_groups_minus1; i++)
+            {
+                /* run_length_minus1 */ pnalu->GetUE();
+            }
+        }
+        else if (map_type == 2)
+        {
+            for (int i = 0; i < num_slice_groups_minus1; i++)
+            {
+                /* top_left */ pnalu->GetUE();
+                /* bottom_right */ pnalu->GetUE();
+            }
+        }
+        else if ((map_type >= 3) && (map_type <= 5))
+        {
+            pnalu->Skip(1);     // change direction
+            /* change_rate_minus1 */ pnalu->GetUE();
+        }
+        else if (map_type == 6)
+        {
+            int cBits = 0;
+            while ((1 << cBits) < (num_slice_groups_minus1 + 1))
+            {
+                cBits++;
+            }
+            int pic_size_in_map_units_minus1 = (int)pnalu->GetUE();
+            for (int i = 0; i <= pic_size_in_map_units_minus1; i++)
+            {
+                pnalu->Skip(cBits);
+            }
+        }
+    }
+
+    m_numRefIdxL0 = (int)pnalu->GetUE() + 1;
+    m_numRefIdxL1 = (int)pnalu->GetUE() + 1;
+    m_bWeightedPred = pnalu->GetBit() ? true : false;
+    m_weightedBipredIdc = (int)pnalu->GetWord(2);
+    /* pic_init_qp_minus26 = */ pnalu->GetSE();
+    /* pic_init_qs_minus26 = */ pnalu->GetSE();
+    /* chroma_qp_index_offset = */ pnalu->GetSE();
+    pnalu->Skip(1);     // deblocking filter control present
+    pnalu->Skip(1);     // constrained intra pred
+    m_bRedundantPicCnt = pnalu->GetBit() ? true : false;
+
+    // .. rest are not interesting yet
+    return true;
+}
+
 // --- slice header --------------------
 bool 
-SliceHeader::Parse(NALUnit* pnalu, SeqParamSet* sps, bool bDeltaPresent)
+SliceHeader::Parse(NALUnit* pnalu, SeqParamSet* sps, PicParamSet* pps)
 {
     switch(pnalu->Type())
     {
@@ -427,8 +842,12 @@ SliceHeader::Parse(NALUnit* pnalu, SeqParamSet* sps, bool bDeltaPresent)
     pnalu->ResetBitstream();
     pnalu->Skip(8);     // NALU type
     pnalu->GetUE();     // first mb in slice
-    pnalu->GetUE();     // slice type
+    m_sliceType = eSliceType(pnalu->GetUE() % 5);
     pnalu->GetUE();     // pic param set id
+    if (sps->SeparateColourPlanes())
+    {
+        pnalu->Skip(2); // colour plane id
+    }
 
     m_framenum = (int)pnalu->GetWord(sps->FrameBits());
     
@@ -446,20 +865,161 @@ SliceHeader::Parse(NALUnit* pnalu, SeqParamSet* sps, bool bDeltaPresent)
         /* int idr_pic_id = */ pnalu->GetUE();
     }
     m_poc_lsb = 0;
+    m_pocDelta = 0;
+    m_deltaPOC[0] = m_deltaPOC[1] = 0;
     if (sps->POCType() == 0)
     {
         m_poc_lsb = (int)pnalu->GetWord(sps->POCLSBBits());
-        m_pocDelta = 0;
-        if (bDeltaPresent && !m_bField)
+        if (pps->BottomFieldPOCPresent() && !m_bField)
         {
             m_pocDelta = (int)pnalu->GetSE();
         }
     }
-    
+    else if ((sps->POCType() == 1) && !sps->DeltaPOCAlwaysZero())
+    {
+        m_deltaPOC[0] = (int)pnalu->GetSE();
+        if (pps->BottomFieldPOCPresent() && !m_bField)
+        {
+            m_deltaPOC[1] = (int)pnalu->GetSE();
+        }
+    }
+
+    // the rest of the header is only needed to reach
+    // the reference picture marking
+    m_bMMCO5 = false;
+    if (!pnalu->IsRefPic())
+    {
+        return true;
+    }
+    if (pps->RedundantPicCntPresent())
+    {
+        /* int redundant_pic_cnt = */ pnalu->GetUE();
+    }
+    if (m_sliceType == Slice_B)
+    {
+        pnalu->Skip(1); // direct spatial mv pred
+    }
+    int cRefL0 = pps->NumRefIdxL0();
+    int cRefL1 = pps->NumRefIdxL1();
+    if ((m_sliceType == Slice_P) || (m_sliceType == Slice_SP) || (m_sliceType == Slice_B))
+    {
+        if (pnalu->GetBit())    // override
+        {
+            cRefL0 = (int)pnalu->GetUE() + 1;
+            if (m_sliceType == Slice_B)
+            {
+                cRefL1 = (int)pnalu->GetUE() + 1;
+            }
+        }
+    }
+    if ((m_sliceType != Slice_I) && (m_sliceType != Slice_SI))
+    {
+        SkipRefPicListModification(pnalu);
+        if (m_sliceType == Slice_B)
+        {
+            SkipRefPicListModification(pnalu);
+        }
+    }
+    if ((pps->WeightedPred() && ((m_sliceType == Slice_P) || (m_sliceType == Slice_SP))) ||
+        ((pps->WeightedBipredIdc() == 1) && (m_sliceType == Slice_B)))
+    {
+        SkipPredWeightTable(pnalu, sps, cRefL0, (m_sliceType == Slice_B) ? cRefL1 : 0);
+    }
+    ParseRefPicMarking(pnalu);
     
     return true;
 }
 
+void
+SliceHeader::SkipRefPicListModification(NALUnit* pnalu)
+{
+    if (pnalu->GetBit())
+    {
+        for (;;)
+        {
+            int idc = (int)pnalu->GetUE();
+            if ((idc == 3) || pnalu->NoMoreBits())
+            {
+                break;
+            }
+            /* abs_diff_pic_num_minus1 or long_term_pic_num */ pnalu->GetUE();
+        }
+    }
+}
+
+void
+SliceHeader::SkipPredWeightTable(NALUnit* pnalu, SeqParamSet* sps, int cRefL0, int cRefL1)
+{
+    bool bChroma = (sps->ChromaArrayType() != 0);
+    /* luma_log2_weight_denom */ pnalu->GetUE();
+    if (bChroma)
+    {
+        /* chroma_log2_weight_denom */ pnalu->GetUE();
+    }
+    for (int list = 0; list < 2; list++)
+    {
+        int cRef = (list == 0) ? cRefL0 : cRefL1;
+        for (int i = 0; i < cRef; i++)
+        {
+            if (pnalu->GetBit())
+            {
+                /* luma weight and offset */ pnalu->GetSE();
+                pnalu->GetSE();
+            }
+            if (bChroma && pnalu->GetBit())
+            {
+                // weight and offset for Cb and Cr
+                for (int j = 0; j < 4; j++)
+                {
+                    pnalu->GetSE();
+                }
+            }
+        }
+    }
+}
+
+void
+SliceHeader::ParseRefPicMarking(NALUnit* pnalu)
+{
+    if (pnalu->Type() == NALUnit::NAL_IDR_Slice)
+    {
+        pnalu->Skip(1); // no output of prior pics
+        pnalu->Skip(1); // long term reference
+        return;
+    }
+    if (pnalu->GetBit())    // adaptive marking
+    {
+        for (;;)
+        {
+            int mmco = (int)pnalu->GetUE();
+            if ((mmco == 0) || pnalu->NoMoreBits())
+            {
+                break;
+            }
+            if (mmco == 5)
+            {
+                m_bMMCO5 = true;
+            }
+            if ((mmco == 1) || (mmco == 3))
+            {
+                /* difference_of_pic_nums_minus1 */ pnalu->GetUE();
+            }
+            if (mmco == 2)
+            {
+                /* long_term_pic_num */ pnalu->GetUE();
+            }
+            if ((mmco == 3) || (mmco == 6))
+            {
+                /* long_term_frame_idx */ pnalu->GetUE();
+            }
+            if (mmco == 4)
+            {
+                /* max_long_term_frame_idx_plus1 */ pnalu->GetUE();
+            }
+        }
+    }
+}
+
 // --- SEI ----------------------
 
 
@@ -535,37 +1095,54 @@ avcCHeader::avcCHeader(const BYTE* header, int cBytes)
 
 POCState::POCState()
 : m_prevLSB(0),
-  m_prevMSB(0)
+  m_prevMSB(0),
+  m_prevFrameNum(0),
+  m_prevFrameNumOffset(0),
+  m_frameNum(0),
+  m_lastlsb(0),
+  m_bReset(false),
+  m_bFirstField(false),
+  m_firstFieldFrameNum(0),
+  m_bFirstFieldBottom(false),
+  m_cRecent(0),
+  m_reorderDepth(0),
+  m_bDepthMeasured(false)
 {
 }
 
 void POCState::SetHeader(avcCHeader* avc)
 {
-    m_avc = avc;
-    m_sps.Parse(m_avc->sps());
-    NALUnit* pps = avc->pps();
-    pps->ResetBitstream();
-    /* int ppsid = */ pps->GetUE();
-    /* int spsid = */ pps->GetUE();
-    pps->Skip(1);
-    m_deltaPresent = pps->GetBit() ? true : false;
+    SetParams(avc->sps(), avc->pps());
+}
+
+void POCState::SetParams(NALUnit* sps, NALUnit* pps)
+{
+    m_sps.Parse(sps);
+    m_pps.Parse(pps);
 }
 
 bool POCState::GetPOC(NALUnit* nal, int* pPOC)
 {
-    int maxlsb = 1 << (m_sps.POCLSBBits());
     SliceHeader slice;
-    if (slice.Parse(nal, &m_sps, m_deltaPresent))
+    if (!slice.Parse(nal, &m_sps, &m_pps))
     {
-        m_frameNum = slice.FrameNum();
-        
+        return false;
+    }
+    m_frameNum = slice.FrameNum();
+    bool bIDR = (nal->Type() == NALUnit::NAL_IDR_Slice);
+    bool bRef = nal->IsRefPic();
+
+    int top = 0;
+    int bottom = 0;
+    if (m_sps.POCType() == 0)
+    {
+        int maxlsb = 1 << (m_sps.POCLSBBits());
         int prevMSB = m_prevMSB;
         int prevLSB = m_prevLSB;
-        if (nal->Type() == NALUnit::NAL_IDR_Slice)
+        if (bIDR)
         {
             prevLSB = prevMSB= 0;
         }
-        // !! mmoc == 5
         
         int lsb = slice.POCLSB();
         int MSB = prevMSB;
@@ -577,17 +1154,173 @@ bool POCState::GetPOC(NALUnit* nal, int* pPOC)
         {
             MSB = prevMSB - maxlsb;
         }
-        if (nal->IsRefPic())
+        if (bRef)
         {
             m_prevLSB = lsb;
             m_prevMSB = MSB;
         }
-        
-        *pPOC = MSB + lsb;
+        top = MSB + lsb;
+        bottom = slice.IsField() ? top : (top + slice.Delta());
         m_lastlsb = lsb;
-        return true;
     }
-    return false;
+    else
+    {
+        // types 1 and 2 are derived from the frame number
+        int maxFrameNum = 1 << m_sps.FrameBits();
+        int frameNumOffset = 0;
+        if (!bIDR)
+        {
+            frameNumOffset = m_prevFrameNumOffset;
+            if (m_prevFrameNum > m_frameNum)
+            {
+                frameNumOffset += maxFrameNum;
+            }
+        }
+
+        if (m_sps.POCType() == 1)
+        {
+            // expected poc from the cycle of reference frame offsets in the sps
+            int cCycle = m_sps.RefFramesInPOCCycle();
+            int absFrameNum = (cCycle != 0) ? (frameNumOffset + m_frameNum) : 0;
+            if (!bRef && (absFrameNum > 0))
+            {
+                absFrameNum--;
+            }
+            int expected = 0;
+            if (absFrameNum > 0)
+            {
+                int deltaPerCycle = 0;
+                for (int i = 0; i < cCycle; i++)
+                {
+                    deltaPerCycle += m_sps.OffsetForRefFrame(i);
+                }
+                int inCycle = (absFrameNum - 1) % cCycle;
+                expected = ((absFrameNum - 1) / cCycle) * deltaPerCycle;
+                for (int i = 0; i <= inCycle; i++)
+                {
+                    expected += m_sps.OffsetForRefFrame(i);
+                }
+            }
+            if (!bRef)
+            {
+                expected += m_sps.OffsetForNonRefPic();
+            }
+
+            if (!slice.IsField())
+            {
+                top = expected + slice.DeltaPOC(0);
+                bottom = top + m_sps.OffsetTopToBottom() + slice.DeltaPOC(1);
+            }
+            else if (!slice.IsBottom())
+            {
+                top = bottom = expected + slice.DeltaPOC(0);
+            }
+            else
+            {
+                top = bottom = expected + m_sps.OffsetTopToBottom() + slice.DeltaPOC(0);
+            }
+        }
+        else
+        {
+            // type 2: output order is decode order
+            int temp = 0;
+            if (!bIDR)
+            {
+                temp = 2 * (frameNumOffset + m_frameNum);
+                if (!bRef)
+                {
+                    temp--;
+                }
+            }
+            top = bottom = temp;
+        }
+        m_prevFrameNumOffset = frameNumOffset;
+        m_prevFrameNum = m_frameNum;
+    }
+
+    int poc = slice.IsField() ? (slice.IsBottom() ? bottom : top) : ((top < bottom) ? top : bottom);
+
+    if (slice.HasMMCO5())
+    {
+        // all earlier pictures are output before this one, and
+        // it becomes the base for the pictures that follow
+        top -= poc;
+        poc = 0;
+        m_prevMSB = 0;
+        m_prevLSB = slice.IsBottom() ? 0 : top;
+        m_prevFrameNumOffset = 0;
+        m_prevFrameNum = 0;
+    }
+    m_bReset = bIDR || slice.HasMMCO5();
+
+    // the second field of a pair is not a separate picture for reordering
+    bool bSecondField = slice.IsField() && m_bFirstField &&
+                        (m_firstFieldFrameNum == m_frameNum) && (m_bFirstFieldBottom != slice.IsBottom());
+    m_bFirstField = slice.IsField() && !bSecondField;
+    m_firstFieldFrameNum = m_frameNum;
+    m_bFirstFieldBottom = slice.IsBottom();
+    if (!bSecondField)
+    {
+        UpdateReorderDepth(poc);
+    }
+
+    *pPOC = poc;
+    return true;
+}
+
+void POCState::UpdateReorderDepth(int poc)
+{
+    if (m_bReset)
+    {
+        if (m_cRecent > 1)
+        {
+            m_bDepthMeasured = true;
+        }
+        m_cRecent = 0;
+    }
+
+    // count earlier-decoded pictures that are presented after this one
+    int cLater = 0;
+    for (int i = 0; i < m_cRecent; i++)
+    {
+        if (m_recent[i] > poc)
+        {
+            cLater++;
+        }
+    }
+    if (cLater > m_reorderDepth)
+    {
+        m_reorderDepth = cLater;
+    }
+
+    if (m_cRecent == MaxReorderWindow)
+    {
+        for (int i = 1; i < MaxReorderWindow; i++)
+        {
+            m_recent[i-1] = m_recent[i];
+        }
+        m_cRecent--;
+    }
+    m_recent[m_cRecent++] = poc;
+}
+
+int POCState::ReorderDepth()
+{
+    int depth = m_reorderDepth;
+    if (m_sps.POCType() == 2)
+    {
+        // presentation order is always decoding order
+        return depth;
+    }
+    if (m_sps.ReorderSignalled() || !m_bDepthMeasured)
+    {
+        int limit = m_sps.MaxReorderFrames();
+        if (limit > depth)
+        {
+            depth = limit;
+        }
+    }
+    return depth;
 }
 
 
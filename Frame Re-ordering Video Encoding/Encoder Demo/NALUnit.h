@@ -85,7 +85,10 @@ public:
         return m_pStart;
     }
 
-    // bitwise access to data
+    // bitwise access to data.
+    // Bits are served from a 64-bit cache that is refilled several
+    // bytes at a time, with emulation prevention bytes removed during
+    // the refill.
     void ResetBitstream();
     void Skip(int nBits);
 
@@ -109,16 +112,19 @@ public:
 
 private:
     bool GetStartCode(const BYTE*& pBegin, const BYTE*& pStart, int& cRemain);
+    void FillCache();
+    void Consume(int nBits);
 
 private:
 	const BYTE* m_pStartCodeStart;
     const BYTE* m_pStart;
     int m_cBytes;
 
-    // bitstream access
+    // bitstream access: m_cache holds m_nBits valid bits, msb first,
+    // and m_idx is the next unread byte of the NALU.
     int m_idx;
     int m_nBits;
-    BYTE m_byte;
+    unsigned long long m_cache;
     int m_cZeros;
 };
 
@@ -174,7 +180,27 @@ public:
 	NALUnit* NALU() {return &m_nalu; }
     int POCLSBBits()    { return m_pocLSBBits;  }
     int POCType()       { return m_pocType; }
+
+    // 0 for monochrome or separate colour planes, else chroma_format_idc
+    int ChromaArrayType()   { return m_bSeparatePlanes ? 0 : m_ChromaFormat; }
+    bool SeparateColourPlanes() { return m_bSeparatePlanes; }
+    int NumRefFrames()      { return m_numRefFrames; }
+
+    // poc type 1 parameters
+    bool DeltaPOCAlwaysZero()   { return m_bDeltaAlwaysZero; }
+    int OffsetForNonRefPic()    { return m_offsetNonRef; }
+    int OffsetTopToBottom()     { return m_offsetTopToBottom; }
+    int RefFramesInPOCCycle()   { return m_cRefInCycle; }
+    int OffsetForRefFrame(int i) { return m_offsetRefFrame[i]; }
+
+    // max_num_reorder_frames from the vui, or the spec's inferred
+    // value (the dpb size for the level) if not present
+    bool ReorderSignalled() { return m_bReorderSignalled; }
+    int MaxReorderFrames();
     
+private:
+    void ParseVUI(NALUnit* pnalu);
+
 private:
     NALUnit m_nalu;
     int m_FrameBits;
@@ -188,34 +214,86 @@ private:
 	int m_Profile;
 	int m_Level;
 	BYTE m_Compatibility;
+    int m_ChromaFormat;
+    bool m_bSeparatePlanes;
+    int m_numRefFrames;
     int m_pocType;
     int m_pocLSBBits;
+    bool m_bDeltaAlwaysZero;
+    int m_offsetNonRef;
+    int m_offsetTopToBottom;
+    int m_cRefInCycle;
+    int m_offsetRefFrame[256];
+    bool m_bReorderSignalled;
+    int m_maxReorderFrames;
 };
 
-// extract frame num from slice headers
+// the picture parameter set fields needed to get through the slice header
+class PicParamSet
+{
+public:
+    PicParamSet();
+    bool Parse(NALUnit* pnalu);
+    bool BottomFieldPOCPresent()    { return m_bBottomPOCPresent; }
+    int NumRefIdxL0()               { return m_numRefIdxL0; }
+    int NumRefIdxL1()               { return m_numRefIdxL1; }
+    bool WeightedPred()             { return m_bWeightedPred; }
+    int WeightedBipredIdc()         { return m_weightedBipredIdc; }
+    bool RedundantPicCntPresent()   { return m_bRedundantPicCnt; }
+
+private:
+    bool m_bBottomPOCPresent;
+    int m_numRefIdxL0;
+    int m_numRefIdxL1;
+    bool m_bWeightedPred;
+    int m_weightedBipredIdc;
+    bool m_bRedundantPicCnt;
+};
+
+// extract frame num and picture order count fields from slice headers.
+// The header is parsed through to the reference picture marking
+// so that memory management control operation 5 can be detected.
 class SliceHeader
 {
 public:
+    enum eSliceType
+    {
+        Slice_P     = 0,
+        Slice_B     = 1,
+        Slice_I     = 2,
+        Slice_SP    = 3,
+        Slice_SI    = 4,
+    };
 
-    bool Parse(NALUnit* pnalu, SeqParamSet* sps, bool bDeltaPresent);
+    bool Parse(NALUnit* pnalu, SeqParamSet* sps, PicParamSet* pps);
     int FrameNum()
     {
         return m_framenum;
     }
+    eSliceType SliceType()  { return m_sliceType; }
     bool IsField()  { return m_bField; }
     bool IsBottom() { return m_bBottom; }
     int Delta()     { return m_pocDelta; }
     int POCLSB()    { return m_poc_lsb; }
+    // delta_pic_order_cnt[0] and [1] for poc type 1
+    int DeltaPOC(int i) { return m_deltaPOC[i]; }
+    bool HasMMCO5() { return m_bMMCO5; }
+
+private:
+    void SkipRefPicListModification(NALUnit* pnalu);
+    void SkipPredWeightTable(NALUnit* pnalu, SeqParamSet* sps, int cRefL0, int cRefL1);
+    void ParseRefPicMarking(NALUnit* pnalu);
 
 private:
     int m_framenum;
-    int m_nBitsFrame;
-    bool m_bFrameOnly;
+    eSliceType m_sliceType;
     
     bool m_bField;
     bool m_bBottom;
     int m_pocDelta;
     int m_poc_lsb;
+    int m_deltaPOC[2];
+    bool m_bMMCO5;
 };
 
 // SEI message structure
@@ -248,15 +326,21 @@ private:
     NALUnit m_pps;
 };
 
-// NB this is NOT general-purpose. This
-// implements only the details that I've seen in
-// iOS encoding (poc type 0 only, and no checks for mmco 5)
+// Picture order count derivation for poc types 0, 1 and 2
+// (H.264 section 8.2.1), including the reset after mmco 5.
+// GetPOC must be called once per picture, in decoding order.
+//
+// The reorder depth is the largest number of pictures that precede
+// any picture in decoding order but follow it in presentation order.
+// A picture's presentation position is known once that many later
+// pictures have been decoded.
 class POCState
 {
 public:
     POCState();
     
     void SetHeader(avcCHeader* avc);
+    void SetParams(NALUnit* sps, NALUnit* pps);
     bool GetPOC(NALUnit* nal, int* pPOC);
     int getFrameNum()
     {
@@ -266,14 +350,48 @@ public:
     {
         return m_lastlsb;
     }
+    // true if the last picture was an IDR or had mmco 5, so that
+    // all earlier pictures precede it in presentation order
+    bool isReset()
+    {
+        return m_bReset;
+    }
+    // The signalled limit if the sps has one. Otherwise the spec's
+    // bound for the level is used until one whole run of pictures
+    // between resets has been seen, and after that the running
+    // estimate measured from the stream.
+    int ReorderDepth();
+
+private:
+    void UpdateReorderDepth(int poc);
+
 private:
+    SeqParamSet m_sps;
+    PicParamSet m_pps;
+
+    // previous reference picture (poc type 0)
     int m_prevLSB;
     int m_prevMSB;
-    avcCHeader* m_avc;
-    SeqParamSet m_sps;
-    bool m_deltaPresent;
+
+    // previous picture (poc types 1 and 2)
+    int m_prevFrameNum;
+    int m_prevFrameNumOffset;
+
     int m_frameNum;
     int m_lastlsb;
+    bool m_bReset;
+
+    // first field of a pair, waiting for the second
+    bool m_bFirstField;
+    int m_firstFieldFrameNum;
+    bool m_bFirstFieldBottom;
+
+    // pocs of the most recent pictures since the last reset
+    enum { MaxReorderWindow = 16 };
+    int m_recent[MaxReorderWindow];
+    int m_cRecent;
+    int m_reorderDepth;
+    bool m_bDepthMeasured;
 };
 
 
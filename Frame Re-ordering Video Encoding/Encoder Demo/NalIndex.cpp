@@ -0,0 +1,142 @@
+//
+// NalIndex.cpp
+//
+// Implementation of an index of NAL Units in a memory-mapped file
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+#include "NalIndex.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// NALUnit::Parse works on int-sized buffers, so files larger than
+// this are scanned through a moving window
+static const unsigned long long kMaxWindow = 1 << 30;
+
+NalIndex::NalIndex()
+: m_fd(-1),
+  m_pData(NULL),
+  m_cBytes(0)
+{
+}
+
+NalIndex::~NalIndex()
+{
+    Close();
+}
+
+bool
+NalIndex::Open(const char* path, int LengthSize)
+{
+    Close();
+
+    m_fd = open(path, O_RDONLY);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if ((fstat(m_fd, &st) != 0) || (st.st_size <= 0))
+    {
+        Close();
+        return false;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (p == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    m_pData = (const BYTE*)p;
+    m_cBytes = (unsigned long long)st.st_size;
+
+    // the index is built front to back in a single pass
+    madvise(p, (size_t)m_cBytes, MADV_SEQUENTIAL);
+    bool bOK = Build(LengthSize);
+    madvise(p, (size_t)m_cBytes, MADV_NORMAL);
+    if (!bOK)
+    {
+        // no NALUs: don't hold on to the mapping or the file
+        Close();
+    }
+    return bOK;
+}
+
+void
+NalIndex::Close()
+{
+    if (m_pData != NULL)
+    {
+        munmap((void*)m_pData, (size_t)m_cBytes);
+        m_pData = NULL;
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_cBytes = 0;
+    m_entries.clear();
+}
+
+bool
+NalIndex::Build(int LengthSize)
+{
+    // rough guess to avoid most re-allocations: iOS encoding
+    // produces a couple of NALUs per 10-20KB frame
+    m_entries.reserve((size_t)(m_cBytes / 8192) + 16);
+
+    unsigned long long pos = 0;
+    while (pos < m_cBytes)
+    {
+        unsigned long long cRemain = m_cBytes - pos;
+        int cSpace = (int)((cRemain < kMaxWindow) ? cRemain : kMaxWindow);
+        bool bEnd = ((unsigned long long)cSpace == cRemain);
+
+        NALUnit nalu;
+        if (!nalu.Parse(m_pData + pos, cSpace, LengthSize, bEnd))
+        {
+            // trailing partial NALU, or garbage after the last one
+            break;
+        }
+        if (nalu.Length() > 0)
+        {
+            Add(&nalu);
+        }
+        pos = (unsigned long long)((nalu.Start() + nalu.Length()) - m_pData);
+    }
+    return !m_entries.empty();
+}
+
+void
+NalIndex::Add(NALUnit* pnalu)
+{
+    Entry e;
+    e.offset = (unsigned long long)(pnalu->Start() - m_pData);
+    e.length = (unsigned int)pnalu->Length();
+    e.type = pnalu->Type();
+    e.nal_ref_idc = (pnalu->Start()[0] >> 5) & 3;
+    e.first_mb = 0;
+    if ((e.type >= NALUnit::NAL_Slice) && (e.type <= NALUnit::NAL_IDR_Slice))
+    {
+        pnalu->ResetBitstream();
+        pnalu->Skip(8);
+        e.first_mb = (unsigned int)pnalu->GetUE();
+    }
+    m_entries.push_back(e);
+}
+
+int
+NalIndex::Next(int idxFrom, NALUnit::eNALType type)
+{
+    for (int i = idxFrom; i < Count(); i++)
+    {
+        if (m_entries[i].type == (unsigned int)type)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
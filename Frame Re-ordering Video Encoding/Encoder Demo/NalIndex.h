@@ -0,0 +1,67 @@
+//
+// NalIndex.h
+//
+// Index of the NAL Units in a memory-mapped H.264 elementary stream
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+
+#pragma once
+
+#include "NALUnit.h"
+#include <vector>
+
+// Maps a whole file (either Annex-B start-code delimited or
+// length-prefixed NALUs, as in an mdat) and builds a compact table of
+// the NALUs in it, in one pass. NALUnit objects returned from the index
+// point directly into the mapping, so nothing is copied; they are only
+// valid while the index remains open.
+class NalIndex
+{
+public:
+    NalIndex();
+    ~NalIndex();
+
+    struct Entry
+    {
+        unsigned long long offset;      // first byte of the NALU (the type byte)
+        unsigned int length;            // excluding start code or length field
+        unsigned int first_mb : 24;     // slices only; 0 for other NALU types
+        unsigned int type : 5;
+        unsigned int nal_ref_idc : 2;
+    };
+
+    // If LengthSize is non-zero, the file contains NALUs each
+    // preceded by a big-endian length field of that many bytes.
+    // Otherwise, we expect start-code delimiters.
+    bool Open(const char* path, int LengthSize);
+    void Close();
+
+    int Count()                     { return (int)m_entries.size(); }
+    const Entry& At(int idx)        { return m_entries[idx]; }
+    NALUnit NALU(int idx)
+    {
+        const Entry& e = m_entries[idx];
+        return NALUnit(m_pData + e.offset, (int)e.length);
+    }
+
+    // index of the first entry at or after idxFrom with the given type, or -1
+    int Next(int idxFrom, NALUnit::eNALType type);
+
+    const BYTE* Data()              { return m_pData; }
+    unsigned long long Size()       { return m_cBytes; }
+
+private:
+    bool Build(int LengthSize);
+    void Add(NALUnit* pnalu);
+
+private:
+    // not copyable: the mapping is owned by this object
+    NalIndex(const NalIndex&);
+    const NalIndex& operator=(const NalIndex&);
+
+    int m_fd;
+    const BYTE* m_pData;
+    unsigned long long m_cBytes;
+    std::vector<Entry> m_entries;
+};
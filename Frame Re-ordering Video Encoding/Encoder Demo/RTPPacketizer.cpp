@@ -0,0 +1,237 @@
+//
+// RTPPacketizer.cpp
+//
+// Implementation of RTP packetization and batched sending
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+#include "RTPPacketizer.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#endif
+
+// enough for a typical 1080p IDR frame without growing
+static const int kInitialArena = 512 * 1024;
+
+// limits for a single UDP GSO send
+static const int kMaxSegments = 64;
+static const int kMaxSegmentBytes = 65000;
+
+static void
+tonet_short(BYTE* p, unsigned short s)
+{
+    p[0] = (s >> 8) & 0xff;
+    p[1] = s & 0xff;
+}
+
+static void
+tonet_long(BYTE* p, unsigned long l)
+{
+    p[0] = (l >> 24) & 0xff;
+    p[1] = (l >> 16) & 0xff;
+    p[2] = (l >> 8) & 0xff;
+    p[3] = l & 0xff;
+}
+
+RTPPacketizer::RTPPacketizer(int maxPacket)
+: m_maxPacket(maxPacket),
+  m_cArena(0),
+  m_idxIDR(-1),
+#if defined(__linux__) && defined(UDP_SEGMENT)
+  m_bGSO(true)
+#else
+  m_bGSO(false)
+#endif
+{
+    m_arena.resize(kInitialArena);
+    m_packets.reserve(kInitialArena / maxPacket);
+}
+
+void
+RTPPacketizer::Reset()
+{
+    m_cArena = 0;
+    m_packets.clear();
+    m_idxIDR = -1;
+}
+
+BYTE*
+RTPPacketizer::AddPacket(int cPayload, bool bMarker)
+{
+    int cBytes = RTPHeaderSize + cPayload;
+    if ((m_cArena + cBytes) > (int)m_arena.size())
+    {
+        m_arena.resize(m_arena.size() * 2 + cBytes);
+    }
+    PacketEntry e;
+    e.offset = m_cArena;
+    e.length = cBytes;
+    e.bMarker = bMarker;
+    m_packets.push_back(e);
+    m_cArena += cBytes;
+
+    // header is filled in later by StampHeaders
+    return &m_arena[e.offset + RTPHeaderSize];
+}
+
+void
+RTPPacketizer::AddNALU(const BYTE* pNALU, int cBytes, bool bLast)
+{
+    const int max_single_packet = m_maxPacket - RTPHeaderSize;
+    const int max_fragment_packet = max_single_packet - 2;
+
+    if (cBytes <= 0)
+    {
+        return;
+    }
+    if (((pNALU[0] & 0x1f) == NALUnit::NAL_IDR_Slice) && (m_idxIDR < 0))
+    {
+        m_idxIDR = Count();
+    }
+
+    if (cBytes < max_single_packet)
+    {
+        BYTE* pDest = AddPacket(cBytes, bLast);
+        memcpy(pDest, pNALU, cBytes);
+        return;
+    }
+
+    BYTE NALU_Header = pNALU[0];
+    const BYTE* pSource = pNALU + 1;
+    cBytes -= 1;
+    bool bStart = true;
+    while (cBytes)
+    {
+        int cThis = (cBytes < max_fragment_packet)? cBytes : max_fragment_packet;
+        bool bEnd = (cThis == cBytes);
+        BYTE* pDest = AddPacket(cThis + 2, bLast && bEnd);
+
+        pDest[0] = (NALU_Header & 0xe0) + 28;   // FU_A type
+        BYTE fu_header = (NALU_Header & 0x1f);
+        if (bStart)
+        {
+            fu_header |= 0x80;
+            bStart = false;
+        }
+        else if (bEnd)
+        {
+            fu_header |= 0x40;
+        }
+        pDest[1] = fu_header;
+        memcpy(pDest + 2, pSource, cThis);
+
+        pSource += cThis;
+        cBytes -= cThis;
+    }
+}
+
+void
+RTPPacketizer::StampHeaders(int idxFrom, unsigned short seqStart, unsigned long rtpTime, unsigned long ssrc)
+{
+    unsigned short seq = seqStart;
+    for (int i = idxFrom; i < Count(); i++)
+    {
+        BYTE* packet = Packet(i);
+        packet[0] = 0x80;   // v= 2
+        packet[1] = PayloadTypeH264 | (m_packets[i].bMarker ? 0x80 : 0);
+        tonet_short(packet+2, seq++);
+        tonet_long(packet+4, rtpTime);
+        tonet_long(packet+8, ssrc);
+    }
+}
+
+int
+RTPPacketizer::Send(int fd, const struct sockaddr* addr, socklen_t cbAddr, int idxFrom)
+{
+    int idx = idxFrom;
+#if defined(__linux__)
+    const int MaxBatch = 64;
+    struct mmsghdr msgs[MaxBatch];
+    struct iovec iov[MaxBatch];
+    int cPackets[MaxBatch];
+#if defined(UDP_SEGMENT)
+    char control[MaxBatch][CMSG_SPACE(sizeof(unsigned short))];
+#endif
+
+    while (idx < Count())
+    {
+        int cMsgs = 0;
+        int idxBatch = idx;
+        while ((idxBatch < Count()) && (cMsgs < MaxBatch))
+        {
+            // packets are contiguous in the buffer, so a run of equal-sized
+            // fragments (plus a shorter final one) can go as one GSO message
+            int cSegment = Length(idxBatch);
+            int cRun = 1;
+            int cBytes = cSegment;
+            while (m_bGSO && ((idxBatch + cRun) < Count()) && (cRun < kMaxSegments))
+            {
+                int cNext = Length(idxBatch + cRun);
+                if ((cNext > cSegment) || ((cBytes + cNext) > kMaxSegmentBytes))
+                {
+                    break;
+                }
+                cBytes += cNext;
+                cRun++;
+                if (cNext < cSegment)
+                {
+                    break;
+                }
+            }
+
+            memset(&msgs[cMsgs], 0, sizeof(msgs[cMsgs]));
+            iov[cMsgs].iov_base = Packet(idxBatch);
+            iov[cMsgs].iov_len = cBytes;
+            msgs[cMsgs].msg_hdr.msg_name = (void*)addr;
+            msgs[cMsgs].msg_hdr.msg_namelen = cbAddr;
+            msgs[cMsgs].msg_hdr.msg_iov = &iov[cMsgs];
+            msgs[cMsgs].msg_hdr.msg_iovlen = 1;
+#if defined(UDP_SEGMENT)
+            if (cRun > 1)
+            {
+                msgs[cMsgs].msg_hdr.msg_control = control[cMsgs];
+                msgs[cMsgs].msg_hdr.msg_controllen = sizeof(control[cMsgs]);
+                struct cmsghdr* cm = CMSG_FIRSTHDR(&msgs[cMsgs].msg_hdr);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(unsigned short));
+                unsigned short gso_size = (unsigned short)cSegment;
+                memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+            }
+#endif
+            cPackets[cMsgs] = cRun;
+            idxBatch += cRun;
+            cMsgs++;
+        }
+
+        int cDone = sendmmsg(fd, msgs, cMsgs, 0);
+        if (cDone <= 0)
+        {
+            if (m_bGSO && ((errno == EIO) || (errno == EINVAL) || (errno == ENOPROTOOPT)))
+            {
+                // no GSO on this path: retry as separate packets
+                m_bGSO = false;
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < cDone; i++)
+        {
+            idx += cPackets[i];
+        }
+    }
+#else
+    for (; idx < Count(); idx++)
+    {
+        if (sendto(fd, Packet(idx), Length(idx), 0, addr, cbAddr) < 0)
+        {
+            break;
+        }
+    }
+#endif
+    return (idx > idxFrom) ? (idx - idxFrom) : -1;
+}
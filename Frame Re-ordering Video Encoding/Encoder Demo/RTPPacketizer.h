@@ -0,0 +1,85 @@
+//
+// RTPPacketizer.h
+//
+// RTP packetization of H.264 access units (RFC 6184), built into
+// a single buffer so that a whole frame can be sent in one batch.
+// The payloads are built once per frame and shared by all clients
+// (see RTPPacketList); each client only rewrites the 12-byte headers
+// with its own sequence, timestamp and SSRC before sending.
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+
+#pragma once
+
+#include "NALUnit.h"
+#include <vector>
+#include <memory>
+#include <sys/socket.h>
+
+class RTPPacketizer
+{
+public:
+    enum
+    {
+        RTPHeaderSize       = 12,
+        DefaultMaxPacket    = 1200,
+        PayloadTypeH264     = 96,
+    };
+
+    RTPPacketizer(int maxPacket = DefaultMaxPacket);
+
+    // start a new access unit. The buffer is kept from frame to frame
+    // and only grows if a frame is larger than any seen before.
+    void Reset();
+
+    // Add one NALU (with no start code or length) as either a single
+    // NAL unit packet or a series of FU-A fragments. bLast is set
+    // for the final NALU of the access unit, to set the marker bit.
+    void AddNALU(const BYTE* pNALU, int cBytes, bool bLast);
+
+    // fill in the RTP header of packets idxFrom onwards, with sequence
+    // numbers following on from seqStart. The header space is shared,
+    // so stamping and sending must be serialized between clients.
+    void StampHeaders(int idxFrom, unsigned short seqStart, unsigned long rtpTime, unsigned long ssrc);
+
+    // Send packets idxFrom onwards to addr, batched where the platform
+    // allows (sendmmsg, and UDP GSO for runs of FU-A fragments on Linux).
+    // Returns the number of packets sent, or -1 if none could be.
+    int Send(int fd, const struct sockaddr* addr, socklen_t cbAddr, int idxFrom);
+
+    int Count()                 { return (int)m_packets.size(); }
+    BYTE* Packet(int idx)       { return &m_arena[m_packets[idx].offset]; }
+    int Length(int idx)         { return m_packets[idx].length; }
+    int Bytes()                 { return m_cArena; }
+
+    // bytes in packets idxFrom onwards
+    int BytesFrom(int idxFrom)
+    {
+        return (idxFrom < Count()) ? (m_cArena - m_packets[idxFrom].offset) : 0;
+    }
+
+    // index of the first packet of the first IDR slice, or -1
+    int FirstIDRPacket()        { return m_idxIDR; }
+
+private:
+    BYTE* AddPacket(int cPayload, bool bMarker);
+
+private:
+    struct PacketEntry
+    {
+        int offset;
+        int length;
+        bool bMarker;
+    };
+
+    int m_maxPacket;
+    std::vector<BYTE> m_arena;
+    int m_cArena;
+    std::vector<PacketEntry> m_packets;
+    int m_idxIDR;
+    bool m_bGSO;
+};
+
+// one frame's packets, shared by reference between client connections
+typedef std::shared_ptr<RTPPacketizer> RTPPacketList;
@@ -8,13 +8,16 @@
 
 #import <Foundation/Foundation.h>
 #import "RTSPServer.h"
+#import "RTPPacketizer.h"
 
 @interface RTSPClientConnection : NSObject
 
 
 + (RTSPClientConnection*) createWithSocket:(CFSocketNativeHandle) s server:(RTSPServer*) server;
 
-- (void) onVideoData:(NSArray*) data time:(double) pts;
+// packets are built once per frame by the server and shared
+// by all connections
+- (void) onVideoPackets:(RTPPacketList) packets time:(double) pts;
 - (void) shutdown;
 
 @end
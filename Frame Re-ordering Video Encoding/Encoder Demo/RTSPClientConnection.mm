@@ -9,6 +9,7 @@
 #import "RTSPClientConnection.h"
 #import "RTSPMessage.h"
 #import "NALUnit.h"
+#import "RTSPSendQueue.h"
 #import "arpa/inet.h"
 
 void tonet_short(uint8_t* p, unsigned short s)
@@ -93,6 +94,13 @@ enum ServerState
     CFSocketRef _s;
     RTSPServer* _server;
     CFRunLoopSourceRef _rls;
+    NSMutableData* _recvBuffer;
+    
+    // responses, and RTP for interleaved sessions, go out through this
+    std::unique_ptr<RTSPSendQueue> _sendQueue;
+    BOOL _bInterleaved;
+    int _channelRTP;
+    int _channelRTCP;
     
     CFDataRef _addrRTP;
     CFSocketRef _sRTP;
@@ -115,13 +123,13 @@ enum ServerState
     long _bytesReported;
     NSDate* _sentRTCP;
     
-    // reader reports
-    CFSocketRef _recvRTCP;
+    // reader reports are received on _sRTCP
     CFRunLoopSourceRef _rlsRTCP;
 }
 
 - (RTSPClientConnection*) initWithSocket:(CFSocketNativeHandle) s Server:(RTSPServer*) server;
 - (void) onSocketData:(CFDataRef)data;
+- (void) onWritable;
 - (void) onRTCP:(CFDataRef) data;
 
 @end
@@ -141,6 +149,10 @@ static void onSocket (
             [conn onSocketData:(CFDataRef) data];
             break;
             
+        case kCFSocketWriteCallBack:
+            [conn onWritable];
+            break;
+            
         default:
             NSLog(@"unexpected socket event");
             break;
@@ -148,6 +160,27 @@ static void onSocket (
     
 }
 
+// bind a UDP socket, returning the port actually used, or -1
+static int bindUDP(CFSocketRef s, int port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    CFDataRef dataAddr = CFDataCreate(nil, (const uint8_t*)&addr, sizeof(addr));
+    CFSocketError e = CFSocketSetAddress(s, dataAddr);
+    CFRelease(dataAddr);
+    if (e)
+    {
+        return -1;
+    }
+    CFDataRef local = CFSocketCopyAddress(s);
+    int portBound = ntohs(((struct sockaddr_in*) CFDataGetBytePtr(local))->sin_port);
+    CFRelease(local);
+    return portBound;
+}
+
 static void onRTCP(CFSocketRef s,
                    CFSocketCallBackType callbackType,
                    CFDataRef address,
@@ -184,14 +217,16 @@ static void onRTCP(CFSocketRef s,
 {
     _state = ServerIdle;
     _server = server;
+    _recvBuffer = [NSMutableData dataWithCapacity:1024];
     CFSocketContext info;
     memset(&info, 0, sizeof(info));
     info.info = (void*)CFBridgingRetain(self);
     
-    _s = CFSocketCreateWithNative(nil, s, kCFSocketDataCallBack, onSocket, &info);
+    _s = CFSocketCreateWithNative(nil, s, kCFSocketDataCallBack | kCFSocketWriteCallBack, onSocket, &info);
+    _sendQueue.reset(new RTSPSendQueue(s));
     
     _rls = CFSocketCreateRunLoopSource(nil, _s, 0);
-    CFRunLoopAddSource(CFRunLoopGetMain(), _rls, kCFRunLoopCommonModes);
+    CFRunLoopAddSource([RTSPServer controlRunLoop], _rls, kCFRunLoopCommonModes);
 
     return self;
 }
@@ -200,107 +235,186 @@ static void onRTCP(CFSocketRef s,
 {
     if (CFDataGetLength(data) == 0)
     {
-        [self tearDown];
-        CFSocketInvalidate(_s);
-        _s = nil;
-        [_server shutdownConnection:self];
+        [self closeConnection];
         return;
     }
-    RTSPMessage* msg = [RTSPMessage createWithData:data];
-    if (msg != nil)
+    
+    // requests can be split across reads, or several can arrive together
+    [_recvBuffer appendBytes:CFDataGetBytePtr(data) length:CFDataGetLength(data)];
+    const uint8_t* p = (const uint8_t*)[_recvBuffer bytes];
+    int cBytes = (int)[_recvBuffer length];
+    int cParsed = 0;
+    while ((cParsed < cBytes) && (_s != nil))
     {
-        NSString* response = nil;
-        NSString* cmd = msg.command;
-        if ([cmd caseInsensitiveCompare:@"options"] == NSOrderedSame)
+        if (p[cParsed] == '$')
         {
-            response = [msg createResponse:200 text:@"OK"];
-            response = [response stringByAppendingString:@"Server: AVEncoderDemo/1.0\r\n"];
-            response = [response stringByAppendingString:@"Public: DESCRIBE, SETUP, TEARDOWN, PLAY, OPTIONS\r\n\r\n"];
+            // interleaved RTCP from the client: skip the whole frame
+            if ((cBytes - cParsed) < RTSPSendQueue::InterleavedHeaderSize)
+            {
+                break;
+            }
+            int cFrame = RTSPSendQueue::InterleavedHeaderSize + ((p[cParsed+2] << 8) | p[cParsed+3]);
+            if ((cBytes - cParsed) < cFrame)
+            {
+                break;
+            }
+            cParsed += cFrame;
+            continue;
         }
-        else if ([cmd caseInsensitiveCompare:@"describe"] == NSOrderedSame)
+        
+        int cUsed;
+        RTSPMessage* msg = [RTSPMessage parseBytes:(p + cParsed) length:(cBytes - cParsed) used:&cUsed];
+        if (cUsed < 0)
         {
-            NSString* sdp = [self makeSDP];
-            response = [msg createResponse:200 text:@"OK"];
-            NSString* date = [NSDateFormatter localizedStringFromDate:[NSDate date] dateStyle:NSDateFormatterLongStyle timeStyle:NSDateFormatterLongStyle];
-            CFDataRef dlocaladdr = CFSocketCopyAddress(_s);
-            struct sockaddr_in* localaddr = (struct sockaddr_in*) CFDataGetBytePtr(dlocaladdr);
-            
-            response = [response stringByAppendingFormat:@"Content-base: rtsp://%s/\r\n", inet_ntoa(localaddr->sin_addr)];
-            CFRelease(dlocaladdr);
-            response = [response stringByAppendingFormat:@"Date: %@\r\nContent-Type: application/sdp\r\nContent-Length: %d\r\n\r\n", date, (int)[sdp length] ];
-            response = [response stringByAppendingString:sdp];
+            NSLog(@"RTSP stream error");
+            [self closeConnection];
+            return;
+        }
+        if (cUsed == 0)
+        {
+            break;
         }
-        else if ([cmd caseInsensitiveCompare:@"setup"] == NSOrderedSame)
+        cParsed += cUsed;
+        if (msg != nil)
         {
-            NSString* transport = [msg valueForOption:@"transport"];
-            NSArray* props = [transport componentsSeparatedByString:@";"];
-            NSArray* ports = nil;
-            for (NSString* s in props)
+            [self onMessage:msg];
+        }
+    }
+    [_recvBuffer replaceBytesInRange:NSMakeRange(0, cParsed) withBytes:NULL length:0];
+}
+
+- (void) closeConnection
+{
+    [self tearDown];
+    @synchronized(self)
+    {
+        [self closeSocket];
+    }
+    [_server shutdownConnection:self];
+}
+
+- (void) onMessage:(RTSPMessage*) msg
+{
+    NSString* response = nil;
+    NSString* cmd = msg.command;
+    if ([cmd caseInsensitiveCompare:@"options"] == NSOrderedSame)
+    {
+        response = [msg createResponse:200 text:@"OK"];
+        response = [response stringByAppendingString:@"Server: AVEncoderDemo/1.0\r\n"];
+        response = [response stringByAppendingString:@"Public: DESCRIBE, SETUP, TEARDOWN, PLAY, OPTIONS\r\n\r\n"];
+    }
+    else if ([cmd caseInsensitiveCompare:@"describe"] == NSOrderedSame)
+    {
+        NSString* sdp = [self makeSDP];
+        response = [msg createResponse:200 text:@"OK"];
+        NSString* date = [NSDateFormatter localizedStringFromDate:[NSDate date] dateStyle:NSDateFormatterLongStyle timeStyle:NSDateFormatterLongStyle];
+        CFDataRef dlocaladdr = CFSocketCopyAddress(_s);
+        struct sockaddr_in* localaddr = (struct sockaddr_in*) CFDataGetBytePtr(dlocaladdr);
+        
+        response = [response stringByAppendingFormat:@"Content-base: rtsp://%s/\r\n", inet_ntoa(localaddr->sin_addr)];
+        CFRelease(dlocaladdr);
+        response = [response stringByAppendingFormat:@"Date: %@\r\nContent-Type: application/sdp\r\nContent-Length: %d\r\n\r\n", date, (int)[sdp length] ];
+        response = [response stringByAppendingString:sdp];
+    }
+    else if ([cmd caseInsensitiveCompare:@"setup"] == NSOrderedSame)
+    {
+        NSString* transport = [msg valueForOption:@"transport"];
+        NSArray* props = [transport componentsSeparatedByString:@";"];
+        NSArray* ports = nil;
+        NSArray* channels = nil;
+        BOOL bTCP = NO;
+        for (NSString* s in props)
+        {
+            if ([s hasPrefix:@"RTP/AVP/TCP"])
             {
-                if ([s length] > 14)
-                {
-                    if ([s compare:@"client_port=" options:0 range:NSMakeRange(0, 12)] == NSOrderedSame)
-                    {
-                        NSString* val = [s substringFromIndex:12];
-                        ports = [val componentsSeparatedByString:@"-"];
-                        break;
-                    }
-                }
+                bTCP = YES;
             }
-            if ([ports count] == 2)
+            else if ([s hasPrefix:@"client_port="])
             {
-                int portRTP = (int)[ports[0] integerValue];
-                int portRTCP = (int) [ports[1] integerValue];
-                
-                NSString* session_name = [self createSession:portRTP rtcp:portRTCP];
-                if (session_name != nil)
-                {
-                    response = [msg createResponse:200 text:@"OK"];
-                    response = [response stringByAppendingFormat:@"Session: %@\r\nTransport: RTP/AVP;unicast;client_port=%d-%d;server_port=6970-6971\r\n\r\n",
-                                session_name,
-                                portRTP,portRTCP];
-                }
+                ports = [[s substringFromIndex:12] componentsSeparatedByString:@"-"];
             }
-            if (response == nil)
+            else if ([s hasPrefix:@"interleaved="])
             {
-                // !!
-                response = [msg createResponse:451 text:@"Need better error string here"];
+                channels = [[s substringFromIndex:12] componentsSeparatedByString:@"-"];
             }
         }
-        else if ([cmd caseInsensitiveCompare:@"play"] == NSOrderedSame)
+        if (bTCP)
         {
-            @synchronized(self)
+            int channelRTP = 0;
+            int channelRTCP = 1;
+            if ([channels count] == 2)
+            {
+                channelRTP = (int)[channels[0] integerValue];
+                channelRTCP = (int)[channels[1] integerValue];
+            }
+            
+            NSString* session_name = [self createInterleavedSession:channelRTP rtcp:channelRTCP];
+            if (session_name != nil)
             {
-                if (_state != Setup)
-                {
-                    response = [msg createResponse:451 text:@"Wrong state"];
-                }
-                else
-                {
-                    _state = Playing;
-                    _bFirst = YES;
-                    response = [msg createResponse:200 text:@"OK"];
-                    response = [response stringByAppendingFormat:@"Session: %@\r\n\r\n", _session];
-                }
+                response = [msg createResponse:200 text:@"OK"];
+                response = [response stringByAppendingFormat:@"Session: %@\r\nTransport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n\r\n",
+                            session_name,
+                            channelRTP, channelRTCP];
             }
         }
-        else if ([cmd caseInsensitiveCompare:@"teardown"] == NSOrderedSame)
+        else if ([ports count] == 2)
         {
-            [self tearDown];
-            response = [msg createResponse:200 text:@"OK"];
+            int portRTP = (int)[ports[0] integerValue];
+            int portRTCP = (int) [ports[1] integerValue];
+            
+            int portServer;
+            NSString* session_name = [self createSession:portRTP rtcp:portRTCP serverPort:&portServer];
+            if (session_name != nil)
+            {
+                response = [msg createResponse:200 text:@"OK"];
+                response = [response stringByAppendingFormat:@"Session: %@\r\nTransport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n\r\n",
+                            session_name,
+                            portRTP,portRTCP,
+                            portServer, portServer+1];
+            }
         }
-        else
+        if (response == nil)
         {
-            NSLog(@"RTSP method %@ not handled", cmd);
-            response = [msg createResponse:451 text:@"Method not recognised"];
+            // !!
+            response = [msg createResponse:451 text:@"Need better error string here"];
+        }
+    }
+    else if ([cmd caseInsensitiveCompare:@"play"] == NSOrderedSame)
+    {
+        @synchronized(self)
+        {
+            if (_state != Setup)
+            {
+                response = [msg createResponse:451 text:@"Wrong state"];
+            }
+            else
+            {
+                _state = Playing;
+                _bFirst = YES;
+                response = [msg createResponse:200 text:@"OK"];
+                response = [response stringByAppendingFormat:@"Session: %@\r\n\r\n", _session];
+            }
         }
-        if (response != nil)
+    }
+    else if ([cmd caseInsensitiveCompare:@"teardown"] == NSOrderedSame)
+    {
+        [self tearDown];
+        response = [msg createResponse:200 text:@"OK"];
+    }
+    else
+    {
+        NSLog(@"RTSP method %@ not handled", cmd);
+        response = [msg createResponse:451 text:@"Method not recognised"];
+    }
+    if (response != nil)
+    {
+        NSData* dataResponse = [response dataUsingEncoding:NSUTF8StringEncoding];
+        @synchronized(self)
         {
-            NSData* dataResponse = [response dataUsingEncoding:NSUTF8StringEncoding];
-            CFSocketError e = CFSocketSendData(_s, NULL, (__bridge CFDataRef)(dataResponse), 2);
-            if (e)
+            if (_sendQueue)
             {
-                NSLog(@"send %ld", e);
+                _sendQueue->QueueData((const BYTE*)[dataResponse bytes], (int)[dataResponse length]);
+                [self flushSendQueue];
             }
         }
     }
@@ -339,147 +453,125 @@ static void onRTCP(CFSocketRef s,
     return sdp;
 }
 
-- (NSString*) createSession:(int) portRTP rtcp:(int) portRTCP
+- (NSString*) createSession:(int) portRTP rtcp:(int) portRTCP serverPort:(int*) pportServer
 {
-    // !! most basic possible for initial testing
     @synchronized(self)
     {
+        // release the sockets and addresses of any earlier SETUP
+        [self closeTransport];
+        if (![self bindServerPorts])
+        {
+            NSLog(@"no free UDP ports");
+            return nil;
+        }
+        CFDataRef local = CFSocketCopyAddress(_sRTP);
+        *pportServer = ntohs(((struct sockaddr_in*) CFDataGetBytePtr(local))->sin_port);
+        CFRelease(local);
+        
         CFDataRef data = CFSocketCopyPeerAddress(_s);
         struct sockaddr_in* paddr = (struct sockaddr_in*) CFDataGetBytePtr(data);
         paddr->sin_port = htons(portRTP);
         _addrRTP = CFDataCreate(nil, (uint8_t*) paddr, sizeof(struct sockaddr_in));
-        _sRTP = CFSocketCreate(nil, PF_INET, SOCK_DGRAM, IPPROTO_UDP, 0, nil, nil);
-        
         paddr->sin_port = htons(portRTCP);
         _addrRTCP = CFDataCreate(nil, (uint8_t*) paddr, sizeof(struct sockaddr_in));
-        _sRTCP = CFSocketCreate(nil, PF_INET, SOCK_DGRAM, IPPROTO_UDP, 0, nil, nil);
         CFRelease(data);
         
-        // reader reports received here
-        CFSocketContext info;
-        memset(&info, 0, sizeof(info));
-        info.info = (void*)CFBridgingRetain(self);
-        _recvRTCP = CFSocketCreate(nil, PF_INET, SOCK_DGRAM, IPPROTO_UDP, kCFSocketDataCallBack, onRTCP, &info);
-        
-        struct sockaddr_in addr;
-        addr.sin_addr.s_addr = INADDR_ANY;
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(6971);
-        CFDataRef dataAddr = CFDataCreate(nil, (const uint8_t*)&addr, sizeof(addr));
-        CFSocketSetAddress(_recvRTCP, dataAddr);
-        CFRelease(dataAddr);
-        
-        _rlsRTCP = CFSocketCreateRunLoopSource(nil, _recvRTCP, 0);
-        CFRunLoopAddSource(CFRunLoopGetMain(), _rlsRTCP, kCFRunLoopCommonModes);
+        _rlsRTCP = CFSocketCreateRunLoopSource(nil, _sRTCP, 0);
+        CFRunLoopAddSource([RTSPServer controlRunLoop], _rlsRTCP, kCFRunLoopCommonModes);
         
-        // flag that setup is valid
-        long sessionid = random();
-        _session = [NSString stringWithFormat:@"%ld", sessionid];
-        _state = Setup;
-        _ssrc = random();
-        _packets = 0;
-        _bytesSent = 0;
-        _rtpBase = 0;
-    
-        _sentRTCP = nil;
-        _packetsReported = 0;
-        _bytesReported = 0;
+        _bInterleaved = NO;
+        [self startSession];
     }
     return _session;
 }
 
-- (void) onVideoData:(NSArray*) data time:(double) pts
+// RTP and RTCP are sent from an even/odd pair of free ports
+// (RFC 3550 11), so that any number of sessions can be set up at once
+- (BOOL) bindServerPorts
 {
-    @synchronized(self)
+    for (int attempt = 0; attempt < 16; attempt++)
     {
-        if (_state != Playing)
+        CFSocketRef sRTP = CFSocketCreate(nil, PF_INET, SOCK_DGRAM, IPPROTO_UDP, 0, nil, nil);
+        int port = bindUDP(sRTP, 0);
+        if ((port > 0) && ((port & 1) == 0))
         {
-            return;
+            // reader reports received here
+            CFSocketContext info;
+            memset(&info, 0, sizeof(info));
+            info.info = (void*)CFBridgingRetain(self);
+            CFSocketRef sRTCP = CFSocketCreate(nil, PF_INET, SOCK_DGRAM, IPPROTO_UDP, kCFSocketDataCallBack, onRTCP, &info);
+            if (bindUDP(sRTCP, port + 1) > 0)
+            {
+                _sRTP = sRTP;
+                _sRTCP = sRTCP;
+                return YES;
+            }
+            CFSocketInvalidate(sRTCP);
+            CFRelease(sRTCP);
+            CFBridgingRelease(info.info);
         }
+        CFSocketInvalidate(sRTP);
+        CFRelease(sRTP);
     }
+    return NO;
+}
+
+- (NSString*) createInterleavedSession:(int) channelRTP rtcp:(int) channelRTCP
+{
+    @synchronized(self)
+    {
+        [self closeTransport];
+        _bInterleaved = YES;
+        _channelRTP = channelRTP;
+        _channelRTCP = channelRTCP;
+        [self startSession];
+    }
+    return _session;
+}
+
+// called under @synchronized(self) once the transport is set up
+- (void) startSession
+{
+    // flag that setup is valid
+    long sessionid = random();
+    _session = [NSString stringWithFormat:@"%ld", sessionid];
+    _state = Setup;
+    _ssrc = random();
+    _packets = 0;
+    _bytesSent = 0;
+    _rtpBase = 0;
     
-    const int rtp_header_size = 12;
-    const int max_single_packet = max_packet_size - rtp_header_size;
-    const int max_fragment_packet = max_single_packet - 2;
-    unsigned char packet[max_packet_size];
-    
-    int nNALUs = (int)[data count];
-    for (int i = 0; i < nNALUs; i++)
+    _sentRTCP = nil;
+    _packetsReported = 0;
+    _bytesReported = 0;
+}
+
+- (void) onVideoPackets:(RTPPacketList) packets time:(double) pts
+{
+    @synchronized(self)
     {
-        NSData* nalu = [data objectAtIndex:i];
-        int cBytes = (int)[nalu length];
-        BOOL bLast = (i == nNALUs-1);
+        if (_state != Playing)
+        {
+            return;
+        }
         
-        const unsigned char* pSource = (unsigned char*)[nalu bytes];
- 
+        int idxFrom = 0;
         if (_bFirst)
         {
-            if ((pSource[0] & 0x1f) != 5)
+            idxFrom = packets->FirstIDRPacket();
+            if (idxFrom < 0)
             {
-                continue;
+                return;
             }
             _bFirst = NO;
             NSLog(@"Playback starting at first IDR");
         }
-        
-        if (cBytes < max_single_packet)
-        {
-            [self writeHeader:packet marker:bLast time:pts];
-            memcpy(packet + rtp_header_size, [nalu bytes], cBytes);
-            [self sendPacket:packet length:(cBytes + rtp_header_size)];
-        }
-        else
-        {
-            unsigned char NALU_Header = pSource[0];
-            pSource += 1;
-            cBytes -= 1;
-            BOOL bStart = YES;
-            
-            while (cBytes)
-            {
-                int cThis = (cBytes < max_fragment_packet)? cBytes : max_fragment_packet;
-                BOOL bEnd = (cThis == cBytes);
-                [self writeHeader:packet marker:(bLast && bEnd) time:pts];
-                unsigned char* pDest = packet + rtp_header_size;
-                
-                pDest[0] = (NALU_Header & 0xe0) + 28;   // FU_A type
-                unsigned char fu_header = (NALU_Header & 0x1f);
-                if (bStart)
-                {
-                    fu_header |= 0x80;
-                    bStart = false;
-                }
-                else if (bEnd)
-                {
-                    fu_header |= 0x40;
-                }
-                pDest[1] = fu_header;
-                pDest += 2;
-                memcpy(pDest, pSource, cThis);
-                pDest += cThis;
-                [self sendPacket:packet length:(int)(pDest - packet)];
-                
-                pSource += cThis;
-                cBytes -= cThis;
-            }
-        }
+        [self sendPackets:packets from:idxFrom time:pts];
     }
 }
 
-- (void) writeHeader:(uint8_t*) packet marker:(BOOL) bMarker time:(double) pts
+- (unsigned long) rtpTime:(double) pts
 {
-    packet[0] = 0x80;   // v= 2
-    if (bMarker)
-    {
-        packet[1] = 96 | 0x80;
-    }
-    else
-    {
-        packet[1] = 96;
-    }
-    unsigned short seq = _packets & 0xffff;
-    tonet_short(packet+2, seq);
-
     // map time
     while (_rtpBase == 0)
     {
@@ -494,49 +586,66 @@ static void onRTCP(CFSocketRef s,
     pts -= _ptsBase;
     uint64_t rtp = (uint64_t)(pts * 90000);
     rtp += _rtpBase;
-    tonet_long(packet + 4, rtp);
-    tonet_long(packet + 8, _ssrc);
+    return (unsigned long)rtp;
 }
 
-- (void) sendPacket:(uint8_t*) packet length:(int) cBytes
+// called under @synchronized(self). Only the headers are written:
+// the payloads are shared with the other connections.
+- (void) sendPackets:(RTPPacketList) packets from:(int) idxFrom time:(double) pts
 {
-    @synchronized(self)
+    packets->StampHeaders(idxFrom, _packets & 0xffff, [self rtpTime:pts], _ssrc);
+    if (_bInterleaved)
     {
-        if (_sRTP)
+        if (!_sendQueue->QueueFrame(packets, idxFrom, _channelRTP))
         {
-            CFDataRef data = CFDataCreate(nil, packet, cBytes);
-            CFSocketSendData(_sRTP, _addrRTP, data, 0);
-            CFRelease(data);
+            // the client is not keeping up: drop frames until the next IDR
+            _bFirst = YES;
+            return;
         }
-        _packets++;
-        _bytesSent += cBytes;
-        
-        // RTCP packets
-        NSDate* now = [NSDate date];
-        if ((_sentRTCP == nil) || ([now timeIntervalSinceDate:_sentRTCP] >= 1))
+        [self flushSendQueue];
+    }
+    else if (_sRTP)
+    {
+        packets->Send(CFSocketGetNative(_sRTP), (const struct sockaddr*) CFDataGetBytePtr(_addrRTP), (socklen_t) CFDataGetLength(_addrRTP), idxFrom);
+    }
+    _packets += packets->Count() - idxFrom;
+    _bytesSent += packets->BytesFrom(idxFrom);
+    
+    // RTCP packets: checked once per frame
+    NSDate* now = [NSDate date];
+    if ((_sentRTCP == nil) || ([now timeIntervalSinceDate:_sentRTCP] >= 1))
+    {
+        uint8_t buf[7 * sizeof(uint32_t)];
+        buf[0] = 0x80;
+        buf[1] = 200;   // type == SR
+        tonet_short(buf+2, 6);  // length (count of uint32_t minus 1)
+        tonet_long(buf+4, _ssrc);
+        tonet_long(buf+8, (_ntpBase >> 32));
+        tonet_long(buf+12, _ntpBase);
+        tonet_long(buf+16, _rtpBase);
+        tonet_long(buf+20, (_packets - _packetsReported));
+        tonet_long(buf+24, (_bytesSent - _bytesReported));
+        int lenRTCP = 28;
+        if (_bInterleaved)
         {
-            uint8_t buf[7 * sizeof(uint32_t)];
-            buf[0] = 0x80;
-            buf[1] = 200;   // type == SR
-            tonet_short(buf+2, 6);  // length (count of uint32_t minus 1)
-            tonet_long(buf+4, _ssrc);
-            tonet_long(buf+8, (_ntpBase >> 32));
-            tonet_long(buf+12, _ntpBase);
-            tonet_long(buf+16, _rtpBase);
-            tonet_long(buf+20, (_packets - _packetsReported));
-            tonet_long(buf+24, (_bytesSent - _bytesReported));
-            int lenRTCP = 28;
-            if (_sRTCP)
-            {
-                CFDataRef dataRTCP = CFDataCreate(nil, buf, lenRTCP);
-                CFSocketSendData(_sRTCP, _addrRTCP, dataRTCP, lenRTCP);
-                CFRelease(dataRTCP);
-            }
-            
-            _sentRTCP = now;
-            _packetsReported = _packets;
-            _bytesReported = _bytesSent;
+            uint8_t frame[RTSPSendQueue::InterleavedHeaderSize];
+            frame[0] = '$';
+            frame[1] = (uint8_t) _channelRTCP;
+            tonet_short(frame+2, lenRTCP);
+            _sendQueue->QueueData(frame, sizeof(frame));
+            _sendQueue->QueueData(buf, lenRTCP);
+            [self flushSendQueue];
+        }
+        else if (_sRTCP)
+        {
+            CFDataRef dataRTCP = CFDataCreate(nil, buf, lenRTCP);
+            CFSocketSendData(_sRTCP, _addrRTCP, dataRTCP, lenRTCP);
+            CFRelease(dataRTCP);
         }
+        
+        _sentRTCP = now;
+        _packetsReported = _packets;
+        _bytesReported = _bytesSent;
     }
 }
 
@@ -545,36 +654,100 @@ static void onRTCP(CFSocketRef s,
     // NSLog(@"RTCP recv");
 }
 
+// called under @synchronized(self)
+- (void) flushSendQueue
+{
+    if (_s == nil)
+    {
+        return;
+    }
+    if (!_sendQueue->Flush())
+    {
+        NSLog(@"RTSP send error %d", errno);
+    }
+    else if (_sendQueue->Pending())
+    {
+        // socket is full: carry on when it drains
+        CFSocketEnableCallBacks(_s, kCFSocketWriteCallBack);
+    }
+}
+
+- (void) onWritable
+{
+    @synchronized(self)
+    {
+        [self flushSendQueue];
+    }
+}
+
+// called under @synchronized(self)
+- (void) closeTransport
+{
+    if (_rlsRTCP)
+    {
+        CFRunLoopSourceInvalidate(_rlsRTCP);
+        CFRelease(_rlsRTCP);
+        _rlsRTCP = nil;
+    }
+    if (_sRTP)
+    {
+        CFSocketInvalidate(_sRTP);
+        CFRelease(_sRTP);
+        _sRTP = nil;
+    }
+    if (_sRTCP)
+    {
+        // the reader report callback holds a reference to us,
+        // taken in bindServerPorts
+        CFSocketContext info;
+        memset(&info, 0, sizeof(info));
+        CFSocketGetContext(_sRTCP, &info);
+        CFSocketInvalidate(_sRTCP);
+        CFRelease(_sRTCP);
+        _sRTCP = nil;
+        CFBridgingRelease(info.info);
+    }
+    if (_addrRTP)
+    {
+        CFRelease(_addrRTP);
+        _addrRTP = nil;
+    }
+    if (_addrRTCP)
+    {
+        CFRelease(_addrRTCP);
+        _addrRTCP = nil;
+    }
+    _bInterleaved = NO;
+}
+
 - (void) tearDown
 {
     @synchronized(self)
     {
-        if (_sRTP)
-        {
-            CFSocketInvalidate(_sRTP);
-            _sRTP = nil;
-        }
-        if (_sRTCP)
-        {
-            CFSocketInvalidate(_sRTCP);
-            _sRTCP = nil;
-        }
-        if (_recvRTCP)
-        {
-            CFSocketInvalidate(_recvRTCP);
-            _recvRTCP = nil;
-        }
+        [self closeTransport];
+        _state = ServerIdle;
         _session = nil;
     }
 }
 
+// called under @synchronized(self). The send queue goes with the socket,
+// so nothing can write to the descriptor once it is closed
+- (void) closeSocket
+{
+    if (_s != nil)
+    {
+        CFSocketInvalidate(_s);
+        _s = nil;
+    }
+    _sendQueue.reset();
+}
+
 - (void) shutdown
 {
     [self tearDown];
     @synchronized(self)
     {
-        CFSocketInvalidate(_s);
-        _s = nil;
+        [self closeSocket];
     }
 }
 @end
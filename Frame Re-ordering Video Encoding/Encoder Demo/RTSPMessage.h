@@ -8,11 +8,20 @@
 
 #import <Foundation/Foundation.h>
 
+// requests larger than this are treated as a protocol error
+#define MAX_RTSP_REQUEST    (16 * 1024)
+
 @interface RTSPMessage : NSObject
 
 
 + (RTSPMessage*) createWithData:(CFDataRef) data;
 
+// Parse one request from the start of a receive buffer, which may hold
+// a partial request or several pipelined ones. Returns nil with *pcUsed = 0
+// if the request is not yet complete. A malformed request returns nil with
+// *pcUsed set so that it can be skipped, or -1 if the stream cannot be resynced.
++ (RTSPMessage*) parseBytes:(const uint8_t*) p length:(int) cBytes used:(int*) pcUsed;
+
 - (NSString*) valueForOption:(NSString*) option;
 - (NSString*) createResponse:(int) code text:(NSString*) desc;
 
@@ -8,18 +8,108 @@
 
 #import "RTSPMessage.h"
 
+// header lines are held as offsets into the request, and only
+// converted to strings when asked for
+#define MAX_RTSP_HEADERS    32
+
+typedef struct
+{
+    int name;
+    int cName;
+    int value;
+    int cValue;
+} HeaderLine;
+
 @interface RTSPMessage ()
 
 {
-    NSArray* _lines;
+    NSData* _data;
+    HeaderLine _headers[MAX_RTSP_HEADERS];
+    int _cHeaders;
     NSString* _request;
     int _cseq;
 }
 
-- (RTSPMessage*) initWithData:(CFDataRef) data;
+- (RTSPMessage*) initWithBytes:(const uint8_t*) p length:(int) cBytes;
 
 @end
 
+static int findHeaderEnd(const uint8_t* p, int cBytes)
+{
+    for (int i = 0; (i + 3) < cBytes; i++)
+    {
+        if ((p[i+3] == '\n') && (p[i+2] == '\r') && (p[i+1] == '\n') && (p[i] == '\r'))
+        {
+            return i + 4;
+        }
+    }
+    return -1;
+}
+
+static BOOL isBlank(uint8_t ch)
+{
+    return (ch == ' ') || (ch == '\t');
+}
+
+// Content-Length read straight from the header bytes, so that the body of a
+// request we can't use is still skipped. Returns NO if the value is bad;
+// *pcBody is 0 if there is no Content-Length line
+static BOOL findContentLength(const uint8_t* p, int cHeader, int* pcBody)
+{
+    static const char name[] = "content-length";
+    const int cName = sizeof(name) - 1;
+    *pcBody = 0;
+    
+    // header lines start after the request line
+    int idx = 0;
+    while ((idx < cHeader) && (p[idx] != '\n'))
+    {
+        idx++;
+    }
+    idx++;
+    while (idx < cHeader)
+    {
+        int start = idx;
+        while ((idx < cHeader) && (p[idx] != '\n'))
+        {
+            idx++;
+        }
+        int end = idx;
+        idx++;
+        if (((end - start) <= cName) || (p[start + cName] != ':') || (strncasecmp((const char*)p + start, name, cName) != 0))
+        {
+            continue;
+        }
+        int i = start + cName + 1;
+        while ((i < end) && isBlank(p[i]))
+        {
+            i++;
+        }
+        BOOL bNegative = (i < end) && (p[i] == '-');
+        if ((i < end) && ((p[i] == '-') || (p[i] == '+')))
+        {
+            i++;
+        }
+        long long cBody = 0;
+        while ((i < end) && (p[i] >= '0') && (p[i] <= '9') && (cBody <= MAX_RTSP_REQUEST))
+        {
+            cBody = (cBody * 10) + (p[i] - '0');
+            i++;
+        }
+        if (bNegative && (cBody > 0))
+        {
+            return NO;
+        }
+        if (cBody > MAX_RTSP_REQUEST)
+        {
+            return NO;
+        }
+        *pcBody = (int)cBody;
+        return YES;
+    }
+    return YES;
+}
+
 @implementation RTSPMessage
 
 @synthesize command = _request;
@@ -27,22 +117,104 @@
 
 + (RTSPMessage*) createWithData:(CFDataRef) data
 {
-    RTSPMessage* msg = [[RTSPMessage alloc] initWithData:data];
+    RTSPMessage* msg = [[RTSPMessage alloc] initWithBytes:CFDataGetBytePtr(data) length:(int)CFDataGetLength(data)];
     return msg;
 }
 
-- (RTSPMessage*) initWithData:(CFDataRef) data
++ (RTSPMessage*) parseBytes:(const uint8_t*) p length:(int) cBytes used:(int*) pcUsed
+{
+    *pcUsed = 0;
+    int cHeader = findHeaderEnd(p, cBytes);
+    if (cHeader < 0)
+    {
+        if (cBytes > MAX_RTSP_REQUEST)
+        {
+            NSLog(@"RTSP request too long");
+            *pcUsed = -1;
+        }
+        return nil;
+    }
+    
+    // any body is skipped, but we must wait for all of it, even when
+    // the request itself is no use to us
+    int cBody;
+    if (!findContentLength(p, cHeader, &cBody))
+    {
+        *pcUsed = -1;
+        return nil;
+    }
+    if ((cHeader + cBody) > cBytes)
+    {
+        return nil;
+    }
+    *pcUsed = cHeader + cBody;
+    return [[RTSPMessage alloc] initWithBytes:p length:cHeader];
+}
+
+- (RTSPMessage*) initWithBytes:(const uint8_t*) p length:(int) cBytes
 {
     self = [super init];
-    NSString* msg = [[NSString alloc] initWithData:(__bridge NSData*)data encoding:NSUTF8StringEncoding];
-    _lines = [msg componentsSeparatedByString:@"\r\n"];
-    if ([_lines count] < 2)
+    _data = [NSData dataWithBytes:p length:cBytes];
+    p = (const uint8_t*)[_data bytes];
+    _cHeaders = 0;
+    
+    // request line: method up to the first space
+    int idx = 0;
+    while ((idx < cBytes) && (p[idx] != ' ') && (p[idx] != '\r'))
+    {
+        idx++;
+    }
+    if ((idx == 0) || (idx >= cBytes))
     {
         NSLog(@"msg parse error");
         return nil;
     }
-    NSArray* lineone = [[_lines objectAtIndex:0] componentsSeparatedByString:@" "];
-    _request = [lineone objectAtIndex:0];
+    _request = [[NSString alloc] initWithBytes:p length:idx encoding:NSUTF8StringEncoding];
+    while ((idx < cBytes) && (p[idx] != '\n'))
+    {
+        idx++;
+    }
+    idx++;
+    
+    // header lines as name: value
+    while ((idx < cBytes) && (_cHeaders < MAX_RTSP_HEADERS))
+    {
+        int start = idx;
+        while ((idx < cBytes) && (p[idx] != '\n'))
+        {
+            idx++;
+        }
+        int end = idx;
+        idx++;
+        if ((end > start) && (p[end-1] == '\r'))
+        {
+            end--;
+        }
+        int colon = start;
+        while ((colon < end) && (p[colon] != ':'))
+        {
+            colon++;
+        }
+        if (colon == end)
+        {
+            continue;
+        }
+        int value = colon + 1;
+        while ((value < end) && isBlank(p[value]))
+        {
+            value++;
+        }
+        while ((end > value) && isBlank(p[end-1]))
+        {
+            end--;
+        }
+        HeaderLine* h = &_headers[_cHeaders++];
+        h->name = start;
+        h->cName = colon - start;
+        h->value = value;
+        h->cValue = end - value;
+    }
+    
     NSString* strSeq = [self valueForOption:@"CSeq"];
     if (strSeq == nil)
     {
@@ -56,18 +228,15 @@
 
 - (NSString*) valueForOption:(NSString*) option
 {
-    for (int i = 1; i < [_lines count]; i++)
+    const char* name = [option UTF8String];
+    int cName = (int)strlen(name);
+    const uint8_t* p = (const uint8_t*)[_data bytes];
+    for (int i = 0; i < _cHeaders; i++)
     {
-        NSString* line = [_lines objectAtIndex:i];
-        NSArray* comps = [line componentsSeparatedByString:@":"];
-        if ([comps count] == 2)
-        {
-            if ([option caseInsensitiveCompare:[comps objectAtIndex:0]] == NSOrderedSame)
-            {
-                NSString* val = [comps objectAtIndex:1];
-                val = [val stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-                return val;
-            }
+        HeaderLine* h = &_headers[i];
+        if ((h->cName == cName) && (strncasecmp((const char*)p + h->name, name, cName) == 0))
+        {
+            return [[NSString alloc] initWithBytes:(p + h->value) length:h->cValue encoding:NSUTF8StringEncoding];
         }
     }
     return nil;
@@ -0,0 +1,162 @@
+//
+// RTSPSendQueue.cpp
+//
+// Implementation of the RTSP TCP output queue
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+#include "RTSPSendQueue.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// iovecs per writev call
+static const int kMaxPieces = 256;
+
+RTSPSendQueue::RTSPSendQueue(int fd, int maxQueued)
+: m_fd(fd),
+  m_maxQueued(maxQueued),
+  m_cQueued(0)
+{
+    int flags = fcntl(m_fd, F_GETFL, 0);
+    fcntl(m_fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+void
+RTSPSendQueue::QueueData(const BYTE* p, int cBytes)
+{
+    // an empty piece would never be consumed by a write
+    if (cBytes <= 0)
+    {
+        return;
+    }
+    m_queue.push_back(Segment());
+    Segment& seg = m_queue.back();
+    seg.data.assign(p, p + cBytes);
+    struct iovec iov;
+    iov.iov_base = &seg.data[0];
+    iov.iov_len = cBytes;
+    seg.pieces.push_back(iov);
+    seg.idxPiece = 0;
+    seg.cOffset = 0;
+    m_cQueued += cBytes;
+}
+
+bool
+RTSPSendQueue::QueueFrame(RTPPacketList packets, int idxFrom, int channel)
+{
+    int cPackets = packets->Count() - idxFrom;
+    if (cPackets <= 0)
+    {
+        return true;
+    }
+    int cBytes = packets->BytesFrom(idxFrom) + (cPackets * InterleavedHeaderSize);
+    if ((m_cQueued + cBytes) > m_maxQueued)
+    {
+        return false;
+    }
+
+    m_queue.push_back(Segment());
+    Segment& seg = m_queue.back();
+    seg.packets = packets;
+    seg.idxPiece = 0;
+    seg.cOffset = 0;
+
+    // our own copy of the framing and RTP header for each packet;
+    // sized first so that the pointers into it stay valid
+    const int cPrefix = InterleavedHeaderSize + RTPPacketizer::RTPHeaderSize;
+    seg.data.resize(cPackets * cPrefix);
+    seg.pieces.reserve(cPackets * 2);
+    for (int i = 0; i < cPackets; i++)
+    {
+        BYTE* packet = packets->Packet(idxFrom + i);
+        int cPacket = packets->Length(idxFrom + i);
+        BYTE* prefix = &seg.data[i * cPrefix];
+        prefix[0] = '$';
+        prefix[1] = (BYTE) channel;
+        prefix[2] = (cPacket >> 8) & 0xff;
+        prefix[3] = cPacket & 0xff;
+        memcpy(prefix + InterleavedHeaderSize, packet, RTPPacketizer::RTPHeaderSize);
+
+        struct iovec iov;
+        iov.iov_base = prefix;
+        iov.iov_len = cPrefix;
+        seg.pieces.push_back(iov);
+        if (cPacket > RTPPacketizer::RTPHeaderSize)
+        {
+            iov.iov_base = packet + RTPPacketizer::RTPHeaderSize;
+            iov.iov_len = cPacket - RTPPacketizer::RTPHeaderSize;
+            seg.pieces.push_back(iov);
+        }
+    }
+    m_cQueued += cBytes;
+    return true;
+}
+
+bool
+RTSPSendQueue::Flush()
+{
+    struct iovec iov[kMaxPieces];
+    while (!m_queue.empty())
+    {
+        // gather from the front segments, starting part way
+        // through the first piece if a write was short
+        int cPieces = 0;
+        for (std::deque<Segment>::iterator it = m_queue.begin(); (it != m_queue.end()) && (cPieces < kMaxPieces); it++)
+        {
+            for (size_t i = it->idxPiece; (i < it->pieces.size()) && (cPieces < kMaxPieces); i++)
+            {
+                iov[cPieces] = it->pieces[i];
+                if ((it == m_queue.begin()) && (i == it->idxPiece))
+                {
+                    iov[cPieces].iov_base = (BYTE*)iov[cPieces].iov_base + it->cOffset;
+                    iov[cPieces].iov_len -= it->cOffset;
+                }
+                cPieces++;
+            }
+        }
+
+        ssize_t cWritten = writev(m_fd, iov, cPieces);
+        if (cWritten < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+            {
+                return true;
+            }
+            return false;
+        }
+        if (cWritten == 0)
+        {
+            // nothing taken: try again when the socket is writable
+            // rather than spin here
+            return true;
+        }
+        Consume(cWritten);
+    }
+    return true;
+}
+
+void
+RTSPSendQueue::Consume(size_t cBytes)
+{
+    m_cQueued -= (int)cBytes;
+    while (cBytes && !m_queue.empty())
+    {
+        Segment& seg = m_queue.front();
+        size_t cPiece = seg.pieces[seg.idxPiece].iov_len - seg.cOffset;
+        if (cBytes < cPiece)
+        {
+            seg.cOffset += cBytes;
+            return;
+        }
+        cBytes -= cPiece;
+        seg.cOffset = 0;
+        seg.idxPiece++;
+        if (seg.idxPiece == seg.pieces.size())
+        {
+            // releases our reference to the shared packets
+            m_queue.pop_front();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+//
+// RTSPSendQueue.h
+//
+// Output queue for an RTSP TCP connection. Responses and, for
+// RTP/AVP/TCP sessions, '$'-framed interleaved RTP packets (RFC 2326 10.12)
+// are written in order, batched with writev on a non-blocking socket.
+//
+// Copyright (c) GDCL 2004-2008 http://www.gdcl.co.uk/license.htm
+
+
+#pragma once
+
+#include "RTPPacketizer.h"
+#include <deque>
+#include <sys/uio.h>
+
+class RTSPSendQueue
+{
+public:
+    enum
+    {
+        InterleavedHeaderSize   = 4,
+        DefaultMaxQueued        = 2 * 1024 * 1024,
+    };
+
+    RTSPSendQueue(int fd, int maxQueued = DefaultMaxQueued);
+
+    // control data such as an RTSP response: always queued
+    void QueueData(const BYTE* p, int cBytes);
+
+    // Queue packets idxFrom onwards, whose headers have just been stamped
+    // for this client, on an interleaved channel. The headers are copied
+    // but the payloads are referenced in the shared list. If the client
+    // has fallen too far behind, the frame is dropped and false is returned;
+    // the caller should then wait for the next IDR.
+    bool QueueFrame(RTPPacketList packets, int idxFrom, int channel);
+
+    // Write as much as the socket will take. Returns false on a
+    // socket error. Pending() is true if the socket filled up.
+    bool Flush();
+    bool Pending()          { return !m_queue.empty(); }
+
+private:
+    struct Segment
+    {
+        RTPPacketList packets;
+        std::vector<BYTE> data;
+        std::vector<struct iovec> pieces;
+        size_t idxPiece;
+        size_t cOffset;
+    };
+
+    void Consume(size_t cBytes);
+
+private:
+    int m_fd;
+    int m_maxQueued;
+    int m_cQueued;
+    std::deque<Segment> m_queue;
+};
@@ -17,6 +17,10 @@
 + (NSString*) getIPAddress;
 + (RTSPServer*) setupListener:(NSData*) configData;
 
+// RTSP control sockets are serviced on this run loop,
+// on a thread of its own rather than the main thread
++ (CFRunLoopRef) controlRunLoop;
+
 - (NSData*) getConfigData;
 - (void) onVideoData:(NSArray*) data time:(double) pts;
 - (void) shutdownConnection:(id) conn;
@@ -1,5 +1,5 @@
 //
-//  RTSPServer.m
+//  RTSPServer.mm
 //  Encoder Demo
 //
 //  Created by Geraint Davies on 17/01/2013.
@@ -18,6 +18,9 @@
     NSMutableArray* _connections;
     NSData* _configData;
     int _bitrate;
+    
+    // packetized once per frame and shared by all connections
+    RTPPacketList _packets;
 }
 
 - (RTSPServer*) init:(NSData*) configData;
@@ -49,10 +52,45 @@ static void onSocket (
     
 }
 
+static CFRunLoopRef s_controlRunLoop;
+static dispatch_semaphore_t s_controlStarted;
+
 @implementation RTSPServer
 
 @synthesize bitrate = _bitrate;
 
++ (CFRunLoopRef) controlRunLoop
+{
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        s_controlStarted = dispatch_semaphore_create(0);
+        NSThread* thread = [[NSThread alloc] initWithTarget:self selector:@selector(controlThread:) object:nil];
+        [thread setName:@"RTSP control"];
+        [thread start];
+        dispatch_semaphore_wait(s_controlStarted, DISPATCH_TIME_FOREVER);
+    });
+    return s_controlRunLoop;
+}
+
++ (void) controlThread:(id) arg
+{
+    @autoreleasepool
+    {
+        s_controlRunLoop = CFRunLoopGetCurrent();
+        
+        // a port keeps the run loop alive while there are no sockets
+        [[NSRunLoop currentRunLoop] addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+        dispatch_semaphore_signal(s_controlStarted);
+    }
+    for (;;)
+    {
+        @autoreleasepool
+        {
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+        }
+    }
+}
+
 + (RTSPServer*) setupListener:(NSData*) configData
 {
     RTSPServer* obj = [RTSPServer alloc];
@@ -92,7 +130,7 @@ static void onSocket (
     }
     
     CFRunLoopSourceRef rls = CFSocketCreateRunLoopSource(nil, _listener, 0);
-    CFRunLoopAddSource(CFRunLoopGetMain(), rls, kCFRunLoopCommonModes);
+    CFRunLoopAddSource([RTSPServer controlRunLoop], rls, kCFRunLoopCommonModes);
     CFRelease(rls);
     
     return self;
@@ -121,9 +159,27 @@ static void onSocket (
 {
     @synchronized(self)
     {
+        if ([_connections count] == 0)
+        {
+            return;
+        }
+        
+        // reuse last frame's buffer unless a connection still holds it
+        if (!_packets || !_packets.unique())
+        {
+            _packets = std::make_shared<RTPPacketizer>();
+        }
+        _packets->Reset();
+        int nNALUs = (int)[data count];
+        for (int i = 0; i < nNALUs; i++)
+        {
+            NSData* nalu = [data objectAtIndex:i];
+            _packets->AddNALU((const BYTE*)[nalu bytes], (int)[nalu length], (i == nNALUs-1));
+        }
+        
         for (RTSPClientConnection* conn in _connections)
         {
-            [conn onVideoData:data time:pts];
+            [conn onVideoPackets:_packets time:pts];
         }
     }
 }
@@ -0,0 +1,303 @@
+/*
+     File: RippleSimulationBenchmark.cpp
+ Abstract: Checks and times the fused ripple simulation step.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+/*
+ Build and run from this directory with:
+ 
+    c++ -std=c++11 -O2 -pthread -I../GLCameraRipple -o RippleSimulationBenchmark RippleSimulationBenchmark.cpp ../GLCameraRipple/RippleSimulation.cpp
+    ./RippleSimulationBenchmark
+ 
+ It checks that the fused step gives exactly the heights and texture coordinates of the two passes RippleModel used
+ to run, over a few hundred steps with ripples started along the way, for odd pool sizes and thread counts. Then it
+ times steps per second at 4K screen sizes for several mesh factors, the two passes against the fused step.
+*/
+
+#include "RippleSimulation.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what)
+{
+    if ( ! ok ) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// The model's buffers and the setup RippleModel does for them
+struct Pool {
+    unsigned int width, height, touchRadius;
+    std::vector<float> coeff, source, dest, texCoordS, texCoordT, texCoords;
+    
+    Pool(unsigned int screenWidth, unsigned int screenHeight, unsigned int meshFactor, unsigned int radius)
+        : width(screenWidth / meshFactor), height(screenHeight / meshFactor), touchRadius(radius),
+          coeff((radius * 2 + 1) * (radius * 2 + 1)), source((width + 2) * (height + 2)), dest(source.size()),
+          texCoordS(height), texCoordT(width), texCoords(width * height * 2)
+    {
+        // a 640x480 texture, as the camera gives
+        float factorS = 1.f, offsetS = 0.f, factorT = 1.f, offsetT = 0.f;
+        if ( (float)screenHeight / screenWidth < 640.f / 480.f ) {
+            factorS = (float)(480 * screenHeight) / (screenWidth * 640);
+            offsetS = (1.f - factorS) / 2.f;
+        }
+        else {
+            factorT = (float)(screenWidth * 640) / (480 * screenHeight);
+            offsetT = (1.f - factorT) / 2.f;
+        }
+        for (unsigned int i = 0; i < height; i++)
+            texCoordS[i] = (float)i / (height - 1) * factorS + offsetS;
+        for (unsigned int j = 0; j < width; j++)
+            texCoordT[j] = (1.f - (float)j / (width - 1)) * factorT + offsetT;
+        
+        for (unsigned int y = 0; y <= 2 * radius; y++) {
+            for (unsigned int x = 0; x <= 2 * radius; x++) {
+                float distance = sqrt((x - radius) * (x - radius) + (y - radius) * (y - radius));
+                coeff[y * (radius * 2 + 1) + x] = distance <= radius ? -(cos(distance / radius * M_PI) + 1.f) * 256.f : 0.f;
+            }
+        }
+    }
+    
+    // initiateRippleAtLocation: on a pool position
+    void Touch(int xIndex, int yIndex)
+    {
+        int r = (int)touchRadius;
+        for (int y = yIndex - r; y <= yIndex + r; y++)
+            for (int x = xIndex - r; x <= xIndex + r; x++)
+                if ( x >= 0 && x < (int)width && y >= 0 && y < (int)height )
+                    source[(width + 2) * (y + 1) + x + 1] += coeff[(y - (yIndex - r)) * (r * 2 + 1) + x - (xIndex - r)];
+    }
+    
+    void Swap()
+    {
+        source.swap(dest);
+    }
+    
+    RippleSimulationPool Fused()
+    {
+        RippleSimulationPool pool = { width, height, &source[0], &dest[0], &texCoordS[0], &texCoordT[0], &texCoords[0] };
+        return pool;
+    }
+};
+
+#pragma mark The original step
+
+// runSimulation's two passes, as they were, over rows [firstRow, endRow)
+static void OriginalHeights(Pool *pool, size_t firstRow, size_t endRow)
+{
+    unsigned int poolWidth = pool->width;
+    float *rippleSource = &pool->source[0], *rippleDest = &pool->dest[0];
+    for (size_t y = firstRow; y < endRow; y++) {
+        for (int x=0; x<poolWidth; x++)
+        {
+            float a = rippleSource[(y)*(poolWidth+2) + x+1];
+            float b = rippleSource[(y+2)*(poolWidth+2) + x+1];
+            float c = rippleSource[(y+1)*(poolWidth+2) + x];
+            float d = rippleSource[(y+1)*(poolWidth+2) + x+2];
+            
+            float result = (a + b + c + d)/2.f - rippleDest[(y+1)*(poolWidth+2) + x+1];
+            
+            result -= result/32.f;
+            
+            rippleDest[(y+1)*(poolWidth+2) + x+1] = result;
+        }
+    }
+}
+
+static void OriginalTexCoords(Pool *pool, size_t firstRow, size_t endRow)
+{
+    unsigned int poolWidth = pool->width;
+    float *rippleDest = &pool->dest[0], *rippleTexCoords = &pool->texCoords[0];
+    for (size_t y = firstRow; y < endRow; y++) {
+        for (int x=0; x<poolWidth; x++)
+        {
+            float a = rippleDest[(y)*(poolWidth+2) + x+1];
+            float b = rippleDest[(y+2)*(poolWidth+2) + x+1];
+            float c = rippleDest[(y+1)*(poolWidth+2) + x];
+            float d = rippleDest[(y+1)*(poolWidth+2) + x+2];
+            
+            float s_offset = ((b - a) / 2048.f);
+            float t_offset = ((c - d) / 2048.f);
+            
+            // clamp
+            s_offset = (s_offset < -0.5f) ? -0.5f : s_offset;
+            t_offset = (t_offset < -0.5f) ? -0.5f : t_offset;
+            s_offset = (s_offset > 0.5f) ? 0.5f : s_offset;
+            t_offset = (t_offset > 0.5f) ? 0.5f : t_offset;
+            
+            rippleTexCoords[(y*poolWidth+x)*2+0] = pool->texCoordS[y] + s_offset;
+            rippleTexCoords[(y*poolWidth+x)*2+1] = pool->texCoordT[x] + t_offset;
+        }
+    }
+}
+
+// Each pass split over the threads, as dispatch_apply did
+static void OriginalStep(Pool *pool, size_t threadCount)
+{
+    void (*passes[2])(Pool *, size_t, size_t) = { OriginalHeights, OriginalTexCoords };
+    for (int pass = 0; pass < 2; pass++) {
+        if ( threadCount <= 1 ) {
+            passes[pass](pool, 0, pool->height);
+            continue;
+        }
+        std::vector<std::thread> threads;
+        size_t rowsPerThread = (pool->height + threadCount - 1) / threadCount;
+        for (size_t firstRow = 0; firstRow < pool->height; firstRow += rowsPerThread)
+            threads.push_back(std::thread(passes[pass], pool, firstRow, std::min<size_t>(firstRow + rowsPerThread, pool->height)));
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+}
+
+#pragma mark Checks
+
+static void CheckSteps(unsigned int screenWidth, unsigned int screenHeight, unsigned int meshFactor, size_t threads)
+{
+    Pool original(screenWidth, screenHeight, meshFactor, 8), fused(screenWidth, screenHeight, meshFactor, 8);
+    srand(screenWidth * 31 + screenHeight + meshFactor);
+    bool same = true;
+    for (int step = 0; step < 300 && same; step++) {
+        if ( step % 25 == 0 ) {
+            // by the edges too, where the padding comes into it
+            int x = step % 50 == 0 ? rand() % original.width : 0, y = rand() % original.height;
+            original.Touch(x, y);
+            fused.Touch(x, y);
+        }
+        OriginalStep(&original, 1);
+        RippleSimulationPool pool = fused.Fused();
+        RippleSimulationStep(&pool, threads);
+        same = original.dest == fused.dest && original.texCoords == fused.texCoords;
+        original.Swap();
+        fused.Swap();
+    }
+    
+    char what[128];
+    snprintf(what, sizeof(what), "%ux%u pool on %zu threads matches the two passes", original.width, original.height, threads);
+    Check(same, what);
+    
+    // the waves have to have gone somewhere for that to mean anything
+    bool moved = false;
+    for (size_t i = 0; i < fused.texCoords.size() / 2 && ! moved; i++)
+        moved = fused.texCoords[i * 2] != fused.texCoordS[i / fused.width];
+    Check(moved, "the ripples move the texture coordinates");
+}
+
+static void CheckAll()
+{
+    // a pool of one row and column on top of the padding, widths that aren't multiples of four, and pools tall
+    // enough for several bands with a short one at the end
+    const unsigned int sizes[][3] = { { 4, 4, 2 }, { 37, 23, 1 }, { 320, 480, 4 }, { 1023, 777, 3 }, { 2048, 1536, 2 } };
+    const size_t threads[] = { 1, 3, 0 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        for (size_t j = 0; j < sizeof(threads) / sizeof(threads[0]); j++)
+            CheckSteps(sizes[i][0], sizes[i][1], sizes[i][2], threads[j]);
+}
+
+#pragma mark Timing
+
+static double StepsPerSecond(Pool *pool, int kind, size_t threads)
+{
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    double best = 1e9;
+    for (int run = 0; run < 5; run++) {
+        const int kSteps = 8;
+        double start = NowSeconds();
+        for (int step = 0; step < kSteps; step++) {
+            if ( kind == 0 ) {
+                OriginalStep(pool, threads ? threads : (hardwareThreads ? hardwareThreads : 1));
+            }
+            else {
+                RippleSimulationPool fused = pool->Fused();
+                RippleSimulationStep(&fused, threads);
+            }
+            pool->Swap();
+        }
+        best = std::min(best, (NowSeconds() - start) / kSteps);
+    }
+    return 1.0 / best;
+}
+
+static void TimeSteps()
+{
+    const unsigned int screens[][2] = { { 3840, 2160 }, { 2160, 3840 } };
+    const unsigned int meshFactors[] = { 1, 2, 4, 8 };
+    printf("steps/s                   two passes 1T   fused 1T   two passes NT   fused NT\n");
+    for (size_t i = 0; i < sizeof(screens) / sizeof(screens[0]); i++) {
+        for (size_t j = 0; j < sizeof(meshFactors) / sizeof(meshFactors[0]); j++) {
+            Pool pool(screens[i][0], screens[i][1], meshFactors[j], 8);
+            for (int touch = 0; touch < 16; touch++)
+                pool.Touch(pool.width * touch / 16, pool.height * touch / 16);
+            char name[32];
+            snprintf(name, sizeof(name), "%ux%u /%u", screens[i][0], screens[i][1], meshFactors[j]);
+            printf("%-20s %15.0f %10.0f %15.0f %10.0f\n", name,
+                   StepsPerSecond(&pool, 0, 1), StepsPerSecond(&pool, 1, 1), StepsPerSecond(&pool, 0, 0), StepsPerSecond(&pool, 1, 0));
+        }
+    }
+}
+
+int main()
+{
+    CheckAll();
+    printf("checks %s\n\n", failures ? "FAILED" : "passed");
+    TimeSteps();
+    return failures ? 1 : 0;
+}
@@ -46,6 +46,7 @@
  */
 
 #import "RippleModel.h"
+#import "RippleSimulation.h"
 
 @interface RippleModel () {
     unsigned int screenWidth;
@@ -68,6 +69,10 @@
     float *rippleSource;
     float *rippleDest;
     
+    // texture coords before the ripples move them, by row (s) and column (t)
+    float *rippleTexCoordS;
+    float *rippleTexCoordT;
+    
     // data passed to GL
     GLfloat *rippleVertices;
     GLfloat *rippleTexCoords;
@@ -78,13 +83,6 @@
 
 @implementation RippleModel
 
-- (void)initRippleMap
-{
-    // +2 for padding the border
-    memset(rippleSource, 0, (poolWidth+2)*(poolHeight+2)*sizeof(float));
-    memset(rippleDest, 0, (poolWidth+2)*(poolHeight+2)*sizeof(float));
-}
-
 - (void)initRippleCoeff
 {
     for (int y=0; y<=2*touchRadius; y++)
@@ -108,6 +106,19 @@
     }    
 }
 
+- (void)initTexCoordBase
+{
+    for (int i=0; i<poolHeight; i++)
+    {
+        rippleTexCoordS[i] = (float)i/(poolHeight-1) * texCoordFactorS + texCoordOffsetS;
+    }
+    
+    for (int j=0; j<poolWidth; j++)
+    {
+        rippleTexCoordT[j] = (1.f - (float)j/(poolWidth-1)) * texCoordFactorT + texCoordOffsetT;
+    }
+}
+
 - (void)initMesh
 {
     for (int i=0; i<poolHeight; i++)
@@ -210,6 +221,9 @@
     free(rippleSource);
     free(rippleDest);
     
+    free(rippleTexCoordS);
+    free(rippleTexCoordT);
+    
     free(rippleVertices);
     free(rippleTexCoords);
     free(rippleIndicies);    
@@ -252,25 +266,30 @@
         
         rippleCoeff = (float *)malloc((touchRadius*2+1)*(touchRadius*2+1)*sizeof(float));
         
-        // +2 for padding the border
-        rippleSource = (float *)malloc((poolWidth+2)*(poolHeight+2)*sizeof(float));
-        rippleDest = (float *)malloc((poolWidth+2)*(poolHeight+2)*sizeof(float));
+        // +2 for padding the border, which has to stay zero. calloc'd memory comes zeroed, and after that the
+        // simulation only ever writes inside the border.
+        rippleSource = (float *)calloc((poolWidth+2)*(poolHeight+2), sizeof(float));
+        rippleDest = (float *)calloc((poolWidth+2)*(poolHeight+2), sizeof(float));
+        
+        rippleTexCoordS = (float *)malloc(poolHeight*sizeof(float));
+        rippleTexCoordT = (float *)malloc(poolWidth*sizeof(float));
         
         rippleVertices = (GLfloat *)malloc(poolWidth*poolHeight*2*sizeof(GLfloat));
         rippleTexCoords = (GLfloat *)malloc(poolWidth*poolHeight*2*sizeof(GLfloat));
         rippleIndicies = (GLushort *)malloc((poolHeight-1)*(poolWidth*2+2)*sizeof(GLushort));
         
         if (!rippleCoeff || !rippleSource || !rippleDest || 
+            !rippleTexCoordS || !rippleTexCoordT ||
             !rippleVertices || !rippleTexCoords || !rippleIndicies)
         {
             [self freeBuffers];
             return nil;
         }
         
-        [self initRippleMap];
-        
         [self initRippleCoeff];
         
+        [self initTexCoordBase];
+        
         [self initMesh];
     }
     
@@ -279,64 +298,14 @@
 
 - (void)runSimulation
 {
-    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-    
-    // first pass for simulation buffers...
-    dispatch_apply(poolHeight, queue, ^(size_t y) {
-        for (int x=0; x<poolWidth; x++)
-        {
-            // * - denotes current pixel
-            //
-            //       a 
-            //     c * d
-            //       b 
-            
-            // +1 to both x/y values because the border is padded
-            float a = rippleSource[(y)*(poolWidth+2) + x+1];
-            float b = rippleSource[(y+2)*(poolWidth+2) + x+1];
-            float c = rippleSource[(y+1)*(poolWidth+2) + x];
-            float d = rippleSource[(y+1)*(poolWidth+2) + x+2];
-            
-            float result = (a + b + c + d)/2.f - rippleDest[(y+1)*(poolWidth+2) + x+1];
-            
-            result -= result/32.f;
-            
-            rippleDest[(y+1)*(poolWidth+2) + x+1] = result;
-        }            
-    });
-    
-    // second pass for modifying texture coord
-    dispatch_apply(poolHeight, queue, ^(size_t y) {
-        for (int x=0; x<poolWidth; x++)
-        {
-            // * - denotes current pixel
-            //
-            //       a
-            //     c * d
-            //       b
-            
-            // +1 to both x/y values because the border is padded
-            float a = rippleDest[(y)*(poolWidth+2) + x+1];
-            float b = rippleDest[(y+2)*(poolWidth+2) + x+1];
-            float c = rippleDest[(y+1)*(poolWidth+2) + x];
-            float d = rippleDest[(y+1)*(poolWidth+2) + x+2];
-            
-            float s_offset = ((b - a) / 2048.f);
-            float t_offset = ((c - d) / 2048.f);
-            
-            // clamp
-            s_offset = (s_offset < -0.5f) ? -0.5f : s_offset;
-            t_offset = (t_offset < -0.5f) ? -0.5f : t_offset;
-            s_offset = (s_offset > 0.5f) ? 0.5f : s_offset;
-            t_offset = (t_offset > 0.5f) ? 0.5f : t_offset;
-            
-            float s_tc = (float)y/(poolHeight-1) * texCoordFactorS + texCoordOffsetS;
-            float t_tc = (1.f - (float)x/(poolWidth-1)) * texCoordFactorT + texCoordOffsetT;
-            
-            rippleTexCoords[(y*poolWidth+x)*2+0] = s_tc + s_offset;
-            rippleTexCoords[(y*poolWidth+x)*2+1] = t_tc + t_offset;
-        }
-    });
+    // one pass for both the simulation buffers and the texture coords
+    RippleSimulationPool pool = {
+        poolWidth, poolHeight,
+        rippleSource, rippleDest,
+        rippleTexCoordS, rippleTexCoordT,
+        rippleTexCoords
+    };
+    RippleSimulationStep(&pool, 0);
     
     float *pTmp = rippleDest;
     rippleDest = rippleSource;
@@ -0,0 +1,343 @@
+/*
+     File: RippleSimulation.cpp
+ Abstract: One fused, banded step of the ripple simulation.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+#include "RippleSimulation.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#if __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t Float4;
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 Float4;
+#else
+typedef struct { float f[4]; } Float4;
+#endif
+
+// Bands are never shorter than this, so the rows left for the second pass stay a small share of the pool
+static const size_t kMinRowsPerBand = 16;
+
+#pragma mark Four lane floats
+
+static inline Float4 Load4(const float *p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vld1q_f32(p);
+#elif defined(__SSE2__)
+    return _mm_loadu_ps(p);
+#else
+    Float4 v; memcpy(v.f, p, 16); return v;
+#endif
+}
+
+static inline void Store4(float *p, Float4 v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    vst1q_f32(p, v);
+#elif defined(__SSE2__)
+    _mm_storeu_ps(p, v);
+#else
+    memcpy(p, v.f, 16);
+#endif
+}
+
+// s0 t0 s1 t1 ... s3 t3
+static inline void StoreInterleaved4(float *p, Float4 s, Float4 t)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    float32x4x2_t pairs = { { s, t } };
+    vst2q_f32(p, pairs);
+#elif defined(__SSE2__)
+    _mm_storeu_ps(p, _mm_unpacklo_ps(s, t));
+    _mm_storeu_ps(p + 4, _mm_unpackhi_ps(s, t));
+#else
+    for (int i = 0; i < 4; i++) {
+        p[2*i] = s.f[i];
+        p[2*i+1] = t.f[i];
+    }
+#endif
+}
+
+static inline Float4 Splat4(float x)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vdupq_n_f32(x);
+#elif defined(__SSE2__)
+    return _mm_set1_ps(x);
+#else
+    Float4 v; for (int i = 0; i < 4; i++) v.f[i] = x;
+    return v;
+#endif
+}
+
+static inline Float4 Add4(Float4 a, Float4 b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vaddq_f32(a, b);
+#elif defined(__SSE2__)
+    return _mm_add_ps(a, b);
+#else
+    for (int i = 0; i < 4; i++) a.f[i] += b.f[i];
+    return a;
+#endif
+}
+
+static inline Float4 Sub4(Float4 a, Float4 b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vsubq_f32(a, b);
+#elif defined(__SSE2__)
+    return _mm_sub_ps(a, b);
+#else
+    for (int i = 0; i < 4; i++) a.f[i] -= b.f[i];
+    return a;
+#endif
+}
+
+static inline Float4 Mul4(Float4 a, Float4 b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vmulq_f32(a, b);
+#elif defined(__SSE2__)
+    return _mm_mul_ps(a, b);
+#else
+    for (int i = 0; i < 4; i++) a.f[i] *= b.f[i];
+    return a;
+#endif
+}
+
+static inline Float4 Clamp4(Float4 v, Float4 low, Float4 high)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    return vminq_f32(vmaxq_f32(v, low), high);
+#elif defined(__SSE2__)
+    return _mm_min_ps(_mm_max_ps(v, low), high);
+#else
+    for (int i = 0; i < 4; i++) {
+        v.f[i] = (v.f[i] < low.f[i]) ? low.f[i] : v.f[i];
+        v.f[i] = (v.f[i] > high.f[i]) ? high.f[i] : v.f[i];
+    }
+    return v;
+#endif
+}
+
+#pragma mark Rows
+
+// The arithmetic is RippleModel's original, with the divisions by powers of two done as multiplications, which
+// gives the same floats.
+
+// Row y of the pool, which is row y+1 of the padded grids
+static void UpdateHeights(const RippleSimulationPool *pool, size_t y)
+{
+    size_t stride = pool->width + 2;
+    
+    // * - denotes current pixel
+    //
+    //       a
+    //     c * d
+    //       b
+    
+    // +1 to x because the border is padded
+    const float *above = pool->source + y * stride + 1;
+    const float *row = pool->source + (y + 1) * stride + 1;
+    const float *below = pool->source + (y + 2) * stride + 1;
+    float *dest = pool->dest + (y + 1) * stride + 1;
+    
+    const Float4 half = Splat4(0.5f), damping = Splat4(1.f / 32.f);
+    int width = (int)pool->width, x = 0;
+    for (; x + 4 <= width; x += 4) {
+        Float4 sum = Add4(Add4(Add4(Load4(above + x), Load4(below + x)), Load4(row + x - 1)), Load4(row + x + 1));
+        Float4 result = Sub4(Mul4(sum, half), Load4(dest + x));
+        Store4(dest + x, Sub4(result, Mul4(result, damping)));
+    }
+    for (; x < width; x++) {
+        float result = (above[x] + below[x] + row[x-1] + row[x+1]) * 0.5f - dest[x];
+        dest[x] = result - result * (1.f / 32.f);
+    }
+}
+
+// Needs rows y-1, y and y+1 of the new heights
+static void UpdateTexCoords(const RippleSimulationPool *pool, size_t y)
+{
+    size_t stride = pool->width + 2;
+    const float *above = pool->dest + y * stride + 1;
+    const float *row = pool->dest + (y + 1) * stride + 1;
+    const float *below = pool->dest + (y + 2) * stride + 1;
+    const float *texCoordT = pool->texCoordT;
+    float *texCoords = pool->texCoords + y * pool->width * 2;
+    float texCoordS = pool->texCoordS[y];
+    
+    const Float4 scale = Splat4(1.f / 2048.f), low = Splat4(-0.5f), high = Splat4(0.5f), s = Splat4(texCoordS);
+    int width = (int)pool->width, x = 0;
+    for (; x + 4 <= width; x += 4) {
+        Float4 sOffset = Clamp4(Mul4(Sub4(Load4(below + x), Load4(above + x)), scale), low, high);
+        Float4 tOffset = Clamp4(Mul4(Sub4(Load4(row + x - 1), Load4(row + x + 1)), scale), low, high);
+        StoreInterleaved4(texCoords + x * 2, Add4(s, sOffset), Add4(Load4(texCoordT + x), tOffset));
+    }
+    for (; x < width; x++) {
+        float sOffset = (below[x] - above[x]) * (1.f / 2048.f);
+        float tOffset = (row[x-1] - row[x+1]) * (1.f / 2048.f);
+        
+        // clamp
+        sOffset = (sOffset < -0.5f) ? -0.5f : sOffset;
+        tOffset = (tOffset < -0.5f) ? -0.5f : tOffset;
+        sOffset = (sOffset > 0.5f) ? 0.5f : sOffset;
+        tOffset = (tOffset > 0.5f) ? 0.5f : tOffset;
+        
+        texCoords[x*2+0] = texCoordS + sOffset;
+        texCoords[x*2+1] = texCoordT[x] + tOffset;
+    }
+}
+
+#pragma mark Bands
+
+struct StepJob {
+    const RippleSimulationPool *pool;
+    size_t rowsPerBand;
+    size_t bandCount;
+#if !__APPLE__
+    std::atomic<size_t> nextItem;
+    size_t itemCount;
+    void (*function)(void *, size_t);
+#endif
+};
+
+static void RunBand(void *context, size_t band)
+{
+    StepJob *job = (StepJob *)context;
+    const RippleSimulationPool *pool = job->pool;
+    size_t firstRow = band * job->rowsPerBand;
+    size_t endRow = firstRow + job->rowsPerBand < pool->height ? firstRow + job->rowsPerBand : pool->height;
+    
+    // A row's texture coordinates can be done here unless the row above or below it belongs to another band,
+    // whose heights may not be there yet. The padding stands in for the rows beyond the edges of the pool.
+    bool firstRowIsOurs = firstRow == 0;
+    bool lastRowIsOurs = endRow == pool->height;
+    
+    for (size_t y = firstRow; y < endRow; y++) {
+        UpdateHeights(pool, y);
+        if ( y > firstRow + 1 || (y == firstRow + 1 && firstRowIsOurs) )
+            UpdateTexCoords(pool, y - 1);
+    }
+    if ( lastRowIsOurs && (endRow - 1 > firstRow || firstRowIsOurs) )
+        UpdateTexCoords(pool, endRow - 1);
+}
+
+// The last row of one band and the first of the next
+static void RunBoundary(void *context, size_t boundary)
+{
+    StepJob *job = (StepJob *)context;
+    size_t firstRowBelow = (boundary + 1) * job->rowsPerBand;
+    UpdateTexCoords(job->pool, firstRowBelow - 1);
+    UpdateTexCoords(job->pool, firstRowBelow);
+}
+
+#if !__APPLE__
+static void RunItems(StepJob *job)
+{
+    for (size_t item; (item = job->nextItem++) < job->itemCount; )
+        job->function(job, item);
+}
+#endif
+
+static void RunConcurrently(StepJob *job, size_t itemCount, size_t threadCount, void (*function)(void *, size_t))
+{
+#if __APPLE__
+    (void)threadCount;
+    dispatch_apply_f(itemCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), job, function);
+#else
+    job->nextItem = 0;
+    job->itemCount = itemCount;
+    job->function = function;
+    size_t helperCount = (threadCount < itemCount ? threadCount : itemCount) - 1;
+    std::vector<std::thread> helpers;
+    for (size_t i = 0; i < helperCount; i++)
+        helpers.push_back(std::thread(RunItems, job));
+    RunItems(job);
+    for (size_t i = 0; i < helperCount; i++)
+        helpers[i].join();
+#endif
+}
+
+void RippleSimulationStep(const RippleSimulationPool *pool, size_t maxThreads)
+{
+    if ( pool->width == 0 || pool->height == 0 )
+        return;
+    
+    long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threadCount = maxThreads ? maxThreads : (size_t)(processorCount > 0 ? processorCount : 1);
+    
+    // A few bands per thread, so a core that starts late doesn't hold everything up. Only the three rows around the
+    // one being worked on need to stay in the cache, so a band can be as tall as it likes.
+    size_t rowsPerBand = (pool->height + threadCount * 4 - 1) / (threadCount * 4);
+    if ( rowsPerBand < kMinRowsPerBand )
+        rowsPerBand = kMinRowsPerBand;
+    
+    StepJob job;
+    job.pool = pool;
+    job.rowsPerBand = rowsPerBand;
+    job.bandCount = (pool->height + rowsPerBand - 1) / rowsPerBand;
+    
+    if ( threadCount <= 1 || job.bandCount <= 1 ) {
+        job.rowsPerBand = pool->height;
+        RunBand(&job, 0);
+        return;
+    }
+    
+    RunConcurrently(&job, job.bandCount, threadCount, RunBand);
+    RunConcurrently(&job, job.bandCount - 1, threadCount, RunBoundary);
+}
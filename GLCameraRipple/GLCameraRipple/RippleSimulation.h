@@ -0,0 +1,79 @@
+/*
+     File: RippleSimulation.h
+ Abstract: One fused, banded step of the ripple simulation.
+  Version: 1.0
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2013 Apple Inc. All Rights Reserved.
+ 
+ */
+
+#ifndef GLCameraRipple_RippleSimulation_h
+#define GLCameraRipple_RippleSimulation_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The pool as RippleModel keeps it. The height grids are (width+2)*(height+2) floats with a border of zeroes all
+// round, and a step turns the heights before source into the heights after it, in place in dest.
+typedef struct RippleSimulationPool {
+    unsigned int width;
+    unsigned int height;
+    const float *source;        // current heights
+    float *dest;                // the heights from the step before, overwritten with the new ones
+    const float *texCoordS;     // undisturbed s for each row, height entries
+    const float *texCoordT;     // undisturbed t for each column, width entries
+    float *texCoords;           // width*height s,t pairs for GL
+} RippleSimulationPool;
+
+// Updates the heights and derives the texture coordinates from them in one pass over the pool. Rows go in bands
+// across the cores, four columns at a time, and each row's texture coordinates are worked out right after the row
+// below it is updated, while the three rows they need are still in the cache. The rows either side of a boundary
+// between bands wait for a short second pass, once both bands are done. Pass 0 for maxThreads to use every core.
+void RippleSimulationStep(const RippleSimulationPool *pool, size_t maxThreads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ Checks the fused filter graph against plain reference code and compares fused and unfused chains
+ */
+
+/*
+ Build and run from this directory with:
+
+	c++ -std=c++11 -O2 -pthread -I../Classes/Utilities/CPU -o ImageFilterGraphBenchmark ImageFilterGraphBenchmark.cpp ../Classes/Utilities/CPU/ImageFilterGraph.cpp ../Classes/Utilities/CPU/ImageKernels.cpp
+	./ImageFilterGraphBenchmark
+
+ It checks fused graphs against double precision reference code, odd widths and tile edges included, and
+ unfused chains against fused ones. Then it runs chains of one to five stages (tint, channel mask, color matrix,
+ lookup table, threshold) on 1080p and 4K BGRA frames, fused and unfused, on one thread and on every core, and
+ reports the frame time and the memory bandwidth it took: each pass reads and writes the whole frame.
+*/
+
+#include "ImageFilterGraph.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check( bool ok, const char *what )
+{
+	if ( ! ok ) {
+		printf( "FAILED: %s\n", what );
+		failures++;
+	}
+}
+
+// A BGRA test image with its rows padded out the way CoreVideo pads them
+struct TestImage {
+	ImageKernelView view;
+	std::vector<uint8_t> pixels;
+	
+	TestImage( size_t width, size_t height, uint32_t format = kImageKernelFormat_32BGRA )
+	{
+		memset( &view, 0, sizeof( view ) );
+		view.format = format;
+		view.width = width;
+		view.height = height;
+		view.planes[0].width = width;
+		view.planes[0].height = height;
+		view.planes[0].bytesPerRow = ( width * 4 + 64 + 63 ) / 64 * 64;
+		pixels.resize( view.planes[0].bytesPerRow * height );
+		view.planes[0].base = &pixels[0];
+		uint32_t seed = 1;
+		for ( size_t i = 0; i < pixels.size(); i++ ) {
+			seed = seed * 1664525u + 1013904223u;
+			pixels[i] = (uint8_t)( seed >> 24 );
+		}
+	}
+};
+
+// The stages again, in double precision, to check the graph against
+struct ReferenceStage {
+	enum { kMatrix, kTable, kThreshold } kind;
+	double matrix[12];
+	uint8_t tables[3][256];
+	double level;
+};
+
+struct Chain {
+	ImageFilterGraphRef graph;
+	std::vector<ReferenceStage> reference;
+	
+	Chain() : graph( ImageFilterGraphCreate() ) {}
+	~Chain() { ImageFilterGraphRelease( graph ); }
+	
+	void Matrix( const float m[12] )
+	{
+		ImageFilterGraphAddColorMatrix( graph, m );
+		ReferenceStage stage = ReferenceStage();
+		stage.kind = ReferenceStage::kMatrix;
+		for ( int i = 0; i < 12; i++ ) stage.matrix[i] = m[i];
+		reference.push_back( stage );
+	}
+	
+	void Tint( double r, double g, double b, double amount )
+	{
+		ImageFilterGraphAddTint( graph, (float)r, (float)g, (float)b, (float)amount );
+		ReferenceStage stage = ReferenceStage();
+		stage.kind = ReferenceStage::kMatrix;
+		const double tint[3] = { r, g, b }, luma[3] = { 0.299, 0.587, 0.114 };
+		for ( int i = 0; i < 3; i++ ) {
+			for ( int j = 0; j < 3; j++ ) {
+				stage.matrix[i * 4 + j] = amount * tint[i] * luma[j] + ( i == j ? 1.0 - amount : 0.0 );
+			}
+		}
+		reference.push_back( stage );
+	}
+	
+	void Mask( bool r, bool g, bool b )
+	{
+		ImageFilterGraphAddChannelMask( graph, r, g, b );
+		ReferenceStage stage = ReferenceStage();
+		stage.kind = ReferenceStage::kMatrix;
+		stage.matrix[0] = r;
+		stage.matrix[5] = g;
+		stage.matrix[10] = b;
+		reference.push_back( stage );
+	}
+	
+	void Gamma( double gamma )
+	{
+		ReferenceStage stage = ReferenceStage();
+		stage.kind = ReferenceStage::kTable;
+		for ( int i = 0; i < 256; i++ ) {
+			uint8_t value = (uint8_t)floor( 255.0 * pow( i / 255.0, gamma ) + 0.5 );
+			stage.tables[0][i] = stage.tables[1][i] = stage.tables[2][i] = value;
+		}
+		ImageFilterGraphAddLookupTable( graph, stage.tables[0], stage.tables[1], stage.tables[2] );
+		reference.push_back( stage );
+	}
+	
+	void Threshold( double level )
+	{
+		ImageFilterGraphAddThreshold( graph, (float)level );
+		ReferenceStage stage = ReferenceStage();
+		stage.kind = ReferenceStage::kThreshold;
+		stage.level = level;
+		reference.push_back( stage );
+	}
+};
+
+static int ClampIndex( double x )
+{
+	return x <= 0.0 ? 0 : ( x >= 255.0 ? 255 : (int)floor( x + 0.5 ) );
+}
+
+// Values aren't clamped between stages except to index a table, as in the graph
+static void ReferencePixel( const std::vector<ReferenceStage> &stages, const uint8_t *in, uint8_t *out )
+{
+	double c[3] = { (double)in[2], (double)in[1], (double)in[0] };
+	for ( size_t s = 0; s < stages.size(); s++ ) {
+		const ReferenceStage &stage = stages[s];
+		double n[3];
+		for ( int i = 0; i < 3; i++ ) {
+			switch ( stage.kind ) {
+				case ReferenceStage::kMatrix:
+					n[i] = stage.matrix[i * 4] * c[0] + stage.matrix[i * 4 + 1] * c[1] + stage.matrix[i * 4 + 2] * c[2] + stage.matrix[i * 4 + 3];
+					break;
+				case ReferenceStage::kTable:
+					n[i] = stage.tables[i][ClampIndex( c[i] )];
+					break;
+				case ReferenceStage::kThreshold:
+					n[i] = ( 0.299 * c[0] + 0.587 * c[1] + 0.114 * c[2] >= stage.level ) ? 255.0 : 0.0;
+					break;
+			}
+		}
+		memcpy( c, n, sizeof( c ) );
+	}
+	out[0] = (uint8_t)ClampIndex( c[2] );
+	out[1] = (uint8_t)ClampIndex( c[1] );
+	out[2] = (uint8_t)ClampIndex( c[0] );
+	out[3] = in[3];
+}
+
+// Every pixel within tolerance of what's expected, and the row padding left alone
+static bool Compare( const TestImage &image, const std::vector<uint8_t> &expected, int tolerance )
+{
+	size_t rowBytes = image.view.width * 4;
+	for ( size_t i = 0; i < image.pixels.size(); i++ ) {
+		int allowed = ( i % image.view.planes[0].bytesPerRow < rowBytes ) ? tolerance : 0;
+		if ( abs( (int)image.pixels[i] - (int)expected[i] ) > allowed ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void CheckChain( Chain &chain, const char *name, size_t width, size_t height )
+{
+	TestImage image( width, height );
+	std::vector<uint8_t> expected = image.pixels;
+	for ( size_t y = 0; y < height; y++ ) {
+		for ( size_t x = 0; x < width; x++ ) {
+			size_t offset = y * image.view.planes[0].bytesPerRow + x * 4;
+			ReferencePixel( chain.reference, &image.pixels[offset], &expected[offset] );
+		}
+	}
+	
+	char what[128];
+	ImageKernelOptions options = { 3, 1 };
+	snprintf( what, sizeof( what ), "fused %s at %zux%zu", name, width, height );
+	Check( ImageFilterGraphApply( chain.graph, &image.view, &options ) && Compare( image, expected, 1 ), what );
+	
+	// unfused rounds to bytes after every stage, so it can be a step further off
+	TestImage unfused( width, height );
+	snprintf( what, sizeof( what ), "unfused %s at %zux%zu", name, width, height );
+	Check( ImageFilterGraphApplyUnfused( chain.graph, &unfused.view, &options ) && Compare( unfused, expected, (int)chain.reference.size() ), what );
+}
+
+static void RunChecks()
+{
+	const float sepiaish[12] = {
+		0.35f, 0.45f, 0.15f, 10.f,
+		0.30f, 0.45f, 0.15f, 5.f,
+		0.25f, 0.40f, 0.10f, 0.f
+	};
+	const size_t sizes[][2] = { { 1, 1 }, { 3, 2 }, { 37, 5 }, { 256, 3 }, { 261, 7 }, { 640, 9 } };
+	for ( size_t i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); i++ ) {
+		size_t width = sizes[i][0], height = sizes[i][1];
+		
+		Chain all;
+		all.Tint( 1.0, 0.8, 0.6, 0.5 );
+		all.Mask( true, false, true );
+		all.Matrix( sepiaish );
+		all.Gamma( 0.8 );
+		all.Gamma( 1.5 );
+		CheckChain( all, "tint, mask, matrix, two tables", width, height );
+		
+		Chain table;
+		table.Gamma( 2.2 );
+		CheckChain( table, "one table", width, height );
+		
+		// a level no weighted sum of bytes lands on, so float and double agree
+		Chain threshold;
+		threshold.Gamma( 0.7 );
+		threshold.Threshold( 128.2345 );
+		threshold.Matrix( sepiaish );
+		CheckChain( threshold, "table, threshold, matrix", width, height );
+	}
+	
+	// biplanar 420 takes a graph that fuses to a matrix, and refuses the rest without touching the pixels
+	std::vector<uint8_t> luma( 64 * 8, 100 ), chroma( 64 * 4, 128 );
+	ImageKernelView biplanar;
+	memset( &biplanar, 0, sizeof( biplanar ) );
+	biplanar.format = kImageKernelFormat_420YpCbCr8BiPlanarFullRange;
+	biplanar.width = 16;
+	biplanar.height = 8;
+	ImageKernelPlane lumaPlane = { &luma[0], 16, 8, 64 }, chromaPlane = { &chroma[0], 8, 4, 64 };
+	biplanar.planes[0] = lumaPlane;
+	biplanar.planes[1] = chromaPlane;
+	Chain matrices;
+	matrices.Tint( 1.0, 0.5, 0.5, 1.0 );
+	matrices.Mask( true, true, false );
+	Check( ImageFilterGraphApply( matrices.graph, &biplanar, NULL ), "420 takes a graph of matrices" );
+	std::vector<uint8_t> before = luma;
+	matrices.Gamma( 2.0 );
+	Check( ! ImageFilterGraphApply( matrices.graph, &biplanar, NULL ) && luma == before, "420 refuses a table" );
+}
+
+static double SecondsPerFrame( Chain &chain, TestImage &image, bool fused, size_t threads )
+{
+	ImageKernelOptions options = { threads, 0 };
+	double best = 1e9;
+	for ( int run = 0; run < 5; run++ ) {
+		const int kFrames = 5;
+		double start = NowSeconds();
+		for ( int frame = 0; frame < kFrames; frame++ ) {
+			if ( fused ) {
+				ImageFilterGraphApply( chain.graph, &image.view, &options );
+			}
+			else {
+				ImageFilterGraphApplyUnfused( chain.graph, &image.view, &options );
+			}
+		}
+		double seconds = ( NowSeconds() - start ) / kFrames;
+		if ( seconds < best ) best = seconds;
+	}
+	return best;
+}
+
+int main()
+{
+	RunChecks();
+	printf( "checks %s\n\n", failures ? "FAILED" : "passed" );
+	
+	const float warm[12] = {
+		1.10f, 0.05f, 0.00f, 4.f,
+		0.02f, 1.00f, 0.02f, 0.f,
+		0.00f, 0.05f, 0.85f, 0.f
+	};
+	const char *stageNames[] = { "tint", "+ mask", "+ matrix", "+ table", "+ threshold" };
+	const struct { const char *name; size_t width, height; } frames[] = { { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+	
+	for ( size_t f = 0; f < sizeof( frames ) / sizeof( frames[0] ); f++ ) {
+		TestImage image( frames[f].width, frames[f].height );
+		double frameBytes = (double)frames[f].width * frames[f].height * 4;
+		printf( "%s            unfused 1T        fused 1T          unfused NT        fused NT\n", frames[f].name );
+		printf( "                   ms     GB/s       ms     GB/s       ms     GB/s       ms     GB/s\n" );
+		Chain chain;
+		for ( size_t stages = 1; stages <= 5; stages++ ) {
+			switch ( stages ) {
+				case 1: chain.Tint( 1.0, 0.9, 0.7, 0.4 ); break;
+				case 2: chain.Mask( true, false, true ); break;
+				case 3: chain.Matrix( warm ); break;
+				case 4: chain.Gamma( 0.9 ); break;
+				case 5: chain.Threshold( 100.0 ); break;
+			}
+			printf( "%-12s", stageNames[stages - 1] );
+			for ( int threads = 1; threads >= 0; threads-- ) {
+				for ( int fused = 0; fused <= 1; fused++ ) {
+					double seconds = SecondsPerFrame( chain, image, fused, (size_t)threads );
+					// a pass reads and writes the frame once, the unfused chain makes one per stage
+					double traffic = 2.0 * frameBytes * ( fused ? 1 : stages );
+					printf( " %8.2f %8.2f", seconds * 1e3, traffic / seconds * 1e-9 );
+				}
+			}
+			printf( "\n" );
+		}
+		printf( "\n" );
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ Checks the CPU image kernels against plain reference code and measures their throughput
+ */
+
+/*
+ Build and run from this directory with:
+ 
+	c++ -std=c++11 -O2 -pthread -I../Classes/Utilities/CPU -o ImageKernelsBenchmark ImageKernelsBenchmark.cpp ../Classes/Utilities/CPU/ImageKernels.cpp
+	./ImageKernelsBenchmark
+ 
+ It checks the BGRA and biplanar 420 kernels against double precision reference code, odd sizes included, and
+ reports megapixels per second at 720p, 1080p and 4K for the original pixel by pixel de-green loop and for the
+ kernels on one thread and on every core.
+*/
+
+#include "ImageKernels.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// A test image with its rows padded out the way CoreVideo pads them
+struct TestImage {
+	ImageKernelView view;
+	std::vector<uint8_t> luma, chroma;
+	
+	TestImage( uint32_t format, size_t width, size_t height, ImageKernelYCbCrMatrix matrix = kImageKernelYCbCrMatrix_ITU_R_601 )
+	{
+		memset( &view, 0, sizeof( view ) );
+		view.format = format;
+		view.width = width;
+		view.height = height;
+		view.yCbCrMatrix = matrix;
+		bool bgra = ( format == kImageKernelFormat_32BGRA );
+		ImageKernelPlane &plane0 = view.planes[0];
+		plane0.width = width;
+		plane0.height = height;
+		plane0.bytesPerRow = ( ( bgra ? width * 4 : width ) + 64 + 63 ) / 64 * 64;
+		luma.resize( plane0.bytesPerRow * height );
+		plane0.base = &luma[0];
+		if ( ! bgra ) {
+			ImageKernelPlane &plane1 = view.planes[1];
+			plane1.width = ( width + 1 ) / 2;
+			plane1.height = ( height + 1 ) / 2;
+			plane1.bytesPerRow = ( plane1.width * 2 + 64 + 63 ) / 64 * 64;
+			chroma.resize( plane1.bytesPerRow * plane1.height );
+			plane1.base = &chroma[0];
+		}
+		Fill( 1 );
+	}
+	
+	void Fill( uint32_t seed )
+	{
+		for ( size_t i = 0; i < luma.size(); i++ ) {
+			seed = seed * 1664525u + 1013904223u;
+			luma[i] = (uint8_t)( seed >> 24 );
+		}
+		for ( size_t i = 0; i < chroma.size(); i++ ) {
+			seed = seed * 1664525u + 1013904223u;
+			chroma[i] = (uint8_t)( seed >> 24 );
+		}
+	}
+};
+
+static uint8_t ClampByte( double x )
+{
+	return x <= 0.0 ? 0 : ( x >= 255.0 ? 255 : (uint8_t)floor( x + 0.5 ) );
+}
+
+static void Check( bool ok, const char *what )
+{
+	if ( ! ok ) {
+		printf( "FAILED: %s\n", what );
+		failures++;
+	}
+}
+
+// The kernels round through single precision floats, so allow for being a step off
+static bool Near( uint8_t a, uint8_t b )
+{
+	return abs( (int)a - (int)b ) <= 1;
+}
+
+static void CheckBGRA( size_t width, size_t height, const float matrix[12] )
+{
+	TestImage image( kImageKernelFormat_32BGRA, width, height );
+	std::vector<uint8_t> original = image.luma;
+	ImageKernelOptions options = { 3, 1 };
+	ImageKernelApplyColorMatrix( &image.view, matrix, &options );
+	
+	bool ok = true;
+	for ( size_t y = 0; y < height; y++ ) {
+		size_t row = y * image.view.planes[0].bytesPerRow;
+		for ( size_t x = 0; x < image.view.planes[0].bytesPerRow; x++ ) {
+			if ( x >= width * 4 ) {
+				ok &= ( image.luma[row + x] == original[row + x] );		// the padding is left alone
+				continue;
+			}
+			const uint8_t *in = &original[row + x / 4 * 4];
+			int channel = x % 4;
+			uint8_t expected = in[3];
+			if ( channel < 3 ) {
+				const float *m = matrix + ( 2 - channel ) * 4;
+				expected = ClampByte( m[0] * in[2] + m[1] * in[1] + m[2] * in[0] + m[3] );
+			}
+			ok &= Near( image.luma[row + x], expected );
+		}
+	}
+	char what[128];
+	snprintf( what, sizeof( what ), "BGRA color matrix at %zux%zu", width, height );
+	Check( ok, what );
+}
+
+static void CheckMask( size_t width, size_t height )
+{
+	TestImage image( kImageKernelFormat_32BGRA, width, height );
+	std::vector<uint8_t> original = image.luma;
+	ImageKernelScaleChannels( &image.view, 1.0f, 0.0f, 1.0f, NULL );
+	bool ok = true;
+	for ( size_t i = 0; i < original.size(); i++ ) {
+		size_t x = i % image.view.planes[0].bytesPerRow;
+		bool green = ( x < width * 4 && x % 4 == 1 );
+		ok &= ( image.luma[i] == ( green ? 0 : original[i] ) );
+	}
+	char what[128];
+	snprintf( what, sizeof( what ), "BGRA de-green mask at %zux%zu", width, height );
+	Check( ok, what );
+}
+
+static void CheckBiplanar( uint32_t format, ImageKernelYCbCrMatrix standard, size_t width, size_t height, const float matrix[12] )
+{
+	TestImage image( format, width, height, standard );
+	std::vector<uint8_t> luma = image.luma, chroma = image.chroma;
+	ImageKernelOptions options = { 3, 2 };
+	ImageKernelApplyColorMatrix( &image.view, matrix, &options );
+	
+	double kr = standard == kImageKernelYCbCrMatrix_ITU_R_709 ? 0.2126 : 0.299;
+	double kb = standard == kImageKernelYCbCrMatrix_ITU_R_709 ? 0.0722 : 0.114;
+	double kg = 1.0 - kr - kb;
+	bool full = ( format == kImageKernelFormat_420YpCbCr8BiPlanarFullRange );
+	double yOffset = full ? 0.0 : 16.0, yScale = full ? 255.0 : 219.0, cScale = full ? 255.0 : 224.0;
+	
+	const ImageKernelPlane &lumaPlane = image.view.planes[0], &chromaPlane = image.view.planes[1];
+	bool ok = true;
+	for ( size_t by = 0; by < chromaPlane.height; by++ ) {
+		for ( size_t bx = 0; bx < chromaPlane.width; bx++ ) {
+			const uint8_t *c = &chroma[by * chromaPlane.bytesPerRow + bx * 2];
+			double pb = ( c[0] - 128.0 ) / cScale, pr = ( c[1] - 128.0 ) / cScale;
+			double cbSum = 0.0, crSum = 0.0;
+			int count = 0;
+			for ( size_t dy = 0; dy < 2; dy++ ) {
+				for ( size_t dx = 0; dx < 2; dx++ ) {
+					// odd edges reuse the last row or column, as the kernel does
+					size_t y = by * 2 + dy < height ? by * 2 + dy : height - 1;
+					size_t x = bx * 2 + dx < width ? bx * 2 + dx : width - 1;
+					double yn = ( luma[y * lumaPlane.bytesPerRow + x] - yOffset ) / yScale;
+					double r = 255.0 * ( yn + 2.0 * ( 1.0 - kr ) * pr );
+					double b = 255.0 * ( yn + 2.0 * ( 1.0 - kb ) * pb );
+					double g = ( 255.0 * yn - kr * r - kb * b ) / kg;
+					double r2 = matrix[0] * r + matrix[1] * g + matrix[2] * b + matrix[3];
+					double g2 = matrix[4] * r + matrix[5] * g + matrix[6] * b + matrix[7];
+					double b2 = matrix[8] * r + matrix[9] * g + matrix[10] * b + matrix[11];
+					double yn2 = ( kr * r2 + kg * g2 + kb * b2 ) / 255.0;
+					cbSum += 128.0 + cScale * ( b2 / 255.0 - yn2 ) / ( 2.0 * ( 1.0 - kb ) );
+					crSum += 128.0 + cScale * ( r2 / 255.0 - yn2 ) / ( 2.0 * ( 1.0 - kr ) );
+					count++;
+					if ( by * 2 + dy < height && bx * 2 + dx < width ) {
+						ok &= Near( image.luma[y * lumaPlane.bytesPerRow + x], ClampByte( yOffset + yScale * yn2 ) );
+					}
+				}
+			}
+			const uint8_t *c2 = &image.chroma[by * chromaPlane.bytesPerRow + bx * 2];
+			ok &= Near( c2[0], ClampByte( cbSum / count ) ) && Near( c2[1], ClampByte( crSum / count ) );
+		}
+	}
+	char what[128];
+	snprintf( what, sizeof( what ), "%s %s color matrix at %zux%zu", full ? "420f" : "420v", standard == kImageKernelYCbCrMatrix_ITU_R_709 ? "709" : "601", width, height );
+	Check( ok, what );
+}
+
+// The loop RosyWriterCPURenderer had before the kernels
+static void DeGreenPixelByPixel( const ImageKernelView *image )
+{
+	const int kBytesPerPixel = 4;
+	for ( int row = 0; row < (int)image->height; row++ ) {
+		uint8_t *pixel = image->planes[0].base + row * image->planes[0].bytesPerRow;
+		for ( int column = 0; column < (int)image->width; column++ ) {
+			pixel[1] = 0;
+			pixel += kBytesPerPixel;
+		}
+	}
+}
+
+enum Test { kPixelByPixel, kMask, kColorMatrix };
+
+static double MegapixelsPerSecond( TestImage &image, Test test, size_t threads )
+{
+	static const float sepia[12] = {
+		0.393f, 0.769f, 0.189f, 0.f,
+		0.349f, 0.686f, 0.168f, 0.f,
+		0.272f, 0.534f, 0.131f, 0.f
+	};
+	ImageKernelOptions options = { threads, 0 };
+	double best = 1e9;
+	for ( int run = 0; run < 5; run++ ) {
+		const int kFrames = 10;
+		double start = NowSeconds();
+		for ( int frame = 0; frame < kFrames; frame++ ) {
+			switch ( test ) {
+				case kPixelByPixel: DeGreenPixelByPixel( &image.view ); break;
+				case kMask: ImageKernelScaleChannels( &image.view, 1.0f, 0.0f, 1.0f, &options ); break;
+				case kColorMatrix: ImageKernelApplyColorMatrix( &image.view, sepia, &options ); break;
+			}
+		}
+		double seconds = ( NowSeconds() - start ) / kFrames;
+		if ( seconds < best ) best = seconds;
+	}
+	return image.view.width * image.view.height / best * 1e-6;
+}
+
+int main()
+{
+	const float deGreen[12] = { 1.f, 0.f, 0.f, 0.f,  0.f, 0.f, 0.f, 0.f,  0.f, 0.f, 1.f, 0.f };
+	const float mix[12] = { 0.9f, 0.3f, -0.2f, 12.f,  -0.1f, 1.2f, 0.1f, -20.f,  0.2f, -0.4f, 1.3f, 5.f };
+	const size_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 37, 21 }, { 64, 64 }, { 321, 179 } };
+	for ( size_t i = 0; i < sizeof( sizes ) / sizeof( sizes[0] ); i++ ) {
+		size_t w = sizes[i][0], h = sizes[i][1];
+		CheckMask( w, h );
+		CheckBGRA( w, h, deGreen );
+		CheckBGRA( w, h, mix );
+		CheckBiplanar( kImageKernelFormat_420YpCbCr8BiPlanarFullRange, kImageKernelYCbCrMatrix_ITU_R_601, w, h, deGreen );
+		CheckBiplanar( kImageKernelFormat_420YpCbCr8BiPlanarVideoRange, kImageKernelYCbCrMatrix_ITU_R_709, w, h, mix );
+		CheckBiplanar( kImageKernelFormat_420YpCbCr8BiPlanarFullRange, kImageKernelYCbCrMatrix_ITU_R_709, w, h, mix );
+	}
+	printf( "checks %s\n\n", failures ? "FAILED" : "passed" );
+	
+	const struct { const char *name; size_t width, height; } frames[] = {
+		{ "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "4K", 3840, 2160 }
+	};
+	printf( "Mpix/s          pixel loop   mask 1T   mask NT   matrix 1T   matrix NT   420f 1T   420f NT\n" );
+	for ( size_t i = 0; i < sizeof( frames ) / sizeof( frames[0] ); i++ ) {
+		TestImage bgra( kImageKernelFormat_32BGRA, frames[i].width, frames[i].height );
+		TestImage biplanar( kImageKernelFormat_420YpCbCr8BiPlanarFullRange, frames[i].width, frames[i].height );
+		printf( "%-14s %11.0f %9.0f %9.0f %11.0f %11.0f %9.0f %9.0f\n", frames[i].name,
+				MegapixelsPerSecond( bgra, kPixelByPixel, 1 ),
+				MegapixelsPerSecond( bgra, kMask, 1 ), MegapixelsPerSecond( bgra, kMask, 0 ),
+				MegapixelsPerSecond( bgra, kColorMatrix, 1 ), MegapixelsPerSecond( bgra, kColorMatrix, 0 ),
+				MegapixelsPerSecond( biplanar, kMask, 1 ), MegapixelsPerSecond( biplanar, kMask, 0 ) );
+	}
+	return failures ? 1 : 0;
+}
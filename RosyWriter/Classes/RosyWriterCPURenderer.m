@@ -8,9 +8,78 @@
  */
 
 #import "RosyWriterCPURenderer.h"
+#import "ImageFilterGraph.h"
+
+// The buffer must be locked for as long as the view is used
+static BOOL imageKernelViewForPixelBuffer( CVPixelBufferRef pixelBuffer, ImageKernelView *image )
+{
+	memset( image, 0, sizeof( *image ) );
+	image->format = CVPixelBufferGetPixelFormatType( pixelBuffer );
+	image->width = CVPixelBufferGetWidth( pixelBuffer );
+	image->height = CVPixelBufferGetHeight( pixelBuffer );
+	
+	switch ( image->format )
+	{
+		case kCVPixelFormatType_32BGRA:
+			image->planes[0].base = CVPixelBufferGetBaseAddress( pixelBuffer );
+			image->planes[0].width = image->width;
+			image->planes[0].height = image->height;
+			image->planes[0].bytesPerRow = CVPixelBufferGetBytesPerRow( pixelBuffer );
+			return YES;
+			
+		case kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange:
+		case kCVPixelFormatType_420YpCbCr8BiPlanarFullRange:
+		{
+			for ( size_t plane = 0; plane < 2; plane++ ) {
+				image->planes[plane].base = CVPixelBufferGetBaseAddressOfPlane( pixelBuffer, plane );
+				image->planes[plane].width = CVPixelBufferGetWidthOfPlane( pixelBuffer, plane );
+				image->planes[plane].height = CVPixelBufferGetHeightOfPlane( pixelBuffer, plane );
+				image->planes[plane].bytesPerRow = CVPixelBufferGetBytesPerRowOfPlane( pixelBuffer, plane );
+			}
+			CFTypeRef matrix = CVBufferGetAttachment( pixelBuffer, kCVImageBufferYCbCrMatrixKey, NULL );
+			if ( matrix && CFEqual( matrix, kCVImageBufferYCbCrMatrix_ITU_R_709_2 ) ) {
+				image->yCbCrMatrix = kImageKernelYCbCrMatrix_ITU_R_709;
+			}
+			else {
+				image->yCbCrMatrix = kImageKernelYCbCrMatrix_ITU_R_601;
+			}
+			return YES;
+		}
+			
+		default:
+			return NO;
+	}
+}
+
+@interface RosyWriterCPURenderer ()
+{
+	ImageFilterGraphRef _filterGraph;
+}
+
+@end
 
 @implementation RosyWriterCPURenderer
 
+#pragma mark API
+
+- (instancetype)init
+{
+	self = [super init];
+	if ( self )
+	{
+		// The effect is a chain of point operations run as one pass over the frame, so more stages can be added
+		// here without costing another trip through memory each
+		_filterGraph = ImageFilterGraphCreate();
+		ImageFilterGraphAddChannelMask( _filterGraph, true, false, true );
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	ImageFilterGraphRelease( _filterGraph );
+}
+
 #pragma mark RosyWriterRenderer
 
 - (BOOL)operatesInPlace
@@ -20,38 +89,28 @@
 
 - (FourCharCode)inputPixelFormat
 {
+	// The kernels also take 420v and 420f as they come from the camera, but the preview only draws BGRA
 	return kCVPixelFormatType_32BGRA;
 }
 
 - (void)prepareForInputWithFormatDescription:(CMFormatDescriptionRef)inputFormatDescription outputRetainedBufferCountHint:(size_t)outputRetainedBufferCountHint
 {
-	// nothing to do, we are stateless
+	// nothing to do, the filter graph keeps no per-frame state
 }
 
 - (void)reset
 {
-	// nothing to do, we are stateless
+	// nothing to do, the filter graph keeps no per-frame state
 }
 
 - (CVPixelBufferRef)copyRenderedPixelBuffer:(CVPixelBufferRef)pixelBuffer
-{	
-	const int kBytesPerPixel = 4;
-	
+{
 	CVPixelBufferLockBaseAddress( pixelBuffer, 0 );
 	
-	int bufferWidth = (int)CVPixelBufferGetWidth( pixelBuffer );
-	int bufferHeight = (int)CVPixelBufferGetHeight( pixelBuffer );
-	size_t bytesPerRow = CVPixelBufferGetBytesPerRow( pixelBuffer );
-	uint8_t *baseAddress = CVPixelBufferGetBaseAddress( pixelBuffer );
-	
-	for ( int row = 0; row < bufferHeight; row++ )
-	{
-		uint8_t *pixel = baseAddress + row * bytesPerRow;
-		for ( int column = 0; column < bufferWidth; column++ )
-		{
-			pixel[1] = 0; // De-green (second pixel in BGRA is green)
-			pixel += kBytesPerPixel;
-		}
+	// De-green, in as many bands as there are cores
+	ImageKernelView image;
+	if ( ! imageKernelViewForPixelBuffer( pixelBuffer, &image ) || ! ImageFilterGraphApply( _filterGraph, &image, NULL ) ) {
+		NSLog( @"Unsupported pixel format for the CPU renderer" );
 	}
 	
 	CVPixelBufferUnlockBaseAddress( pixelBuffer, 0 );
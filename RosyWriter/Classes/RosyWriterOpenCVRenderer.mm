@@ -47,23 +47,16 @@
 	size_t width = CVPixelBufferGetWidth( pixelBuffer );
 	size_t height = CVPixelBufferGetHeight( pixelBuffer );
 	size_t stride = CVPixelBufferGetBytesPerRow( pixelBuffer );
-	size_t extendedWidth = stride / sizeof( uint32_t ); // each pixel is 4 bytes/32 bits
 	
 	// Since the OpenCV Mat is wrapping the CVPixelBuffer's pixel data, we must do all of our modifications while its base address is locked.
 	// If we want to operate on the buffer later, we'll have to do an expensive deep copy of the pixel data, using memcpy or Mat::clone().
 	
-	// Use extendedWidth instead of width to account for possible row extensions (sometimes used for memory alignment).
-	// We only need to work on columms from [0, width - 1] regardless.
+	// Passing the stride lets the Mat skip any row extensions (sometimes used for memory alignment), so we only touch columns [0, width - 1].
 	
-	cv::Mat bgraImage = cv::Mat( (int)height, (int)extendedWidth, CV_8UC4, base );
+	cv::Mat bgraImage = cv::Mat( (int)height, (int)width, CV_8UC4, base, stride );
 	
-	for ( uint32_t y = 0; y < height; y++ )
-	{
-		for ( uint32_t x = 0; x < width; x++ )
-		{
-			bgraImage.at<cv::Vec<uint8_t,4> >(y,x)[1] = 0;
-		}
-	}
+	// De-green with a whole-image mask rather than pixel by pixel through Mat::at<>, so OpenCV can use its vectorized loops
+	bgraImage &= cv::Scalar( 255, 0, 255, 255 );
 	
 	CVPixelBufferUnlockBaseAddress( pixelBuffer, 0 );
 	
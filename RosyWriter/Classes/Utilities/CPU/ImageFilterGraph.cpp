@@ -0,0 +1,442 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ A chain of point operations that runs as one pass over the frame
+ */
+
+#include "ImageFilterGraph.h"
+#include "ImageVec.h"
+
+#include <string.h>
+#include <vector>
+
+// 256 pixels of red, green and blue floats is 3 KB, which stays in L1 however many stages run over it
+static const size_t kTilePixels = 256;
+
+// Rec. 601 luma weights, for the tint and threshold stages
+static const float kLumaRed = 0.299f, kLumaGreen = 0.587f, kLumaBlue = 0.114f;
+
+enum StageKind {
+	kStageColorMatrix,		// tints and channel masks become color matrices too
+	kStageLookupTable,
+	kStageThreshold
+};
+
+struct Stage {
+	StageKind kind;
+	float matrix[12];
+	uint8_t tables[3][256];		// red, green, blue
+	float level;
+};
+
+struct ImageFilterGraph {
+	std::vector<Stage> stages;
+	std::vector<Stage> fused;		// rebuilt when the stages change
+	bool fusedIsCurrent;
+};
+
+#pragma mark Fusion
+
+// b after a
+static void ConcatColorMatrices(const float a[12], const float b[12], float out[12])
+{
+	float result[12];
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 4; j++ ) {
+			double sum = ( j == 3 ) ? b[i * 4 + 3] : 0.0;
+			for ( int k = 0; k < 3; k++ ) {
+				sum += (double)b[i * 4 + k] * a[k * 4 + j];
+			}
+			result[i * 4 + j] = (float)sum;
+		}
+	}
+	memcpy( out, result, sizeof( result ) );
+}
+
+// b after a
+static void ConcatLookupTables(const uint8_t a[3][256], const uint8_t b[3][256], uint8_t out[3][256])
+{
+	uint8_t result[3][256];
+	for ( int c = 0; c < 3; c++ ) {
+		for ( int i = 0; i < 256; i++ ) {
+			result[c][i] = b[c][a[c][i]];
+		}
+	}
+	memcpy( out, result, sizeof( result ) );
+}
+
+static void FuseStages(const std::vector<Stage> &stages, std::vector<Stage> &fused)
+{
+	fused.clear();
+	for ( size_t i = 0; i < stages.size(); i++ ) {
+		const Stage &stage = stages[i];
+		Stage *last = fused.empty() ? NULL : &fused.back();
+		if ( last && last->kind == stage.kind && stage.kind == kStageColorMatrix ) {
+			ConcatColorMatrices( last->matrix, stage.matrix, last->matrix );
+		}
+		else if ( last && last->kind == stage.kind && stage.kind == kStageLookupTable ) {
+			ConcatLookupTables( last->tables, stage.tables, last->tables );
+		}
+		else {
+			fused.push_back( stage );
+		}
+	}
+}
+
+#pragma mark Tiles
+
+// A stage ready to run on tiles, with its constants splatted and its tables as floats
+struct TileStage {
+	StageKind kind;
+	VecF m[12];
+	float tables[3][256];
+};
+
+struct Tile {
+	float r[kTilePixels], g[kTilePixels], b[kTilePixels];
+};
+
+struct TileJob {
+	const ImageKernelPlane *plane;
+	const TileStage *stages;
+	size_t stageCount;
+};
+
+static inline void UnpackPixels(const uint8_t *pixels, Tile &tile, size_t i)
+{
+	VecU p = VLoad( pixels );
+	VStoreF( tile.b + i, VByteToFloat( p ) );
+	VStoreF( tile.g + i, VByteToFloat( VShiftRight( p, 8 ) ) );
+	VStoreF( tile.r + i, VByteToFloat( VShiftRight( p, 16 ) ) );
+}
+
+static inline void PackPixels(uint8_t *pixels, const Tile &tile, size_t i)
+{
+	VecU alpha = VAnd( VLoad( pixels ), VSplatU( 0xFF000000 ) );
+	VecU r = VShiftLeft( VFloatToByte( VLoadF( tile.r + i ) ), 16 );
+	VecU g = VShiftLeft( VFloatToByte( VLoadF( tile.g + i ) ), 8 );
+	VecU b = VFloatToByte( VLoadF( tile.b + i ) );
+	VStore( pixels, VOr( VOr( alpha, b ), VOr( g, r ) ) );
+}
+
+static void ColorMatrixTile(const TileStage &stage, Tile &tile, size_t count)
+{
+	const VecF *m = stage.m;
+	for ( size_t i = 0; i < count; i += 4 ) {
+		VecF r = VLoadF( tile.r + i ), g = VLoadF( tile.g + i ), b = VLoadF( tile.b + i );
+		VStoreF( tile.r + i, VMulAdd( VMulAdd( VMulAdd( m[3], m[0], r ), m[1], g ), m[2], b ) );
+		VStoreF( tile.g + i, VMulAdd( VMulAdd( VMulAdd( m[7], m[4], r ), m[5], g ), m[6], b ) );
+		VStoreF( tile.b + i, VMulAdd( VMulAdd( VMulAdd( m[11], m[8], r ), m[9], g ), m[10], b ) );
+	}
+}
+
+static inline void LookUp(const float table[256], float *values)
+{
+	// the indices are rounded and clamped by VFloatToByte, as when a stored frame is read; the lookups themselves
+	// are scalar, there being no gathers in NEON or SSE2
+	uint32_t index[4];
+	VStore( (uint8_t *)index, VFloatToByte( VLoadF( values ) ) );
+	values[0] = table[index[0]];
+	values[1] = table[index[1]];
+	values[2] = table[index[2]];
+	values[3] = table[index[3]];
+}
+
+static void LookupTableTile(const TileStage &stage, Tile &tile, size_t count)
+{
+	for ( size_t i = 0; i < count; i += 4 ) {
+		LookUp( stage.tables[0], tile.r + i );
+		LookUp( stage.tables[1], tile.g + i );
+		LookUp( stage.tables[2], tile.b + i );
+	}
+}
+
+static void ThresholdTile(const TileStage &stage, Tile &tile, size_t count)
+{
+	// m holds the luma weights, then the level, then 255
+	for ( size_t i = 0; i < count; i += 4 ) {
+		VecF luma = VMulAdd( VMulAdd( VMul( stage.m[0], VLoadF( tile.r + i ) ), stage.m[1], VLoadF( tile.g + i ) ), stage.m[2], VLoadF( tile.b + i ) );
+		VecF value = VMul( VStep( stage.m[3], luma ), stage.m[4] );
+		VStoreF( tile.r + i, value );
+		VStoreF( tile.g + i, value );
+		VStoreF( tile.b + i, value );
+	}
+}
+
+static void RunTile(const TileJob *job, uint8_t *pixels, size_t pixelCount, Tile &tile)
+{
+	size_t wholeCount = pixelCount / 4 * 4;
+	uint8_t tail[16] = { 0 };
+	for ( size_t i = 0; i < wholeCount; i += 4 ) {
+		UnpackPixels( pixels + i * 4, tile, i );
+	}
+	if ( wholeCount < pixelCount ) {
+		// the last few pixels go through the same vector code from a copy
+		memcpy( tail, pixels + wholeCount * 4, ( pixelCount - wholeCount ) * 4 );
+		UnpackPixels( tail, tile, wholeCount );
+	}
+	
+	size_t count = ( pixelCount + 3 ) / 4 * 4;
+	for ( size_t s = 0; s < job->stageCount; s++ ) {
+		const TileStage &stage = job->stages[s];
+		switch ( stage.kind ) {
+			case kStageColorMatrix: ColorMatrixTile( stage, tile, count ); break;
+			case kStageLookupTable: LookupTableTile( stage, tile, count ); break;
+			case kStageThreshold: ThresholdTile( stage, tile, count ); break;
+		}
+	}
+	
+	for ( size_t i = 0; i < wholeCount; i += 4 ) {
+		PackPixels( pixels + i * 4, tile, i );
+	}
+	if ( wholeCount < pixelCount ) {
+		PackPixels( tail, tile, wholeCount );
+		memcpy( pixels + wholeCount * 4, tail, ( pixelCount - wholeCount ) * 4 );
+	}
+}
+
+static void TileRows(void *context, size_t firstRow, size_t rowCount)
+{
+	const TileJob *job = (const TileJob *)context;
+	const ImageKernelPlane *plane = job->plane;
+	Tile tile;
+	
+	for ( size_t row = firstRow; row < firstRow + rowCount; row++ ) {
+		uint8_t *pixels = plane->base + row * plane->bytesPerRow;
+		for ( size_t x = 0; x < plane->width; x += kTilePixels ) {
+			size_t pixelCount = plane->width - x < kTilePixels ? plane->width - x : kTilePixels;
+			RunTile( job, pixels + x * 4, pixelCount, tile );
+		}
+	}
+}
+
+static void PrepareTileStage(const Stage &stage, TileStage *outStage)
+{
+	outStage->kind = stage.kind;
+	switch ( stage.kind ) {
+		case kStageColorMatrix:
+			for ( int i = 0; i < 12; i++ ) {
+				outStage->m[i] = VSplat( stage.matrix[i] );
+			}
+			break;
+		case kStageLookupTable:
+			for ( int c = 0; c < 3; c++ ) {
+				for ( int i = 0; i < 256; i++ ) {
+					outStage->tables[c][i] = stage.tables[c][i];
+				}
+			}
+			break;
+		case kStageThreshold:
+			outStage->m[0] = VSplat( kLumaRed );
+			outStage->m[1] = VSplat( kLumaGreen );
+			outStage->m[2] = VSplat( kLumaBlue );
+			outStage->m[3] = VSplat( stage.level );
+			outStage->m[4] = VSplat( 255.f );
+			break;
+	}
+}
+
+#pragma mark Single stage passes
+
+struct LookupTableJob {
+	const ImageKernelPlane *plane;
+	const Stage *stage;
+};
+
+// a table on its own doesn't need floats at all
+static void LookupTableRows(void *context, size_t firstRow, size_t rowCount)
+{
+	const LookupTableJob *job = (const LookupTableJob *)context;
+	const ImageKernelPlane *plane = job->plane;
+	const uint8_t (*tables)[256] = job->stage->tables;
+	
+	for ( size_t row = firstRow; row < firstRow + rowCount; row++ ) {
+		uint8_t *pixel = plane->base + row * plane->bytesPerRow;
+		for ( size_t x = 0; x < plane->width; x++ ) {
+			pixel[0] = tables[2][pixel[0]];
+			pixel[1] = tables[1][pixel[1]];
+			pixel[2] = tables[0][pixel[2]];
+			pixel += 4;
+		}
+	}
+}
+
+// 0 or 1 on the diagonal and nothing else, which ImageKernelScaleChannels does as a mask
+static bool IsChannelMask(const float matrix[12])
+{
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 4; j++ ) {
+			float value = matrix[i * 4 + j];
+			bool ok = ( i == j ) ? ( value == 0.f || value == 1.f ) : ( value == 0.f );
+			if ( ! ok ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool IsBiplanar(uint32_t format)
+{
+	return format == kImageKernelFormat_420YpCbCr8BiPlanarVideoRange || format == kImageKernelFormat_420YpCbCr8BiPlanarFullRange;
+}
+
+// Runs stages that have already been fused as far as they go, in one pass
+static bool ApplyStages(const Stage *stages, size_t stageCount, const ImageKernelView *image, const ImageKernelOptions *options)
+{
+	if ( stageCount == 0 ) {
+		return true;
+	}
+	
+	if ( stageCount == 1 && stages[0].kind == kStageColorMatrix ) {
+		const float *m = stages[0].matrix;
+		if ( IsChannelMask( m ) ) {
+			return ImageKernelScaleChannels( image, m[0], m[5], m[10], options );
+		}
+		return ImageKernelApplyColorMatrix( image, m, options );
+	}
+	
+	if ( image->format != kImageKernelFormat_32BGRA ) {
+		return false;
+	}
+	
+	if ( stageCount == 1 && stages[0].kind == kStageLookupTable ) {
+		LookupTableJob job = { &image->planes[0], &stages[0] };
+		ImageKernelForEachBand( image->planes[0].height, 1, options, LookupTableRows, &job );
+		return true;
+	}
+	
+	std::vector<TileStage> tileStages( stageCount );
+	for ( size_t i = 0; i < stageCount; i++ ) {
+		PrepareTileStage( stages[i], &tileStages[i] );
+	}
+	TileJob job = { &image->planes[0], &tileStages[0], stageCount };
+	ImageKernelForEachBand( image->planes[0].height, 1, options, TileRows, &job );
+	return true;
+}
+
+// Biplanar 420 can only be worked on through a color matrix, checked up front so nothing is half done
+static bool CanApply(const std::vector<Stage> &stages, const ImageKernelView *image)
+{
+	if ( image->format == kImageKernelFormat_32BGRA ) {
+		return true;
+	}
+	if ( ! IsBiplanar( image->format ) ) {
+		return false;
+	}
+	for ( size_t i = 0; i < stages.size(); i++ ) {
+		if ( stages[i].kind != kStageColorMatrix ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#pragma mark Graph
+
+ImageFilterGraphRef ImageFilterGraphCreate(void)
+{
+	ImageFilterGraph *graph = new ImageFilterGraph;
+	graph->fusedIsCurrent = true;
+	return graph;
+}
+
+void ImageFilterGraphRelease(ImageFilterGraphRef graph)
+{
+	delete graph;
+}
+
+size_t ImageFilterGraphGetStageCount(ImageFilterGraphRef graph)
+{
+	return graph->stages.size();
+}
+
+void ImageFilterGraphRemoveAllStages(ImageFilterGraphRef graph)
+{
+	graph->stages.clear();
+	graph->fusedIsCurrent = false;
+}
+
+static void AddStage(ImageFilterGraphRef graph, const Stage &stage)
+{
+	graph->stages.push_back( stage );
+	graph->fusedIsCurrent = false;
+}
+
+void ImageFilterGraphAddColorMatrix(ImageFilterGraphRef graph, const float matrix[12])
+{
+	Stage stage;
+	memset( &stage, 0, sizeof( stage ) );
+	stage.kind = kStageColorMatrix;
+	memcpy( stage.matrix, matrix, sizeof( stage.matrix ) );
+	AddStage( graph, stage );
+}
+
+void ImageFilterGraphAddTint(ImageFilterGraphRef graph, float red, float green, float blue, float amount)
+{
+	// (1 - amount) * color + amount * tint * luma
+	const float tint[3] = { red, green, blue };
+	const float luma[3] = { kLumaRed, kLumaGreen, kLumaBlue };
+	float matrix[12] = { 0 };
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 3; j++ ) {
+			matrix[i * 4 + j] = amount * tint[i] * luma[j] + ( i == j ? 1.f - amount : 0.f );
+		}
+	}
+	ImageFilterGraphAddColorMatrix( graph, matrix );
+}
+
+void ImageFilterGraphAddChannelMask(ImageFilterGraphRef graph, bool red, bool green, bool blue)
+{
+	const float matrix[12] = {
+		red ? 1.f : 0.f, 0.f, 0.f, 0.f,
+		0.f, green ? 1.f : 0.f, 0.f, 0.f,
+		0.f, 0.f, blue ? 1.f : 0.f, 0.f
+	};
+	ImageFilterGraphAddColorMatrix( graph, matrix );
+}
+
+void ImageFilterGraphAddLookupTable(ImageFilterGraphRef graph, const uint8_t red[256], const uint8_t green[256], const uint8_t blue[256])
+{
+	Stage stage;
+	memset( &stage, 0, sizeof( stage ) );
+	stage.kind = kStageLookupTable;
+	memcpy( stage.tables[0], red, 256 );
+	memcpy( stage.tables[1], green, 256 );
+	memcpy( stage.tables[2], blue, 256 );
+	AddStage( graph, stage );
+}
+
+void ImageFilterGraphAddThreshold(ImageFilterGraphRef graph, float level)
+{
+	Stage stage;
+	memset( &stage, 0, sizeof( stage ) );
+	stage.kind = kStageThreshold;
+	stage.level = level;
+	AddStage( graph, stage );
+}
+
+bool ImageFilterGraphApply(ImageFilterGraphRef graph, const ImageKernelView *image, const ImageKernelOptions *options)
+{
+	if ( ! CanApply( graph->stages, image ) ) {
+		return false;
+	}
+	if ( ! graph->fusedIsCurrent ) {
+		FuseStages( graph->stages, graph->fused );
+		graph->fusedIsCurrent = true;
+	}
+	return ApplyStages( graph->fused.empty() ? NULL : &graph->fused[0], graph->fused.size(), image, options );
+}
+
+bool ImageFilterGraphApplyUnfused(ImageFilterGraphRef graph, const ImageKernelView *image, const ImageKernelOptions *options)
+{
+	if ( ! CanApply( graph->stages, image ) ) {
+		return false;
+	}
+	for ( size_t i = 0; i < graph->stages.size(); i++ ) {
+		ApplyStages( &graph->stages[i], 1, image, options );
+	}
+	return true;
+}
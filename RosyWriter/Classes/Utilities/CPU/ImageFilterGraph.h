@@ -0,0 +1,61 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ A chain of point operations that runs as one pass over the frame
+ */
+
+#ifndef RosyWriter_ImageFilterGraph_h
+#define RosyWriter_ImageFilterGraph_h
+
+#include "ImageKernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stages are added in the order they apply. Applying the graph fuses them: neighbouring color matrices, tints and
+// masks are multiplied into one matrix, neighbouring lookup tables are folded into one table, and whatever is left
+// runs on small tiles of pixels that stay in the cache, so the frame is read and written once whatever the
+// number of stages. As in Core Image, values aren't clamped between stages except where a lookup table needs a
+// byte to index with.
+//
+// A graph isn't thread safe: don't change it while it's being applied.
+typedef struct ImageFilterGraph *ImageFilterGraphRef;
+
+ImageFilterGraphRef ImageFilterGraphCreate(void);
+void ImageFilterGraphRelease(ImageFilterGraphRef graph);
+
+size_t ImageFilterGraphGetStageCount(ImageFilterGraphRef graph);
+void ImageFilterGraphRemoveAllStages(ImageFilterGraphRef graph);
+
+// Mixes each pixel with its luminance times the tint color, by amount 0...1. The color's components are 0...1.
+void ImageFilterGraphAddTint(ImageFilterGraphRef graph, float red, float green, float blue, float amount);
+
+// Keeps or zeroes each of red, green and blue.
+void ImageFilterGraphAddChannelMask(ImageFilterGraphRef graph, bool red, bool green, bool blue);
+
+// A 3x4 matrix laid out as for ImageKernelApplyColorMatrix.
+void ImageFilterGraphAddColorMatrix(ImageFilterGraphRef graph, const float matrix[12]);
+
+// A 256 entry table per channel, indexed by the channel's value rounded and clamped to 0...255.
+void ImageFilterGraphAddLookupTable(ImageFilterGraphRef graph, const uint8_t red[256], const uint8_t green[256], const uint8_t blue[256]);
+
+// White where the luminance is at least level, 0...255, and black elsewhere.
+void ImageFilterGraphAddThreshold(ImageFilterGraphRef graph, float level);
+
+// Runs the graph over the image in place, one fused pass in row bands across the cores. BGRA takes any graph;
+// biplanar 420 takes graphs that fuse down to a single color matrix. Returns false if the image can't be done,
+// true for an empty graph. options may be NULL.
+bool ImageFilterGraphApply(ImageFilterGraphRef graph, const ImageKernelView *image, const ImageKernelOptions *options);
+
+// The same stages run one full frame pass each, as separate kernels would. Results match ImageFilterGraphApply
+// within rounding as long as no stage takes values out of 0...255. It's there to measure fusion against.
+bool ImageFilterGraphApplyUnfused(ImageFilterGraphRef graph, const ImageKernelView *image, const ImageKernelOptions *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,368 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ Portable CPU image kernels that work on plain views of BGRA and biplanar 420 pixels
+ */
+
+#include "ImageKernels.h"
+#include "ImageVec.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#if __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <atomic>
+#include <thread>
+#endif
+
+static const size_t kDefaultMinRowsPerBand = 16;
+static const size_t kBandsPerThread = 4;	// a few each, so a core that starts late doesn't hold up the frame
+
+#pragma mark Work splitter
+
+struct BandJob {
+	void (*function)(void *context, size_t firstRow, size_t rowCount);
+	void *context;
+	size_t rowCount;
+	size_t rowsPerBand;
+#if !__APPLE__
+	std::atomic<size_t> nextBand;
+	size_t bandCount;
+#endif
+};
+
+static void RunBand(void *context, size_t band)
+{
+	BandJob *job = (BandJob *)context;
+	size_t firstRow = band * job->rowsPerBand;
+	size_t rowCount = job->rowCount - firstRow;
+	if ( rowCount > job->rowsPerBand ) {
+		rowCount = job->rowsPerBand;
+	}
+	job->function( job->context, firstRow, rowCount );
+}
+
+#if !__APPLE__
+static void RunBands(BandJob *job)
+{
+	for ( size_t band; ( band = job->nextBand++ ) < job->bandCount; ) {
+		RunBand( job, band );
+	}
+}
+#endif
+
+void ImageKernelForEachBand(size_t rowCount, size_t rowAlignment, const ImageKernelOptions *options,
+							void (*function)(void *context, size_t firstRow, size_t rowCount), void *context)
+{
+	long processorCount = sysconf( _SC_NPROCESSORS_ONLN );
+	size_t threadCount = ( options && options->maxThreads ) ? options->maxThreads : (size_t)( processorCount > 0 ? processorCount : 1 );
+	size_t minRowsPerBand = ( options && options->minRowsPerBand ) ? options->minRowsPerBand : kDefaultMinRowsPerBand;
+	if ( rowAlignment < 1 ) {
+		rowAlignment = 1;
+	}
+	
+	// with an explicit thread count there's one band per thread, since the dispatch queue decides how many run at once
+	size_t bandCount = ( options && options->maxThreads ) ? threadCount : threadCount * kBandsPerThread;
+	size_t rowsPerBand = ( rowCount + bandCount - 1 ) / bandCount;
+	if ( rowsPerBand < minRowsPerBand ) {
+		rowsPerBand = minRowsPerBand;
+	}
+	rowsPerBand = ( rowsPerBand + rowAlignment - 1 ) / rowAlignment * rowAlignment;
+	bandCount = ( rowCount + rowsPerBand - 1 ) / rowsPerBand;
+	
+	if ( threadCount <= 1 || bandCount <= 1 ) {
+		function( context, 0, rowCount );
+		return;
+	}
+	
+	BandJob job;
+	job.function = function;
+	job.context = context;
+	job.rowCount = rowCount;
+	job.rowsPerBand = rowsPerBand;
+#if __APPLE__
+	// the capture pipeline delivers frames on a high priority queue, the bands keep to that
+	dispatch_apply_f( bandCount, dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_HIGH, 0 ), &job, RunBand );
+#else
+	job.nextBand = 0;
+	job.bandCount = bandCount;
+	size_t helperCount = ( threadCount < bandCount ? threadCount : bandCount ) - 1;
+	std::vector<std::thread> helpers;
+	for ( size_t i = 0; i < helperCount; i++ ) {
+		helpers.push_back( std::thread( RunBands, &job ) );
+	}
+	RunBands( &job );
+	for ( size_t i = 0; i < helperCount; i++ ) {
+		helpers[i].join();
+	}
+#endif
+}
+
+#pragma mark BGRA
+
+struct MaskJob {
+	const ImageKernelPlane *plane;
+	uint32_t mask;
+};
+
+static void MaskRows(void *context, size_t firstRow, size_t rowCount)
+{
+	const MaskJob *job = (const MaskJob *)context;
+	const ImageKernelPlane *plane = job->plane;
+	VecU mask = VSplatU( job->mask );
+	size_t rowBytes = plane->width * 4;
+	
+	for ( size_t row = firstRow; row < firstRow + rowCount; row++ ) {
+		uint8_t *pixel = plane->base + row * plane->bytesPerRow;
+		size_t x = 0;
+		for ( ; x + 64 <= rowBytes; x += 64 ) {
+			VecU a = VLoad( pixel + x ), b = VLoad( pixel + x + 16 ), c = VLoad( pixel + x + 32 ), d = VLoad( pixel + x + 48 );
+			VStore( pixel + x, VAnd( a, mask ) );
+			VStore( pixel + x + 16, VAnd( b, mask ) );
+			VStore( pixel + x + 32, VAnd( c, mask ) );
+			VStore( pixel + x + 48, VAnd( d, mask ) );
+		}
+		for ( ; x + 16 <= rowBytes; x += 16 ) {
+			VStore( pixel + x, VAnd( VLoad( pixel + x ), mask ) );
+		}
+		for ( ; x < rowBytes; x += 4 ) {
+			uint32_t value;
+			memcpy( &value, pixel + x, 4 );
+			value &= job->mask;
+			memcpy( pixel + x, &value, 4 );
+		}
+	}
+}
+
+struct ColorMatrix {
+	VecF m[12];		// splatted, in the order of the public matrix
+};
+
+struct ColorMatrixJob {
+	const ImageKernelPlane *plane;
+	ColorMatrix matrix;
+};
+
+static inline VecU ColorMatrixPixels(VecU pixels, const ColorMatrix &m)
+{
+	VecF b = VByteToFloat( pixels );
+	VecF g = VByteToFloat( VShiftRight( pixels, 8 ) );
+	VecF r = VByteToFloat( VShiftRight( pixels, 16 ) );
+	VecF r2 = VMulAdd( VMulAdd( VMulAdd( m.m[3], m.m[0], r ), m.m[1], g ), m.m[2], b );
+	VecF g2 = VMulAdd( VMulAdd( VMulAdd( m.m[7], m.m[4], r ), m.m[5], g ), m.m[6], b );
+	VecF b2 = VMulAdd( VMulAdd( VMulAdd( m.m[11], m.m[8], r ), m.m[9], g ), m.m[10], b );
+	VecU alpha = VAnd( pixels, VSplatU( 0xFF000000 ) );
+	return VOr( VOr( alpha, VFloatToByte( b2 ) ), VOr( VShiftLeft( VFloatToByte( g2 ), 8 ), VShiftLeft( VFloatToByte( r2 ), 16 ) ) );
+}
+
+static void ColorMatrixRowsBGRA(void *context, size_t firstRow, size_t rowCount)
+{
+	const ColorMatrixJob *job = (const ColorMatrixJob *)context;
+	const ImageKernelPlane *plane = job->plane;
+	size_t rowBytes = plane->width * 4;
+	
+	for ( size_t row = firstRow; row < firstRow + rowCount; row++ ) {
+		uint8_t *pixel = plane->base + row * plane->bytesPerRow;
+		size_t x = 0;
+		for ( ; x + 16 <= rowBytes; x += 16 ) {
+			VStore( pixel + x, ColorMatrixPixels( VLoad( pixel + x ), job->matrix ) );
+		}
+		if ( x < rowBytes ) {
+			// the last few pixels go through the same vector code from a copy, so they come out exactly the same
+			uint8_t tail[16] = { 0 };
+			memcpy( tail, pixel + x, rowBytes - x );
+			VStore( tail, ColorMatrixPixels( VLoad( tail ), job->matrix ) );
+			memcpy( pixel + x, tail, rowBytes - x );
+		}
+	}
+}
+
+#pragma mark Biplanar 420
+
+// The color matrix moved into YCbCr code values. Luma comes from each pixel's own luma and the block's chroma,
+// chroma from the block's mean luma and its chroma.
+struct YCbCrMatrix {
+	VecF luma[4];		// times Y, Cb, Cr, then the offset
+	VecF cb[4];
+	VecF cr[4];
+};
+
+struct YCbCrMatrixJob {
+	const ImageKernelView *image;
+	YCbCrMatrix matrix;
+};
+
+static void MultiplyAffine(const double a[4][4], const double b[4][4], double out[4][4])
+{
+	for ( int i = 0; i < 4; i++ ) {
+		for ( int j = 0; j < 4; j++ ) {
+			out[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] + a[i][3] * b[3][j];
+		}
+	}
+}
+
+static void MakeYCbCrMatrix(const float rgbMatrix[12], const ImageKernelView *image, YCbCrMatrix *outMatrix)
+{
+	double kr = 0.299, kb = 0.114;
+	if ( image->yCbCrMatrix == kImageKernelYCbCrMatrix_ITU_R_709 ) {
+		kr = 0.2126;
+		kb = 0.0722;
+	}
+	double kg = 1.0 - kr - kb;
+	bool fullRange = ( image->format == kImageKernelFormat_420YpCbCr8BiPlanarFullRange );
+	double yOffset = fullRange ? 0.0 : 16.0;
+	double yScale = fullRange ? 255.0 : 219.0;
+	double cScale = fullRange ? 255.0 : 224.0;
+	
+	// code values to red, green and blue 0...255
+	double prToR = 2.0 * ( 1.0 - kr ), pbToB = 2.0 * ( 1.0 - kb );
+	double y = 255.0 / yScale, c = 255.0 / cScale;
+	double toRGB[4][4] = {
+		{ y, 0.0, c * prToR, -y * yOffset - c * prToR * 128.0 },
+		{ y, -c * pbToB * kb / kg, -c * prToR * kr / kg, 0.0 },
+		{ y, c * pbToB, 0.0, -y * yOffset - c * pbToB * 128.0 },
+		{ 0.0, 0.0, 0.0, 1.0 }
+	};
+	toRGB[1][3] = -y * yOffset + c * 128.0 * ( pbToB * kb + prToR * kr ) / kg;
+	
+	// and back
+	double lumaScale = yScale / 255.0;
+	double toYCbCr[4][4] = {
+		{ kr * lumaScale, kg * lumaScale, kb * lumaScale, yOffset },
+		{ -kr / pbToB * cScale / 255.0, -kg / pbToB * cScale / 255.0, ( 1.0 - kb ) / pbToB * cScale / 255.0, 128.0 },
+		{ ( 1.0 - kr ) / prToR * cScale / 255.0, -kg / prToR * cScale / 255.0, -kb / prToR * cScale / 255.0, 128.0 },
+		{ 0.0, 0.0, 0.0, 1.0 }
+	};
+	
+	double rgb[4][4] = { { 0 } };
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 4; j++ ) {
+			rgb[i][j] = rgbMatrix[i * 4 + j];
+		}
+	}
+	rgb[3][3] = 1.0;
+	
+	double temp[4][4], ycc[4][4];
+	MultiplyAffine( rgb, toRGB, temp );
+	MultiplyAffine( toYCbCr, temp, ycc );
+	for ( int j = 0; j < 4; j++ ) {
+		outMatrix->luma[j] = VSplat( (float)ycc[0][j] );
+		outMatrix->cb[j] = VSplat( (float)ycc[1][j] );
+		outMatrix->cr[j] = VSplat( (float)ycc[2][j] );
+	}
+}
+
+// Four 2x2 blocks: eight luma from each of two rows and the four Cb Cr pairs under them.
+static inline void YCbCrMatrixBlocks(uint8_t *luma0, uint8_t *luma1, uint8_t *chroma, const YCbCrMatrix &m)
+{
+	VecU y0 = VLoadHalves( luma0 ), y1 = VLoadHalves( luma1 ), c = VLoadHalves( chroma );
+	VecF y00 = VByteToFloat( y0 ), y01 = VByteToFloat( VShiftRight( y0, 8 ) );
+	VecF y10 = VByteToFloat( y1 ), y11 = VByteToFloat( VShiftRight( y1, 8 ) );
+	VecF cb = VByteToFloat( c ), cr = VByteToFloat( VShiftRight( c, 8 ) );
+	
+	VecF lumaFromChroma = VMulAdd( VMulAdd( m.luma[3], m.luma[1], cb ), m.luma[2], cr );
+	VecU out0 = VOr( VFloatToByte( VMulAdd( lumaFromChroma, m.luma[0], y00 ) ), VShiftLeft( VFloatToByte( VMulAdd( lumaFromChroma, m.luma[0], y01 ) ), 8 ) );
+	VecU out1 = VOr( VFloatToByte( VMulAdd( lumaFromChroma, m.luma[0], y10 ) ), VShiftLeft( VFloatToByte( VMulAdd( lumaFromChroma, m.luma[0], y11 ) ), 8 ) );
+	
+	VecF meanY = VMul( VAdd( VAdd( y00, y01 ), VAdd( y10, y11 ) ), VSplat( 0.25f ) );
+	VecF cb2 = VMulAdd( VMulAdd( VMulAdd( m.cb[3], m.cb[0], meanY ), m.cb[1], cb ), m.cb[2], cr );
+	VecF cr2 = VMulAdd( VMulAdd( VMulAdd( m.cr[3], m.cr[0], meanY ), m.cr[1], cb ), m.cr[2], cr );
+	
+	VStoreHalves( luma0, out0 );
+	VStoreHalves( luma1, out1 );
+	VStoreHalves( chroma, VOr( VFloatToByte( cb2 ), VShiftLeft( VFloatToByte( cr2 ), 8 ) ) );
+}
+
+static void YCbCrMatrixRows(void *context, size_t firstRow, size_t rowCount)
+{
+	const YCbCrMatrixJob *job = (const YCbCrMatrixJob *)context;
+	const ImageKernelPlane *lumaPlane = &job->image->planes[0];
+	const ImageKernelPlane *chromaPlane = &job->image->planes[1];
+	size_t width = lumaPlane->width;
+	size_t height = lumaPlane->height;
+	
+	for ( size_t row = firstRow; row < firstRow + rowCount; row += 2 ) {
+		uint8_t *luma0 = lumaPlane->base + row * lumaPlane->bytesPerRow;
+		uint8_t *chroma = chromaPlane->base + ( row / 2 ) * chromaPlane->bytesPerRow;
+		// an odd last row pairs with a copy of itself that's thrown away
+		std::vector<uint8_t> lastRow;
+		uint8_t *luma1 = luma0 + lumaPlane->bytesPerRow;
+		if ( row + 1 >= height ) {
+			lastRow.assign( luma0, luma0 + width );
+			luma1 = &lastRow[0];
+		}
+		
+		size_t x = 0;
+		for ( ; x + 8 <= width; x += 8 ) {
+			YCbCrMatrixBlocks( luma0 + x, luma1 + x, chroma + x, job->matrix );
+		}
+		if ( x < width ) {
+			// what's left of the row, from copies, with an odd last column repeated
+			uint8_t tail0[8], tail1[8], tailChroma[8];
+			size_t lumaBytes = width - x, chromaBytes = ( lumaBytes + 1 ) / 2 * 2;
+			for ( size_t i = 0; i < 8; i++ ) {
+				size_t source = x + ( i < lumaBytes ? i : lumaBytes - 1 );
+				tail0[i] = luma0[source];
+				tail1[i] = luma1[source];
+			}
+			memset( tailChroma, 128, sizeof( tailChroma ) );
+			memcpy( tailChroma, chroma + x, chromaBytes );
+			YCbCrMatrixBlocks( tail0, tail1, tailChroma, job->matrix );
+			memcpy( luma0 + x, tail0, lumaBytes );
+			memcpy( luma1 + x, tail1, lumaBytes );
+			memcpy( chroma + x, tailChroma, chromaBytes );
+		}
+	}
+}
+
+#pragma mark Kernels
+
+static bool IsBiplanar(uint32_t format)
+{
+	return format == kImageKernelFormat_420YpCbCr8BiPlanarVideoRange || format == kImageKernelFormat_420YpCbCr8BiPlanarFullRange;
+}
+
+bool ImageKernelApplyColorMatrix(const ImageKernelView *image, const float matrix[12], const ImageKernelOptions *options)
+{
+	if ( image->format == kImageKernelFormat_32BGRA ) {
+		ColorMatrixJob job;
+		job.plane = &image->planes[0];
+		for ( int i = 0; i < 12; i++ ) {
+			job.matrix.m[i] = VSplat( matrix[i] );
+		}
+		ImageKernelForEachBand( image->planes[0].height, 1, options, ColorMatrixRowsBGRA, &job );
+		return true;
+	}
+	if ( IsBiplanar( image->format ) ) {
+		YCbCrMatrixJob job;
+		job.image = image;
+		MakeYCbCrMatrix( matrix, image, &job.matrix );
+		ImageKernelForEachBand( image->planes[0].height, 2, options, YCbCrMatrixRows, &job );
+		return true;
+	}
+	return false;
+}
+
+bool ImageKernelScaleChannels(const ImageKernelView *image, float red, float green, float blue, const ImageKernelOptions *options)
+{
+	bool masks = ( red == 0.f || red == 1.f ) && ( green == 0.f || green == 1.f ) && ( blue == 0.f || blue == 1.f );
+	if ( masks && image->format == kImageKernelFormat_32BGRA ) {
+		MaskJob job;
+		job.plane = &image->planes[0];
+		job.mask = 0xFF000000 | ( red != 0.f ? 0x00FF0000 : 0 ) | ( green != 0.f ? 0x0000FF00 : 0 ) | ( blue != 0.f ? 0x000000FF : 0 );
+		ImageKernelForEachBand( image->planes[0].height, 1, options, MaskRows, &job );
+		return true;
+	}
+	
+	const float matrix[12] = {
+		red, 0.f, 0.f, 0.f,
+		0.f, green, 0.f, 0.f,
+		0.f, 0.f, blue, 0.f
+	};
+	return ImageKernelApplyColorMatrix( image, matrix, options );
+}
@@ -0,0 +1,76 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ Portable CPU image kernels that work on plain views of BGRA and biplanar 420 pixels
+ */
+
+#ifndef RosyWriter_ImageKernels_h
+#define RosyWriter_ImageKernels_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The pixel formats the kernels take as they are, with no conversion. The values are the CoreVideo pixel format types.
+enum {
+	kImageKernelFormat_32BGRA = 'BGRA',
+	kImageKernelFormat_420YpCbCr8BiPlanarVideoRange = '420v',
+	kImageKernelFormat_420YpCbCr8BiPlanarFullRange = '420f'
+};
+
+// The standard a biplanar image's YCbCr follows, from the pixel buffer's YCbCr matrix attachment.
+typedef enum {
+	kImageKernelYCbCrMatrix_ITU_R_601,
+	kImageKernelYCbCrMatrix_ITU_R_709
+} ImageKernelYCbCrMatrix;
+
+typedef struct ImageKernelPlane {
+	uint8_t *base;
+	size_t width;			// in samples: pixels for BGRA and luma, Cb Cr pairs for chroma
+	size_t height;
+	size_t bytesPerRow;
+} ImageKernelPlane;
+
+// Pixels someone else owns, a locked CVPixelBuffer for instance. BGRA uses planes[0]; biplanar 420 has luma in
+// planes[0] and interleaved Cb Cr at half the width and height in planes[1].
+typedef struct ImageKernelView {
+	uint32_t format;
+	size_t width;
+	size_t height;
+	ImageKernelPlane planes[2];
+	ImageKernelYCbCrMatrix yCbCrMatrix;
+} ImageKernelView;
+
+typedef struct ImageKernelOptions {
+	size_t maxThreads;		// 0 for one per core, 1 to stay on the calling thread
+	size_t minRowsPerBand;	// 0 for the default
+} ImageKernelOptions;
+
+// Multiplies red, green and blue by the given gains. Gains of exactly 0 or 1 on BGRA come down to a mask, which
+// is as fast as the memory. On biplanar 420 it's done as the equivalent color matrix. Returns false if the format
+// isn't one of the above. options may be NULL.
+bool ImageKernelScaleChannels(const ImageKernelView *image, float red, float green, float blue, const ImageKernelOptions *options);
+
+// Applies a 3x4 matrix to each pixel's red, green and blue, 0...255: row by row, red then green then blue, each
+// row being the red, green and blue coefficients and then an offset. Alpha is left alone. Biplanar 420 is
+// worked on directly through the same matrix moved into YCbCr; chroma is computed from the mean luma of the
+// 2x2 pixels it covers, which is exact for a linear map up to the clamping.
+bool ImageKernelApplyColorMatrix(const ImageKernelView *image, const float matrix[12], const ImageKernelOptions *options);
+
+// The row band work splitter the kernels use. Calls function on bands of rows that together cover
+// 0...rowCount-1, concurrently across the cores, and returns when they've all finished. Bands start on
+// multiples of rowAlignment.
+void ImageKernelForEachBand(size_t rowCount, size_t rowAlignment, const ImageKernelOptions *options,
+							void (*function)(void *context, size_t firstRow, size_t rowCount), void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
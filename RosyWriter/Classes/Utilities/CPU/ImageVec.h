@@ -0,0 +1,245 @@
+/*
+ Copyright (C) 2016 Apple Inc. All Rights Reserved.
+ See LICENSE.txt for this sample’s licensing information
+ 
+ Abstract:
+ Four lane float and integer vectors for the CPU image kernels, on NEON, SSE2 or plain C
+ */
+
+#ifndef RosyWriter_ImageVec_h
+#define RosyWriter_ImageVec_h
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t VecF;
+typedef uint32x4_t VecU;
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 VecF;
+typedef __m128i VecU;
+#else
+typedef struct { float f[4]; } VecF;
+typedef struct { uint32_t u[4]; } VecU;
+#endif
+
+// Pixels go in and out through the integer vectors, either 16 bytes as four 32 bit lanes or 8 bytes as four
+// 16 bit units widened to a lane each. The arithmetic is done on floats.
+
+static inline VecU VLoad(const uint8_t *p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vreinterpretq_u32_u8(vld1q_u8(p));
+#elif defined(__SSE2__)
+	return _mm_loadu_si128((const __m128i *)p);
+#else
+	VecU v; memcpy(v.u, p, 16); return v;
+#endif
+}
+
+static inline void VStore(uint8_t *p, VecU v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	vst1q_u8(p, vreinterpretq_u8_u32(v));
+#elif defined(__SSE2__)
+	_mm_storeu_si128((__m128i *)p, v);
+#else
+	memcpy(p, v.u, 16);
+#endif
+}
+
+static inline VecU VLoadHalves(const uint8_t *p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vmovl_u16(vreinterpret_u16_u8(vld1_u8(p)));
+#elif defined(__SSE2__)
+	return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+#else
+	VecU v; uint16_t h[4]; memcpy(h, p, 8);
+	for (int i = 0; i < 4; ++i) v.u[i] = h[i];
+	return v;
+#endif
+}
+
+// every lane must fit in 16 bits
+static inline void VStoreHalves(uint8_t *p, VecU v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	vst1_u8(p, vreinterpret_u8_u16(vmovn_u32(v)));
+#elif defined(__SSE2__)
+	// there's no unsigned 32 to 16 bit pack before SSE4.1, so bias into the signed range and back
+	const __m128i bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16((short)0x8000);
+	__m128i packed = _mm_packs_epi32(_mm_sub_epi32(v, bias32), _mm_setzero_si128());
+	_mm_storel_epi64((__m128i *)p, _mm_xor_si128(packed, bias16));
+#else
+	for (int i = 0; i < 4; ++i) { uint16_t h = (uint16_t)v.u[i]; memcpy(p + 2 * i, &h, 2); }
+#endif
+}
+
+static inline VecU VSplatU(uint32_t x)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vdupq_n_u32(x);
+#elif defined(__SSE2__)
+	return _mm_set1_epi32((int)x);
+#else
+	VecU v; for (int i = 0; i < 4; ++i) v.u[i] = x; return v;
+#endif
+}
+
+static inline VecF VSplat(float x)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vdupq_n_f32(x);
+#elif defined(__SSE2__)
+	return _mm_set1_ps(x);
+#else
+	VecF v; for (int i = 0; i < 4; ++i) v.f[i] = x; return v;
+#endif
+}
+
+static inline VecU VAnd(VecU a, VecU b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vandq_u32(a, b);
+#elif defined(__SSE2__)
+	return _mm_and_si128(a, b);
+#else
+	for (int i = 0; i < 4; ++i) a.u[i] &= b.u[i];
+	return a;
+#endif
+}
+
+static inline VecU VOr(VecU a, VecU b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vorrq_u32(a, b);
+#elif defined(__SSE2__)
+	return _mm_or_si128(a, b);
+#else
+	for (int i = 0; i < 4; ++i) a.u[i] |= b.u[i];
+	return a;
+#endif
+}
+
+// NEON wants the shift count as an immediate, hence the macros
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define VShiftRight(v, n)	vshrq_n_u32((v), (n))
+#define VShiftLeft(v, n)	vshlq_n_u32((v), (n))
+#elif defined(__SSE2__)
+#define VShiftRight(v, n)	_mm_srli_epi32((v), (n))
+#define VShiftLeft(v, n)	_mm_slli_epi32((v), (n))
+#else
+static inline VecU VShiftRightScalar(VecU v, int n) { for (int i = 0; i < 4; ++i) v.u[i] >>= n; return v; }
+static inline VecU VShiftLeftScalar(VecU v, int n) { for (int i = 0; i < 4; ++i) v.u[i] <<= n; return v; }
+#define VShiftRight(v, n)	VShiftRightScalar((v), (n))
+#define VShiftLeft(v, n)	VShiftLeftScalar((v), (n))
+#endif
+
+// the low byte of each lane, as a float
+static inline VecF VByteToFloat(VecU v)
+{
+	v = VAnd(v, VSplatU(0xFF));
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vcvtq_f32_u32(v);
+#elif defined(__SSE2__)
+	return _mm_cvtepi32_ps(v);
+#else
+	VecF f; for (int i = 0; i < 4; ++i) f.f[i] = (float)v.u[i]; return f;
+#endif
+}
+
+// clamps to 0...255 and rounds to the nearest integer
+static inline VecU VFloatToByte(VecF v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.f)), vdupq_n_f32(255.f));
+	return vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+#elif defined(__SSE2__)
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.f));
+	return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+#else
+	VecU u;
+	for (int i = 0; i < 4; ++i) {
+		float x = v.f[i] < 0.f ? 0.f : (v.f[i] > 255.f ? 255.f : v.f[i]);
+		u.u[i] = (uint32_t)(x + 0.5f);
+	}
+	return u;
+#endif
+}
+
+static inline VecF VLoadF(const float *p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vld1q_f32(p);
+#elif defined(__SSE2__)
+	return _mm_loadu_ps(p);
+#else
+	VecF v; memcpy(v.f, p, 16); return v;
+#endif
+}
+
+static inline void VStoreF(float *p, VecF v)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	vst1q_f32(p, v);
+#elif defined(__SSE2__)
+	_mm_storeu_ps(p, v);
+#else
+	memcpy(p, v.f, 16);
+#endif
+}
+
+// 1 where x >= edge and 0 elsewhere, like GLSL's step()
+static inline VecF VStep(VecF edge, VecF x)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(x, edge), vreinterpretq_u32_f32(vdupq_n_f32(1.f))));
+#elif defined(__SSE2__)
+	return _mm_and_ps(_mm_cmpge_ps(x, edge), _mm_set1_ps(1.f));
+#else
+	for (int i = 0; i < 4; ++i) x.f[i] = x.f[i] >= edge.f[i] ? 1.f : 0.f;
+	return x;
+#endif
+}
+
+static inline VecF VAdd(VecF a, VecF b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vaddq_f32(a, b);
+#elif defined(__SSE2__)
+	return _mm_add_ps(a, b);
+#else
+	for (int i = 0; i < 4; ++i) a.f[i] += b.f[i];
+	return a;
+#endif
+}
+
+static inline VecF VMul(VecF a, VecF b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vmulq_f32(a, b);
+#elif defined(__SSE2__)
+	return _mm_mul_ps(a, b);
+#else
+	for (int i = 0; i < 4; ++i) a.f[i] *= b.f[i];
+	return a;
+#endif
+}
+
+// a + b * c
+static inline VecF VMulAdd(VecF a, VecF b, VecF c)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vmlaq_f32(a, b, c);
+#elif defined(__SSE2__)
+	return _mm_add_ps(a, _mm_mul_ps(b, c));
+#else
+	for (int i = 0; i < 4; ++i) a.f[i] += b.f[i] * c.f[i];
+	return a;
+#endif
+}
+
+#endif
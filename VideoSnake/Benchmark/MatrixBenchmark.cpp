@@ -0,0 +1,577 @@
+
+/*
+     File: MatrixBenchmark.cpp
+ Abstract: Checks and times the inline matrix functions
+  Version: 2.2
+ 
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+ Inc. ("Apple") in consideration of your agreement to the following
+ terms, and your use, installation, modification or redistribution of
+ this Apple software constitutes acceptance of these terms.  If you do
+ not agree with these terms, please do not use, install, modify or
+ redistribute this Apple software.
+ 
+ In consideration of your agreement to abide by the following terms, and
+ subject to these terms, Apple grants you a personal, non-exclusive
+ license, under Apple's copyrights in this original Apple software (the
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple
+ Software, with or without modifications, in source and/or binary forms;
+ provided that if you redistribute the Apple Software in its entirety and
+ without modifications, you must retain this notice and the following
+ text and disclaimers in all such redistributions of the Apple Software.
+ Neither the name, trademarks, service marks or logos of Apple Inc. may
+ be used to endorse or promote products derived from the Apple Software
+ without specific prior written permission from Apple.  Except as
+ expressly stated in this notice, no other rights or licenses, express or
+ implied, are granted by Apple herein, including but not limited to any
+ patent rights that may be infringed by your derivative works or by other
+ works in which the Apple Software may be incorporated.
+ 
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+ 
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+ POSSIBILITY OF SUCH DAMAGE.
+ 
+ Copyright (C) 2014 Apple Inc. All Rights Reserved.
+ 
+ */
+
+/*
+ Build and run from this directory with:
+ 
+    c++ -std=c++11 -O2 -I../Classes/Utilities/GL -o MatrixBenchmark MatrixBenchmark.cpp
+    ./MatrixBenchmark
+ 
+ It checks the builders and multiply in matrix.h against matrix.c as it was, the transforms against double
+ precision, and the grid transform against the vertices RippleModel's initMesh lays out in GLCameraRipple. Then it
+ times multiplies, batches of matrices over batches of points, and building a mesh.
+*/
+
+#include "matrix.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what)
+{
+	if ( ! ok ) {
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// matrix.c, as it was
+namespace original {
+
+void mat4f_LoadIdentity(float* m)
+{
+	m[0] = 1.0f;
+	m[1] = 0.0f;
+	m[2] = 0.0f;
+	m[3] = 0.0f;
+	
+	m[4] = 0.0f;
+	m[5] = 1.0f;
+	m[6] = 0.0f;
+	m[7] = 0.0f;
+	
+	m[8] = 0.0f;
+	m[9] = 0.0f;
+	m[10] = 1.0f;
+	m[11] = 0.0f;	
+
+	m[12] = 0.0f;
+	m[13] = 0.0f;
+	m[14] = 0.0f;
+	m[15] = 1.0f;
+}
+
+// s is a 3D vector
+void mat4f_LoadScale(float* s, float* m)
+{
+	m[0] = s[0];
+	m[1] = 0.0f;
+	m[2] = 0.0f;
+	m[3] = 0.0f;
+	
+	m[4] = 0.0f;
+	m[5] = s[1];
+	m[6] = 0.0f;
+	m[7] = 0.0f;
+	
+	m[8] = 0.0f;
+	m[9] = 0.0f;
+	m[10] = s[2];
+	m[11] = 0.0f;	
+	
+	m[12] = 0.0f;
+	m[13] = 0.0f;
+	m[14] = 0.0f;
+	m[15] = 1.0f;
+}
+
+void mat4f_LoadXRotation(float radians, float* m)
+{
+	float cosrad = cosf(radians);
+	float sinrad = sinf(radians);
+	
+	m[0] = 1.0f;
+	m[1] = 0.0f;
+	m[2] = 0.0f;
+	m[3] = 0.0f;
+	
+	m[4] = 0.0f;
+	m[5] = cosrad;
+	m[6] = sinrad;
+	m[7] = 0.0f;
+	
+	m[8] = 0.0f;
+	m[9] = -sinrad;
+	m[10] = cosrad;
+	m[11] = 0.0f;	
+	
+	m[12] = 0.0f;
+	m[13] = 0.0f;
+	m[14] = 0.0f;
+	m[15] = 1.0f;
+}
+
+void mat4f_LoadYRotation(float radians, float* mout)
+{
+	float cosrad = cosf(radians);
+	float sinrad = sinf(radians);
+	
+	mout[0] = cosrad;
+	mout[1] = 0.0f;
+	mout[2] = -sinrad;
+	mout[3] = 0.0f;
+	
+	mout[4] = 0.0f;
+	mout[5] = 1.0f;
+	mout[6] = 0.0f;
+	mout[7] = 0.0f;
+	
+	mout[8] = sinrad;
+	mout[9] = 0.0f;
+	mout[10] = cosrad;
+	mout[11] = 0.0f;	
+	
+	mout[12] = 0.0f;
+	mout[13] = 0.0f;
+	mout[14] = 0.0f;
+	mout[15] = 1.0f;
+}
+
+void mat4f_LoadZRotation(float radians, float* mout)
+{
+	float cosrad = cosf(radians);
+	float sinrad = sinf(radians);
+	
+	mout[0] = cosrad;
+	mout[1] = sinrad;
+	mout[2] = 0.0f;
+	mout[3] = 0.0f;
+	
+	mout[4] = -sinrad;
+	mout[5] = cosrad;
+	mout[6] = 0.0f;
+	mout[7] = 0.0f;
+	
+	mout[8] = 0.0f;
+	mout[9] = 0.0f;
+	mout[10] = 1.0f;
+	mout[11] = 0.0f;	
+	
+	mout[12] = 0.0f;
+	mout[13] = 0.0f;
+	mout[14] = 0.0f;
+	mout[15] = 1.0f;
+}
+
+// v is a 3D vector
+void mat4f_LoadTranslation(float* v, float* mout)
+{
+	mout[0] = 1.0f;
+	mout[1] = 0.0f;
+	mout[2] = 0.0f;
+	mout[3] = 0.0f;
+	
+	mout[4] = 0.0f;
+	mout[5] = 1.0f;
+	mout[6] = 0.0f;
+	mout[7] = 0.0f;
+	
+	mout[8] = 0.0f;
+	mout[9] = 0.0f;
+	mout[10] = 1.0f;
+	mout[11] = 0.0f;	
+	
+	mout[12] = v[0];
+	mout[13] = v[1];
+	mout[14] = v[2];
+	mout[15] = 1.0f;
+}
+
+void mat4f_LoadPerspective(float fov_radians, float aspect, float zNear, float zFar, float* mout)
+{
+	float f = 1.0f / tanf(fov_radians/2.0f);
+	
+	mout[0] = f / aspect;
+	mout[1] = 0.0f;
+	mout[2] = 0.0f;
+	mout[3] = 0.0f;
+	
+	mout[4] = 0.0f;
+	mout[5] = f;
+	mout[6] = 0.0f;
+	mout[7] = 0.0f;
+	
+	mout[8] = 0.0f;
+	mout[9] = 0.0f;
+	mout[10] = (zFar+zNear) / (zNear-zFar);
+	mout[11] = -1.0f;
+	
+	mout[12] = 0.0f;
+	mout[13] = 0.0f;
+	mout[14] = 2 * zFar * zNear /  (zNear-zFar);
+	mout[15] = 0.0f;
+}
+
+void mat4f_LoadOrtho(float left, float right, float bottom, float top, float near, float far, float* mout)
+{
+	float r_l = right - left;
+	float t_b = top - bottom;
+	float f_n = far - near;
+	float tx = - (right + left) / (right - left);
+	float ty = - (top + bottom) / (top - bottom);
+	float tz = - (far + near) / (far - near);
+
+	mout[0] = 2.0f / r_l;
+	mout[1] = 0.0f;
+	mout[2] = 0.0f;
+	mout[3] = 0.0f;
+	
+	mout[4] = 0.0f;
+	mout[5] = 2.0f / t_b;
+	mout[6] = 0.0f;
+	mout[7] = 0.0f;
+	
+	mout[8] = 0.0f;
+	mout[9] = 0.0f;
+	mout[10] = -2.0f / f_n;
+	mout[11] = 0.0f;
+	
+	mout[12] = tx;
+	mout[13] = ty;
+	mout[14] = tz;
+	mout[15] = 1.0f;
+}
+
+void mat4f_MultiplyMat4f(const float* a, const float* b, float* mout)
+{
+	mout[0]  = a[0] * b[0]  + a[4] * b[1]  + a[8] * b[2]   + a[12] * b[3];
+	mout[1]  = a[1] * b[0]  + a[5] * b[1]  + a[9] * b[2]   + a[13] * b[3];
+	mout[2]  = a[2] * b[0]  + a[6] * b[1]  + a[10] * b[2]  + a[14] * b[3];
+	mout[3]  = a[3] * b[0]  + a[7] * b[1]  + a[11] * b[2]  + a[15] * b[3];
+
+	mout[4]  = a[0] * b[4]  + a[4] * b[5]  + a[8] * b[6]   + a[12] * b[7];
+	mout[5]  = a[1] * b[4]  + a[5] * b[5]  + a[9] * b[6]   + a[13] * b[7];
+	mout[6]  = a[2] * b[4]  + a[6] * b[5]  + a[10] * b[6]  + a[14] * b[7];
+	mout[7]  = a[3] * b[4]  + a[7] * b[5]  + a[11] * b[6]  + a[15] * b[7];
+
+	mout[8]  = a[0] * b[8]  + a[4] * b[9]  + a[8] * b[10]  + a[12] * b[11];
+	mout[9]  = a[1] * b[8]  + a[5] * b[9]  + a[9] * b[10]  + a[13] * b[11];
+	mout[10] = a[2] * b[8]  + a[6] * b[9]  + a[10] * b[10] + a[14] * b[11];
+	mout[11] = a[3] * b[8]  + a[7] * b[9]  + a[11] * b[10] + a[15] * b[11];
+
+	mout[12] = a[0] * b[12] + a[4] * b[13] + a[8] * b[14]  + a[12] * b[15];
+	mout[13] = a[1] * b[12] + a[5] * b[13] + a[9] * b[14]  + a[13] * b[15];
+	mout[14] = a[2] * b[12] + a[6] * b[13] + a[10] * b[14] + a[14] * b[15];
+	mout[15] = a[3] * b[12] + a[7] * b[13] + a[11] * b[14] + a[15] * b[15];
+}
+
+}
+
+static float RandomFloat(float low, float high)
+{
+	return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+static bool Same(const float *a, const float *b, size_t count)
+{
+	return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+// Within a few units in the last place of the larger value. A compiler may fuse a scalar multiply and add, where the
+// vector code rounds both, so the products needn't match to the bit on every CPU.
+static bool Close(const float *a, const float *b, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float scale = std::max(fabsf(a[i]), fabsf(b[i]));
+		if ( fabsf(a[i] - b[i]) > scale * 4 * 1.1920929e-7f + 1e-30f )
+			return false;
+	}
+	return true;
+}
+
+#pragma mark Checks
+
+static void CheckBuilders()
+{
+	bool same = true;
+	for (int i = 0; i < 1000; i++) {
+		float a[16], b[16];
+		float v[3] = { RandomFloat(-10.f, 10.f), RandomFloat(-10.f, 10.f), RandomFloat(-10.f, 10.f) };
+		float radians = RandomFloat(-7.f, 7.f);
+		
+		original::mat4f_LoadIdentity(a); mat4f_LoadIdentity(b); same = same && Same(a, b, 16);
+		original::mat4f_LoadScale(v, a); mat4f_LoadScale(v, b); same = same && Same(a, b, 16);
+		original::mat4f_LoadTranslation(v, a); mat4f_LoadTranslation(v, b); same = same && Same(a, b, 16);
+		original::mat4f_LoadXRotation(radians, a); mat4f_LoadXRotation(radians, b); same = same && Same(a, b, 16);
+		original::mat4f_LoadYRotation(radians, a); mat4f_LoadYRotation(radians, b); same = same && Same(a, b, 16);
+		original::mat4f_LoadZRotation(radians, a); mat4f_LoadZRotation(radians, b); same = same && Same(a, b, 16);
+		
+		float fov = RandomFloat(0.2f, 3.f), aspect = RandomFloat(0.3f, 3.f), zNear = RandomFloat(0.01f, 1.f), zFar = zNear + RandomFloat(1.f, 1000.f);
+		original::mat4f_LoadPerspective(fov, aspect, zNear, zFar, a); mat4f_LoadPerspective(fov, aspect, zNear, zFar, b);
+		same = same && Same(a, b, 16);
+		
+		float left = RandomFloat(-100.f, 0.f), right = left + RandomFloat(1.f, 100.f);
+		float bottom = RandomFloat(-100.f, 0.f), top = bottom + RandomFloat(1.f, 100.f);
+		original::mat4f_LoadOrtho(left, right, bottom, top, zNear, zFar, a); mat4f_LoadOrtho(left, right, bottom, top, zNear, zFar, b);
+		same = same && Same(a, b, 16);
+	}
+	Check(same, "builders match matrix.c");
+}
+
+static void CheckMultiply()
+{
+	bool close = true, inPlace = true;
+	for (int i = 0; i < 10000; i++) {
+		float a[16], b[16], expected[16], result[16];
+		for (int j = 0; j < 16; j++) {
+			a[j] = RandomFloat(-100.f, 100.f);
+			b[j] = RandomFloat(-100.f, 100.f);
+		}
+		original::mat4f_MultiplyMat4f(a, b, expected);
+		mat4f_MultiplyMat4f(a, b, result);
+		close = close && Close(expected, result, 16);
+		
+		// matrix.c would have overwritten a while it still needed it
+		mat4f_MultiplyMat4f(a, b, a);
+		inPlace = inPlace && Same(a, result, 16);
+	}
+	Check(close, "products match matrix.c");
+	Check(inPlace, "a product can go over one of its inputs");
+}
+
+static void CheckTransforms()
+{
+	std::vector<float> matrices(7 * 16), points(1001 * 4);
+	for (size_t i = 0; i < matrices.size(); i++)
+		matrices[i] = RandomFloat(-10.f, 10.f);
+	for (size_t i = 0; i < points.size(); i++)
+		points[i] = RandomFloat(-10.f, 10.f);
+	
+	for (unsigned int inComponents = 2; inComponents <= 4; inComponents++) {
+		for (unsigned int outComponents = 1; outComponents <= 4; outComponents++) {
+			size_t pointCount = points.size() / 4;
+			// a sentinel after the end, which shouldn't be touched
+			std::vector<float> out(7 * pointCount * outComponents + 1, 12345.f);
+			mat4f_TransformPointsBatch(&matrices[0], 7, &points[0], pointCount, inComponents, &out[0], outComponents);
+			
+			bool close = out.back() == 12345.f;
+			for (size_t m = 0; m < 7 && close; m++) {
+				const float *matrix = &matrices[m * 16];
+				for (size_t i = 0; i < pointCount && close; i++) {
+					const float *point = &points[i * inComponents];
+					double p[4] = { point[0], point[1], inComponents > 2 ? point[2] : 0.0, inComponents > 3 ? point[3] : 1.0 };
+					for (unsigned int row = 0; row < outComponents; row++) {
+						double expected = 0.0, magnitude = 0.0;
+						for (int column = 0; column < 4; column++) {
+							expected += matrix[column * 4 + row] * p[column];
+							magnitude += fabs(matrix[column * 4 + row] * p[column]);
+						}
+						close = close && fabs(out[(m * pointCount + i) * outComponents + row] - expected) <= magnitude * 1e-6;
+					}
+				}
+			}
+			
+			char what[96];
+			snprintf(what, sizeof(what), "batch transform of %u component points to %u components", inComponents, outComponents);
+			Check(close, what);
+		}
+	}
+}
+
+// RippleModel's initMesh, for the vertices
+static void RippleVertices(unsigned int poolWidth, unsigned int poolHeight, float *rippleVertices)
+{
+	for (int i=0; i<poolHeight; i++)
+	{
+		for (int j=0; j<poolWidth; j++)
+		{
+			rippleVertices[(i*poolWidth+j)*2+0] = -1.f + j*(2.f/(poolWidth-1));
+			rippleVertices[(i*poolWidth+j)*2+1] = 1.f - i*(2.f/(poolHeight-1));
+		}
+	}
+}
+
+static mat4f RippleVertexMatrix(unsigned int poolWidth, unsigned int poolHeight)
+{
+	return mat4f_Multiply(mat4f_Translation(-1.f, 1.f, 0.f), mat4f_Scale(2.f/(poolWidth-1), -(2.f/(poolHeight-1)), 1.f));
+}
+
+static void CheckGrid()
+{
+	const unsigned int sizes[][2] = { { 2, 2 }, { 33, 17 }, { 320, 480 }, { 640, 1136 } };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		unsigned int width = sizes[i][0], height = sizes[i][1];
+		std::vector<float> expected(width * height * 2), vertices(expected.size());
+		RippleVertices(width, height, &expected[0]);
+		mat4f_TransformGrid(RippleVertexMatrix(width, height), width, height, &vertices[0], 2);
+		
+		char what[96];
+		snprintf(what, sizeof(what), "a %ux%u grid gives initMesh's vertices", width, height);
+		Check(expected == vertices, what);
+	}
+}
+
+#pragma mark Timing
+
+static volatile float sink;
+
+static void TimeMultiplies()
+{
+	const int kCount = 1 << 20;
+	float a[16], b[16], c[16];
+	for (int j = 0; j < 16; j++)
+		a[j] = RandomFloat(-1.f, 1.f);
+	
+	// Each product feeds the next, so it's the latency of a product, as in a chain of transforms. A rotation keeps
+	// the values from running off to infinity or into denormals.
+	mat4f_LoadZRotation(0.1f, b);
+	double best[2] = { 1e9, 1e9 };
+	for (int run = 0; run < 5; run++) {
+		memcpy(c, a, sizeof(c));
+		double start = NowSeconds();
+		for (int i = 0; i < kCount; i++) {
+			original::mat4f_MultiplyMat4f(c, b, a);
+			original::mat4f_MultiplyMat4f(a, b, c);
+		}
+		best[0] = std::min(best[0], NowSeconds() - start);
+		sink = c[0];
+		
+		memcpy(c, a, sizeof(c));
+		start = NowSeconds();
+		for (int i = 0; i < kCount; i++)
+			mat4f_MultiplyMat4f(c, b, c), mat4f_MultiplyMat4f(c, b, c);
+		best[1] = std::min(best[1], NowSeconds() - start);
+		sink = c[0];
+	}
+	printf("multiplies               %8.1f M/s %8.1f M/s\n", 2 * kCount / best[0] * 1e-6, 2 * kCount / best[1] * 1e-6);
+}
+
+// What the batch replaces: a multiply per vertex, written out in scalar code
+static void ScalarTransformBatch(const float *matrices, size_t matrixCount, const float *points, size_t pointCount, float *out)
+{
+	for (size_t m = 0; m < matrixCount; m++) {
+		const float *a = matrices + m * 16;
+		for (size_t i = 0; i < pointCount; i++) {
+			const float *b = points + i * 4;
+			float *o = out + (m * pointCount + i) * 4;
+			o[0] = a[0] * b[0] + a[4] * b[1] + a[8] * b[2] + a[12] * b[3];
+			o[1] = a[1] * b[0] + a[5] * b[1] + a[9] * b[2] + a[13] * b[3];
+			o[2] = a[2] * b[0] + a[6] * b[1] + a[10] * b[2] + a[14] * b[3];
+			o[3] = a[3] * b[0] + a[7] * b[1] + a[11] * b[2] + a[15] * b[3];
+		}
+	}
+}
+
+static void TimeBatches()
+{
+	const size_t sizes[][2] = { { 1, 1 << 16 }, { 16, 4096 }, { 256, 256 } };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t matrixCount = sizes[s][0], pointCount = sizes[s][1];
+		std::vector<float> matrices(matrixCount * 16), points(pointCount * 4), out(matrixCount * pointCount * 4);
+		for (size_t i = 0; i < matrices.size(); i++)
+			matrices[i] = RandomFloat(-1.f, 1.f);
+		for (size_t i = 0; i < points.size(); i++)
+			points[i] = RandomFloat(-1.f, 1.f);
+		
+		double best[2] = { 1e9, 1e9 };
+		for (int run = 0; run < 5; run++) {
+			const int kRepeats = 16;
+			double start = NowSeconds();
+			for (int r = 0; r < kRepeats; r++)
+				ScalarTransformBatch(&matrices[0], matrixCount, &points[0], pointCount, &out[0]);
+			best[0] = std::min(best[0], (NowSeconds() - start) / kRepeats);
+			
+			start = NowSeconds();
+			for (int r = 0; r < kRepeats; r++)
+				mat4f_TransformPointsBatch(&matrices[0], matrixCount, &points[0], pointCount, 4, &out[0], 4);
+			best[1] = std::min(best[1], (NowSeconds() - start) / kRepeats);
+		}
+		double transforms = (double)matrixCount * pointCount;
+		printf("%4zu x %-6zu points     %8.1f M/s %8.1f M/s\n", matrixCount, pointCount, transforms / best[0] * 1e-6, transforms / best[1] * 1e-6);
+	}
+}
+
+static void TimeGrid()
+{
+	const unsigned int width = 640, height = 1136;
+	std::vector<float> vertices(width * height * 2);
+	double best[2] = { 1e9, 1e9 };
+	for (int run = 0; run < 5; run++) {
+		const int kRepeats = 16;
+		double start = NowSeconds();
+		for (int r = 0; r < kRepeats; r++)
+			RippleVertices(width, height, &vertices[0]);
+		best[0] = std::min(best[0], (NowSeconds() - start) / kRepeats);
+		
+		start = NowSeconds();
+		for (int r = 0; r < kRepeats; r++)
+			mat4f_TransformGrid(RippleVertexMatrix(width, height), width, height, &vertices[0], 2);
+		best[1] = std::min(best[1], (NowSeconds() - start) / kRepeats);
+	}
+	printf("%ux%u mesh vertices    %8.1f M/s %8.1f M/s\n", width, height, width * height / best[0] * 1e-6, width * height / best[1] * 1e-6);
+}
+
+int main()
+{
+	CheckBuilders();
+	CheckMultiply();
+	CheckTransforms();
+	CheckGrid();
+	printf("checks %s\n\n", failures ? "FAILED" : "passed");
+	
+	printf("                          matrix.c    matrix.h\n");
+	TimeMultiplies();
+	TimeBatches();
+	TimeGrid();
+	return failures ? 1 : 0;
+}
@@ -1,7 +1,7 @@
 
 /*
      File: matrix.h
- Abstract: Simple 4x4 matrix computations
+ Abstract: Simple 4x4 matrix computations, inline and vectorized
   Version: 2.2
  
  Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
@@ -49,18 +49,386 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
-void mat4f_LoadIdentity(float* m);
-void mat4f_LoadScale(float* s, float* m);
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
 
-void mat4f_LoadXRotation(float radians, float* mout);
-void mat4f_LoadYRotation(float radians, float* mout);
-void mat4f_LoadZRotation(float radians, float* mout);
+/*
+ Everything here is inline, so a matrix built from constants folds down to the few values that aren't 0 or 1, and
+ a product of builders only costs the arithmetic the zeroes leave. The multiplies and transforms work a column at
+ a time in NEON or SSE2 registers, or in plain C elsewhere.
+ 
+ Matrices are column major, as GL takes them: m[column*4 + row].
+*/
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t vec4f;
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128 vec4f;
+#else
+typedef struct { float v[4]; } vec4f;
+#endif
+
+typedef struct { vec4f c[4]; } mat4f;
+
+#pragma mark vec4f
+
+static inline vec4f vec4f_Make(float x, float y, float z, float w)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	float v[4] = { x, y, z, w };
+	return vld1q_f32(v);
+#elif defined(__SSE2__)
+	return _mm_setr_ps(x, y, z, w);
+#else
+	vec4f v = { { x, y, z, w } };
+	return v;
+#endif
+}
+
+static inline vec4f vec4f_Splat(float x)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vdupq_n_f32(x);
+#elif defined(__SSE2__)
+	return _mm_set1_ps(x);
+#else
+	return vec4f_Make(x, x, x, x);
+#endif
+}
+
+static inline vec4f vec4f_Load(const float* p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vld1q_f32(p);
+#elif defined(__SSE2__)
+	return _mm_loadu_ps(p);
+#else
+	vec4f v;
+	memcpy(v.v, p, sizeof(v.v));
+	return v;
+#endif
+}
+
+static inline void vec4f_Store(vec4f v, float* p)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	vst1q_f32(p, v);
+#elif defined(__SSE2__)
+	_mm_storeu_ps(p, v);
+#else
+	memcpy(p, v.v, sizeof(v.v));
+#endif
+}
+
+// the first count components, 1 to 4
+static inline void vec4f_StorePartial(vec4f v, float* p, unsigned int count)
+{
+	if (count == 4) {
+		vec4f_Store(v, p);
+	}
+	else if (count == 2) {
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+		vst1_f32(p, vget_low_f32(v));
+#elif defined(__SSE2__)
+		_mm_storel_pi((__m64*)p, v);
+#else
+		memcpy(p, v.v, 2 * sizeof(float));
+#endif
+	}
+	else {
+		float all[4];
+		vec4f_Store(v, all);
+		memcpy(p, all, count * sizeof(float));
+	}
+}
+
+static inline vec4f vec4f_Add(vec4f a, vec4f b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vaddq_f32(a, b);
+#elif defined(__SSE2__)
+	return _mm_add_ps(a, b);
+#else
+	for (int i = 0; i < 4; i++) a.v[i] += b.v[i];
+	return a;
+#endif
+}
+
+static inline vec4f vec4f_Mul(vec4f a, vec4f b)
+{
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	return vmulq_f32(a, b);
+#elif defined(__SSE2__)
+	return _mm_mul_ps(a, b);
+#else
+	for (int i = 0; i < 4; i++) a.v[i] *= b.v[i];
+	return a;
+#endif
+}
+
+// one component in every lane; NEON and SSE want the lane as a constant, hence the four of them
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define VEC4F_SPLAT_LANE(v, lane) vdupq_n_f32(vgetq_lane_f32((v), (lane)))
+#elif defined(__SSE2__)
+#define VEC4F_SPLAT_LANE(v, lane) _mm_shuffle_ps((v), (v), _MM_SHUFFLE((lane), (lane), (lane), (lane)))
+#else
+#define VEC4F_SPLAT_LANE(v, lane) vec4f_Splat((v).v[(lane)])
+#endif
+
+static inline vec4f vec4f_SplatX(vec4f v) { return VEC4F_SPLAT_LANE(v, 0); }
+static inline vec4f vec4f_SplatY(vec4f v) { return VEC4F_SPLAT_LANE(v, 1); }
+static inline vec4f vec4f_SplatZ(vec4f v) { return VEC4F_SPLAT_LANE(v, 2); }
+static inline vec4f vec4f_SplatW(vec4f v) { return VEC4F_SPLAT_LANE(v, 3); }
+
+#pragma mark mat4f
+
+static inline mat4f mat4f_Columns(vec4f c0, vec4f c1, vec4f c2, vec4f c3)
+{
+	mat4f m;
+	m.c[0] = c0;
+	m.c[1] = c1;
+	m.c[2] = c2;
+	m.c[3] = c3;
+	return m;
+}
+
+static inline mat4f mat4f_Load(const float* m)
+{
+	return mat4f_Columns(vec4f_Load(m), vec4f_Load(m + 4), vec4f_Load(m + 8), vec4f_Load(m + 12));
+}
+
+static inline void mat4f_Store(mat4f m, float* mout)
+{
+	vec4f_Store(m.c[0], mout);
+	vec4f_Store(m.c[1], mout + 4);
+	vec4f_Store(m.c[2], mout + 8);
+	vec4f_Store(m.c[3], mout + 12);
+}
+
+static inline mat4f mat4f_Identity(void)
+{
+	return mat4f_Columns(vec4f_Make(1.0f, 0.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 1.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 1.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static inline mat4f mat4f_Scale(float x, float y, float z)
+{
+	return mat4f_Columns(vec4f_Make(x, 0.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, y, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, z, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static inline mat4f mat4f_Translation(float x, float y, float z)
+{
+	return mat4f_Columns(vec4f_Make(1.0f, 0.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 1.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 1.0f, 0.0f),
+						 vec4f_Make(x, y, z, 1.0f));
+}
+
+static inline mat4f mat4f_XRotation(float radians)
+{
+	float cosrad = cosf(radians);
+	float sinrad = sinf(radians);
+	
+	return mat4f_Columns(vec4f_Make(1.0f, 0.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, cosrad, sinrad, 0.0f),
+						 vec4f_Make(0.0f, -sinrad, cosrad, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static inline mat4f mat4f_YRotation(float radians)
+{
+	float cosrad = cosf(radians);
+	float sinrad = sinf(radians);
+	
+	return mat4f_Columns(vec4f_Make(cosrad, 0.0f, -sinrad, 0.0f),
+						 vec4f_Make(0.0f, 1.0f, 0.0f, 0.0f),
+						 vec4f_Make(sinrad, 0.0f, cosrad, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static inline mat4f mat4f_ZRotation(float radians)
+{
+	float cosrad = cosf(radians);
+	float sinrad = sinf(radians);
+	
+	return mat4f_Columns(vec4f_Make(cosrad, sinrad, 0.0f, 0.0f),
+						 vec4f_Make(-sinrad, cosrad, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 1.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static inline mat4f mat4f_Perspective(float fov_radians, float aspect, float zNear, float zFar)
+{
+	float f = 1.0f / tanf(fov_radians/2.0f);
+	
+	return mat4f_Columns(vec4f_Make(f / aspect, 0.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, (zFar+zNear) / (zNear-zFar), -1.0f),
+						 vec4f_Make(0.0f, 0.0f, 2 * zFar * zNear / (zNear-zFar), 0.0f));
+}
+
+static inline mat4f mat4f_Ortho(float left, float right, float bottom, float top, float near, float far)
+{
+	float r_l = right - left;
+	float t_b = top - bottom;
+	float f_n = far - near;
+	float tx = - (right + left) / (right - left);
+	float ty = - (top + bottom) / (top - bottom);
+	float tz = - (far + near) / (far - near);
+	
+	return mat4f_Columns(vec4f_Make(2.0f / r_l, 0.0f, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 2.0f / t_b, 0.0f, 0.0f),
+						 vec4f_Make(0.0f, 0.0f, -2.0f / f_n, 0.0f),
+						 vec4f_Make(tx, ty, tz, 1.0f));
+}
+
+// m * v, summed in the same order as the scalar code always has
+static inline vec4f mat4f_Transform(mat4f m, vec4f v)
+{
+	vec4f r = vec4f_Add(vec4f_Mul(m.c[0], vec4f_SplatX(v)), vec4f_Mul(m.c[1], vec4f_SplatY(v)));
+	r = vec4f_Add(r, vec4f_Mul(m.c[2], vec4f_SplatZ(v)));
+	return vec4f_Add(r, vec4f_Mul(m.c[3], vec4f_SplatW(v)));
+}
+
+// a * b, so b applies first
+static inline mat4f mat4f_Multiply(mat4f a, mat4f b)
+{
+	return mat4f_Columns(mat4f_Transform(a, b.c[0]),
+						 mat4f_Transform(a, b.c[1]),
+						 mat4f_Transform(a, b.c[2]),
+						 mat4f_Transform(a, b.c[3]));
+}
+
+#pragma mark Batches
+
+// A point of 2, 3 or 4 components, z missing as 0 and w as 1. With a constant count the tests fold away.
+static inline vec4f mat4f_TransformPoint(mat4f m, const float* p, unsigned int components)
+{
+	vec4f r = vec4f_Add(vec4f_Mul(m.c[0], vec4f_Splat(p[0])), vec4f_Mul(m.c[1], vec4f_Splat(p[1])));
+	if (components > 2)
+		r = vec4f_Add(r, vec4f_Mul(m.c[2], vec4f_Splat(p[2])));
+	return vec4f_Add(r, components > 3 ? vec4f_Mul(m.c[3], vec4f_Splat(p[3])) : m.c[3]);
+}
+
+// count points packed inComponents apiece, out packed outComponents apiece (1 to 4, so 2 gives just x and y)
+static inline void mat4f_TransformPoints(mat4f m, const float* points, size_t count, unsigned int inComponents,
+										 float* out, unsigned int outComponents)
+{
+	for (size_t i = 0; i < count; i++)
+		vec4f_StorePartial(mat4f_TransformPoint(m, points + i * inComponents, inComponents), out + i * outComponents, outComponents);
+}
+
+// Every one of matrixCount 16 float matrices applied to every point, the results for matrix i starting at
+// out + i*pointCount*outComponents. The points go a block at a time, so they stay in the cache while each matrix
+// takes its turn on them.
+static inline void mat4f_TransformPointsBatch(const float* matrices, size_t matrixCount,
+											  const float* points, size_t pointCount, unsigned int inComponents,
+											  float* out, unsigned int outComponents)
+{
+	const size_t blockSize = 512;
+	for (size_t first = 0; first < pointCount; first += blockSize) {
+		size_t count = pointCount - first < blockSize ? pointCount - first : blockSize;
+		for (size_t i = 0; i < matrixCount; i++) {
+			mat4f_TransformPoints(mat4f_Load(matrices + i * 16), points + first * inComponents, count, inComponents,
+								  out + (i * pointCount + first) * outComponents, outComponents);
+		}
+	}
+}
+
+// The points (x, y, 0, 1) for x in 0..<columns and y in 0..<rows, row by row, which is how a mesh is usually laid
+// out: a scale and a translation give its vertices or texture coordinates without a point array to read.
+static inline void mat4f_TransformGrid(mat4f m, unsigned int columns, unsigned int rows, float* out, unsigned int outComponents)
+{
+	float c0[4], c3[4];
+	vec4f_Store(m.c[0], c0);
+	vec4f_Store(m.c[3], c3);
+	
+	for (unsigned int y = 0; y < rows; y++) {
+		vec4f rowOffset = vec4f_Mul(m.c[1], vec4f_Splat((float)y));
+		unsigned int x = 0;
+		
+		if (outComponents == 2) {
+			// two vertices to a register, x y x y
+			float r[4];
+			vec4f_Store(rowOffset, r);
+			vec4f step = vec4f_Make(c0[0], c0[1], c0[0], c0[1]);
+			vec4f rowOffsets = vec4f_Make(r[0], r[1], r[0], r[1]);
+			vec4f translation = vec4f_Make(c3[0], c3[1], c3[0], c3[1]);
+			vec4f xs = vec4f_Make(0.0f, 0.0f, 1.0f, 1.0f), two = vec4f_Splat(2.0f);
+			for (; x + 2 <= columns; x += 2) {
+				vec4f_Store(vec4f_Add(vec4f_Add(vec4f_Mul(step, xs), rowOffsets), translation), out);
+				xs = vec4f_Add(xs, two);
+				out += 4;
+			}
+		}
+		
+		for (; x < columns; x++) {
+			vec4f r = vec4f_Add(vec4f_Add(vec4f_Mul(m.c[0], vec4f_Splat((float)x)), rowOffset), m.c[3]);
+			vec4f_StorePartial(r, out, outComponents);
+			out += outComponents;
+		}
+	}
+}
+
+#pragma mark Arrays of 16 floats
+
+/*
+ The original interface, on plain float arrays. mout may be one of the inputs.
+*/
+
+static inline void mat4f_LoadIdentity(float* m)
+{
+	mat4f_Store(mat4f_Identity(), m);
+}
+
+// s is a 3D vector
+static inline void mat4f_LoadScale(float* s, float* m)
+{
+	mat4f_Store(mat4f_Scale(s[0], s[1], s[2]), m);
+}
+
+static inline void mat4f_LoadXRotation(float radians, float* mout)
+{
+	mat4f_Store(mat4f_XRotation(radians), mout);
+}
+
+static inline void mat4f_LoadYRotation(float radians, float* mout)
+{
+	mat4f_Store(mat4f_YRotation(radians), mout);
+}
+
+static inline void mat4f_LoadZRotation(float radians, float* mout)
+{
+	mat4f_Store(mat4f_ZRotation(radians), mout);
+}
+
+// t is a 3D vector
+static inline void mat4f_LoadTranslation(float* t, float* mout)
+{
+	mat4f_Store(mat4f_Translation(t[0], t[1], t[2]), mout);
+}
 
-void mat4f_LoadTranslation(float* t, float* mout);
+static inline void mat4f_LoadPerspective(float fov_radians, float aspect, float zNear, float zFar, float* mout)
+{
+	mat4f_Store(mat4f_Perspective(fov_radians, aspect, zNear, zFar), mout);
+}
 
-void mat4f_LoadPerspective(float fov_radians, float aspect, float zNear, float zFar, float* mout);
-void mat4f_LoadOrtho(float left, float right, float bottom, float top, float near, float far, float* mout);
+static inline void mat4f_LoadOrtho(float left, float right, float bottom, float top, float near, float far, float* mout)
+{
+	mat4f_Store(mat4f_Ortho(left, right, bottom, top, near, far), mout);
+}
 
-void mat4f_MultiplyMat4f(const float* a, const float* b, float* mout);
+static inline void mat4f_MultiplyMat4f(const float* a, const float* b, float* mout)
+{
+	mat4f_Store(mat4f_Multiply(mat4f_Load(a), mat4f_Load(b)), mout);
+}
 
 #endif /* MATRIX_H */
@@ -0,0 +1,416 @@
+/*
+
+    File: PacketReadAheadBenchmark.cpp
+Abstract: Command line check and benchmark for PacketReadAhead, against an in-memory audio file
+ Version: 1.4.3
+
+Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+Inc. ("Apple") in consideration of your agreement to the following
+terms, and your use, installation, modification or redistribution of
+this Apple software constitutes acceptance of these terms.  If you do
+not agree with these terms, please do not use, install, modify or
+redistribute this Apple software.
+
+In consideration of your agreement to abide by the following terms, and
+subject to these terms, Apple grants you a personal, non-exclusive
+license, under Apple's copyrights in this original Apple software (the
+"Apple Software"), to use, reproduce, modify and redistribute the Apple
+Software, with or without modifications, in source and/or binary forms;
+provided that if you redistribute the Apple Software in its entirety and
+without modifications, you must retain this notice and the following
+text and disclaimers in all such redistributions of the Apple Software.
+Neither the name, trademarks, service marks or logos of Apple Inc. may
+be used to endorse or promote products derived from the Apple Software
+without specific prior written permission from Apple.  Except as
+expressly stated in this notice, no other rights or licenses, express or
+implied, are granted by Apple herein, including but not limited to any
+patent rights that may be infringed by your derivative works or by other
+works in which the Apple Software may be incorporated.
+
+The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+
+IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+Copyright (C) 2014 Apple Inc. All Rights Reserved.
+
+
+*/
+
+/*
+ Build and run from this directory on a Mac with:
+
+	c++ -O2 -I.. -o PacketReadAheadBenchmark PacketReadAheadBenchmark.cpp ../PacketReadAhead.cpp
+	./PacketReadAheadBenchmark
+
+ The two AudioFile calls PacketReadAhead makes are defined here, over an in-memory file whose every byte depends on
+ its offset and whose reads take a millisecond or so, like a slow disk; so it isn't linked against AudioToolbox. For a
+ constant bit rate format, a variable bit rate one with 1024 frames to a packet, and one with a variable number of
+ frames to a packet, it plays a callback that asks for packets in the order CASound's does: straight through and
+ round a loop, segment by segment skipping forwards and backwards, and at random after seeks. Every read has to
+ match what the file itself returns for the same request, bytes and packet descriptions both. Playing straight on or
+ skipping, most reads have to be served from the window; it reports the hits and misses, and the longest a read took
+ while playing and after seeks, when most reads go to the file. Lastly the frame of the end of the file, which the callback asks for when it
+ runs out of data, has to come without a file lookup.
+*/
+
+#include "PacketReadAhead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+static double NowSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void Check(bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static UInt32 Random(UInt32 &ioSeed)
+{
+	ioSeed = ioSeed * 1103515245 + 12345;
+	return ioSeed >> 8;
+}
+
+// --- the in-memory file ------------------------------------
+
+enum FileKind { kConstantBitRate, kVariableBitRate, kVariableFrames };
+
+struct OpaqueAudioFileID
+{
+	AudioStreamBasicDescription		format;
+	std::vector<UInt32>				sizes;
+	std::vector<UInt32>				frames;			// in each packet
+	std::vector<UInt64>				offsets;
+	std::vector<SInt64>				firstFrames;	// one more than there are packets, ending with the frame count
+	UInt32							readMicroseconds;
+	volatile UInt32					lookups;		// frame and packet translations asked for
+};
+
+static UInt8 ByteAt(UInt64 inOffset)
+{
+	return (UInt8)((inOffset * 2654435761u) >> 13);
+}
+
+static AudioFileID MakeFile(FileKind inKind, SInt64 inPackets)
+{
+	AudioFileID file = new OpaqueAudioFileID;
+	memset(&file->format, 0, sizeof(file->format));
+	file->format.mSampleRate = 44100.;
+	file->format.mChannelsPerFrame = 2;
+	file->format.mFramesPerPacket = (inKind == kConstantBitRate) ? 1 : (inKind == kVariableBitRate) ? 1024 : 0;
+	file->format.mBytesPerPacket = (inKind == kConstantBitRate) ? 4 : 0;
+	file->readMicroseconds = 1000;
+	file->lookups = 0;
+
+	UInt32 seed = 3;
+	UInt64 offset = 0;
+	SInt64 frame = 0;
+	for (SInt64 i = 0; i < inPackets; i++)
+	{
+		UInt32 size = (inKind == kConstantBitRate) ? 4 : 100 + Random(seed) % 500;
+		UInt32 frames = (inKind == kVariableFrames) ? 256 + Random(seed) % 1793 : file->format.mFramesPerPacket;
+		file->sizes.push_back(size);
+		file->frames.push_back(frames);
+		file->offsets.push_back(offset);
+		file->firstFrames.push_back(frame);
+		offset += size;
+		frame += frames;
+	}
+	file->firstFrames.push_back(frame);
+	return file;
+}
+
+static SInt64 PacketCountOf(AudioFileID inFile)
+{
+	return (SInt64)inFile->sizes.size();
+}
+
+OSStatus AudioFileGetProperty(AudioFileID inFile, AudioFilePropertyID inPropertyID, UInt32 *ioDataSize, void *outPropertyData)
+{
+	switch (inPropertyID)
+	{
+		case kAudioFilePropertyDataFormat:
+			memcpy(outPropertyData, &inFile->format, sizeof(inFile->format));
+			return noErr;
+		case kAudioFilePropertyAudioDataPacketCount:
+			*(SInt64 *)outPropertyData = PacketCountOf(inFile);
+			return noErr;
+		case kAudioFilePropertyPacketSizeUpperBound:
+			*(UInt32 *)outPropertyData = inFile->format.mBytesPerPacket ? inFile->format.mBytesPerPacket : 600;
+			return noErr;
+		case kAudioFilePropertyPacketToFrame:
+		{
+			AudioFramePacketTranslation *translation = (AudioFramePacketTranslation *)outPropertyData;
+			__sync_fetch_and_add(&inFile->lookups, 1);
+			if (translation->mPacket < 0 || translation->mPacket > PacketCountOf(inFile))
+				return kAudioFileInvalidPacketOffsetError;
+			translation->mFrame = inFile->firstFrames[translation->mPacket];
+			translation->mFrameOffsetInPacket = 0;
+			return noErr;
+		}
+		case kAudioFilePropertyFrameToPacket:
+		{
+			AudioFramePacketTranslation *translation = (AudioFramePacketTranslation *)outPropertyData;
+			__sync_fetch_and_add(&inFile->lookups, 1);
+			if (translation->mFrame < 0 || translation->mFrame >= inFile->firstFrames.back())
+				return kAudioFileInvalidPacketOffsetError;
+			SInt64 packet = 0, past = PacketCountOf(inFile);
+			while (past - packet > 1)
+			{
+				SInt64 middle = (packet + past) / 2;
+				if (inFile->firstFrames[middle] <= translation->mFrame)
+					packet = middle;
+				else
+					past = middle;
+			}
+			translation->mPacket = packet;
+			translation->mFrameOffsetInPacket = (UInt32)(translation->mFrame - inFile->firstFrames[packet]);
+			return noErr;
+		}
+	}
+	return kAudioFileUnsupportedPropertyError;
+}
+
+OSStatus AudioFileReadPacketData(AudioFileID inFile, Boolean inUseCache, UInt32 *ioNumBytes, AudioStreamPacketDescription *outPacketDescriptions,
+								 SInt64 inStartingPacket, UInt32 *ioNumPackets, void *outBuffer)
+{
+	if (!inFile->format.mBytesPerPacket && !outPacketDescriptions)
+		return kAudio_ParamError;
+	if (inFile->readMicroseconds)
+		usleep(inFile->readMicroseconds);
+
+	SInt64 count = PacketCountOf(inFile);
+	UInt32 numBytes = 0, numPackets = 0;
+	while (numPackets < *ioNumPackets && inStartingPacket + numPackets < count)
+	{
+		SInt64 packet = inStartingPacket + numPackets;
+		UInt32 size = inFile->sizes[packet];
+		if (numBytes + size > *ioNumBytes)
+			break;
+		for (UInt32 i = 0; i < size; i++)
+			((UInt8 *)outBuffer)[numBytes + i] = ByteAt(inFile->offsets[packet] + i);
+		if (outPacketDescriptions)
+		{
+			outPacketDescriptions[numPackets].mStartOffset = numBytes;
+			outPacketDescriptions[numPackets].mVariableFramesInPacket = inFile->format.mFramesPerPacket ? 0 : inFile->frames[packet];
+			outPacketDescriptions[numPackets].mDataByteSize = size;
+		}
+		numBytes += size;
+		numPackets++;
+	}
+	*ioNumBytes = numBytes;
+	*ioNumPackets = numPackets;
+	return (numPackets == 0 && inStartingPacket >= count) ? kAudioFileEndOfFileError : noErr;
+}
+
+// --- the callback ------------------------------------------
+
+static const UInt32 kBufferBytes = 65536;
+static const UInt32 kMaxDescriptions = 512;
+
+struct Player
+{
+	AudioFileID						file;
+	PacketReadAhead					*readAhead;
+	bool							variable;
+	std::vector<UInt8>				bytes;
+	std::vector<UInt8>				expectedBytes;
+	AudioStreamPacketDescription	descriptions[kMaxDescriptions];
+	AudioStreamPacketDescription	expectedDescriptions[kMaxDescriptions];
+	UInt32							reads;
+	UInt32							wrong;
+	double							longest;
+	
+	Player(AudioFileID inFile) : file(inFile), variable(inFile->format.mBytesPerPacket == 0), bytes(kBufferBytes), expectedBytes(kBufferBytes), reads(0), wrong(0), longest(0.)
+	{
+		readAhead = new PacketReadAhead(inFile, 1.);
+	}
+	
+	~Player() { delete readAhead; }
+	
+	// reads through the read-ahead, checks the result against the file's own and returns the number of packets read
+	UInt32 Read(SInt64 inPacket, UInt32 inMaxBytes, UInt32 inMaxPackets)
+	{
+		UInt32 numBytes = inMaxBytes, numPackets = inMaxPackets;
+		double start = NowSeconds();
+		OSStatus err = readAhead->ReadPackets(inPacket, &numBytes, variable ? descriptions : NULL, &numPackets, &bytes[0]);
+		double elapsed = NowSeconds() - start;
+		if (elapsed > longest)
+			longest = elapsed;
+		reads++;
+		
+		UInt32 readMicroseconds = file->readMicroseconds;
+		file->readMicroseconds = 0;
+		UInt32 expectedNumBytes = inMaxBytes, expectedNumPackets = inMaxPackets;
+		AudioFileReadPacketData(file, false, &expectedNumBytes, variable ? expectedDescriptions : NULL, inPacket, &expectedNumPackets, &expectedBytes[0]);
+		file->readMicroseconds = readMicroseconds;
+		
+		bool same = err == noErr && numBytes == expectedNumBytes && numPackets == expectedNumPackets && memcmp(&bytes[0], &expectedBytes[0], numBytes) == 0;
+		for (UInt32 i = 0; same && variable && i < numPackets; i++)
+			same = descriptions[i].mStartOffset == expectedDescriptions[i].mStartOffset && descriptions[i].mDataByteSize == expectedDescriptions[i].mDataByteSize
+				&& descriptions[i].mVariableFramesInPacket == expectedDescriptions[i].mVariableFramesInPacket;
+		if (!same)
+			wrong++;
+		return numPackets;
+	}
+	
+	UInt32 MaxPackets() const { return variable ? kMaxDescriptions : kBufferBytes / file->format.mBytesPerPacket; }
+};
+
+static const char *KindName(FileKind inKind)
+{
+	return (inKind == kConstantBitRate) ? "constant bit rate  " : (inKind == kVariableBitRate) ? "variable bit rate  " : "variable frames    ";
+}
+
+// a callback every 20ms, still many times as fast as playback, so the reader has to keep up
+static const useconds_t kCallbackMicroseconds = 20000;
+
+static void PlayStraight(Player &ioPlayer, FileKind inKind, SInt64 inLoopStart)
+{
+	PacketReadAhead &readAhead = *ioPlayer.readAhead;
+	SInt64 count = readAhead.PacketCount();
+	UInt32 hits = readAhead.Hits(), misses = readAhead.Misses(), wrong = ioPlayer.wrong;
+	readAhead.SetLoop(true, inLoopStart);
+	readAhead.Seek(0);
+	usleep(50000);
+	
+	SInt64 packet = 0;
+	for (int i = 0; i < 150; i++)
+	{
+		packet += ioPlayer.Read(packet, kBufferBytes, ioPlayer.MaxPackets());
+		if (packet >= count)
+			packet = inLoopStart;
+		usleep(kCallbackMicroseconds);
+	}
+	hits = readAhead.Hits() - hits;
+	misses = readAhead.Misses() - misses;
+	printf("%s straight on: %u hits, %u misses\n", KindName(inKind), (unsigned)hits, (unsigned)misses);
+	Check(ioPlayer.wrong == wrong, "reads straight on and round the loop match the file");
+	Check(misses * 10 < hits, "most reads straight on and round the loop come from the window");
+}
+
+static void PlaySkipping(Player &ioPlayer, FileKind inKind, bool inBackwards)
+{
+	PacketReadAhead &readAhead = *ioPlayer.readAhead;
+	SInt64 count = readAhead.PacketCount();
+	UInt32 hits = readAhead.Hits(), misses = readAhead.Misses(), wrong = ioPlayer.wrong;
+	
+	// as CASound does: half a second of every two seconds, the packet counts worked out before the callback runs
+	SInt64 play = readAhead.PacketForFrame(22050), jump = readAhead.PacketForFrame(88200);
+	if (inBackwards)
+		jump = -jump;
+	SInt64 segment = count / 2, packet = segment;
+	readAhead.SetSkip(segment, play, jump);
+	bool skipping = true;
+	usleep(50000);
+	
+	for (int i = 0; i < 150 && packet < count; i++)
+	{
+		UInt32 maxPackets = ioPlayer.MaxPackets();
+		if (skipping && segment + play - packet < maxPackets)
+			maxPackets = (UInt32)(segment + play - packet);
+		packet += ioPlayer.Read(packet, kBufferBytes, maxPackets);
+		if (skipping && packet == segment + play)
+		{
+			skipping = readAhead.NextSkipSegment(segment, jump);
+			packet = segment;
+			if (!skipping)
+				readAhead.ClearSkip();
+		}
+		usleep(kCallbackMicroseconds);
+	}
+	hits = readAhead.Hits() - hits;
+	misses = readAhead.Misses() - misses;
+	printf("%s skipping %s: %u hits, %u misses\n", KindName(inKind), inBackwards ? "back" : "on  ", (unsigned)hits, (unsigned)misses);
+	Check(ioPlayer.wrong == wrong, "reads skipping match the file");
+	Check(misses * 5 < hits, "most reads skipping come from the window");
+}
+
+static void PlaySeeking(Player &ioPlayer)
+{
+	PacketReadAhead &readAhead = *ioPlayer.readAhead;
+	SInt64 count = readAhead.PacketCount();
+	UInt32 wrong = ioPlayer.wrong;
+	UInt32 seed = 5;
+	for (int i = 0; i < 300; i++)
+	{
+		SInt64 packet = Random(seed) % count;
+		if (i % 3 == 0)
+			readAhead.Seek(packet);
+		ioPlayer.Read(packet, 1 + Random(seed) % kBufferBytes, 1 + Random(seed) % ioPlayer.MaxPackets());
+	}
+	Check(ioPlayer.wrong == wrong, "reads after seeks, of any size, match the file");
+}
+
+static void CheckFrames(Player &ioPlayer)
+{
+	PacketReadAhead &readAhead = *ioPlayer.readAhead;
+	AudioFileID file = ioPlayer.file;
+	SInt64 count = readAhead.PacketCount();
+	
+	UInt32 lookups = file->lookups;
+	SInt64 endFrame = readAhead.FrameForPacket(count);
+	Check(endFrame == file->firstFrames.back(), "the frame of the end of the file is the number of frames in it");
+	Check(file->lookups == lookups, "the frame of the end of the file comes without a lookup");
+	
+	bool same = true;
+	UInt32 seed = 9;
+	for (int i = 0; i < 1000 && same; i++)
+	{
+		SInt64 packet = Random(seed) % count;
+		same = readAhead.FrameForPacket(packet) == file->firstFrames[packet]
+			&& readAhead.PacketForFrame(file->firstFrames[packet] + Random(seed) % file->frames[packet]) == packet;
+	}
+	Check(same, "frames and packets translate both ways");
+}
+
+static void Run(FileKind inKind, SInt64 inPackets)
+{
+	AudioFileID file = MakeFile(inKind, inPackets);
+	{
+		Player player(file);
+		PlayStraight(player, inKind, inPackets / 10);
+		PlaySkipping(player, inKind, false);
+		PlaySkipping(player, inKind, true);
+		double longestWindowed = player.longest;
+		PlaySeeking(player);
+		CheckFrames(player);
+		printf("%s longest read %.2f ms through the window, %.2f ms after seeks\n", KindName(inKind), longestWindowed * 1e3, player.longest * 1e3);
+	}
+	delete file;
+}
+
+int main()
+{
+	Run(kConstantBitRate, 2000000);
+	Run(kVariableBitRate, 6000);
+	Run(kVariableFrames, 6000);
+	printf(failures ? "FAILED\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
@@ -9,14 +9,17 @@
 #import <AVFoundation/AVFoundation.h>
 
 #include "MeterTable.h"
+#include "LevelMeterEngine.h"
 
 #define kPeakFalloffPerSec	.7
 #define kLevelFalloffPerSec .8
 #define kMinDBvalue -80.0
 
-// A LevelMeter subclass which is used specifically for AVAudioPlayer objects
+// A LevelMeter subclass which is used specifically for AVAudioPlayer objects, or for a LevelMeterEngine fed with samples
 @interface CALevelMeter : UIView {
 	AVAudioPlayer				*_player;
+	LevelMeterEngine			*_meterEngine;
+	LevelMeterLevels			*_meterLevels;
 	NSArray						*_channelNumbers;
 	NSArray						*_subLevelMeters;
 	MeterTable					*_meterTable;
@@ -29,8 +32,10 @@
 }
 
 - (void)setPlayer:(AVAudioPlayer*)v;
+- (void)setMeterEngine:(LevelMeterEngine*)v;
 
 @property (readonly)	AVAudioPlayer *player; // The AVAudioPlayer object
+@property (readonly)	LevelMeterEngine *meterEngine; // The engine to read levels from instead of a player. Not owned; its ballistics and peak hold replace the falloff here
 @property (retain)		NSArray *channelNumbers; // Array of NSNumber objects: The indices of the channels to display in this meter
 @property				BOOL showsPeaks; // Whether or not we show peak levels
 @property				BOOL vertical; // Whether the view is oriented V or H
@@ -124,7 +124,7 @@
 	BOOL success = NO;
 
 	// if we have no queue, but still have levels, gradually bring them down
-	if (_player == NULL)
+	if (_player == NULL && _meterEngine == NULL)
 	{
 		CGFloat maxLvl = -1.;
 		CFAbsoluteTime thisFire = CFAbsoluteTimeGetCurrent();
@@ -156,6 +156,22 @@
 		
 		_peakFalloffLastFire = thisFire;
 		success = YES;
+	} else if (_meterEngine != NULL) {
+		// the engine has already applied the meter ballistics and peak hold, so the levels are drawn as they are
+		_meterEngine->GetLevels(_meterLevels);
+		for (int i=0; i<[_channelNumbers count]; i++)
+		{
+			NSInteger channelIdx = [(NSNumber *)[_channelNumbers objectAtIndex:i] intValue];
+			if (channelIdx >= _meterEngine->NumberChannels()) goto bail;
+			
+			LevelMeter *channelView = [_subLevelMeters objectAtIndex:i];
+			channelView.level = _meterTable->ValueAtAmplitude(_meterLevels[channelIdx].meter);
+			if (_showsPeaks) channelView.peakLevel = _meterTable->ValueAtAmplitude(_meterLevels[channelIdx].peakHold);
+			else
+				channelView.peakLevel = 0.;
+			[channelView setNeedsDisplay];
+			success = YES;
+		}
 	} else {
 		[_player updateMeters];
 		for (int i=0; i<[_channelNumbers count]; i++)
@@ -191,6 +207,7 @@ bail:
 	[_channelNumbers release];
 	[_subLevelMeters release];
 	delete _meterTable;
+	free(_meterLevels);
 	
 	[super dealloc];
 }
@@ -233,6 +250,38 @@ bail:
 }
 
 
+- (LevelMeterEngine*)meterEngine { return _meterEngine; }
+- (void)setMeterEngine:(LevelMeterEngine*)v
+{
+	if ((_meterEngine == NULL) && (v != NULL))
+	{
+		if (_updateTimer) [_updateTimer invalidate];
+		_updateTimer = [CADisplayLink displayLinkWithTarget:self selector:@selector(_refresh)];
+		[_updateTimer addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+	} else if ((_meterEngine != NULL) && (v == NULL)) {
+		_peakFalloffLastFire = CFAbsoluteTimeGetCurrent();
+	}
+	
+	_meterEngine = v;
+	
+	free(_meterLevels);
+	_meterLevels = NULL;
+	if (_meterEngine)
+	{
+		_meterLevels = (LevelMeterLevels*)calloc(_meterEngine->NumberChannels(), sizeof(LevelMeterLevels));
+		if (_meterEngine->NumberChannels() != [_channelNumbers count])
+		{
+			NSArray *chan_array;
+			if (_meterEngine->NumberChannels() < 2)
+				chan_array = [[NSArray alloc] initWithObjects:[NSNumber numberWithInt:0], nil];
+			else
+				chan_array = [[NSArray alloc] initWithObjects:[NSNumber numberWithInt:0], [NSNumber numberWithInt:1], nil];
+			[self setChannelNumbers:chan_array];
+			[chan_array release];
+		}
+	}
+}
+
 - (NSArray *)channelNumbers { return _channelNumbers; }
 - (void)setChannelNumbers:(NSArray *)v
 {
@@ -257,7 +306,7 @@ bail:
 
 - (void)resumeTimer
 {
-	if (_player)
+	if (_player || _meterEngine)
 	{
 		_updateTimer = [CADisplayLink displayLinkWithTarget:self selector:@selector(_refresh)];
 		[_updateTimer addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
@@ -47,6 +47,8 @@
  
  */
 
+#include "LevelMeterEngine.h"
+
 @class NSData, NSURL;
 @class CASound;
 
@@ -143,6 +145,12 @@ A negative number will loop indefinitely until stopped.
 */
 @property NSInteger numberOfLoops;
 
+/* "readAheadDuration" is how many seconds of the file are read ahead of playback, on a thread of the sound's own,
+so the queue's buffers are filled from memory rather than from the file. The default is 2 seconds.
+A change takes effect the next time the sound is prepared after being stopped.
+*/
+@property NSTimeInterval readAheadDuration;
+
 /* metering */
 
 @property BOOL enableMetering; /* turns level metering ON or OFF. default is OFF. */
@@ -151,6 +159,10 @@ A negative number will loop indefinitely until stopped.
 The array is owned by the CASound object and its lifetime is the same as that of the CASound object. */
 @property(readonly) CASoundLevels* meters;
 
+/* gets the full set of levels as linear amplitudes: RMS, sample and true peak, peak hold and PPM ballistics.
+Same size and lifetime as meters. Both are measured from the decoded samples by a LevelMeterEngine. */
+@property(readonly) LevelMeterLevels* levelMeters;
+
 
 @end
 
@@ -52,6 +52,8 @@
 
 #import <AudioToolbox/AudioToolbox.h>
 
+#include "PacketReadAhead.h"
+
 NSString* const CASoundFormat_LPCM_8_bit_integer = @"CASoundFormat_LPCM_8_bit_integer";
 NSString* const CASoundFormat_LPCM_16_bit_integer = @"CASoundFormat_LPCM_16_bit_integer";
 NSString* const CASoundFormat_LPCM_24_bit_integer = @"CASoundFormat_LPCM_24_bit_integer";
@@ -76,6 +78,15 @@ static OSStatus CASoundAFReadProc(
 
 static SInt64 CASoundAFGetSizeProc(void * 		inClientData);
 
+static void CASoundAQTapCallback(
+								void *							inClientData,
+								AudioQueueProcessingTapRef		inAQTap,
+								UInt32							inNumberFrames,
+								AudioTimeStamp *				ioTimeStamp,
+								AudioQueueProcessingTapFlags *	ioFlags,
+								UInt32 *						outNumberFrames,
+								AudioBufferList *				ioData);
+
 enum {
 	kNumberOfAudioQueueBuffers = 4
 };
@@ -90,6 +101,8 @@ struct CASoundImpl
 
 	AudioStreamBasicDescription _asbd;
 	AudioFileID _afid;
+	PacketReadAhead* _readAhead;
+	double _readAheadSeconds;
 	AudioQueueRef _queue;
 	SInt64 _readPos;
 	SInt64 _readStartPos;
@@ -112,25 +125,82 @@ struct CASoundImpl
 
 	bool _enableMetering;
 	CASoundLevels* _meters;
+	LevelMeterLevels* _levelMeters;
+	
+	// metering taps the decoded audio rather than asking the queue for its levels
+	AudioQueueProcessingTapRef _tap;
+	AudioStreamBasicDescription _tapFormat;
+	LevelMeterEngine* _meterEngine;
+	bool _tapMeterable;		// false for a tap format the engine can't be fed
+	UInt32 _tapIntegerBytes;	// 2 or 4 when integer samples are converted to float first, otherwise 0
+	float _tapIntegerScale;
+	UInt32 _tapMaxFrames;
+	float* _tapSamples;		// the converted samples, _tapMaxFrames per channel
 	
 	// skip mode
 	float _playSeconds;
 	float _periodLengthSeconds; // negative for rewind
+	SInt64 _skipSegmentStart; // -1 until the callback starts the first segment
+	SInt64 _skipPlayPackets;
+	SInt64 _skipJumpPackets;
 	
 	AudioQueueBufferRef _aqbuf[kNumberOfAudioQueueBuffers];
 	AudioQueueBufferRef _lastBufferEnqueued;
 };
 
+/* works out how the tap's samples reach the meter engine: float as they are, signed integers (including 8.24 fixed
+point) through _tapSamples. any other format is logged here, once, and not metered. */
+static void setUpTapMetering(CASoundImpl* impl, UInt32 inMaxFrames)
+{
+	const AudioStreamBasicDescription& fmt = impl->_tapFormat;
+	UInt32 fractionBits = (fmt.mFormatFlags & kLinearPCMFormatFlagsSampleFractionMask) >> kLinearPCMFormatFlagsSampleFractionShift;
+	bool nativeEndian = (fmt.mFormatFlags & kAudioFormatFlagIsBigEndian) == kAudioFormatFlagsNativeEndian;
+	
+	impl->_tapMeterable = false;
+	impl->_tapIntegerBytes = 0;
+	if (fmt.mFormatID != kAudioFormatLinearPCM || !nativeEndian) {
+		// not something the engine can read
+	} else if ((fmt.mFormatFlags & kAudioFormatFlagIsFloat) && fmt.mBitsPerChannel == 32) {
+		impl->_tapMeterable = true;
+	} else if ((fmt.mFormatFlags & kAudioFormatFlagIsSignedInteger) && (fmt.mBitsPerChannel == 16 || fmt.mBitsPerChannel == 32)) {
+		impl->_tapIntegerBytes = fmt.mBitsPerChannel / 8;
+		impl->_tapIntegerScale = ldexpf(1.f, -(int)(fractionBits ? fractionBits : fmt.mBitsPerChannel - 1));
+		impl->_tapMaxFrames = inMaxFrames;
+		impl->_tapSamples = (float*)malloc(inMaxFrames * fmt.mChannelsPerFrame * sizeof(float));
+		impl->_tapMeterable = (impl->_tapSamples != NULL);
+	}
+	if (!impl->_tapMeterable)
+		NSLog(@"CASound: can't meter the tap format (flags 0x%x, %u bits), levels will read as silence", (unsigned)fmt.mFormatFlags, (unsigned)fmt.mBitsPerChannel);
+}
+
+/* the read-ahead is made the first time it's needed and goes when the queue is disposed of */
+static PacketReadAhead* getReadAhead(CASoundImpl* impl)
+{
+	if (!impl->_readAhead && impl->_afid) {
+		impl->_readAhead = new PacketReadAhead(impl->_afid, impl->_readAheadSeconds);
+		impl->_readAhead->SetLoop(impl->_numLoops != 0, impl->_readStartPos);
+		impl->_readAhead->Seek(impl->_readPos);
+	}
+	return impl->_readAhead;
+}
+
 static OSStatus allocAudioQueue(CASound* myself, CASoundImpl* impl)
 {
 	if (impl->_queue) return noErr;
 	
+	if (!getReadAhead(impl)) return -50/*paramErr*/;
+	
 	OSStatus err = AudioQueueNewOutput(&impl->_asbd, CASoundAQOutputCallback, myself, NULL, NULL, 0, &impl->_queue);
 	if (err) return err;
 	
-	if (impl->_enableMetering) {
-		UInt32 iflag = true;
-		AudioQueueSetProperty(impl->_queue, kAudioQueueProperty_EnableLevelMetering, &iflag, sizeof(iflag));
+	// a siphon only looks at the audio on its way out, the callback skips it unless metering is on
+	UInt32 maxFrames = 0;
+	err = AudioQueueProcessingTapNew(impl->_queue, CASoundAQTapCallback, impl, kAudioQueueProcessingTap_PostEffects | kAudioQueueProcessingTap_Siphon,
+									 &maxFrames, &impl->_tapFormat, &impl->_tap);
+	if (err == noErr) {
+		setUpTapMetering(impl, maxFrames);
+		if (!impl->_meterEngine)
+			impl->_meterEngine = new LevelMeterEngine(impl->_tapFormat.mChannelsPerFrame, impl->_tapFormat.mSampleRate);
 	}
 	
 	AudioQueueAddPropertyListener(impl->_queue, kAudioQueueProperty_IsRunning, CASoundAQPropertyListenerProc, myself);
@@ -159,6 +229,9 @@ static OSStatus stopQueue(CASoundImpl* impl)
 	impl->_queueStartSampleTime = 0.;
 	impl->_mediaSampleTime = impl->_mediaStartSampleTime;
 	impl->_readPos = impl->_readStartPos;
+	impl->_skipSegmentStart = -1;
+	impl->_readAhead->ClearSkip();
+	impl->_readAhead->Seek(impl->_readPos);
 	OSMemoryBarrier();
 	return err;
 }
@@ -171,8 +244,17 @@ static OSStatus disposeQueue(CASound* myself, CASoundImpl* impl)
 	AudioQueueRemovePropertyListener(impl->_queue, kAudioQueueProperty_IsRunning, CASoundAQPropertyListenerProc, myself);
 	impl->_isStopping = true;
 	OSMemoryBarrier(); // make sure _isStopping is written
+	if (impl->_tap) {
+		AudioQueueProcessingTapDispose(impl->_tap);
+		impl->_tap = NULL;
+	}
+	free(impl->_tapSamples);
+	impl->_tapSamples = NULL;
+	impl->_tapMeterable = false;
 	OSStatus err = AudioQueueDispose(impl->_queue, true);
 	impl->_queue = NULL;
+	delete impl->_readAhead;
+	impl->_readAhead = NULL;
 	impl->_wasStarted = false;
 	impl->_isPlaying = false;
 	impl->_isSkipping = false;
@@ -194,6 +276,72 @@ static double getQueueTime(CASoundImpl* impl)
 	return impl->_queueSampleTime = timeStamp.mSampleTime;
 }
 
+/* caller's thread, when skip mode is turned on. works out the segment lengths in packets up front, since for a
+variable frames per packet format that takes a file lookup the callback mustn't wait on */
+static void setUpSkipping(CASoundImpl* impl, double playSeconds, double periodSeconds)
+{
+	impl->_playSeconds = playSeconds;
+	impl->_periodLengthSeconds = periodSeconds;
+	impl->_skipSegmentStart = -1; // the callback starts a new pattern from where it's reading
+	PacketReadAhead* readAhead = getReadAhead(impl);
+	if (readAhead) {
+		double sampleRate = impl->_asbd.mSampleRate;
+		SInt64 playPackets = readAhead->PacketForFrame((SInt64)(playSeconds * sampleRate));
+		SInt64 jumpPackets = readAhead->PacketForFrame((SInt64)(fabs(periodSeconds) * sampleRate));
+		impl->_skipPlayPackets = playPackets > 0 ? playPackets : 1;
+		impl->_skipJumpPackets = jumpPackets > 0 ? jumpPackets : 1;
+		if (periodSeconds < 0) impl->_skipJumpPackets = -impl->_skipJumpPackets;
+	}
+	OSMemoryBarrier();
+	impl->_isSkipping = true;
+}
+
+/* callback thread. starts a skip pattern from the read position when skip mode is turned on, and tells the
+read-ahead when it's turned off again */
+static void updateSkipping(CASoundImpl* impl)
+{
+	PacketReadAhead* readAhead = impl->_readAhead;
+	if (impl->_isSkipping) {
+		if (impl->_skipSegmentStart >= 0) return;
+		impl->_skipSegmentStart = impl->_readPos;
+		readAhead->SetSkip(impl->_skipSegmentStart, impl->_skipPlayPackets, impl->_skipJumpPackets);
+	} else if (impl->_skipSegmentStart >= 0) {
+		impl->_skipSegmentStart = -1;
+		readAhead->ClearSkip();
+	}
+}
+
+/* how many of maxPackets to read so as not to run past the end of the skip segment */
+static UInt32 packetsLeftInSkipSegment(CASoundImpl* impl, UInt32 maxPackets)
+{
+	if (impl->_skipSegmentStart < 0) return maxPackets;
+	SInt64 left = impl->_skipSegmentStart + impl->_skipPlayPackets - impl->_readPos;
+	if (left < 0) left = 0;
+	return left < maxPackets ? (UInt32)left : maxPackets;
+}
+
+/* callback thread, at the end of a skip segment. skip mode ends where the next segment would start outside the
+file, the same as in the read-ahead */
+static void startNextSkipSegment(CASoundImpl* impl)
+{
+	SInt64 segmentStart = impl->_skipSegmentStart;
+	if (impl->_readAhead->NextSkipSegment(segmentStart, impl->_skipJumpPackets)) {
+		impl->_skipSegmentStart = segmentStart;
+	} else {
+		impl->_isSkipping = false;
+		impl->_skipSegmentStart = -1;
+	}
+	impl->_readPos = segmentStart;
+}
+
+/* callback thread, at the end of the file. skip mode ends here too, as it does in the read-ahead */
+static void endSkipping(CASoundImpl* impl)
+{
+	if (impl->_skipSegmentStart < 0) return;
+	impl->_isSkipping = false;
+	impl->_skipSegmentStart = -1;
+}
+
 @implementation CASound
 
 + (CASound*)soundWithContentsOfURL:(NSURL *)url
@@ -228,8 +376,11 @@ static double getQueueTime(CASoundImpl* impl)
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
 		disposeQueue(self, impl);
+		delete impl->_readAhead;
 		if (impl->_afid) AudioFileClose(impl->_afid);
 		free(impl->_meters);
+		free(impl->_levelMeters);
+		delete impl->_meterEngine;
 		free(_impl);
 	}
 	[super finalize];
@@ -240,8 +391,11 @@ static double getQueueTime(CASoundImpl* impl)
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
 		disposeQueue(self, impl);
+		delete impl->_readAhead;
 		if (impl->_afid) AudioFileClose(impl->_afid);
 		free(impl->_meters);
+		free(impl->_levelMeters);
+		delete impl->_meterEngine;
 		[impl->_data release];
 		[impl->_url release];
 		[impl->_delegate release];
@@ -262,6 +416,8 @@ static double getQueueTime(CASoundImpl* impl)
 
 	impl->_mediaEndSampleTime = 1e100;
 	impl->_volume = 1.0;
+	impl->_readAheadSeconds = 2.0;
+	impl->_skipSegmentStart = -1;
 
 	return self;
 }
@@ -422,10 +578,7 @@ static double getQueueTime(CASoundImpl* impl)
 	OSStatus err = noErr;
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
-		impl->_isSkipping = true;
-		impl->_playSeconds = playSeconds;
-		impl->_periodLengthSeconds = periodSeconds;
-		
+		setUpSkipping(impl, playSeconds, periodSeconds);
 	}
 	return err == noErr;
 }
@@ -436,10 +589,7 @@ static double getQueueTime(CASoundImpl* impl)
 	OSStatus err = noErr;
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
-		impl->_isSkipping = true;
-		impl->_playSeconds = playSeconds;
-		impl->_periodLengthSeconds = -periodSeconds;
-		
+		setUpSkipping(impl, playSeconds, -periodSeconds);
 	}
 	return err == noErr;
 }
@@ -613,10 +763,13 @@ static double getQueueTime(CASoundImpl* impl)
 {
 	CASoundImpl* impl = (CASoundImpl*)_impl;
 	@synchronized(self) {
-		double packetsPerSecond = impl->_asbd.mSampleRate / impl->_asbd.mFramesPerPacket;
-		impl->_readStartPos = (SInt64)floor(seconds * packetsPerSecond + .5);
+		PacketReadAhead* readAhead = getReadAhead(impl);
+		if (!readAhead) return;
+		impl->_readStartPos = readAhead->PacketForFrame((SInt64)floor(seconds * impl->_asbd.mSampleRate + .5));
 		impl->_readPos = impl->_readStartPos;
-		impl->_mediaStartSampleTime = impl->_readPos * impl->_asbd.mFramesPerPacket;
+		impl->_mediaStartSampleTime = readAhead->FrameForPacket(impl->_readPos);
+		readAhead->SetLoop(impl->_numLoops != 0, impl->_readStartPos);
+		readAhead->Seek(impl->_readPos);
 		if (impl->_wasStarted || impl->_wasCued) {
 			if (impl->_isPlaying) {
 				stopQueue(impl);
@@ -639,7 +792,10 @@ static double getQueueTime(CASoundImpl* impl)
 - (void)setNumberOfLoops:(NSInteger)numLoops
 {
 	CASoundImpl* impl = (CASoundImpl*)_impl;
-	impl->_numLoops = numLoops;		
+	@synchronized(self) {
+		impl->_numLoops = numLoops;
+		if (impl->_readAhead) impl->_readAhead->SetLoop(numLoops != 0, impl->_readStartPos);
+	}
 }
 
 /* Returns whether the sound will automatically restart when it is finished playing. */
@@ -649,6 +805,27 @@ static double getQueueTime(CASoundImpl* impl)
 	return impl->_numLoops;
 }
 
+@dynamic readAheadDuration;
+
+/* Sets how many seconds of the file are read ahead of playback. A queue that's already running keeps the read-ahead it has until it's stopped.
+*/
+- (void)setReadAheadDuration:(NSTimeInterval)seconds
+{
+	CASoundImpl* impl = (CASoundImpl*)_impl;
+	@synchronized(self) {
+		impl->_readAheadSeconds = seconds;
+		if (!impl->_queue) {
+			delete impl->_readAhead;
+			impl->_readAhead = NULL;
+		}
+	}
+}
+
+- (NSTimeInterval)readAheadDuration
+{
+	return ((CASoundImpl*)_impl)->_readAheadSeconds;
+}
+
 
 - (NSData*)data
 {
@@ -676,7 +853,7 @@ static double getQueueTime(CASoundImpl* impl)
 - (void)queue: (AudioQueueRef)inAQ buffer: (AudioQueueBufferRef)inBuffer
 {
 	CASoundImpl* impl = (CASoundImpl*)_impl;
-	if (impl->_isStopping) 
+	if (impl->_isStopping || !impl->_readAhead) 
 		return;
 	
 	if (impl->_outOfData && impl->_lastBufferEnqueued == inBuffer) {	
@@ -693,6 +870,10 @@ static double getQueueTime(CASoundImpl* impl)
 		}
 	}
 	
+	// the packets come from memory filled by the read-ahead's thread, not from the file
+	PacketReadAhead* readAhead = impl->_readAhead;
+	updateSkipping(impl);
+	
 	if (impl->_asbd.mBytesPerPacket) {
 		UInt32 bytesToFill = inBuffer->mAudioDataBytesCapacity;
 		UInt32 packetsToFill = inBuffer->mAudioDataBytesCapacity / impl->_asbd.mBytesPerPacket;
@@ -702,8 +883,10 @@ static double getQueueTime(CASoundImpl* impl)
 		while (true) {
 		
 			UInt32 ioNumBytes = bytesToFill;
-			UInt32 ioNumPackets = packetsToFill;
-			OSStatus err = AudioFileReadPackets(impl->_afid, false, &ioNumBytes, NULL, impl->_readPos, &ioNumPackets, fillPtr);
+			UInt32 ioNumPackets = packetsLeftInSkipSegment(impl, packetsToFill);
+			UInt32 packetsRequested = ioNumPackets;
+			bool segmentEnds = packetsRequested < packetsToFill;
+			OSStatus err = readAhead->ReadPackets(impl->_readPos, &ioNumBytes, NULL, &ioNumPackets, fillPtr);
 			if (err) 
 				return;
 		
@@ -713,7 +896,14 @@ static double getQueueTime(CASoundImpl* impl)
 			packetsToFill -= ioNumPackets;
 			impl->_readPos += ioNumPackets;
 			
+			if (segmentEnds && ioNumPackets == packetsRequested) {
+				startNextSkipSegment(impl);
+				if (packetsToFill != 0) continue;
+				break;
+			}
+			
 			if (packetsToFill != 0) {
+				endSkipping(impl);
 				if (impl->_numLoops < 0 || impl->_loopCount+1 < impl->_numLoops) {
 					impl->_loopCount++;
 					if (impl->_readPos == impl->_readStartPos) {
@@ -724,7 +914,7 @@ static double getQueueTime(CASoundImpl* impl)
 					impl->_readPos = impl->_readStartPos;
 				} else {
 					impl->_outOfData = true;
-					impl->_mediaEndSampleTime = impl->_readPos * impl->_asbd.mFramesPerPacket;
+					impl->_mediaEndSampleTime = readAhead->FrameForPacket(impl->_readPos);
 					break;
 				}
 			} else {
@@ -743,20 +933,26 @@ static double getQueueTime(CASoundImpl* impl)
 		const size_t kNumPacketDescs = 512;
 		AudioStreamPacketDescription descs[kNumPacketDescs];
 		UInt32 ioNumBytes = inBuffer->mAudioDataBytesCapacity;
-		UInt32 ioNumPackets = kNumPacketDescs;
-		OSStatus err = AudioFileReadPackets(impl->_afid, false, &ioNumBytes, descs, impl->_readPos, &ioNumPackets, inBuffer->mAudioData);
+		UInt32 ioNumPackets = packetsLeftInSkipSegment(impl, kNumPacketDescs);
+		UInt32 packetsRequested = ioNumPackets;
+		bool segmentEnds = packetsRequested < kNumPacketDescs;
+		OSStatus err = readAhead->ReadPackets(impl->_readPos, &ioNumBytes, descs, &ioNumPackets, inBuffer->mAudioData);
 		if (err) 
 			return;
 		
 		impl->_readPos += ioNumPackets;
 		inBuffer->mAudioDataByteSize = ioNumBytes;
+		if (segmentEnds && ioNumPackets == packetsRequested) {
+			startNextSkipSegment(impl);
+		}
 
 		if (ioNumPackets) {
 			impl->_lastBufferEnqueued = inBuffer;
 			err = AudioQueueEnqueueBuffer(impl->_queue, inBuffer, ioNumPackets, descs);
 		} else {
+			endSkipping(impl);
 			impl->_outOfData = true;
-			impl->_mediaEndSampleTime = impl->_readPos * impl->_asbd.mFramesPerPacket;
+			impl->_mediaEndSampleTime = readAhead->FrameForPacket(impl->_readPos);
 		}
 	}
 }
@@ -774,16 +970,34 @@ static double getQueueTime(CASoundImpl* impl)
 {
 	@synchronized(self) {
 		CASoundImpl* impl = (CASoundImpl*)_impl;
+		// posted before metering is on, so the tap's first block starts from silence
+		if (flag && impl->_meterEngine) impl->_meterEngine->Reset();
 		impl->_enableMetering = flag;
-		if (impl->_queue) {
-			UInt32 iflag = flag;
-			AudioQueueSetProperty(impl->_queue, kAudioQueueProperty_EnableLevelMetering, &iflag, sizeof(iflag));
-		}
 	}
 }
 
 @dynamic meters;
 
+static float linearToDecibels(float amp)
+{
+	return (amp > 0.f) ? 20.f * log10f(amp) : -120.f;
+}
+
+/* reads the newest levels from the meter engine into _levelMeters, zeros if there's nothing to meter.
+must be called with the sound locked, which also makes it the engine's one reader. */
+static void updateLevelMeters(CASoundImpl* impl)
+{
+	UInt32 numChannels = impl->_asbd.mChannelsPerFrame;
+	if (!impl->_levelMeters) {
+		impl->_levelMeters = (LevelMeterLevels*)calloc(numChannels, sizeof(LevelMeterLevels));
+	}
+	if (impl->_queue && impl->_enableMetering && impl->_meterEngine && impl->_meterEngine->NumberChannels() >= numChannels) {
+		impl->_meterEngine->GetLevels(impl->_levelMeters);
+	} else {
+		memset(impl->_levelMeters, 0, sizeof(LevelMeterLevels) * numChannels);
+	}
+}
+
 - (CASoundLevels*)meters
 {
 	CASoundLevels* result = NULL;
@@ -793,20 +1007,29 @@ static double getQueueTime(CASoundImpl* impl)
 		if (!impl->_meters) {
 			impl->_meters = (CASoundLevels*)calloc(numChannels, sizeof(CASoundLevels));
 		}
-		if (impl->_queue && impl->_enableMetering) {
-			UInt32 propSize = sizeof(CASoundLevels) * numChannels;
-			OSStatus err = AudioQueueGetProperty(impl->_queue, kAudioQueueProperty_CurrentLevelMeterDB, impl->_meters, &propSize);
-			if (err) {
-				memset(impl->_meters, 0, sizeof(float) * numChannels);
-			}
-		} else {
-			memset(impl->_meters, 0, sizeof(float) * numChannels);
+		updateLevelMeters(impl);
+		for (UInt32 i = 0; i < numChannels; ++i) {
+			impl->_meters[i].averagePower = linearToDecibels(impl->_levelMeters[i].rms);
+			impl->_meters[i].peakPower = linearToDecibels(impl->_levelMeters[i].peak);
 		}
 		result = impl->_meters;
 	}
 	return result;
 }
 
+@dynamic levelMeters;
+
+- (LevelMeterLevels*)levelMeters
+{
+	LevelMeterLevels* result = NULL;
+	@synchronized(self) {
+		CASoundImpl* impl = (CASoundImpl*)_impl;
+		updateLevelMeters(impl);
+		result = impl->_levelMeters;
+	}
+	return result;
+}
+
 
 @end
 
@@ -831,6 +1054,59 @@ static void CASoundAQOutputCallback(
 	[sound queue: inAQ buffer: inBuffer];
 }
 
+static void integerSamplesToFloat(const CASoundImpl* impl, const void* inSamples, float* outSamples, UInt32 inCount)
+{
+	float scale = impl->_tapIntegerScale;
+	if (impl->_tapIntegerBytes == 2) {
+		const SInt16* in = (const SInt16*)inSamples;
+		for (UInt32 i = 0; i < inCount; ++i) outSamples[i] = in[i] * scale;
+	} else {
+		const SInt32* in = (const SInt32*)inSamples;
+		for (UInt32 i = 0; i < inCount; ++i) outSamples[i] = in[i] * scale;
+	}
+}
+
+/* runs on the queue's thread with each buffer of decoded audio. the engine only needs the samples, so a
+siphon tap leaves ioData as it is. */
+static void CASoundAQTapCallback(
+								void *							inClientData,
+								AudioQueueProcessingTapRef		inAQTap,
+								UInt32							inNumberFrames,
+								AudioTimeStamp *				ioTimeStamp,
+								AudioQueueProcessingTapFlags *	ioFlags,
+								UInt32 *						outNumberFrames,
+								AudioBufferList *				ioData)
+{
+	CASoundImpl* impl = (CASoundImpl*)inClientData;
+	*outNumberFrames = inNumberFrames;
+	if (!impl->_enableMetering || !impl->_meterEngine || !impl->_tapMeterable)
+		return;
+	if (impl->_tapIntegerBytes && inNumberFrames > impl->_tapMaxFrames)
+		return;
+	
+	if (impl->_tapFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved) {
+		const size_t kMaxChannels = 16;
+		const float* channels[kMaxChannels];
+		if (ioData->mNumberBuffers < impl->_meterEngine->NumberChannels() || ioData->mNumberBuffers > kMaxChannels)
+			return;
+		for (UInt32 i = 0; i < ioData->mNumberBuffers; ++i) {
+			if (impl->_tapIntegerBytes) {
+				float* samples = impl->_tapSamples + i * impl->_tapMaxFrames;
+				integerSamplesToFloat(impl, ioData->mBuffers[i].mData, samples, inNumberFrames);
+				channels[i] = samples;
+			} else {
+				channels[i] = (const float*)ioData->mBuffers[i].mData;
+			}
+		}
+		impl->_meterEngine->Process(channels, inNumberFrames);
+	} else if (impl->_tapIntegerBytes) {
+		integerSamplesToFloat(impl, ioData->mBuffers[0].mData, impl->_tapSamples, inNumberFrames * impl->_tapFormat.mChannelsPerFrame);
+		impl->_meterEngine->ProcessInterleaved(impl->_tapSamples, inNumberFrames);
+	} else {
+		impl->_meterEngine->ProcessInterleaved((const float*)ioData->mBuffers[0].mData, inNumberFrames);
+	}
+}
+
 static OSStatus CASoundAFReadProc(
 								void *		inClientData,
 								SInt64		inPosition, 
@@ -0,0 +1,271 @@
+/*
+
+    File: LevelMeterEngine.cpp
+Abstract: Block based level metering with true peak, peak hold and meter ballistics
+ Version: 1.4.3
+
+Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+Inc. ("Apple") in consideration of your agreement to the following
+terms, and your use, installation, modification or redistribution of
+this Apple software constitutes acceptance of these terms.  If you do
+not agree with these terms, please do not use, install, modify or
+redistribute this Apple software.
+
+In consideration of your agreement to abide by the following terms, and
+subject to these terms, Apple grants you a personal, non-exclusive
+license, under Apple's copyrights in this original Apple software (the
+"Apple Software"), to use, reproduce, modify and redistribute the Apple
+Software, with or without modifications, in source and/or binary forms;
+provided that if you redistribute the Apple Software in its entirety and
+without modifications, you must retain this notice and the following
+text and disclaimers in all such redistributions of the Apple Software.
+Neither the name, trademarks, service marks or logos of Apple Inc. may
+be used to endorse or promote products derived from the Apple Software
+without specific prior written permission from Apple.  Except as
+expressly stated in this notice, no other rights or licenses, express or
+implied, are granted by Apple herein, including but not limited to any
+patent rights that may be infringed by your derivative works or by other
+works in which the Apple Software may be incorporated.
+
+The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+
+IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+Copyright (C) 2014 Apple Inc. All Rights Reserved.
+
+
+*/
+
+#include "LevelMeterEngine.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "MeterVec4.h"
+
+// ____________________________________________________________________________
+//
+enum {
+	kTapsPerPhase = 12,					// 48 tap, 4x interpolator, as in ITU-R BS.1770
+	kHistory = kTapsPerPhase - 1,
+	kChunkFrames = 256,					// ballistics are stepped once per chunk, about 5 ms
+	kFresh = 4
+};
+
+static const double kRMSSeconds = 0.3;
+static const double kVUSeconds = 0.3 / 4.605;			// reaches 99% in 300 ms
+static const double kPPMAttackSeconds = 0.005;
+static const double kPPMFalloffDecibelsPerSecond = 20. / 1.5;
+static const double kHoldFalloffDecibelsPerSecond = 20.;
+
+struct LevelMeterEngine::Channel {
+	float	work[kHistory + kChunkFrames + 3];	// the last kHistory samples, then the chunk, then padding to a whole vector
+	double	meanSquare;
+	float	meter;
+	float	hold;
+	size_t	holdRemaining;
+};
+
+static inline double DecibelsToGain(double inDecibels)
+{
+	return pow(10., 0.05 * inDecibels);
+}
+
+LevelMeterEngine::LevelMeterEngine(size_t inNumberChannels, double inSampleRate, Ballistics inBallistics, double inPeakHoldSeconds)
+	: mNumberChannels(inNumberChannels),
+	mSampleRate(inSampleRate),
+	mBallistics(inBallistics),
+	mHoldFrames((size_t)(inPeakHoldSeconds * inSampleRate)),
+	mWriteIndex(0),
+	mReadIndex(1),
+	mShared(2),
+	mResetRequests(0),
+	mResetsHandled(0)
+{
+	mChannels = (Channel*)calloc(inNumberChannels, sizeof(Channel));
+	mPending = (LevelMeterLevels*)calloc(inNumberChannels, sizeof(LevelMeterLevels));
+	for (int i = 0; i < 3; ++i)
+		mSnapshots[i] = (LevelMeterLevels*)calloc(inNumberChannels, sizeof(LevelMeterLevels));
+
+	// a Kaiser windowed sinc at the original Nyquist, each phase normalised to unity gain so a DC input
+	// reads the same oversampled or not
+	const size_t kTaps = 4 * kTapsPerPhase;
+	const double kBeta = 5.;
+	double h[kTaps];
+	double center = (kTaps - 1) * 0.5;
+	double i0Beta = 1., term = 1.;
+	for (int k = 1; k < 25; ++k) { term *= (kBeta * 0.5 / k) * (kBeta * 0.5 / k); i0Beta += term; }
+	for (size_t i = 0; i < kTaps; ++i) {
+		double t = (i - center) / 4.;
+		double sinc = (t == 0.) ? 1. : sin(M_PI * t) / (M_PI * t);
+		double r = (i - center) / (center + 0.5);
+		double x = kBeta * sqrt(1. - r * r), i0 = 1.;
+		term = 1.;
+		for (int k = 1; k < 25; ++k) { term *= (x * 0.5 / k) * (x * 0.5 / k); i0 += term; }
+		h[i] = sinc * i0 / i0Beta;
+	}
+	mCoefficients = (float*)malloc(4 * kTaps * sizeof(float));
+	for (size_t phase = 0; phase < 4; ++phase) {
+		double sum = 0.;
+		for (size_t k = 0; k < kTapsPerPhase; ++k) sum += h[4 * k + phase];
+		for (size_t k = 0; k < kTapsPerPhase; ++k)
+			for (size_t lane = 0; lane < 4; ++lane)
+				mCoefficients[16 * k + 4 * phase + lane] = h[4 * k + phase] / sum;
+	}
+}
+
+LevelMeterEngine::~LevelMeterEngine()
+{
+	free(mChannels);
+	free(mPending);
+	for (int i = 0; i < 3; ++i)
+		free(mSnapshots[i]);
+	free(mCoefficients);
+}
+
+void LevelMeterEngine::Reset()
+{
+	__atomic_fetch_add(&mResetRequests, 1, __ATOMIC_RELEASE);
+}
+
+void LevelMeterEngine::HandleResetRequests()
+{
+	unsigned requests = __atomic_load_n(&mResetRequests, __ATOMIC_ACQUIRE);
+	if (requests != mResetsHandled) {
+		mResetsHandled = requests;
+		memset(mChannels, 0, mNumberChannels * sizeof(Channel));
+	}
+}
+
+void LevelMeterEngine::Process(const float * const *inChannels, size_t inNumberFrames)
+{
+	HandleResetRequests();
+	for (size_t ch = 0; ch < mNumberChannels; ++ch) {
+		memset(&mPending[ch], 0, sizeof(LevelMeterLevels));
+		ProcessChannel(mChannels[ch], inChannels[ch], 1, inNumberFrames, mPending[ch]);
+	}
+	Publish(mPending);
+}
+
+void LevelMeterEngine::ProcessInterleaved(const float *inSamples, size_t inNumberFrames)
+{
+	HandleResetRequests();
+	for (size_t ch = 0; ch < mNumberChannels; ++ch) {
+		memset(&mPending[ch], 0, sizeof(LevelMeterLevels));
+		ProcessChannel(mChannels[ch], inSamples + ch, mNumberChannels, inNumberFrames, mPending[ch]);
+	}
+	Publish(mPending);
+}
+
+// Each chunk is copied in behind the filter history, which also deinterleaves it, and then read once: the sample
+// statistics and the interpolated values of each phase, four frames at a time.
+void LevelMeterEngine::ProcessChannel(Channel &ioChannel, const float *inSamples, size_t inStride, size_t inNumberFrames, LevelMeterLevels &ioLevels)
+{
+	const Vec4 kZero = VSplat(0.f);
+	float peak = 0.f, truePeak = 0.f;
+
+	while (inNumberFrames) {
+		size_t frames = (inNumberFrames < kChunkFrames) ? inNumberFrames : kChunkFrames;
+		float *chunk = ioChannel.work + kHistory;
+		if (inStride == 1)
+			memcpy(chunk, inSamples, frames * sizeof(float));
+		else
+			for (size_t i = 0; i < frames; ++i) chunk[i] = inSamples[i * inStride];
+		for (size_t i = frames; i < ((frames + 3) & ~3); ++i) chunk[i] = 0.f;
+
+		Vec4 sumSquares = kZero, peaks = kZero, truePeaks = kZero;
+		for (size_t n = 0; n < frames; n += 4) {
+			Vec4 x = VLoad(chunk + n);
+			sumSquares = VMulAdd(sumSquares, x, x);
+			peaks = VMax(peaks, VAbs(x));
+
+			// four independent sums, so the multiply-adds pipeline
+			Vec4 y0 = kZero, y1 = kZero, y2 = kZero, y3 = kZero;
+			for (size_t k = 0; k < kTapsPerPhase; ++k) {
+				Vec4 delayed = VLoad(chunk + n - k);
+				const float *c = mCoefficients + 16 * k;
+				y0 = VMulAdd(y0, VLoad(c), delayed);
+				y1 = VMulAdd(y1, VLoad(c + 4), delayed);
+				y2 = VMulAdd(y2, VLoad(c + 8), delayed);
+				y3 = VMulAdd(y3, VLoad(c + 12), delayed);
+			}
+			Vec4 y = VMax(VMax(VAbs(y0), VAbs(y1)), VMax(VAbs(y2), VAbs(y3)));
+			if (frames - n < 4) {
+				// the padding past the end of the chunk doesn't count
+				const float kLanes[7] = { 1.f, 1.f, 1.f, 0.f, 0.f, 0.f, 0.f };
+				y = VMul(y, VLoad(kLanes + 3 - (frames - n)));
+			}
+			truePeaks = VMax(truePeaks, y);
+		}
+		memmove(ioChannel.work, chunk + frames - kHistory, kHistory * sizeof(float));
+
+		float chunkPeak = VMaxAcross(peaks);
+		float chunkTruePeak = fmaxf(VMaxAcross(truePeaks), chunkPeak);
+		double chunkMeanSquare = VSumAcross(sumSquares) / frames;
+		double seconds = frames / mSampleRate;
+
+		ioChannel.meanSquare += (chunkMeanSquare - ioChannel.meanSquare) * (1. - exp(-seconds / kRMSSeconds));
+
+		if (mBallistics == kBallistics_VU) {
+			float rms = sqrtf((float)chunkMeanSquare);
+			ioChannel.meter += (rms - ioChannel.meter) * (float)(1. - exp(-seconds / kVUSeconds));
+		} else if (chunkPeak > ioChannel.meter) {
+			ioChannel.meter += (chunkPeak - ioChannel.meter) * (float)(1. - exp(-seconds / kPPMAttackSeconds));
+		} else {
+			ioChannel.meter = fmaxf(chunkPeak, ioChannel.meter * (float)DecibelsToGain(-kPPMFalloffDecibelsPerSecond * seconds));
+		}
+
+		if (chunkTruePeak >= ioChannel.hold) {
+			ioChannel.hold = chunkTruePeak;
+			ioChannel.holdRemaining = mHoldFrames;
+		} else if (ioChannel.holdRemaining > frames) {
+			ioChannel.holdRemaining -= frames;
+		} else {
+			ioChannel.holdRemaining = 0;
+			ioChannel.hold = fmaxf(chunkTruePeak, ioChannel.hold * (float)DecibelsToGain(-kHoldFalloffDecibelsPerSecond * seconds));
+		}
+
+		peak = fmaxf(peak, chunkPeak);
+		truePeak = fmaxf(truePeak, chunkTruePeak);
+		inSamples += frames * inStride;
+		inNumberFrames -= frames;
+	}
+
+	ioLevels.rms = sqrtf((float)ioChannel.meanSquare);
+	ioLevels.peak = peak;
+	ioLevels.truePeak = truePeak;
+	ioLevels.peakHold = ioChannel.hold;
+	ioLevels.meter = ioChannel.meter;
+}
+
+// The writer fills its own buffer and swaps it for the shared one; the reader swaps its buffer for the shared one
+// only when it's fresh. Each side owns the buffer it holds, so neither ever waits for the other.
+void LevelMeterEngine::Publish(const LevelMeterLevels *inLevels)
+{
+	memcpy(mSnapshots[mWriteIndex], inLevels, mNumberChannels * sizeof(LevelMeterLevels));
+	int previous = __atomic_exchange_n(&mShared, mWriteIndex | kFresh, __ATOMIC_ACQ_REL);
+	mWriteIndex = previous & ~kFresh;
+}
+
+bool LevelMeterEngine::GetLevels(LevelMeterLevels *outLevels)
+{
+	bool fresh = (__atomic_load_n(&mShared, __ATOMIC_ACQUIRE) & kFresh) != 0;
+	if (fresh) {
+		int previous = __atomic_exchange_n(&mShared, mReadIndex, __ATOMIC_ACQ_REL);
+		mReadIndex = previous & ~kFresh;
+	}
+	memcpy(outLevels, mSnapshots[mReadIndex], mNumberChannels * sizeof(LevelMeterLevels));
+	return fresh;
+}
@@ -0,0 +1,123 @@
+/*
+
+    File: LevelMeterEngine.h
+Abstract: Block based level metering with true peak, peak hold and meter ballistics
+ Version: 1.4.3
+
+Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+Inc. ("Apple") in consideration of your agreement to the following
+terms, and your use, installation, modification or redistribution of
+this Apple software constitutes acceptance of these terms.  If you do
+not agree with these terms, please do not use, install, modify or
+redistribute this Apple software.
+
+In consideration of your agreement to abide by the following terms, and
+subject to these terms, Apple grants you a personal, non-exclusive
+license, under Apple's copyrights in this original Apple software (the
+"Apple Software"), to use, reproduce, modify and redistribute the Apple
+Software, with or without modifications, in source and/or binary forms;
+provided that if you redistribute the Apple Software in its entirety and
+without modifications, you must retain this notice and the following
+text and disclaimers in all such redistributions of the Apple Software.
+Neither the name, trademarks, service marks or logos of Apple Inc. may
+be used to endorse or promote products derived from the Apple Software
+without specific prior written permission from Apple.  Except as
+expressly stated in this notice, no other rights or licenses, express or
+implied, are granted by Apple herein, including but not limited to any
+patent rights that may be infringed by your derivative works or by other
+works in which the Apple Software may be incorporated.
+
+The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+
+IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+Copyright (C) 2014 Apple Inc. All Rights Reserved.
+
+
+*/
+
+#ifndef __LevelMeterEngine_h__
+#define __LevelMeterEngine_h__
+
+#include <stddef.h>
+
+// The levels of one channel, as linear amplitudes where 1.0 is full scale. Use MeterTable to map them to the display.
+typedef struct LevelMeterLevels {
+	float	rms;		// root mean square over the last 300 ms
+	float	peak;		// largest sample since the last update
+	float	truePeak;	// largest 4x oversampled value since the last update, so it catches inter-sample overs
+	float	peakHold;	// true peak, held and then let down slowly
+	float	meter;		// what a VU or PPM needle would show
+} LevelMeterLevels;
+
+#ifdef __cplusplus
+
+// LevelMeterEngine computes the levels of N channels of float samples in a single pass over each block, on the
+// thread that has the samples. The results are published through a triple buffer so one other thread, usually
+// the UI, can pick up the newest levels at display rate without ever blocking the audio thread or seeing a
+// half written update.
+class LevelMeterEngine
+{
+public:
+	enum Ballistics {
+		kBallistics_VU,		// 300 ms integration on RMS, same rise and fall
+		kBallistics_PPM		// 5 ms attack on the peak, falling 20 dB in 1.5 s
+	};
+
+	LevelMeterEngine(size_t inNumberChannels, double inSampleRate, Ballistics inBallistics = kBallistics_PPM, double inPeakHoldSeconds = 1.5);
+	~LevelMeterEngine();
+
+	size_t	NumberChannels() const { return mNumberChannels; }
+
+	// Audio thread, one at a time. These never allocate, lock or block.
+	void	Process(const float * const *inChannels, size_t inNumberFrames);				// one buffer per channel
+	void	ProcessInterleaved(const float *inSamples, size_t inNumberFrames);
+
+	// Any thread. Asks the audio thread to go back to silence at the start of its next block.
+	void	Reset();
+
+	// Reader thread, one at a time. Copies NumberChannels() levels to outLevels; returns false if nothing was
+	// published since the last call, in which case outLevels gets the same levels again.
+	bool	GetLevels(LevelMeterLevels *outLevels);
+
+private:
+	struct Channel;
+
+	void	HandleResetRequests();
+	void	ProcessChannel(Channel &ioChannel, const float *inSamples, size_t inStride, size_t inNumberFrames, LevelMeterLevels &ioLevels);
+	void	Publish(const LevelMeterLevels *inLevels);
+
+	size_t				mNumberChannels;
+	double				mSampleRate;
+	Ballistics			mBallistics;
+	size_t				mHoldFrames;
+	Channel				*mChannels;
+	float				*mCoefficients;		// each tap of each phase, repeated across a vector
+	LevelMeterLevels	*mPending;			// this block's levels, before they're published
+
+	// the triple buffer. mShared holds the index of the buffer between the two threads, with kFresh set when the
+	// writer has swapped a new one in that the reader hasn't taken yet
+	LevelMeterLevels	*mSnapshots[3];
+	int					mWriteIndex;
+	int					mReadIndex;
+	volatile int		mShared;
+
+	// Reset bumps mResetRequests; the audio thread clears the channels when it differs from mResetsHandled
+	volatile unsigned	mResetRequests;
+	unsigned			mResetsHandled;
+};
+
+#endif // __cplusplus
+
+#endif // __LevelMeterEngine_h__
@@ -48,6 +48,68 @@ Copyright (C) 2014 Apple Inc. All Rights Reserved.
 */
 
 #include "MeterTable.h"
+#include "MeterVec4.h"
+
+#include <string.h>
+
+// MeterTable(-80., 400, 2.0), the configuration nearly everyone uses, worked out ahead of time
+static const size_t kDefaultTableSize = 400;
+static const float kDefaultTable[kDefaultTableSize + 1] = {
+	1.f, 0.988523417f, 0.977178519f, 0.965963794f, 0.95487775f, 0.94391891f, 0.933085812f, 0.922377015f,
+	0.911791092f, 0.901326632f, 0.890982241f, 0.880756542f, 0.870648172f, 0.860655785f, 0.850778049f, 0.841013649f,
+	0.831361284f, 0.821819668f, 0.81238753f, 0.803063614f, 0.793846677f, 0.784735492f, 0.775728844f, 0.766825535f,
+	0.758024378f, 0.7493242f, 0.740723843f, 0.73222216f, 0.72381802f, 0.715510303f, 0.707297902f, 0.699179723f,
+	0.691154685f, 0.683221718f, 0.675379766f, 0.667627785f, 0.65996474f, 0.652389613f, 0.644901393f, 0.637499082f,
+	0.630181696f, 0.622948259f, 0.615797808f, 0.608729389f, 0.601742062f, 0.594834895f, 0.588006969f, 0.581257373f,
+	0.57458521f, 0.567989589f, 0.561469632f, 0.555024472f, 0.548653248f, 0.542355113f, 0.536129227f, 0.529974761f,
+	0.523890895f, 0.517876819f, 0.511931731f, 0.50605484f, 0.500245362f, 0.494502525f, 0.488825562f, 0.483213717f,
+	0.477666244f, 0.472182402f, 0.466761462f, 0.4614027f, 0.456105405f, 0.450868869f, 0.445692395f, 0.440575293f,
+	0.435516883f, 0.430516489f, 0.425573446f, 0.420687096f, 0.415856787f, 0.411081876f, 0.406361728f, 0.401695712f,
+	0.397083207f, 0.3925236f, 0.388016283f, 0.383560654f, 0.379156122f, 0.374802098f, 0.370498004f, 0.366243264f,
+	0.362037314f, 0.357879592f, 0.353769545f, 0.349706624f, 0.34569029f, 0.341720006f, 0.337795245f, 0.333915482f,
+	0.330080202f, 0.326288893f, 0.32254105f, 0.318836174f, 0.315173772f, 0.311553355f, 0.307974442f, 0.304436555f,
+	0.300939223f, 0.29748198f, 0.294064367f, 0.290685926f, 0.28734621f, 0.284044771f, 0.280781172f, 0.277554976f,
+	0.274365755f, 0.271213083f, 0.26809654f, 0.265015712f, 0.261970187f, 0.25895956f, 0.255983431f, 0.253041402f,
+	0.250133081f, 0.247258082f, 0.244416021f, 0.241606519f, 0.238829203f, 0.236083702f, 0.233369651f, 0.230686688f,
+	0.228034455f, 0.2254126f, 0.222820772f, 0.220258628f, 0.217725825f, 0.215222026f, 0.212746897f, 0.210300109f,
+	0.207881336f, 0.205490256f, 0.20312655f, 0.200789903f, 0.198480003f, 0.196196544f, 0.193939221f, 0.191707733f,
+	0.189501783f, 0.187321078f, 0.185165326f, 0.18303424f, 0.180927537f, 0.178844936f, 0.176786159f, 0.174750932f,
+	0.172738985f, 0.170750048f, 0.168783858f, 0.166840151f, 0.16491867f, 0.163019158f, 0.161141362f, 0.159285032f,
+	0.157449921f, 0.155635784f, 0.15384238f, 0.152069469f, 0.150316816f, 0.148584187f, 0.14687135f, 0.145178079f,
+	0.143504147f, 0.141849331f, 0.140213411f, 0.138596169f, 0.13699739f, 0.13541686f, 0.133854369f, 0.132309709f,
+	0.130782673f, 0.12927306f, 0.127780666f, 0.126305294f, 0.124846747f, 0.123404831f, 0.121979353f, 0.120570124f,
+	0.119176956f, 0.117799663f, 0.116438062f, 0.115091972f, 0.113761212f, 0.112445606f, 0.111144978f, 0.109859156f,
+	0.108587967f, 0.107331243f, 0.106088815f, 0.104860519f, 0.103646191f, 0.102445669f, 0.101258793f, 0.100085404f,
+	0.0989253473f, 0.0977784672f, 0.0966446111f, 0.095523628f, 0.0944153685f, 0.0933196849f, 0.0922364311f, 0.0911654629f,
+	0.0901066374f, 0.0890598135f, 0.0880248518f, 0.0870016143f, 0.0859899647f, 0.084989768f, 0.084000891f, 0.0830232018f,
+	0.0820565702f, 0.0811008673f, 0.0801559656f, 0.0792217393f, 0.0782980638f, 0.0773848159f, 0.0764818738f, 0.0755891173f,
+	0.0747064272f, 0.0738336859f, 0.0729707769f, 0.0721175853f, 0.0712739972f, 0.0704399001f, 0.0696151828f, 0.0687997353f,
+	0.0679934488f, 0.0671962157f, 0.0664079298f, 0.0656284857f, 0.0648577796f, 0.0640957086f, 0.063342171f, 0.0625970662f,
+	0.0618602948f, 0.0611317584f, 0.0604113598f, 0.0596990028f, 0.0589945924f, 0.0582980343f, 0.0576092356f, 0.0569281043f,
+	0.0562545495f, 0.055588481f, 0.05492981f, 0.0542784484f, 0.053634309f, 0.0529973059f, 0.0523673539f, 0.0517443686f,
+	0.0511282668f, 0.050518966f, 0.0499163847f, 0.0493204423f, 0.048731059f, 0.0481481558f, 0.0475716547f, 0.0470014785f,
+	0.0464375506f, 0.0458797956f, 0.0453281387f, 0.0447825057f, 0.0442428236f, 0.0437090199f, 0.0431810229f, 0.0426587617f,
+	0.042142166f, 0.0416311665f, 0.0411256944f, 0.0406256816f, 0.0401310609f, 0.0396417656f, 0.0391577298f, 0.0386788881f,
+	0.0382051759f, 0.0377365294f, 0.037272885f, 0.0368141803f, 0.0363603529f, 0.0359113416f, 0.0354670854f, 0.0350275241f,
+	0.0345925979f, 0.0341622477f, 0.033736415f, 0.0333150418f, 0.0328980706f, 0.0324854444f, 0.0320771069f, 0.0316730021f,
+	0.0312730747f, 0.0308772697f, 0.0304855328f, 0.0300978099f, 0.0297140476f, 0.0293341929f, 0.028958193f, 0.028585996f,
+	0.0282175499f, 0.0278528036f, 0.0274917059f, 0.0271342064f, 0.0267802548f, 0.0264298014f, 0.0260827966f, 0.0257391914f,
+	0.0253989367f, 0.0250619843f, 0.0247282858f, 0.0243977934f, 0.0240704593f, 0.0237462362f, 0.0234250769f, 0.0231069345f,
+	0.0227917622f, 0.0224795136f, 0.0221701422f, 0.0218636019f, 0.0215598467f, 0.0212588306f, 0.0209605077f, 0.0206648324f,
+	0.0203717589f, 0.0200812415f, 0.0197932347f, 0.0195076928f, 0.0192245701f, 0.0189438208f, 0.0186653991f, 0.0183892589f,
+	0.0181153542f, 0.0178436384f, 0.0175740652f, 0.0173065875f, 0.0170411582f, 0.0167777298f, 0.0165162541f, 0.0162566829f,
+	0.0159989671f, 0.0157430572f, 0.0154889029f, 0.0152364533f, 0.0149856566f, 0.0147364602f, 0.0144888104f, 0.0142426526f,
+	0.0139979308f, 0.0137545877f, 0.0135125649f, 0.0132718019f, 0.0130322367f, 0.0127938055f, 0.0125564421f, 0.0123200781f,
+	0.0120846426f, 0.0118500616f, 0.0116162583f, 0.011383152f, 0.0111506585f, 0.0109186889f, 0.0106871498f, 0.0104559423f,
+	0.0102249615f, 0.00999409586f, 0.00976322606f, 0.00953222433f, 0.00930095317f, 0.009069264f, 0.00883699563f, 0.00860397235f,
+	0.00837000175f, 0.00813487201f, 0.00789834871f, 0.00766017086f, 0.00742004607f, 0.00717764454f, 0.00693259145f, 0.00668445738f,
+	0.00643274587f, 0.00617687717f, 0.00591616663f, 0.00564979536f, 0.00537676947f, 0.00509586206f, 0.00480552814f, 0.00450377506f,
+	0.00418795659f, 0.00385442731f, 0.00349792065f, 0.00311032162f, 0.00267790965f, 0.00217380169f, 0.00152821407f, 0.f,
+	0.f
+};
+
+static const float kDecibelsPerOctave = 6.02059991f;	// 20 * log10(2)
+static const float kMinAmplitude = 1e-20f;				// keeps log2 off zero and denormals
 
 inline double DbToAmp(double inDb)
 {
@@ -55,17 +117,27 @@ inline double DbToAmp(double inDb)
 }
 
 MeterTable::MeterTable(float inMinDecibels, size_t inTableSize, float inRoot)
-	: mMinDecibels(inMinDecibels),
-	mDecibelResolution(mMinDecibels / (inTableSize - 1)), 
-	mScaleFactor(1. / mDecibelResolution)
+	: mAllocatedTable(NULL)
 {
 	if (inMinDecibels >= 0.)
 	{
-		printf("MeterTable inMinDecibels must be negative");
+		printf("MeterTable inMinDecibels must be negative\n");
+		inMinDecibels = -80.;
+	}
+	if (inTableSize < 2) inTableSize = 2;
+	
+	mMinDecibels = inMinDecibels;
+	mDecibelResolution = mMinDecibels / (inTableSize - 1);
+	mScaleFactor = 1. / mDecibelResolution;
+	mMaxIndex = inTableSize - 1;
+
+	if (inMinDecibels == -80.f && inTableSize == kDefaultTableSize && inRoot == 2.f)
+	{
+		mTable = kDefaultTable;
 		return;
 	}
 
-	mTable = (float*)malloc(inTableSize*sizeof(float));
+	mAllocatedTable = (float*)malloc((inTableSize + 1) * sizeof(float));
 
 	double minAmp = DbToAmp(inMinDecibels);
 	double ampRange = 1. - minAmp;
@@ -73,14 +145,64 @@ MeterTable::MeterTable(float inMinDecibels, size_t inTableSize, float inRoot)
 	
 	double rroot = 1. / inRoot;
 	for (size_t i = 0; i < inTableSize; ++i) {
-		double decibels = i * mDecibelResolution;
+		double decibels = i * (double)mDecibelResolution;
 		double amp = DbToAmp(decibels);
 		double adjAmp = (amp - minAmp) * invAmpRange;
-		mTable[i] = pow(adjAmp, rroot);
+		mAllocatedTable[i] = (adjAmp > 0.) ? pow(adjAmp, rroot) : 0.;
 	}
+	mAllocatedTable[inTableSize] = mAllocatedTable[inTableSize - 1];
+	mTable = mAllocatedTable;
 }
 
 MeterTable::~MeterTable()
 {
-	free(mTable);
+	free(mAllocatedTable);
+}
+
+float MeterTable::ValueAtAmplitude(float inAmplitude) const
+{
+	if (inAmplitude >= 1.f) return 1.;
+	if (!(inAmplitude > kMinAmplitude)) return 0.;
+	float decibels[4] = { inAmplitude, 1.f, 1.f, 1.f };
+	VStore(decibels, VMul(VLog2(VLoad(decibels)), VSplat(kDecibelsPerOctave)));
+	return ValueAt(decibels[0]);
+}
+
+// Clamping the index to the ends of the table takes care of 0 dB and up, and of everything below the
+// minimum, so each group of four is the same straight line code.
+static inline Vec4 Lookup(Vec4 inDecibels, Vec4 inScaleFactor, Vec4 inMaxIndex, const float *inTable)
+{
+	Vec4 index = VMin(VMax(VMul(inDecibels, inScaleFactor), VSplat(0.f)), inMaxIndex);
+	int32_t i[4];
+	Vec4 fraction = VSplitIndex(index, i);
+	float lower[4] = { inTable[i[0]], inTable[i[1]], inTable[i[2]], inTable[i[3]] };
+	float upper[4] = { inTable[i[0] + 1], inTable[i[1] + 1], inTable[i[2] + 1], inTable[i[3] + 1] };
+	Vec4 a = VLoad(lower);
+	return VMulAdd(a, fraction, VSub(VLoad(upper), a));
+}
+
+void MeterTable::ValuesAt(const float *inDecibels, float *outValues, size_t inCount) const
+{
+	const Vec4 scaleFactor = VSplat(mScaleFactor);
+	const Vec4 maxIndex = VSplat(mMaxIndex);
+	size_t n = 0;
+	for (; n + 4 <= inCount; n += 4)
+		VStore(outValues + n, Lookup(VLoad(inDecibels + n), scaleFactor, maxIndex, mTable));
+	for (; n < inCount; ++n)
+		outValues[n] = ValueAt(inDecibels[n]);
+}
+
+void MeterTable::ValuesAtAmplitude(const float *inAmplitudes, float *outValues, size_t inCount) const
+{
+	const Vec4 scaleFactor = VSplat(mScaleFactor);
+	const Vec4 maxIndex = VSplat(mMaxIndex);
+	const Vec4 decibelsPerOctave = VSplat(kDecibelsPerOctave);
+	const Vec4 minAmplitude = VSplat(kMinAmplitude);
+	size_t n = 0;
+	for (; n + 4 <= inCount; n += 4) {
+		Vec4 decibels = VMul(VLog2(VMax(VLoad(inAmplitudes + n), minAmplitude)), decibelsPerOctave);
+		VStore(outValues + n, Lookup(decibels, scaleFactor, maxIndex, mTable));
+	}
+	for (; n < inCount; ++n)
+		outValues[n] = ValueAtAmplitude(inAmplitudes[n]);
 }
@@ -58,22 +58,36 @@ public:
 // inNumUISteps - the number of steps in the UI element that will be drawn. 
 //					This could be a height in pixels or number of bars in an LED style display.
 // inTableSize - The size of the table. The table needs to be large enough that there are no large gaps in the response.
-// inMinDecibels - the decibel value of the minimum displayed amplitude.
+//					Values between entries are interpolated, so a few hundred entries is plenty.
+// inMinDecibels - the decibel value of the minimum displayed amplitude. Must be negative, -80 is used otherwise.
 // inRoot - this controls the curvature of the response. 2.0 is square root, 3.0 is cube root. But inRoot doesn't have to be integer valued, it could be 1.8 or 2.5, etc.
+// The default arguments use a table built into the binary, so constructing one costs nothing.
 
 MeterTable(float inMinDecibels = -80., size_t inTableSize = 400, float inRoot = 2.0);	
 ~MeterTable();
 	
-	float ValueAt(float inDecibels)
+	float ValueAt(float inDecibels) const
 	{
-		if (inDecibels < mMinDecibels) return  0.;
-		if (inDecibels >= 0.) return 1.;
-		int index = (int)(inDecibels * mScaleFactor);
-		return mTable[index];
+		float index = inDecibels * mScaleFactor;
+		if (index >= mMaxIndex) return 0.;
+		if (index <= 0.) return 1.;
+		int i = (int)index;
+		float fraction = index - i;
+		return mTable[i] + fraction * (mTable[i + 1] - mTable[i]);
 	}
+	
+	// the same for a linear amplitude, using a fast log2 instead of log10f
+	float ValueAtAmplitude(float inAmplitude) const;
+	
+	// many values at once, four at a time
+	void ValuesAt(const float *inDecibels, float *outValues, size_t inCount) const;
+	void ValuesAtAmplitude(const float *inAmplitudes, float *outValues, size_t inCount) const;
+	
 private:
 	float	mMinDecibels;
 	float	mDecibelResolution;
 	float	mScaleFactor;
-	float	*mTable;
+	float	mMaxIndex;
+	const float	*mTable;	// one entry past the minimum repeats it, so interpolation never reads off the end
+	float	*mAllocatedTable;
 };
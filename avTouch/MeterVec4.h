@@ -0,0 +1,189 @@
+/*
+
+    File: MeterVec4.h
+Abstract: Four lane float vectors shared by the metering code
+ Version: 1.4.3
+
+Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+Inc. ("Apple") in consideration of your agreement to the following
+terms, and your use, installation, modification or redistribution of
+this Apple software constitutes acceptance of these terms.  If you do
+not agree with these terms, please do not use, install, modify or
+redistribute this Apple software.
+
+In consideration of your agreement to abide by the following terms, and
+subject to these terms, Apple grants you a personal, non-exclusive
+license, under Apple's copyrights in this original Apple software (the
+"Apple Software"), to use, reproduce, modify and redistribute the Apple
+Software, with or without modifications, in source and/or binary forms;
+provided that if you redistribute the Apple Software in its entirety and
+without modifications, you must retain this notice and the following
+text and disclaimers in all such redistributions of the Apple Software.
+Neither the name, trademarks, service marks or logos of Apple Inc. may
+be used to endorse or promote products derived from the Apple Software
+without specific prior written permission from Apple.  Except as
+expressly stated in this notice, no other rights or licenses, express or
+implied, are granted by Apple herein, including but not limited to any
+patent rights that may be infringed by your derivative works or by other
+works in which the Apple Software may be incorporated.
+
+The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+
+IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+Copyright (C) 2014 Apple Inc. All Rights Reserved.
+
+
+*/
+
+#ifndef __MeterVec4_h__
+#define __MeterVec4_h__
+
+#include <stdint.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#else
+	#include <string.h>
+	#include <math.h>
+#endif
+
+// ____________________________________________________________________________
+//
+//	Four lane float vectors: NEON on devices, SSE2 in the simulator, plain C otherwise.
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+typedef float32x4_t Vec4;
+static inline Vec4	VLoad(const float *p)					{ return vld1q_f32(p); }
+static inline Vec4	VSplat(float x)							{ return vdupq_n_f32(x); }
+static inline Vec4	VAdd(Vec4 a, Vec4 b)					{ return vaddq_f32(a, b); }
+static inline Vec4	VMul(Vec4 a, Vec4 b)					{ return vmulq_f32(a, b); }
+static inline Vec4	VMulAdd(Vec4 a, Vec4 b, Vec4 c)			{ return vmlaq_f32(a, b, c); }
+static inline Vec4	VAbs(Vec4 a)							{ return vabsq_f32(a); }
+static inline Vec4	VMax(Vec4 a, Vec4 b)					{ return vmaxq_f32(a, b); }
+static inline void	VStore(float *p, Vec4 a)				{ vst1q_f32(p, a); }
+static inline Vec4	VSub(Vec4 a, Vec4 b)					{ return vsubq_f32(a, b); }
+static inline Vec4	VMin(Vec4 a, Vec4 b)					{ return vminq_f32(a, b); }
+// for non-negative a: the integer parts to outIndex, returning the fractions
+static inline Vec4	VSplitIndex(Vec4 a, int32_t *outIndex)
+{
+	int32x4_t i = vcvtq_s32_f32(a);
+	vst1q_s32(outIndex, i);
+	return vsubq_f32(a, vcvtq_f32_s32(i));
+}
+// the exponent, and the mantissa in [1, 2)
+static inline Vec4	VExponent(Vec4 a, Vec4 *outMantissa)
+{
+	int32x4_t bits = vreinterpretq_s32_f32(a);
+	*outMantissa = vreinterpretq_f32_s32(vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007FFFFF)), vdupq_n_s32(0x3F800000)));
+	return vcvtq_f32_s32(vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(127)));
+}
+static inline float	VMaxAcross(Vec4 a)
+{
+	float32x2_t m = vpmax_f32(vget_low_f32(a), vget_high_f32(a));
+	return vget_lane_f32(vpmax_f32(m, m), 0);
+}
+static inline float	VSumAcross(Vec4 a)
+{
+	float32x2_t s = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+	return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+#elif defined(__SSE2__)
+
+typedef __m128 Vec4;
+static inline Vec4	VLoad(const float *p)					{ return _mm_loadu_ps(p); }
+static inline Vec4	VSplat(float x)							{ return _mm_set1_ps(x); }
+static inline Vec4	VAdd(Vec4 a, Vec4 b)					{ return _mm_add_ps(a, b); }
+static inline Vec4	VMul(Vec4 a, Vec4 b)					{ return _mm_mul_ps(a, b); }
+static inline Vec4	VMulAdd(Vec4 a, Vec4 b, Vec4 c)			{ return _mm_add_ps(a, _mm_mul_ps(b, c)); }
+static inline Vec4	VAbs(Vec4 a)							{ return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+static inline Vec4	VMax(Vec4 a, Vec4 b)					{ return _mm_max_ps(a, b); }
+static inline void	VStore(float *p, Vec4 a)				{ _mm_storeu_ps(p, a); }
+static inline Vec4	VSub(Vec4 a, Vec4 b)					{ return _mm_sub_ps(a, b); }
+static inline Vec4	VMin(Vec4 a, Vec4 b)					{ return _mm_min_ps(a, b); }
+static inline Vec4	VSplitIndex(Vec4 a, int32_t *outIndex)
+{
+	__m128i i = _mm_cvttps_epi32(a);
+	_mm_storeu_si128((__m128i*)outIndex, i);
+	return _mm_sub_ps(a, _mm_cvtepi32_ps(i));
+}
+static inline Vec4	VExponent(Vec4 a, Vec4 *outMantissa)
+{
+	__m128i bits = _mm_castps_si128(a);
+	*outMantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)));
+	return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+}
+static inline float	VMaxAcross(Vec4 a)
+{
+	Vec4 m = _mm_max_ps(a, _mm_movehl_ps(a, a));
+	return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+static inline float	VSumAcross(Vec4 a)
+{
+	Vec4 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+	return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+#else
+
+struct Vec4 { float v[4]; };
+static inline Vec4	VLoad(const float *p)					{ Vec4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+static inline Vec4	VSplat(float x)							{ Vec4 r = { { x, x, x, x } }; return r; }
+static inline Vec4	VAdd(Vec4 a, Vec4 b)					{ for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+static inline Vec4	VMul(Vec4 a, Vec4 b)					{ for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+static inline Vec4	VMulAdd(Vec4 a, Vec4 b, Vec4 c)			{ for (int i = 0; i < 4; ++i) a.v[i] += b.v[i] * c.v[i]; return a; }
+static inline Vec4	VAbs(Vec4 a)							{ for (int i = 0; i < 4; ++i) a.v[i] = fabsf(a.v[i]); return a; }
+static inline Vec4	VMax(Vec4 a, Vec4 b)					{ for (int i = 0; i < 4; ++i) a.v[i] = (b.v[i] > a.v[i]) ? b.v[i] : a.v[i]; return a; }
+static inline void	VStore(float *p, Vec4 a)				{ for (int i = 0; i < 4; ++i) p[i] = a.v[i]; }
+static inline Vec4	VSub(Vec4 a, Vec4 b)					{ for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline Vec4	VMin(Vec4 a, Vec4 b)					{ for (int i = 0; i < 4; ++i) a.v[i] = (b.v[i] < a.v[i]) ? b.v[i] : a.v[i]; return a; }
+static inline Vec4	VSplitIndex(Vec4 a, int32_t *outIndex)
+{
+	for (int i = 0; i < 4; ++i) { outIndex[i] = (int32_t)a.v[i]; a.v[i] -= (float)outIndex[i]; }
+	return a;
+}
+static inline Vec4	VExponent(Vec4 a, Vec4 *outMantissa)
+{
+	for (int i = 0; i < 4; ++i) {
+		uint32_t bits;
+		memcpy(&bits, &a.v[i], sizeof(bits));
+		a.v[i] = (float)((int32_t)(bits >> 23) - 127);
+		bits = (bits & 0x007FFFFF) | 0x3F800000;
+		memcpy(&outMantissa->v[i], &bits, sizeof(bits));
+	}
+	return a;
+}
+static inline float	VMaxAcross(Vec4 a)						{ return fmaxf(fmaxf(a.v[0], a.v[1]), fmaxf(a.v[2], a.v[3])); }
+static inline float	VSumAcross(Vec4 a)						{ return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]); }
+
+#endif
+
+// log2 of positive, normal a: the exponent plus a quartic fit of log2 over the mantissa, good to 1.2e-4
+// (under 0.001 dB), which is all a meter needs and much cheaper than log10f
+static inline Vec4	VLog2(Vec4 a)
+{
+	Vec4 mantissa;
+	Vec4 exponent = VExponent(a, &mantissa);
+	Vec4 t = VSub(mantissa, VSplat(1.f));
+	Vec4 p = VMulAdd(VSplat(0.321879707f), t, VSplat(-0.0828606983f));
+	p = VMulAdd(VSplat(-0.677743267f), t, p);
+	p = VMulAdd(VSplat(1.43863803f), t, p);
+	return VMulAdd(exponent, t, p);
+}
+
+#endif // __MeterVec4_h__
@@ -0,0 +1,475 @@
+/*
+
+    File: PacketReadAhead.cpp
+Abstract: Background read-ahead of audio file packets for an AudioQueue output callback
+ Version: 1.4.3
+
+Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+Inc. ("Apple") in consideration of your agreement to the following
+terms, and your use, installation, modification or redistribution of
+this Apple software constitutes acceptance of these terms.  If you do
+not agree with these terms, please do not use, install, modify or
+redistribute this Apple software.
+
+In consideration of your agreement to abide by the following terms, and
+subject to these terms, Apple grants you a personal, non-exclusive
+license, under Apple's copyrights in this original Apple software (the
+"Apple Software"), to use, reproduce, modify and redistribute the Apple
+Software, with or without modifications, in source and/or binary forms;
+provided that if you redistribute the Apple Software in its entirety and
+without modifications, you must retain this notice and the following
+text and disclaimers in all such redistributions of the Apple Software.
+Neither the name, trademarks, service marks or logos of Apple Inc. may
+be used to endorse or promote products derived from the Apple Software
+without specific prior written permission from Apple.  Except as
+expressly stated in this notice, no other rights or licenses, express or
+implied, are granted by Apple herein, including but not limited to any
+patent rights that may be infringed by your derivative works or by other
+works in which the Apple Software may be incorporated.
+
+The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+
+IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+Copyright (C) 2014 Apple Inc. All Rights Reserved.
+
+
+*/
+
+#include "PacketReadAhead.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// ____________________________________________________________________________
+//
+enum {
+	kChunkBytes = 32768,						// how much the reader asks the file for at a time
+	kDefaultMaxPacketSize = 8192,				// when the file can't say
+	kDefaultFramesPerPacket = 1024,				// for sizing the window of formats with a variable number
+	kMinWindowBytes = 8 * kChunkBytes,			// a few of the callback's reads, however short the look-ahead
+	kMaxWindowBytes = 8 * 1024 * 1024,
+	kIdleWaitNanoseconds = 20 * 1000 * 1000		// how often a reader with nothing to do looks for room again
+};
+
+// The start of the skip segment inPacket falls in or just after the end of, or inPacket itself if it's nowhere
+// near one. Segment k starts at inOrigin + k * inJump.
+static SInt64 SkipSegmentStartFor(SInt64 inPacket, SInt64 inOrigin, SInt64 inPlay, SInt64 inJump)
+{
+	SInt64 k;
+	if (inJump > 0) {
+		if (inPacket < inOrigin) return inPacket;
+		k = (inPacket - inOrigin) / inJump;
+	} else {
+		SInt64 behind = inOrigin - inPacket;
+		k = (behind <= 0) ? 0 : (behind - inJump - 1) / -inJump;
+	}
+	SInt64 start = inOrigin + k * inJump;
+	return (start <= inPacket && inPacket <= start + inPlay) ? start : inPacket;
+}
+
+PacketReadAhead::PacketReadAhead(AudioFileID inFile, double inLookAheadSeconds)
+	: mFile(inFile),
+	mPacketCount(0),
+	mFrameCount(0),
+	mRunHead(0),
+	mRunTail(0),
+	mByteHead(0),
+	mByteTail(0),
+	mDescs(NULL),
+	mDescCapacity(0),
+	mDescHead(0),
+	mDescTail(0),
+	mChunkDescs(NULL),
+	mQuit(false),
+	mRetarget(false),
+	mRetargetPacket(0),
+	mLooping(false),
+	mLoopStart(0),
+	mSkipChanged(false),
+	mSkipOrigin(0),
+	mSkipPlay(0),
+	mSkipJump(0),
+	mHits(0),
+	mMisses(0)
+{
+	memset(&mFormat, 0, sizeof(mFormat));
+	UInt32 propSize = sizeof(mFormat);
+	AudioFileGetProperty(mFile, kAudioFilePropertyDataFormat, &propSize, &mFormat);
+	propSize = sizeof(mPacketCount);
+	AudioFileGetProperty(mFile, kAudioFilePropertyAudioDataPacketCount, &propSize, &mPacketCount);
+	if (mFormat.mFramesPerPacket) {
+		mFrameCount = mPacketCount * mFormat.mFramesPerPacket;
+	} else {
+		AudioFramePacketTranslation translation = { 0, mPacketCount, 0 };
+		propSize = sizeof(translation);
+		if (!AudioFileGetProperty(mFile, kAudioFilePropertyPacketToFrame, &propSize, &translation))
+			mFrameCount = translation.mFrame;
+	}
+
+	UInt32 maxPacketSize = mFormat.mBytesPerPacket;
+	if (!maxPacketSize) {
+		propSize = sizeof(maxPacketSize);
+		AudioFileGetProperty(mFile, kAudioFilePropertyPacketSizeUpperBound, &propSize, &maxPacketSize);
+		if (!maxPacketSize) maxPacketSize = kDefaultMaxPacketSize;
+	}
+	mChunkBytes = (maxPacketSize > kChunkBytes) ? maxPacketSize : kChunkBytes;
+	mChunkPackets = mChunkBytes / maxPacketSize;
+
+	// sized for the worst case packet, so the window holds at least inLookAheadSeconds
+	double packetsPerSecond = mFormat.mSampleRate / (mFormat.mFramesPerPacket ? mFormat.mFramesPerPacket : kDefaultFramesPerPacket);
+	double windowPackets = inLookAheadSeconds * packetsPerSecond;
+	double windowBytes = windowPackets * maxPacketSize;
+	if (windowBytes > kMaxWindowBytes) windowBytes = kMaxWindowBytes;
+	if (windowBytes < kMinWindowBytes) windowBytes = kMinWindowBytes;
+	if (windowBytes < 4. * mChunkBytes) windowBytes = 4. * mChunkBytes;
+
+	// one chunk more than the window, for what's lost when a chunk doesn't fit before the end and goes to the start
+	mByteCapacity = (UInt64)windowBytes + mChunkBytes;
+	mBytes = (UInt8*)malloc(mByteCapacity);
+	// skip segments and the end of the file make some runs short
+	mRunCapacity = 2 * (UInt32)(mByteCapacity / mChunkBytes) + 16;
+	mRuns = (Run*)calloc(mRunCapacity, sizeof(Run));
+	if (!mFormat.mBytesPerPacket) {
+		// most packets are well under the upper bound, so the bytes hold more of them than it suggests
+		mDescCapacity = 8 * (mByteCapacity / maxPacketSize) + 2 * mChunkPackets;
+		mDescs = (AudioStreamPacketDescription*)malloc(mDescCapacity * sizeof(AudioStreamPacketDescription));
+		mChunkDescs = (AudioStreamPacketDescription*)malloc(mChunkPackets * sizeof(AudioStreamPacketDescription));
+	}
+
+	pthread_mutex_init(&mLock, NULL);
+	pthread_cond_init(&mWake, NULL);
+	pthread_mutex_init(&mFileLock, NULL);
+	pthread_create(&mThread, NULL, ThreadEntry, this);
+}
+
+PacketReadAhead::~PacketReadAhead()
+{
+	pthread_mutex_lock(&mLock);
+	mQuit = true;
+	pthread_cond_signal(&mWake);
+	pthread_mutex_unlock(&mLock);
+	pthread_join(mThread, NULL);
+
+	pthread_mutex_destroy(&mFileLock);
+	pthread_cond_destroy(&mWake);
+	pthread_mutex_destroy(&mLock);
+	free(mChunkDescs);
+	free(mDescs);
+	free(mRuns);
+	free(mBytes);
+}
+
+// ____________________________________________________________________________
+//
+UInt32 PacketReadAhead::RunByteOffset(const Run &inRun, UInt32 inPacket) const
+{
+	if (mFormat.mBytesPerPacket)
+		return inPacket * mFormat.mBytesPerPacket;
+	if (inPacket == inRun.numPackets)
+		return inRun.byteSize;
+	return (UInt32)mDescs[(inRun.descStart + inPacket) % mDescCapacity].mStartOffset;
+}
+
+OSStatus PacketReadAhead::ReadPackets(SInt64 inStartPacket, UInt32 *ioNumBytes, AudioStreamPacketDescription *outDescriptions, UInt32 *ioNumPackets, void *outBuffer)
+{
+	UInt8 *dest = (UInt8*)outBuffer;
+	UInt32 maxBytes = *ioNumBytes, maxPackets = *ioNumPackets;
+	UInt32 numBytes = 0, numPackets = 0;
+	bool full = false, endOfFile = false;
+
+	UInt64 head = __atomic_load_n(&mRunHead, __ATOMIC_ACQUIRE);
+	UInt64 tail = mRunTail;
+	UInt64 byteTail = mByteTail, descTail = mDescTail;
+
+	// runs wholly before the start aren't wanted any more: the callback only goes back by seeking
+	while (tail < head) {
+		const Run &run = mRuns[tail % mRunCapacity];
+		SInt64 offset = inStartPacket - run.packet;
+		if (offset >= 0 && offset < run.numPackets) break;
+		byteTail = run.byteStart + run.byteSize;
+		descTail = run.descStart + run.numPackets;
+		++tail;
+	}
+
+	while (tail < head && !full) {
+		const Run &run = mRuns[tail % mRunCapacity];
+		SInt64 offset = inStartPacket + numPackets - run.packet;
+		if (offset < 0 || offset >= run.numPackets) break;		// the reader jumped somewhere the callback didn't
+
+		UInt32 first = (UInt32)offset;
+		UInt32 count = run.numPackets - first;
+		if (count > maxPackets - numPackets) {
+			count = maxPackets - numPackets;
+			full = true;
+		}
+		UInt32 byteOffset = RunByteOffset(run, first);
+		while (count && RunByteOffset(run, first + count) - byteOffset > maxBytes - numBytes) {
+			count = mFormat.mBytesPerPacket ? (maxBytes - numBytes) / mFormat.mBytesPerPacket : count - 1;
+			full = true;
+		}
+		UInt32 byteSize = RunByteOffset(run, first + count) - byteOffset;
+
+		memcpy(dest + numBytes, mBytes + run.byteStart % mByteCapacity + byteOffset, byteSize);
+		if (outDescriptions && mDescs) {
+			for (UInt32 i = 0; i < count; ++i) {
+				AudioStreamPacketDescription &desc = outDescriptions[numPackets + i];
+				desc = mDescs[(run.descStart + first + i) % mDescCapacity];
+				desc.mStartOffset = desc.mStartOffset - byteOffset + numBytes;
+			}
+		}
+		numBytes += byteSize;
+		numPackets += count;
+
+		if (first + count == run.numPackets) {
+			byteTail = run.byteStart + run.byteSize;
+			descTail = run.descStart + run.numPackets;
+			++tail;
+			if (run.endOfFile) {
+				endOfFile = true;
+				break;
+			}
+		}
+	}
+
+	bool miss = !full && !endOfFile && numPackets < maxPackets && inStartPacket + numPackets < mPacketCount;
+	if (miss) {
+		// whatever else is in the window is from a guess that didn't pan out
+		while (tail < head) {
+			const Run &run = mRuns[tail % mRunCapacity];
+			byteTail = run.byteStart + run.byteSize;
+			descTail = run.descStart + run.numPackets;
+			++tail;
+		}
+	}
+	__atomic_store_n(&mDescTail, descTail, __ATOMIC_RELEASE);
+	__atomic_store_n(&mByteTail, byteTail, __ATOMIC_RELEASE);
+	__atomic_store_n(&mRunTail, tail, __ATOMIC_RELEASE);
+
+	OSStatus err = noErr;
+	if (miss) {
+		UInt32 fileBytes = maxBytes - numBytes, filePackets = maxPackets - numPackets;
+		AudioStreamPacketDescription *fileDescriptions = outDescriptions ? outDescriptions + numPackets : NULL;
+		pthread_mutex_lock(&mFileLock);
+		err = AudioFileReadPacketData(mFile, false, &fileBytes, fileDescriptions, inStartPacket + numPackets, &filePackets, dest + numBytes);
+		pthread_mutex_unlock(&mFileLock);
+		if (err == kAudioFileEndOfFileError) err = noErr;
+		if (err == noErr) {
+			if (fileDescriptions) {
+				for (UInt32 i = 0; i < filePackets; ++i)
+					fileDescriptions[i].mStartOffset += numBytes;
+			}
+			numBytes += fileBytes;
+			numPackets += filePackets;
+		}
+		Retarget(inStartPacket + numPackets);
+		++mMisses;
+	} else {
+		++mHits;
+	}
+
+	*ioNumBytes = numBytes;
+	*ioNumPackets = numPackets;
+	return err;
+}
+
+// ____________________________________________________________________________
+//
+void PacketReadAhead::Retarget(SInt64 inPacket)
+{
+	pthread_mutex_lock(&mLock);
+	mRetarget = true;
+	mRetargetPacket = inPacket;
+	pthread_cond_signal(&mWake);
+	pthread_mutex_unlock(&mLock);
+}
+
+void PacketReadAhead::Seek(SInt64 inPacket)
+{
+	Retarget(inPacket);
+}
+
+void PacketReadAhead::SetLoop(bool inLooping, SInt64 inLoopStartPacket)
+{
+	pthread_mutex_lock(&mLock);
+	mLooping = inLooping;
+	mLoopStart = inLoopStartPacket;
+	pthread_cond_signal(&mWake);
+	pthread_mutex_unlock(&mLock);
+}
+
+void PacketReadAhead::SetSkip(SInt64 inSegmentStartPacket, SInt64 inPlayPackets, SInt64 inJumpPackets)
+{
+	pthread_mutex_lock(&mLock);
+	mSkipChanged = true;
+	mSkipOrigin = inSegmentStartPacket;
+	mSkipPlay = inPlayPackets;
+	mSkipJump = inJumpPackets;
+	pthread_cond_signal(&mWake);
+	pthread_mutex_unlock(&mLock);
+}
+
+void PacketReadAhead::ClearSkip()
+{
+	pthread_mutex_lock(&mLock);
+	mSkipChanged = true;
+	mSkipPlay = 0;
+	pthread_mutex_unlock(&mLock);
+}
+
+bool PacketReadAhead::NextSkipSegment(SInt64 &ioSegmentStart, SInt64 inJumpPackets) const
+{
+	SInt64 next = ioSegmentStart + inJumpPackets;
+	if (next < 0) {
+		ioSegmentStart = 0;
+		return false;
+	}
+	if (next >= mPacketCount) {
+		ioSegmentStart = mPacketCount;
+		return false;
+	}
+	ioSegmentStart = next;
+	return true;
+}
+
+SInt64 PacketReadAhead::PacketForFrame(SInt64 inFrame)
+{
+	if (mFormat.mFramesPerPacket)
+		return inFrame / mFormat.mFramesPerPacket;
+
+	AudioFramePacketTranslation translation = { inFrame, 0, 0 };
+	UInt32 propSize = sizeof(translation);
+	pthread_mutex_lock(&mFileLock);
+	OSStatus err = AudioFileGetProperty(mFile, kAudioFilePropertyFrameToPacket, &propSize, &translation);
+	pthread_mutex_unlock(&mFileLock);
+	return err ? 0 : translation.mPacket;
+}
+
+SInt64 PacketReadAhead::FrameForPacket(SInt64 inPacket)
+{
+	if (mFormat.mFramesPerPacket)
+		return inPacket * mFormat.mFramesPerPacket;
+	if (inPacket >= mPacketCount)
+		return mFrameCount;
+
+	AudioFramePacketTranslation translation = { 0, inPacket, 0 };
+	UInt32 propSize = sizeof(translation);
+	pthread_mutex_lock(&mFileLock);
+	OSStatus err = AudioFileGetProperty(mFile, kAudioFilePropertyPacketToFrame, &propSize, &translation);
+	pthread_mutex_unlock(&mFileLock);
+	return err ? 0 : translation.mFrame;
+}
+
+// ____________________________________________________________________________
+//
+void *PacketReadAhead::ThreadEntry(void *inRefCon)
+{
+	pthread_setname_np("PacketReadAhead");
+	static_cast<PacketReadAhead*>(inRefCon)->ReadAhead();
+	return NULL;
+}
+
+// Appends one run from inPacket on to the rings. Returns the number of packets read, 0 if there's no room for
+// another chunk yet or the read failed.
+UInt32 PacketReadAhead::ReadRun(SInt64 inPacket, UInt32 inMaxPackets)
+{
+	UInt64 runHead = mRunHead;
+	if (runHead - __atomic_load_n(&mRunTail, __ATOMIC_ACQUIRE) >= mRunCapacity)
+		return 0;
+	UInt64 byteStart = mByteHead;
+	UInt64 wrapOffset = byteStart % mByteCapacity;
+	if (wrapOffset + mChunkBytes > mByteCapacity)
+		byteStart += mByteCapacity - wrapOffset;	// a run is never split across the end of the ring
+	if (byteStart + mChunkBytes - __atomic_load_n(&mByteTail, __ATOMIC_ACQUIRE) > mByteCapacity)
+		return 0;
+	if (mDescs && mDescHead + inMaxPackets - __atomic_load_n(&mDescTail, __ATOMIC_ACQUIRE) > mDescCapacity)
+		return 0;
+
+	UInt32 numBytes = mChunkBytes, numPackets = inMaxPackets;
+	pthread_mutex_lock(&mFileLock);
+	OSStatus err = AudioFileReadPacketData(mFile, false, &numBytes, mChunkDescs, inPacket, &numPackets, mBytes + byteStart % mByteCapacity);
+	pthread_mutex_unlock(&mFileLock);
+	if ((err && err != kAudioFileEndOfFileError) || numPackets == 0)
+		return 0;
+
+	Run &run = mRuns[runHead % mRunCapacity];
+	run.packet = inPacket;
+	run.numPackets = numPackets;
+	run.byteSize = numBytes;
+	run.byteStart = byteStart;
+	run.descStart = mDescHead;
+	run.endOfFile = (inPacket + numPackets >= mPacketCount);
+	if (mDescs) {
+		for (UInt32 i = 0; i < numPackets; ++i)
+			mDescs[(mDescHead + i) % mDescCapacity] = mChunkDescs[i];
+		mDescHead += numPackets;
+	}
+	mByteHead = byteStart + numBytes;
+	__atomic_store_n(&mRunHead, runHead + 1, __ATOMIC_RELEASE);
+	return numPackets;
+}
+
+void PacketReadAhead::ReadAhead()
+{
+	SInt64 next = 0, segmentStart = 0;
+
+	pthread_mutex_lock(&mLock);
+	while (!mQuit) {
+		if (mSkipChanged) {
+			mSkipChanged = false;
+			if (mSkipPlay) {
+				segmentStart = mSkipOrigin;
+				if (next < segmentStart || next > segmentStart + mSkipPlay) next = segmentStart;
+			}
+		}
+		if (mRetarget) {
+			mRetarget = false;
+			next = mRetargetPacket;
+			segmentStart = mSkipPlay ? SkipSegmentStartFor(next, mSkipOrigin, mSkipPlay, mSkipJump) : next;
+		}
+
+		// the same steps the callback takes at the end of a skip segment and at the end of the file
+		if (mSkipPlay && next >= segmentStart + mSkipPlay) {
+			if (!NextSkipSegment(segmentStart, mSkipJump)) mSkipPlay = 0;
+			next = segmentStart;
+		}
+		if (next >= mPacketCount && mLooping) {
+			next = mLoopStart;
+			mSkipPlay = 0;
+		}
+
+		UInt32 maxPackets = mChunkPackets;
+		if (mSkipPlay && segmentStart + mSkipPlay - next < maxPackets)
+			maxPackets = (UInt32)(segmentStart + mSkipPlay - next);
+
+		if (next < mPacketCount) {
+			pthread_mutex_unlock(&mLock);
+			UInt32 numPackets = ReadRun(next, maxPackets);
+			pthread_mutex_lock(&mLock);
+			if (numPackets) {
+				next += numPackets;
+				continue;
+			}
+		}
+
+		if (mQuit || mRetarget || mSkipChanged) continue;
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		long nanoseconds = now.tv_usec * 1000L + kIdleWaitNanoseconds;
+		struct timespec until = { now.tv_sec + nanoseconds / 1000000000L, nanoseconds % 1000000000L };
+		pthread_cond_timedwait(&mWake, &mLock, &until);
+	}
+	pthread_mutex_unlock(&mLock);
+}
@@ -0,0 +1,157 @@
+/*
+
+    File: PacketReadAhead.h
+Abstract: Background read-ahead of audio file packets for an AudioQueue output callback
+ Version: 1.4.3
+
+Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple
+Inc. ("Apple") in consideration of your agreement to the following
+terms, and your use, installation, modification or redistribution of
+this Apple software constitutes acceptance of these terms.  If you do
+not agree with these terms, please do not use, install, modify or
+redistribute this Apple software.
+
+In consideration of your agreement to abide by the following terms, and
+subject to these terms, Apple grants you a personal, non-exclusive
+license, under Apple's copyrights in this original Apple software (the
+"Apple Software"), to use, reproduce, modify and redistribute the Apple
+Software, with or without modifications, in source and/or binary forms;
+provided that if you redistribute the Apple Software in its entirety and
+without modifications, you must retain this notice and the following
+text and disclaimers in all such redistributions of the Apple Software.
+Neither the name, trademarks, service marks or logos of Apple Inc. may
+be used to endorse or promote products derived from the Apple Software
+without specific prior written permission from Apple.  Except as
+expressly stated in this notice, no other rights or licenses, express or
+implied, are granted by Apple herein, including but not limited to any
+patent rights that may be infringed by your derivative works or by other
+works in which the Apple Software may be incorporated.
+
+The Apple Software is provided by Apple on an "AS IS" basis.  APPLE
+MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION
+THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS
+FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND
+OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS.
+
+IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION,
+MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED
+AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE),
+STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+Copyright (C) 2014 Apple Inc. All Rights Reserved.
+
+
+*/
+
+#ifndef __PacketReadAhead_h__
+#define __PacketReadAhead_h__
+
+#include <AudioToolbox/AudioFile.h>
+#include <pthread.h>
+
+// PacketReadAhead keeps the next few seconds of an audio file's packets in memory, read by a thread of its own,
+// so an AudioQueue output callback can fill its buffers with a memcpy instead of waiting on the file. The
+// packets are kept as they are in the file; the queue still does the decoding.
+//
+// The reader follows the order the callback will ask for them in: straight on, back to the loop start at the
+// end of the file, or segment by segment in skip mode. A read it didn't see coming, after a seek say, is served
+// from the file on the spot and the reader moves over to carry on from there.
+class PacketReadAhead
+{
+public:
+	PacketReadAhead(AudioFileID inFile, double inLookAheadSeconds = 2.);
+	~PacketReadAhead();
+
+	// Callback thread, one at a time. The same contract as AudioFileReadPacketData: fills outBuffer with as many
+	// whole packets from inStartPacket on as fit in *ioNumBytes and *ioNumPackets, and returns fewer than asked
+	// only at the end of the file. Packets in the window are copied without locking or blocking.
+	OSStatus	ReadPackets(SInt64 inStartPacket, UInt32 *ioNumBytes, AudioStreamPacketDescription *outDescriptions, UInt32 *ioNumPackets, void *outBuffer);
+
+	// Any thread. Where the next read will start, so the reader can be there first.
+	void		Seek(SInt64 inPacket);
+	// Whether to go on at inLoopStartPacket after the last packet of the file.
+	void		SetLoop(bool inLooping, SInt64 inLoopStartPacket);
+	// Skip mode: play inPlayPackets from inSegmentStartPacket, then start the next segment inJumpPackets on from
+	// the start of this one (negative to go backwards), as NextSkipSegment says. ClearSkip goes back to straight on.
+	void		SetSkip(SInt64 inSegmentStartPacket, SInt64 inPlayPackets, SInt64 inJumpPackets);
+	void		ClearSkip();
+
+	// Moves ioSegmentStart on to the start of the next skip segment. Returns false when that would run off either
+	// end of the file, which ends skip mode: ioSegmentStart is then 0 going backwards or PacketCount() going forwards.
+	bool		NextSkipSegment(SInt64 &ioSegmentStart, SInt64 inJumpPackets) const;
+
+	// The packet index, without a file read when the format has a constant number of frames per packet.
+	// FrameForPacket doesn't read the file for the end of it either, so a callback can ask where that is.
+	SInt64		PacketForFrame(SInt64 inFrame);
+	SInt64		FrameForPacket(SInt64 inPacket);
+	SInt64		PacketCount() const { return mPacketCount; }
+
+	// How many ReadPackets calls were served from the window and how many had to go to the file.
+	UInt32		Hits() const { return mHits; }
+	UInt32		Misses() const { return mMisses; }
+
+private:
+	// one file read's worth of consecutive packets
+	struct Run {
+		SInt64	packet;
+		UInt32	numPackets;
+		UInt32	byteSize;
+		UInt64	byteStart;		// in mBytes, counting from the first byte ever read so it never wraps
+		UInt64	descStart;		// in mDescs, the same way; variable bit rate formats only
+		bool	endOfFile;
+	};
+
+	static void *	ThreadEntry(void *inRefCon);
+	void		ReadAhead();
+	UInt32		ReadRun(SInt64 inPacket, UInt32 inMaxPackets);
+	UInt32		RunByteOffset(const Run &inRun, UInt32 inPacket) const;
+	void		Retarget(SInt64 inPacket);
+
+	AudioFileID						mFile;
+	AudioStreamBasicDescription		mFormat;
+	SInt64							mPacketCount;
+	SInt64							mFrameCount;
+	UInt32							mChunkBytes;
+	UInt32							mChunkPackets;
+
+	// single producer, single consumer rings. The reader owns the heads and the callback the tails; each side
+	// only ever reads the other's
+	Run								*mRuns;
+	UInt32							mRunCapacity;
+	volatile UInt64					mRunHead;
+	volatile UInt64					mRunTail;
+	UInt8							*mBytes;
+	UInt64							mByteCapacity;
+	UInt64							mByteHead;
+	volatile UInt64					mByteTail;
+	AudioStreamPacketDescription	*mDescs;
+	UInt64							mDescCapacity;
+	UInt64							mDescHead;
+	volatile UInt64					mDescTail;
+	AudioStreamPacketDescription	*mChunkDescs;
+
+	// where the reader goes next, guarded by mLock
+	pthread_mutex_t					mLock;
+	pthread_cond_t					mWake;
+	bool							mQuit;
+	bool							mRetarget;
+	SInt64							mRetargetPacket;
+	bool							mLooping;
+	SInt64							mLoopStart;
+	bool							mSkipChanged;
+	SInt64							mSkipOrigin;
+	SInt64							mSkipPlay;
+	SInt64							mSkipJump;
+
+	pthread_mutex_t					mFileLock;		// an AudioFileID is only used by one thread at a time
+	pthread_t						mThread;
+
+	volatile UInt32					mHits;
+	volatile UInt32					mMisses;
+};
+
+#endif // __PacketReadAhead_h__